@@ -161,6 +161,16 @@ bgp_adj_out_free (struct bgp_adj_out *adj)
   XFREE (MTYPE_BGP_ADJ_OUT, adj);
 }
 
+/* Is only pending advertisement state kept for routes to the peer from
+   this table, rather than the routes sent as well? */
+int
+bgp_adj_out_pending_only (struct peer *peer, struct bgp_node *rn)
+{
+  return (peer->bgp
+	  && bgp_flag_check (peer->bgp, BGP_FLAG_ADJ_RIB_OUT_PENDING)
+	  && bgp_node_table (rn)->type == BGP_TABLE_MAIN);
+}
+
 int
 bgp_adj_out_lookup (struct peer *peer, struct prefix *p,
 		    afi_t afi, safi_t safi, struct bgp_node *rn)
@@ -277,6 +287,7 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
 {
   struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
+  int withdraw;
 
   if (DISABLE_BGP_ANNOUNCE)
     return;
@@ -286,14 +297,29 @@ bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     if (adj->peer == peer)
       break;
 
+  /* Without an Adj-RIB-Out it is not known whether the route was sent,
+     so once the table has been announced to the peer a withdraw is
+     sent anyway. */
+  withdraw = (bgp_adj_out_pending_only (peer, rn)
+	      && CHECK_FLAG (peer->af_sflags[afi][safi],
+			     PEER_STATUS_ANNOUNCED));
+
   if (! adj)
-    return;
+    {
+      if (! withdraw)
+	return;
+
+      adj = XCALLOC (MTYPE_BGP_ADJ_OUT, sizeof (struct bgp_adj_out));
+      adj->peer = peer_lock (peer); /* adj_out peer reference */
+      BGP_ADJ_OUT_ADD (rn, adj);
+      bgp_lock_node (rn);
+    }
 
   /* Clearn up previous advertisement.  */
   if (adj->adv)
     bgp_advertise_clean (peer, adj, afi, safi);
 
-  if (adj->attr)
+  if (adj->attr || withdraw)
     {
       /* We need advertisement structure.  */
       adj->adv = bgp_advertise_new ();
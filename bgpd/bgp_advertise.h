@@ -157,6 +157,7 @@ extern void bgp_adj_out_unset (struct bgp_node *, struct peer *, struct prefix *
 			afi_t, safi_t);
 extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *, 
 			 struct peer *, afi_t, safi_t);
+extern int bgp_adj_out_pending_only (struct peer *, struct bgp_node *);
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
 
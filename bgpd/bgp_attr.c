@@ -2129,11 +2129,10 @@ bgp_attr_check (struct peer *peer, struct attr *attr)
   return BGP_ATTR_PARSE_PROCEED;
 }
 
-/* Read attribute of update packet.  This function is called from
-   bgp_update_receive() in bgp_packet.c.  */
-bgp_attr_parse_ret_t
-bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
-		struct bgp_nlri *mp_update, struct bgp_nlri *mp_withdraw)
+/* Read attribute of update packet.  */
+static bgp_attr_parse_ret_t
+bgp_attr_parse_main (struct peer *peer, struct attr *attr, bgp_size_t size,
+		     struct bgp_nlri *mp_update, struct bgp_nlri *mp_withdraw)
 {
   int ret;
   u_char flag = 0;
@@ -2460,6 +2459,171 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
   return BGP_ATTR_PARSE_PROCEED;
 }
 
+/* Path attributes of the last few UPDATEs from a peer, as parsed.
+   A full table comes in runs of UPDATEs whose attributes are the same
+   byte for byte and whose NLRI differ, so most need no parsing. */
+#define BGP_ATTR_CACHE_SIZE 8
+
+struct bgp_attr_cache
+{
+  /* What else the parse depends on, as it was for the entries. */
+  as_t as;
+  as_t change_local_as;
+  u_int32_t context;
+
+  struct
+  {
+    u_int32_t key;
+    bgp_size_t size;
+    u_char *data;
+    struct attr *attr;
+  } entry[BGP_ATTR_CACHE_SIZE];
+  int next;
+};
+
+static u_int32_t
+bgp_attr_cache_context (struct peer *peer)
+{
+  u_int32_t context = peer->sort;
+
+  if (CHECK_FLAG (peer->cap, PEER_CAP_AS4_RCV))
+    context |= 1 << 8;
+  if (bgp_flag_check (peer->bgp, BGP_FLAG_ENFORCE_FIRST_AS))
+    context |= 1 << 9;
+  if (CHECK_FLAG (peer->flags, PEER_FLAG_LOCAL_AS_NO_PREPEND))
+    context |= 1 << 10;
+  return context;
+}
+
+static void
+bgp_attr_cache_clear (struct bgp_attr_cache *cache)
+{
+  int i;
+
+  for (i = 0; i < BGP_ATTR_CACHE_SIZE; i++)
+    if (cache->entry[i].attr)
+      {
+	XFREE (MTYPE_BGP_ATTR_CACHE, cache->entry[i].data);
+	bgp_attr_unintern (&cache->entry[i].attr);
+	cache->entry[i].attr = NULL;
+      }
+}
+
+/* Forget the attributes cached for a peer, whose session is down. */
+void
+bgp_attr_cache_free (struct peer *peer)
+{
+  if (! peer->attr_cache)
+    return;
+
+  bgp_attr_cache_clear (peer->attr_cache);
+  XFREE (MTYPE_BGP_ATTR_CACHE, peer->attr_cache);
+  peer->attr_cache = NULL;
+}
+
+static struct bgp_attr_cache *
+bgp_attr_cache_get (struct peer *peer)
+{
+  struct bgp_attr_cache *cache = peer->attr_cache;
+  u_int32_t context = bgp_attr_cache_context (peer);
+
+  if (! cache)
+    cache = peer->attr_cache = XCALLOC (MTYPE_BGP_ATTR_CACHE,
+					sizeof (struct bgp_attr_cache));
+  else if (cache->as != peer->as
+	   || cache->change_local_as != peer->change_local_as
+	   || cache->context != context)
+    bgp_attr_cache_clear (cache);
+
+  cache->as = peer->as;
+  cache->change_local_as = peer->change_local_as;
+  cache->context = context;
+  return cache;
+}
+
+/* Read attribute of update packet.  This function is called from
+   bgp_update_receive() in bgp_packet.c.  Attributes the peer sent in
+   one of its last few UPDATEs are copied from the result then, rather
+   than parsed again. */
+bgp_attr_parse_ret_t
+bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
+		struct bgp_nlri *mp_update, struct bgp_nlri *mp_withdraw)
+{
+  struct bgp_attr_cache *cache;
+  struct attr *cached;
+  bgp_attr_parse_ret_t ret;
+  u_char *pnt;
+  u_int32_t key;
+  int i;
+
+  /* The cache lasts as long as the session. */
+  if (peer->status != Established)
+    return bgp_attr_parse_main (peer, attr, size, mp_update, mp_withdraw);
+
+  assert (size <= STREAM_READABLE (BGP_INPUT (peer)));
+  pnt = BGP_INPUT_PNT (peer);
+  key = jhash (pnt, size, 0);
+  cache = bgp_attr_cache_get (peer);
+
+  for (i = 0; i < BGP_ATTR_CACHE_SIZE; i++)
+    {
+      cached = cache->entry[i].attr;
+      if (! cached
+	  || cache->entry[i].key != key
+	  || cache->entry[i].size != size
+	  || memcmp (cache->entry[i].data, pnt, size))
+	continue;
+
+      /* Hold on to the interned parts, as bgp_attr_parse_main would
+	 have. */
+      bgp_attr_dup (attr, cached);
+      attr->refcnt = 0;
+      if (attr->aspath)
+	attr->aspath->refcnt++;
+      if (attr->community)
+	attr->community->refcnt++;
+      if (attr->extra)
+	{
+	  if (attr->extra->ecommunity)
+	    attr->extra->ecommunity->refcnt++;
+	  if (attr->extra->lcommunity)
+	    attr->extra->lcommunity->refcnt++;
+	  if (attr->extra->cluster)
+	    attr->extra->cluster->refcnt++;
+	  if (attr->extra->transit)
+	    attr->extra->transit->refcnt++;
+	}
+
+      stream_forward_getp (BGP_INPUT (peer), size);
+      peer->attr_cache_hit++;
+      return BGP_ATTR_PARSE_PROCEED;
+    }
+
+  peer->attr_cache_miss++;
+  ret = bgp_attr_parse_main (peer, attr, size, mp_update, mp_withdraw);
+
+  /* The MP attributes carry NLRI, and so are different each time. */
+  if (ret != BGP_ATTR_PARSE_PROCEED
+      || CHECK_FLAG (attr->flag, ATTR_FLAG_BIT (BGP_ATTR_MP_REACH_NLRI))
+      || CHECK_FLAG (attr->flag, ATTR_FLAG_BIT (BGP_ATTR_MP_UNREACH_NLRI)))
+    return ret;
+
+  i = cache->next;
+  cache->next = (i + 1) % BGP_ATTR_CACHE_SIZE;
+  if (cache->entry[i].attr)
+    {
+      XFREE (MTYPE_BGP_ATTR_CACHE, cache->entry[i].data);
+      bgp_attr_unintern (&cache->entry[i].attr);
+    }
+  cache->entry[i].key = key;
+  cache->entry[i].size = size;
+  cache->entry[i].data = XMALLOC (MTYPE_BGP_ATTR_CACHE, size);
+  memcpy (cache->entry[i].data, pnt, size);
+  cache->entry[i].attr = bgp_attr_intern (attr);
+
+  return ret;
+}
+
 int stream_put_prefix (struct stream *, struct prefix *);
 
 size_t
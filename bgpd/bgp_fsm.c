@@ -43,6 +43,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
 #include "bgpd/bgp_nht.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -192,8 +194,14 @@ bgp_timer_set (struct peer *peer)
 	{
 	  BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer,
 			peer->v_holdtime);
-	  BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
-			peer->v_keepalive);
+
+	  /* The I/O thread sends the KEEPALIVEs of the sessions it
+	     serves. */
+	  if (peer->io)
+	    BGP_TIMER_OFF (peer->t_keepalive);
+	  else
+	    BGP_TIMER_ON (peer->t_keepalive, bgp_keepalive_timer,
+			  peer->v_keepalive);
 	}
       break;
     case Deleted:
@@ -253,10 +261,19 @@ static int
 bgp_holdtime_timer (struct thread *thread)
 {
   struct peer *peer;
+  int left;
 
   peer = THREAD_ARG (thread);
   peer->t_holdtime = NULL;
 
+  /* The I/O thread may have read KEEPALIVEs or UPDATEs which the main
+     thread has not got round to. */
+  if (peer->io && (left = bgp_io_peer_holdtime (peer)) > 0)
+    {
+      BGP_TIMER_ON (peer->t_holdtime, bgp_holdtime_timer, left);
+      return 0;
+    }
+
   if (BGP_DEBUG (fsm, FSM))
     zlog (peer->log, LOG_DEBUG,
 	  "%s [FSM] Timer (holdtime timer expire)",
@@ -336,7 +353,8 @@ const char *peer_down_str[] =
   "Capability changed",
   "Passive config change",
   "Multihop config change",
-  "NSF peer closed the session"
+  "NSF peer closed the session",
+  "Adj-RIB-Out mode changed"
 };
 
 static int
@@ -423,6 +441,10 @@ bgp_fsm_change_status (struct peer *peer, int status)
   /* Preserve old status and change into new status. */
   peer->ostatus = peer->status;
   peer->status = status;
+
+  /* Only Established peers are in update groups. */
+  if (peer->status == Established || peer->ostatus == Established)
+    bgp_updgrp_reset (peer->bgp);
   
   if (BGP_DEBUG (normal, NORMAL))
     zlog_debug ("%s went from %s to %s",
@@ -508,7 +530,9 @@ bgp_stop (struct peer *peer)
       peer->synctime = 0;
     }
   
-  /* Stop read and write threads when exists. */
+  /* Take the socket back from the I/O thread, and stop read and write
+     threads when exists. */
+  bgp_io_peer_detach (peer);
   BGP_READ_OFF (peer->t_read);
   BGP_WRITE_OFF (peer->t_write);
 
@@ -522,9 +546,14 @@ bgp_stop (struct peer *peer)
   /* Stream reset. */
   peer->packet_size = 0;
 
+  /* Path attributes are parsed afresh in the next session. */
+  bgp_attr_cache_free (peer);
+
   /* Clear input and output buffer.  */
   if (peer->ibuf)
     stream_reset (peer->ibuf);
+  if (peer->rbuf)
+    stream_reset (peer->rbuf);
   if (peer->work)
     stream_reset (peer->work);
   if (peer->obuf)
@@ -932,6 +961,9 @@ bgp_establish (struct peer *peer)
   /* Reset uptime, send keepalive, send current table. */
   peer->uptime = bgp_clock ();
 
+  /* The I/O thread, if there is one, serves the session from now on. */
+  bgp_io_peer_attach (peer);
+
   /* Send route-refresh when ORF is enabled */
   for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
     for (safi = SAFI_UNICAST ; safi < SAFI_MAX ; safi++)
@@ -25,7 +25,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 /* Macro for BGP read, write and timer thread.  */
 #define BGP_READ_ON(T,F,V)			\
   do {						\
-    if (!(T) && (peer->status != Deleted))	\
+    if (!(T) && (peer->status != Deleted) && !peer->io) \
       THREAD_READ_ON(bm->master,T,F,peer,V);	\
   } while (0)
 
@@ -35,10 +35,17 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
       THREAD_READ_OFF(T);			\
   } while (0)
 
+/* With the I/O thread writing for the peer, all that is left to do
+   on the main thread does not wait for the socket. */
 #define BGP_WRITE_ON(T,F,V)			\
   do {						\
     if (!(T) && (peer->status != Deleted))	\
-      THREAD_WRITE_ON(bm->master,(T),(F),peer,(V)); \
+      {						\
+	if (peer->io)				\
+	  (T) = thread_add_event (bm->master, (F), peer, 0); \
+	else					\
+	  THREAD_WRITE_ON(bm->master,(T),(F),peer,(V)); \
+      }						\
   } while (0)
     
 #define BGP_WRITE_OFF(T)			\
@@ -0,0 +1,914 @@
+/* BGP session I/O thread
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "linklist.h"
+#include "memory.h"
+#include "prefix.h"
+#include "log.h"
+#include "thread.h"
+#include "stream.h"
+#include "network.h"
+#include "filter.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_io.h"
+
+/* The sockets of established sessions can be served by a pthread of
+ * their own, so that a main thread busy with the RIB neither stops
+ * reading nor misses sending KEEPALIVEs, and the sessions are not
+ * dropped for it.  The I/O thread reads ahead into a ring per peer
+ * and frames the messages there, writes the messages the main thread
+ * hands it, and sends the KEEPALIVEs itself.  The main thread, woken
+ * through a pipe, takes whole messages off the rings and processes
+ * them as bgp_read would.
+ *
+ * Everything the two threads share is under one lock, and the I/O
+ * thread neither allocates nor frees anything the main thread's
+ * memory accounting knows of.  A peer is detached again, and the I/O
+ * thread done with it, before its socket is closed or written to by
+ * the main thread.
+ */
+
+#ifdef HAVE_BGP_IO_THREAD
+
+#include <pthread.h>
+#include <poll.h>
+
+#define BGP_IO_BYTE(I,N) ((I)->ring[(N) & (BGP_IO_RING_SIZE - 1)])
+
+/* The I/O thread's side of a peer. */
+struct bgp_io
+{
+  struct bgp_io *next;
+  int fd;
+
+  /* Read ahead.  Bytes from tail up to framed are whole messages,
+     those from framed up to head part of the next one.  The I/O
+     thread moves head and framed, the main thread tail. */
+  unsigned long head;
+  unsigned long framed;
+  unsigned long tail;
+
+  /* The header at framed fails the length check. */
+  int bad;
+
+  /* The session has failed: an errno value, or -1 if the peer closed
+     it. */
+  int error;
+
+  /* When the last KEEPALIVE or UPDATE was read. */
+  time_t readtime;
+  unsigned int reads;
+
+  /* Messages to write, oldest first, and those written, for the main
+     thread to free. */
+  struct stream *out;
+  struct stream **out_tail;
+  size_t out_bytes;
+  struct stream *sent;
+  struct stream **sent_tail;
+
+  /* The main thread is waiting for out_bytes to drop, and has been
+     told it has. */
+  int more;
+  int call_back;
+
+  /* KEEPALIVEs, which the I/O thread queues by itself. */
+  struct stream *keepalive;
+  int keepalive_queued;
+  int v_keepalive;
+  time_t keepalive_next;
+  unsigned int keepalive_out;
+
+  /* Main thread only. */
+  struct peer *peer;
+  int error_seen;
+  u_char msg[BGP_MAX_PACKET_SIZE];
+
+  u_char ring[BGP_IO_RING_SIZE];
+};
+
+static struct
+{
+  int running;
+  pthread_t thread;
+
+  /* Everything below is protected by the lock. */
+  pthread_mutex_t lock;
+
+  /* Attached peers. */
+  struct bgp_io *peers;
+  unsigned int count;
+
+  /* The I/O thread's poll set, with room for the wakeup pipe and each
+     attached peer.  The main thread grows it before attaching one. */
+  struct pollfd *pfd;
+  struct bgp_io **snap;
+  unsigned int max;
+
+  /* Counts the I/O thread's passes over the peers, each of which
+     starts by looking at the list afresh. */
+  unsigned long generation;
+  pthread_cond_t generation_cond;
+
+  /* A wakeup is outstanding for either thread. */
+  int main_woken;
+  int io_woken;
+} bgp_io;
+
+/* Written by the I/O thread to wake the main thread, and the other
+   way round. */
+static int bgp_io_wakeup[2] = { -1, -1 };
+static int bgp_io_kick[2] = { -1, -1 };
+
+/* Main thread only. */
+static struct list *bgp_io_peers;
+static struct thread *bgp_io_t_read;
+static struct thread *bgp_io_t_event;
+
+static int bgp_io_event (struct thread *);
+
+static time_t
+bgp_io_clock (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+/* Called with the lock held. */
+static void
+bgp_io_wake_main (void)
+{
+  if (bgp_io.main_woken)
+    return;
+  bgp_io.main_woken = 1;
+  while (write (bgp_io_wakeup[1], "", 1) < 0 && errno == EINTR)
+    ;
+}
+
+/* Called with the lock held. */
+static void
+bgp_io_wake_thread (void)
+{
+  if (bgp_io.io_woken)
+    return;
+  bgp_io.io_woken = 1;
+  while (write (bgp_io_kick[1], "", 1) < 0 && errno == EINTR)
+    ;
+}
+
+static void
+bgp_io_drain (int fd)
+{
+  char buf[64];
+
+  while (read (fd, buf, sizeof (buf)) > 0)
+    ;
+}
+
+/* Move framed over the whole messages read.  Called with the lock
+   held, or before the peer is attached. */
+static void
+bgp_io_frame (struct bgp_io *io, time_t now)
+{
+  bgp_size_t size;
+  u_char type;
+
+  while (! io->bad && io->head - io->framed >= BGP_HEADER_SIZE)
+    {
+      size = (BGP_IO_BYTE (io, io->framed + BGP_MARKER_SIZE) << 8)
+	     | BGP_IO_BYTE (io, io->framed + BGP_MARKER_SIZE + 1);
+      type = BGP_IO_BYTE (io, io->framed + BGP_MARKER_SIZE + 2);
+
+      /* Leave it to the main thread's header checks. */
+      if (size < BGP_HEADER_SIZE || size > BGP_MAX_PACKET_SIZE)
+	{
+	  io->bad = 1;
+	  break;
+	}
+      if (io->head - io->framed < size)
+	break;
+
+      io->framed += size;
+      if (type == BGP_MSG_UPDATE || type == BGP_MSG_KEEPALIVE)
+	io->readtime = now;
+    }
+}
+
+/* I/O thread: read what the socket has and there is room for. */
+static void
+bgp_io_read (struct bgp_io *io, time_t now)
+{
+  struct iovec iov[2];
+  unsigned long head, framed;
+  size_t space, off;
+  ssize_t nbytes;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  head = io->head;
+  space = BGP_IO_RING_SIZE - (head - io->tail);
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  if (! space)
+    return;
+
+  off = head & (BGP_IO_RING_SIZE - 1);
+  iov[0].iov_base = io->ring + off;
+  iov[0].iov_len = MIN (space, BGP_IO_RING_SIZE - off);
+  iov[1].iov_base = io->ring;
+  iov[1].iov_len = space - iov[0].iov_len;
+
+  nbytes = readv (io->fd, iov, iov[1].iov_len ? 2 : 1);
+  if (nbytes < 0 && ERRNO_IO_RETRY (errno))
+    return;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  framed = io->framed;
+  if (nbytes <= 0)
+    io->error = nbytes ? errno : -1;
+  else
+    {
+      io->head = head + nbytes;
+      io->reads++;
+      bgp_io_frame (io, now);
+    }
+  if (io->error || io->bad || io->framed != framed)
+    bgp_io_wake_main ();
+  pthread_mutex_unlock (&bgp_io.lock);
+}
+
+/* I/O thread: write as much of the queued messages as the socket
+   takes. */
+static void
+bgp_io_write (struct bgp_io *io)
+{
+  struct iovec iov[BGP_WRITE_PACKET_MAX];
+  struct stream *s;
+  int iovcnt;
+  size_t len;
+  ssize_t num;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  for (s = io->out, iovcnt = 0;
+       s && iovcnt < (int) BGP_WRITE_PACKET_MAX;
+       s = s->next, iovcnt++)
+    {
+      iov[iovcnt].iov_base = STREAM_PNT (s);
+      iov[iovcnt].iov_len = STREAM_READABLE (s);
+    }
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  if (! iovcnt)
+    return;
+
+  num = writev (io->fd, iov, iovcnt);
+  if (num < 0 && ERRNO_IO_RETRY (errno))
+    return;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  if (num < 0)
+    {
+      io->error = errno;
+      bgp_io_wake_main ();
+    }
+  while (num > 0 && (s = io->out) != NULL)
+    {
+      len = STREAM_READABLE (s);
+      if ((size_t) num < len)
+	{
+	  stream_forward_getp (s, num);
+	  io->out_bytes -= num;
+	  break;
+	}
+      num -= len;
+      io->out_bytes -= len;
+
+      io->out = s->next;
+      if (! io->out)
+	io->out_tail = &io->out;
+      s->next = NULL;
+
+      if (s == io->keepalive)
+	{
+	  stream_set_getp (s, 0);
+	  io->keepalive_queued = 0;
+	  io->keepalive_out++;
+	}
+      else
+	{
+	  *io->sent_tail = s;
+	  io->sent_tail = &s->next;
+	}
+    }
+  if (io->more && io->out_bytes < BGP_IO_OUT_LOW)
+    {
+      io->more = 0;
+      io->call_back = 1;
+      bgp_io_wake_main ();
+    }
+  pthread_mutex_unlock (&bgp_io.lock);
+}
+
+/* I/O thread: queue a KEEPALIVE when one is due.  Called with the
+   lock held. */
+static void
+bgp_io_keepalive (struct bgp_io *io, time_t now)
+{
+  if (! io->v_keepalive || now < io->keepalive_next)
+    return;
+
+  if (! io->keepalive_queued)
+    {
+      *io->out_tail = io->keepalive;
+      io->out_tail = &io->keepalive->next;
+      io->out_bytes += BGP_HEADER_SIZE;
+      io->keepalive_queued = 1;
+    }
+  io->keepalive_next = now + io->v_keepalive;
+}
+
+static void *
+bgp_io_thread (void *arg)
+{
+  struct pollfd *pfd;
+  struct bgp_io **snap;
+  struct bgp_io *io;
+  unsigned int n, i;
+  time_t now;
+  int timeout;
+  long left;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&bgp_io.lock);
+      bgp_io.generation++;
+      pthread_cond_broadcast (&bgp_io.generation_cond);
+      bgp_io.io_woken = 0;
+      pfd = bgp_io.pfd;
+      snap = bgp_io.snap;
+
+      now = bgp_io_clock ();
+      timeout = -1;
+      pfd[0].fd = bgp_io_kick[0];
+      pfd[0].events = POLLIN;
+      for (n = 1, io = bgp_io.peers; io; io = io->next)
+	{
+	  if (io->error)
+	    continue;
+
+	  pfd[n].fd = io->fd;
+	  pfd[n].events = 0;
+	  if (! io->bad && io->head - io->tail < BGP_IO_RING_SIZE)
+	    pfd[n].events |= POLLIN;
+	  if (io->out)
+	    pfd[n].events |= POLLOUT;
+	  snap[n++] = io;
+
+	  if (io->v_keepalive)
+	    {
+	      left = io->keepalive_next - now;
+	      if (left < 0)
+		left = 0;
+	      if (timeout < 0 || left * 1000 < timeout)
+		timeout = left * 1000;
+	    }
+	}
+      pthread_mutex_unlock (&bgp_io.lock);
+
+      if (poll (pfd, n, timeout) < 0)
+	continue;
+
+      if (pfd[0].revents)
+	bgp_io_drain (bgp_io_kick[0]);
+
+      now = bgp_io_clock ();
+      for (i = 1; i < n; i++)
+	{
+	  io = snap[i];
+
+	  if ((pfd[i].events & POLLIN)
+	      && (pfd[i].revents & (POLLIN | POLLERR | POLLHUP)))
+	    bgp_io_read (io, now);
+
+	  pthread_mutex_lock (&bgp_io.lock);
+	  bgp_io_keepalive (io, now);
+	  pthread_mutex_unlock (&bgp_io.lock);
+
+	  if (! io->error)
+	    bgp_io_write (io);
+	}
+    }
+
+  return NULL;
+}
+
+/* A message at the main thread's end of the ring, copied out if it
+   wraps around. */
+static u_char *
+bgp_io_message (struct bgp_io *io, unsigned long pos, bgp_size_t size)
+{
+  size_t off, len;
+
+  off = pos & (BGP_IO_RING_SIZE - 1);
+  if (off + size <= BGP_IO_RING_SIZE)
+    return io->ring + off;
+
+  len = BGP_IO_RING_SIZE - off;
+  memcpy (io->msg, io->ring + off, len);
+  memcpy (io->msg + len, io->ring, size - len);
+  return io->msg;
+}
+
+/* Main thread: process what the I/O thread has for a peer.  Returns
+   1 if there are whole messages left for another pass. */
+static int
+bgp_io_peer_process (struct peer *peer)
+{
+  struct bgp_io *io = peer->io;
+  struct stream *sent, *s;
+  unsigned long tail, framed;
+  unsigned int count;
+  bgp_size_t size;
+  u_char *pnt;
+  u_int32_t notify_in;
+  int bad, error, call_back;
+  int ret;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  tail = io->tail;
+  framed = io->framed;
+  bad = io->bad;
+  error = io->error;
+  call_back = io->call_back;
+  io->call_back = 0;
+  sent = io->sent;
+  io->sent = NULL;
+  io->sent_tail = &io->sent;
+  peer->read_count += io->reads;
+  io->reads = 0;
+  peer->keepalive_out += io->keepalive_out;
+  io->keepalive_out = 0;
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  while ((s = sent) != NULL)
+    {
+      sent = s->next;
+      stream_free (s);
+    }
+
+  if (call_back)
+    BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+
+  notify_in = peer->notify_in;
+  for (count = 0; tail != framed && count < BGP_READ_PACKET_MAX; count++)
+    {
+      size = (BGP_IO_BYTE (io, tail + BGP_MARKER_SIZE) << 8)
+	     | BGP_IO_BYTE (io, tail + BGP_MARKER_SIZE + 1);
+      pnt = bgp_io_message (io, tail, size);
+      tail += size;
+
+      ret = bgp_read_message (peer, pnt);
+
+      /* The session was closed, and the peer detached.  That includes
+	 a NOTIFICATION having been sent. */
+      if (peer->io != io)
+	return 0;
+
+      pthread_mutex_lock (&bgp_io.lock);
+      if (io->head - io->tail >= BGP_IO_RING_SIZE)
+	bgp_io_wake_thread ();
+      io->tail = tail;
+      pthread_mutex_unlock (&bgp_io.lock);
+
+      /* Leave the rest to the Stop event for a NOTIFICATION received. */
+      if (ret < 0 || peer->notify_in != notify_in)
+	return 0;
+    }
+
+  if (tail != framed)
+    return 1;
+
+  /* Have the header checks fail on it, with the notification they
+     send. */
+  if (bad)
+    bgp_read_message (peer, bgp_io_message (io, tail, BGP_HEADER_SIZE));
+  else if (error && ! io->error_seen)
+    {
+      io->error_seen = 1;
+      bgp_read_error (peer, error < 0 ? 0 : error);
+    }
+
+  return 0;
+}
+
+static void
+bgp_io_process (void)
+{
+  struct listnode *node, *nnode;
+  struct peer *peer;
+  int again = 0;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  bgp_io.main_woken = 0;
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  for (ALL_LIST_ELEMENTS (bgp_io_peers, node, nnode, peer))
+    if (bgp_io_peer_process (peer))
+      again = 1;
+
+  if (again && ! bgp_io_t_event)
+    bgp_io_t_event = thread_add_event (bm->master, bgp_io_event, NULL, 0);
+}
+
+static int
+bgp_io_event (struct thread *thread)
+{
+  bgp_io_t_event = NULL;
+  bgp_io_process ();
+  return 0;
+}
+
+static int
+bgp_io_read_wakeup (struct thread *thread)
+{
+  bgp_io_t_read = NULL;
+  bgp_io_drain (bgp_io_wakeup[0]);
+  bgp_io_process ();
+  bgp_io_t_read = thread_add_read (bm->master, bgp_io_read_wakeup, NULL,
+				   bgp_io_wakeup[0]);
+  return 0;
+}
+
+int
+bgp_io_init (void)
+{
+  if (bgp_io.running)
+    return 0;
+
+  if (pipe (bgp_io_wakeup) < 0 || pipe (bgp_io_kick) < 0)
+    {
+      zlog_err ("%s: can't create pipe: %s", __func__,
+		safe_strerror (errno));
+      return -1;
+    }
+  set_nonblocking (bgp_io_wakeup[0]);
+  set_nonblocking (bgp_io_wakeup[1]);
+  set_nonblocking (bgp_io_kick[0]);
+  set_nonblocking (bgp_io_kick[1]);
+
+  pthread_mutex_init (&bgp_io.lock, NULL);
+  pthread_cond_init (&bgp_io.generation_cond, NULL);
+  bgp_io.max = 16;
+  bgp_io.pfd = XCALLOC (MTYPE_BGP_IO, bgp_io.max * sizeof (struct pollfd));
+  bgp_io.snap = XCALLOC (MTYPE_BGP_IO,
+			 bgp_io.max * sizeof (struct bgp_io *));
+  bgp_io_peers = list_new ();
+  bgp_io.running = 1;
+  return 0;
+}
+
+int
+bgp_io_start (void)
+{
+  sigset_t all, saved;
+  int ret;
+
+  if (! bgp_io.running)
+    return -1;
+
+  /* Signals are for the main thread to handle. */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &saved);
+  ret = pthread_create (&bgp_io.thread, NULL, bgp_io_thread, NULL);
+  pthread_sigmask (SIG_SETMASK, &saved, NULL);
+
+  /* No session can be established yet, so the main thread can simply
+     carry on without it. */
+  if (ret)
+    {
+      zlog_err ("%s: can't create thread: %s", __func__, safe_strerror (ret));
+      bgp_io.running = 0;
+      return -1;
+    }
+
+  bgp_io_t_read = thread_add_read (bm->master, bgp_io_read_wakeup, NULL,
+				   bgp_io_wakeup[0]);
+  zlog_info ("Established sessions are served by the I/O thread");
+  return 0;
+}
+
+int
+bgp_io_running (void)
+{
+  return bgp_io.running;
+}
+
+/* Wait, with the lock held, for the I/O thread to start a new pass
+   over the peers. */
+static void
+bgp_io_wait_pass (void)
+{
+  unsigned long generation;
+
+  bgp_io_wake_thread ();
+  generation = bgp_io.generation;
+  while (bgp_io.generation == generation)
+    pthread_cond_wait (&bgp_io.generation_cond, &bgp_io.lock);
+}
+
+/* Make room in the poll set for one more peer, with the lock held.
+   The old arrays are freed once the I/O thread has taken up the new
+   ones. */
+static void
+bgp_io_grow (void)
+{
+  struct pollfd *pfd;
+  struct bgp_io **snap;
+
+  if (bgp_io.count + 2 <= bgp_io.max)
+    return;
+
+  pfd = bgp_io.pfd;
+  snap = bgp_io.snap;
+  bgp_io.max *= 2;
+  bgp_io.pfd = XCALLOC (MTYPE_BGP_IO, bgp_io.max * sizeof (struct pollfd));
+  bgp_io.snap = XCALLOC (MTYPE_BGP_IO,
+			 bgp_io.max * sizeof (struct bgp_io *));
+  bgp_io_wait_pass ();
+  XFREE (MTYPE_BGP_IO, pfd);
+  XFREE (MTYPE_BGP_IO, snap);
+}
+
+void
+bgp_io_peer_attach (struct peer *peer)
+{
+  struct bgp_io *io;
+  size_t len;
+  time_t now;
+  int i;
+
+  if (! bgp_io.running || peer->io || peer->fd < 0)
+    return;
+
+  io = XCALLOC (MTYPE_BGP_IO, sizeof (struct bgp_io));
+  io->peer = peer;
+  io->fd = peer->fd;
+  io->out_tail = &io->out;
+  io->sent_tail = &io->sent;
+
+  io->keepalive = stream_new (BGP_HEADER_SIZE);
+  for (i = 0; i < BGP_MARKER_SIZE; i++)
+    stream_putc (io->keepalive, 0xff);
+  stream_putw (io->keepalive, BGP_HEADER_SIZE);
+  stream_putc (io->keepalive, BGP_MSG_KEEPALIVE);
+
+  now = bgp_io_clock ();
+  if (peer->v_holdtime)
+    io->v_keepalive = peer->v_keepalive;
+  io->keepalive_next = now + io->v_keepalive;
+  io->readtime = now;
+
+  /* Take over whatever was read ahead already. */
+  len = STREAM_READABLE (peer->rbuf);
+  assert (len <= BGP_IO_RING_SIZE);
+  memcpy (io->ring, STREAM_PNT (peer->rbuf), len);
+  stream_reset (peer->rbuf);
+  io->head = len;
+  bgp_io_frame (io, now);
+
+  BGP_READ_OFF (peer->t_read);
+  BGP_WRITE_OFF (peer->t_write);
+  BGP_TIMER_OFF (peer->t_keepalive);
+
+  peer->io = io;
+  listnode_add (bgp_io_peers, peer);
+
+  pthread_mutex_lock (&bgp_io.lock);
+  bgp_io_grow ();
+  io->next = bgp_io.peers;
+  bgp_io.peers = io;
+  bgp_io.count++;
+  bgp_io_wake_thread ();
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+  if ((io->framed != io->tail || io->bad) && ! bgp_io_t_event)
+    bgp_io_t_event = thread_add_event (bm->master, bgp_io_event, NULL, 0);
+}
+
+void
+bgp_io_peer_detach (struct peer *peer)
+{
+  struct bgp_io *io = peer->io;
+  struct bgp_io **prev;
+  struct stream *s;
+
+  if (! io)
+    return;
+
+  peer->io = NULL;
+  listnode_delete (bgp_io_peers, peer);
+  BGP_WRITE_OFF (peer->t_write);
+
+  /* Once the I/O thread has started a pass without it, it no longer
+     uses it. */
+  pthread_mutex_lock (&bgp_io.lock);
+  for (prev = &bgp_io.peers; *prev != io; prev = &(*prev)->next)
+    ;
+  *prev = io->next;
+  bgp_io.count--;
+  bgp_io_wait_pass ();
+  peer->read_count += io->reads;
+  peer->keepalive_out += io->keepalive_out;
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  while ((s = io->out) != NULL)
+    {
+      io->out = s->next;
+      if (s != io->keepalive)
+	stream_free (s);
+    }
+  while ((s = io->sent) != NULL)
+    {
+      io->sent = s->next;
+      stream_free (s);
+    }
+  stream_free (io->keepalive);
+  XFREE (MTYPE_BGP_IO, io);
+}
+
+size_t
+bgp_io_peer_space (struct peer *peer)
+{
+  size_t queued;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  queued = peer->io->out_bytes;
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  return queued < BGP_IO_OUT_HIGH ? BGP_IO_OUT_HIGH - queued : 0;
+}
+
+void
+bgp_io_peer_send (struct peer *peer, int more)
+{
+  struct bgp_io *io = peer->io;
+  struct stream *s, *head = NULL, **tail = &head;
+  size_t bytes = 0;
+
+  while ((s = stream_fifo_pop (peer->obuf)) != NULL)
+    {
+      switch (STREAM_DATA (s)[BGP_MARKER_SIZE + 2])
+	{
+	case BGP_MSG_UPDATE:
+	  peer->update_out++;
+	  break;
+	case BGP_MSG_KEEPALIVE:
+	  peer->keepalive_out++;
+	  break;
+	case BGP_MSG_ROUTE_REFRESH_NEW:
+	case BGP_MSG_ROUTE_REFRESH_OLD:
+	  peer->refresh_out++;
+	  break;
+	case BGP_MSG_CAPABILITY:
+	  peer->dynamic_cap_out++;
+	  break;
+	}
+      bytes += STREAM_READABLE (s);
+      s->next = NULL;
+      *tail = s;
+      tail = &s->next;
+    }
+
+  pthread_mutex_lock (&bgp_io.lock);
+  if (head)
+    {
+      if (! io->out)
+	bgp_io_wake_thread ();
+      *io->out_tail = head;
+      io->out_tail = tail;
+      io->out_bytes += bytes;
+    }
+  io->more = more;
+  pthread_mutex_unlock (&bgp_io.lock);
+}
+
+int
+bgp_io_peer_holdtime (struct peer *peer)
+{
+  struct bgp_io *io = peer->io;
+  time_t readtime;
+  int backlog;
+  long left;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  backlog = (io->framed != io->tail);
+  readtime = io->readtime;
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  if (backlog)
+    return peer->v_holdtime;
+
+  left = readtime + peer->v_holdtime - bgp_io_clock ();
+  return left > 0 ? left : 0;
+}
+
+void
+bgp_io_peer_show (struct vty *vty, struct peer *peer)
+{
+  unsigned long ahead;
+  size_t queued;
+
+  if (! peer->io)
+    return;
+
+  pthread_mutex_lock (&bgp_io.lock);
+  ahead = peer->io->head - peer->io->tail;
+  queued = peer->io->out_bytes;
+  pthread_mutex_unlock (&bgp_io.lock);
+
+  vty_out (vty, "  Served by the I/O thread: %lu bytes read ahead, "
+	   "%lu bytes to write%s", ahead, (unsigned long) queued,
+	   VTY_NEWLINE);
+}
+#else /* HAVE_BGP_IO_THREAD */
+int
+bgp_io_init (void)
+{
+  zlog_warn ("I/O thread is not supported in this build");
+  return -1;
+}
+
+int
+bgp_io_start (void)
+{
+  return -1;
+}
+
+int
+bgp_io_running (void)
+{
+  return 0;
+}
+
+void
+bgp_io_peer_attach (struct peer *peer)
+{
+  return;
+}
+
+void
+bgp_io_peer_detach (struct peer *peer)
+{
+  return;
+}
+
+size_t
+bgp_io_peer_space (struct peer *peer)
+{
+  return 0;
+}
+
+void
+bgp_io_peer_send (struct peer *peer, int more)
+{
+  return;
+}
+
+int
+bgp_io_peer_holdtime (struct peer *peer)
+{
+  return 0;
+}
+
+void
+bgp_io_peer_show (struct vty *vty, struct peer *peer)
+{
+  return;
+}
+#endif /* HAVE_BGP_IO_THREAD */
@@ -0,0 +1,62 @@
+/* BGP session I/O thread
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_IO_H
+#define _QUAGGA_BGP_IO_H
+
+/* Bytes read ahead for a peer by the I/O thread.  A power of two. */
+#define BGP_IO_RING_SIZE	(BGP_MAX_PACKET_SIZE * 16)
+
+/* Bytes of messages handed to the I/O thread for a peer beyond which
+   the main thread builds no more UPDATEs for it, and below which the
+   I/O thread asks for more. */
+#define BGP_IO_OUT_HIGH		(BGP_MAX_PACKET_SIZE * 64)
+#define BGP_IO_OUT_LOW		(BGP_MAX_PACKET_SIZE * 16)
+
+/* Hand established sessions to the I/O thread.  Must be done before
+   the process daemonizes. */
+extern int bgp_io_init (void);
+
+/* Start the thread itself, once the process has daemonized. */
+extern int bgp_io_start (void);
+
+/* Are established sessions handed to the I/O thread? */
+extern int bgp_io_running (void);
+
+/* Move the socket of a peer which has just become established to the
+   I/O thread, and take it back before the socket is closed or written
+   to directly. */
+extern void bgp_io_peer_attach (struct peer *);
+extern void bgp_io_peer_detach (struct peer *);
+
+/* Bytes of messages the I/O thread can still take for a peer, and
+   hand it everything on peer->obuf.  If the main thread stopped
+   building UPDATEs for lack of room, it is called back to bgp_write
+   once the I/O thread has caught up. */
+extern size_t bgp_io_peer_space (struct peer *);
+extern void bgp_io_peer_send (struct peer *, int more);
+
+/* Seconds until the hold timer of an attached peer really expires,
+   counting messages the main thread has yet to process. */
+extern int bgp_io_peer_holdtime (struct peer *);
+
+extern void bgp_io_peer_show (struct vty *, struct peer *);
+
+#endif /* _QUAGGA_BGP_IO_H */
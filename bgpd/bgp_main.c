@@ -44,6 +44,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_dump.h"
+#include "bgpd/bgp_table.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_nexthop.h"
 #include "bgpd/bgp_regex.h"
@@ -51,6 +52,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_filter.h"
 #include "bgpd/bgp_zebra.h"
+#include "bgpd/bgp_io.h"
 
 /* bgpd options, we use GNU getopt library. */
 static const struct option longopts[] = 
@@ -70,6 +72,7 @@ static const struct option longopts[] =
   { "skip_runas",  no_argument,       NULL, 'S'},
   { "version",     no_argument,       NULL, 'v'},
   { "dryrun",      no_argument,       NULL, 'C'},
+  { "io_thread",   no_argument,       NULL, 'I'},
   { "help",        no_argument,       NULL, 'h'},
   { 0 }
 };
@@ -165,6 +168,7 @@ redistribution between different routing protocols.\n\n\
 -S, --skip_runas   Skip user and group run as\n\
 -v, --version      Print program version\n\
 -C, --dryrun       Check configuration for validity and exit\n\
+-I, --io_thread    Serve established sessions from a separate thread\n\
 -h, --help         Display this help and exit\n\
 \n\
 Report bugs to %s\n", progname, ZEBRA_BUG_ADDRESS);
@@ -323,6 +327,9 @@ bgp_exit (int status)
   /* reverse bgp_scan_init */
   bgp_scan_finish ();
 
+  /* the nodes of all tables, the last of which are gone now */
+  bgp_node_pool_finish ();
+
   /* reverse bgp_master_init */
   if (bm->master)
     thread_master_free (bm->master);
@@ -348,6 +355,7 @@ main (int argc, char **argv)
   char *progname;
   int tmp_port;
   int skip_runas = 0;
+  int io_thread = 0;
 
   /* Set umask before anything for security */
   umask (0027);
@@ -364,7 +372,7 @@ main (int argc, char **argv)
   /* Command line argument treatment. */
   while (1) 
     {
-      opt = getopt_long (argc, argv, "df:i:z:hp:l:A:P:rnu:g:vCS", longopts, 0);
+      opt = getopt_long (argc, argv, "df:i:z:hp:l:A:P:rnu:g:vCSI", longopts, 0);
     
       if (opt == EOF)
 	break;
@@ -432,6 +440,9 @@ main (int argc, char **argv)
 	case 'C':
 	  dryrun = 1;
 	  break;
+	case 'I':
+	  io_thread = 1;
+	  break;
 	case 'h':
 	  usage (progname, 0);
 	  break;
@@ -454,6 +465,8 @@ main (int argc, char **argv)
 
   /* BGP related initialization.  */
   bgp_init ();
+  if (io_thread)
+    bgp_io_init ();
 
   /* Parse config file. */
   vty_read_config (config_file, config_default);
@@ -469,6 +482,10 @@ main (int argc, char **argv)
       return (1);
     }
 
+  /* The I/O thread would not survive daemon(), so it is only started
+     now. */
+  if (bgp_io_running () && bgp_io_start () < 0)
+    zlog_warn ("Serving established sessions from the main thread");
 
   /* Process ID file creation. */
   pid_output (pid_file);
@@ -92,6 +92,7 @@ bgp_maximum_paths_set (struct bgp *bgp, afi_t afi, safi_t safi,
       return -1;
     }
 
+  bgp_best_selection_reset (bgp);
   return 0;
 }
 
@@ -119,6 +120,7 @@ bgp_maximum_paths_unset (struct bgp *bgp, afi_t afi, safi_t safi,
       return -1;
     }
 
+  bgp_best_selection_reset (bgp);
   return 0;
 }
 
@@ -282,6 +284,18 @@ bgp_info_mpath_free (struct bgp_info_mpath **mpath)
     }
 }
 
+/*
+ * bgp_info_mpath_lookup
+ *
+ * Fetch the mpath element for the given bgp_info, if it has one. It
+ * is kept with the ancillary information of the path.
+ */
+static inline struct bgp_info_mpath *
+bgp_info_mpath_lookup (struct bgp_info *binfo)
+{
+  return binfo->extra ? binfo->extra->mpath : NULL;
+}
+
 /*
  * bgp_info_mpath_get
  *
@@ -292,15 +306,15 @@ static struct bgp_info_mpath *
 bgp_info_mpath_get (struct bgp_info *binfo)
 {
   struct bgp_info_mpath *mpath;
-  if (!binfo->mpath)
+  if (!bgp_info_mpath_lookup (binfo))
     {
       mpath = bgp_info_mpath_new();
       if (!mpath)
         return NULL;
-      binfo->mpath = mpath;
+      bgp_info_extra_get (binfo)->mpath = mpath;
       mpath->mp_info = binfo;
     }
-  return binfo->mpath;
+  return binfo->extra->mpath;
 }
 
 /*
@@ -336,7 +350,7 @@ bgp_info_mpath_enqueue (struct bgp_info *prev_info, struct bgp_info *binfo)
 void
 bgp_info_mpath_dequeue (struct bgp_info *binfo)
 {
-  struct bgp_info_mpath *mpath = binfo->mpath;
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
   if (!mpath)
     return;
   if (mpath->mp_prev)
@@ -355,9 +369,10 @@ bgp_info_mpath_dequeue (struct bgp_info *binfo)
 struct bgp_info *
 bgp_info_mpath_next (struct bgp_info *binfo)
 {
-  if (!binfo->mpath || !binfo->mpath->mp_next)
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
+  if (!mpath || !mpath->mp_next)
     return NULL;
-  return binfo->mpath->mp_next->mp_info;
+  return mpath->mp_next->mp_info;
 }
 
 /*
@@ -379,9 +394,10 @@ bgp_info_mpath_first (struct bgp_info *binfo)
 u_int32_t
 bgp_info_mpath_count (struct bgp_info *binfo)
 {
-  if (!binfo->mpath)
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
+  if (!mpath)
     return 0;
-  return binfo->mpath->mp_count;
+  return mpath->mp_count;
 }
 
 /*
@@ -393,7 +409,7 @@ static void
 bgp_info_mpath_count_set (struct bgp_info *binfo, u_int32_t count)
 {
   struct bgp_info_mpath *mpath;
-  if (!count && !binfo->mpath)
+  if (!count && !bgp_info_mpath_lookup (binfo))
     return;
   mpath = bgp_info_mpath_get (binfo);
   if (!mpath)
@@ -410,9 +426,10 @@ bgp_info_mpath_count_set (struct bgp_info *binfo, u_int32_t count)
 struct attr *
 bgp_info_mpath_attr (struct bgp_info *binfo)
 {
-  if (!binfo->mpath)
+  struct bgp_info_mpath *mpath = bgp_info_mpath_lookup (binfo);
+  if (!mpath)
     return NULL;
-  return binfo->mpath->mp_attr;
+  return mpath->mp_attr;
 }
 
 /*
@@ -424,7 +441,7 @@ static void
 bgp_info_mpath_attr_set (struct bgp_info *binfo, struct attr *attr)
 {
   struct bgp_info_mpath *mpath;
-  if (!attr && !binfo->mpath)
+  if (!attr && !bgp_info_mpath_lookup (binfo))
     return;
   mpath = bgp_info_mpath_get (binfo);
   if (!mpath)
@@ -41,6 +41,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_nht.h"
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_damp.h"
+#include "bgpd/bgp_updgrp.h"
 #include "zebra/rib.h"
 #include "zebra/zserv.h"	/* For ZEBRA_SERV_PATH. */
 
@@ -243,6 +244,8 @@ bgp_connected_add (struct connected *ifc)
   if (if_is_loopback (ifp))
     return;
 
+  bgp_updgrp_reset_all ();
+
   addr = ifc->address;
 
   p = *(CONNECTED_PREFIX(ifc));
@@ -307,6 +310,8 @@ bgp_connected_delete (struct connected *ifc)
   if (if_is_loopback (ifp))
     return;
 
+  bgp_updgrp_reset_all ();
+
   addr = ifc->address;
 
   p = *(CONNECTED_PREFIX(ifc));
@@ -408,6 +413,35 @@ bgp_multiaccess_check_v4 (struct in_addr nexthop, struct peer *peer)
   return (ret);
 }
 
+/* Whether bgp_multiaccess_check_v4 answers the same for both peers,
+   whatever the next hop: both are on the same connected subnet, or
+   neither is on any. */
+int
+bgp_multiaccess_same (struct peer *peer1, struct peer *peer2)
+{
+  struct bgp_node *rn1;
+  struct bgp_node *rn2;
+  struct prefix p;
+
+  if (peer1->su.sa.sa_family != AF_INET || peer2->su.sa.sa_family != AF_INET)
+    return peer1->su.sa.sa_family == peer2->su.sa.sa_family;
+
+  p.family = AF_INET;
+  p.prefixlen = IPV4_MAX_BITLEN;
+  p.u.prefix4 = peer1->su.sin.sin_addr;
+  rn1 = bgp_node_match (bgp_connected_table[AFI_IP], &p);
+
+  p.u.prefix4 = peer2->su.sin.sin_addr;
+  rn2 = bgp_node_match (bgp_connected_table[AFI_IP], &p);
+
+  if (rn1)
+    bgp_unlock_node (rn1);
+  if (rn2)
+    bgp_unlock_node (rn2);
+
+  return rn1 == rn2;
+}
+
 static int
 show_ip_bgp_nexthop_table (struct vty *vty, int detail)
 {
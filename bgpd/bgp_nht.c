@@ -192,6 +192,16 @@ bgp_unlink_nexthop_by_peer (struct peer *peer)
   bgp_unlink_nexthop_check (bnc);
 }
 
+u_int32_t
+bgp_info_igpmetric (struct bgp_info *path)
+{
+  struct bgp_nexthop_cache *bnc = path->nexthop;
+
+  if (bnc && CHECK_FLAG(bnc->flags, BGP_NEXTHOP_VALID))
+    return bnc->metric;
+  return 0;
+}
+
 int
 bgp_ensure_nexthop (struct bgp_info *ri, struct peer *peer,
                     int connected)
@@ -227,11 +237,6 @@ bgp_ensure_nexthop (struct bgp_info *ri, struct peer *peer,
   if (ri)
     {
       path_nh_map(ri, bnc, 1); /* updates NHT ri list reference */
-
-      if (CHECK_FLAG(bnc->flags, BGP_NEXTHOP_VALID) && bnc->metric)
-	(bgp_info_extra_get(ri))->igpmetric = bnc->metric;
-      else if (ri->extra)
-	ri->extra->igpmetric = 0;
     }
   else if (peer)
     bnc->nht_info = (void *)peer; /* NHT peer reference */
@@ -563,12 +568,6 @@ evaluate_paths (struct bgp_nexthop_cache *bnc)
 	    }
 	}
 
-      /* Copy the metric to the path. Will be used for bestpath computation */
-      if (CHECK_FLAG(bnc->flags, BGP_NEXTHOP_VALID) && bnc->metric)
-	(bgp_info_extra_get(path))->igpmetric = bnc->metric;
-      else if (path->extra)
-	path->extra->igpmetric = 0;
-
       if (CHECK_FLAG(bnc->flags, BGP_NEXTHOP_METRIC_CHANGED) ||
 	  CHECK_FLAG(bnc->flags, BGP_NEXTHOP_CHANGED))
 	SET_FLAG(path->flags, BGP_INFO_IGP_CHANGED);
@@ -50,6 +50,15 @@ int bgp_nexthop_check (struct bgp_info *, int connected);
  */
 int bgp_ensure_nexthop (struct bgp_info *, struct peer *, int connected);
 
+/**
+ * bgp_info_igpmetric() - IGP metric to the nexthop of a path, or 0 if the
+ *  nexthop does not resolve through the IGP.  Kept with the nexthop
+ *  rather than with each path through it.
+ * ARGUMENTS:
+ *   struct bgp_info *: path structure.
+ */
+u_int32_t bgp_info_igpmetric (struct bgp_info *);
+
 /**
  * bgp_unlink_nexthop() - Unlink the nexthop object from the path structure.
  * ARGUMENTS:
@@ -50,6 +50,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_encap.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_io.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
@@ -102,6 +104,34 @@ bgp_packet_delete (struct peer *peer)
   stream_free (stream_fifo_pop (peer->obuf));
 }
 
+/* Whether peer->rbuf holds a whole message, or a header which won't
+   pass the checks anyway.  */
+static int
+bgp_read_framed (struct peer *peer)
+{
+  bgp_size_t size;
+
+  if (! peer->rbuf || STREAM_READABLE (peer->rbuf) < BGP_HEADER_SIZE)
+    return 0;
+
+  size = stream_getw_from (peer->rbuf,
+			   stream_get_getp (peer->rbuf) + BGP_MARKER_SIZE);
+  return (size < BGP_HEADER_SIZE || size > BGP_MAX_PACKET_SIZE
+	  || STREAM_READABLE (peer->rbuf) >= size);
+}
+
+/* Come straight back to whole messages already read, rather than wait
+   for the socket to have more.  */
+static void
+bgp_read_continue (struct peer *peer)
+{
+  if (peer->t_read && bgp_read_framed (peer))
+    {
+      BGP_READ_OFF (peer->t_read);
+      peer->t_read = thread_add_event (bm->master, bgp_read, peer, 0);
+    }
+}
+
 /* Check file descriptor whether connect is established. */
 static void
 bgp_connect_check (struct peer *peer)
@@ -140,23 +170,81 @@ bgp_connect_check (struct peer *peer)
     }
 }
 
+/* An advertisement has gone into an UPDATE for the peer: note what was
+   sent in the adjacency, and return the next advertisement with the
+   same attributes. */
+static struct bgp_advertise *
+bgp_update_packet_sent (struct peer *peer, struct bgp_advertise *adv,
+			afi_t afi, safi_t safi)
+{
+  struct bgp_adj_out *adj = adv->adj;
+  struct bgp_node *rn = adv->rn;
+
+  if (BGP_DEBUG (update, UPDATE_OUT))
+    {
+      char buf[INET6_BUFSIZ];
+
+      zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
+	    peer->host,
+	    inet_ntop (rn->p.family, &(rn->p.u.prefix), buf, INET6_BUFSIZ),
+	    rn->p.prefixlen);
+    }
+
+  /* Without an Adj-RIB-Out, forget the route once it is sent. */
+  if (bgp_adj_out_pending_only (peer, rn))
+    {
+      struct bgp_advertise *next;
+
+      next = bgp_advertise_clean (peer, adj, afi, safi);
+      bgp_adj_out_remove (rn, adj, peer, afi, safi);
+      bgp_unlock_node (rn);
+      return next;
+    }
+
+  /* Synchnorize attribute.  */
+  if (adj->attr)
+    bgp_attr_unintern (&adj->attr);
+  else
+    peer->scount[afi][safi]++;
+
+  adj->attr = bgp_attr_intern (adv->baa->attr);
+
+  return bgp_advertise_clean (peer, adj, afi, safi);
+}
+
 /* Make BGP update packet.  */
 static struct stream *
 bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
   struct stream *snlri;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct stream *packet;
   struct bgp_node *rn = NULL;
   struct bgp_info *binfo = NULL;
+  struct updgrp_packet *upkt = NULL;
   bgp_size_t total_attr_len = 0;
   unsigned long attrlen_pos = 0;
   int space_remaining = 0;
   int space_needed = 0;
   size_t mpattrlen_pos = 0;
   size_t mpattr_pos = 0;
+  u_int32_t i;
+
+  /* Another member of the peer's update group may already have built
+     the message. */
+  upkt = bgp_updgrp_packet_lookup (peer, afi, safi);
+  if (upkt)
+    {
+      adv = BGP_ADV_FIFO_HEAD (&peer->sync[afi][safi]->update);
+      for (i = 0; i < upkt->count; i++)
+	adv = bgp_update_packet_sent (peer, adv, afi, safi);
+
+      packet = stream_dup (upkt->s);
+      bgp_packet_add (peer, packet);
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return packet;
+    }
 
   s = peer->work;
   stream_reset (s);
@@ -169,7 +257,6 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
     {
       assert (adv->rn);
       rn = adv->rn;
-      adj = adv->adj;
       if (adv->binfo)
         binfo = adv->binfo;
 
@@ -188,8 +275,8 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	  u_char *tag = NULL;
 	  struct peer *from = NULL;
 
-	  if (rn->prn)
-	    prd = (struct prefix_rd *) &rn->prn->p;
+	  if (bgp_node_prn (rn))
+	    prd = (struct prefix_rd *) &bgp_node_prn (rn)->p;
           if (binfo)
             {
               from = binfo->peer;
@@ -222,6 +309,8 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
                                                   &rn->p : NULL),
                                                  afi, safi,
 	                                         from, prd, tag);
+          upkt = bgp_updgrp_packet_new (peer, afi, safi, adv->baa->attr,
+                                        from);
           space_remaining = STREAM_CONCAT_REMAIN (s, snlri, STREAM_SIZE(s)) -
                             BGP_MAX_PACKET_SIZE_OVERFLOW;
           space_needed = BGP_NLRI_LENGTH + bgp_packet_mpattr_prefix_size (afi, safi, &rn->p);;
@@ -232,6 +321,8 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
             {
               zlog_err ("%s cannot send UPDATE, the attributes do not leave "
                         "room for NLRI", peer->host);
+              if (upkt)
+                bgp_updgrp_packet_free (upkt);
               /* Flush the FIFO update queue */
               while (adv)
                 adv = bgp_advertise_clean (peer, adv->adj, afi, safi);
@@ -248,8 +339,8 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	  struct prefix_rd *prd = NULL;
 	  u_char *tag = NULL;
 
-	  if (rn->prn)
-	    prd = (struct prefix_rd *) &rn->prn->p;
+	  if (bgp_node_prn (rn))
+	    prd = (struct prefix_rd *) &bgp_node_prn (rn)->p;
 	  if (binfo && binfo->extra)
 	    tag = binfo->extra->tag;
 
@@ -258,25 +349,10 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 						    adv->baa->attr);
 	  bgp_packet_mpattr_prefix(snlri, afi, safi, &rn->p, prd, tag);
 	}
-      if (BGP_DEBUG (update, UPDATE_OUT))
-        {
-          char buf[INET6_BUFSIZ];
-
-          zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
-                peer->host,
-                inet_ntop (rn->p.family, &(rn->p.u.prefix), buf, INET6_BUFSIZ),
-                rn->p.prefixlen);
-        }
-
-      /* Synchnorize attribute.  */
-      if (adj->attr)
-	bgp_attr_unintern (&adj->attr);
-      else
-	peer->scount[afi][safi]++;
+      if (upkt)
+        bgp_updgrp_packet_note (upkt, &rn->p);
 
-      adj->attr = bgp_attr_intern (adv->baa->attr);
-
-      adv = bgp_advertise_clean (peer, adj, afi, safi);
+      adv = bgp_update_packet_sent (peer, adv, afi, safi);
     }
 
   if (! stream_empty (s))
@@ -295,6 +371,8 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
       else
 	packet = stream_dup (s);
       bgp_packet_set_size (packet);
+      if (upkt)
+	bgp_updgrp_packet_add (peer, afi, safi, upkt, packet);
       bgp_packet_add (peer, packet);
       BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
       stream_reset (s);
@@ -402,8 +480,8 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 	{
 	  struct prefix_rd *prd = NULL;
 
-	  if (rn->prn)
-	    prd = (struct prefix_rd *) &rn->prn->p;
+	  if (bgp_node_prn (rn))
+	    prd = (struct prefix_rd *) &bgp_node_prn (rn)->p;
 
 	  /* If first time, format the MP_UNREACH header */
 	  if (first_time)
@@ -428,7 +506,8 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
                 rn->p.prefixlen);
         }
 
-      peer->scount[afi][safi]--;
+      if (adj->attr)
+	peer->scount[afi][safi]--;
 
       bgp_adj_out_remove (rn, adj, peer, afi, safi);
       bgp_unlock_node (rn);
@@ -603,7 +682,8 @@ bgp_default_withdraw_send (struct peer *peer, afi_t afi, safi_t safi)
   BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 }
 
-/* Get next packet to be written.  */
+/* Build the next packet to be written, once those already queued on
+   peer->obuf have been.  */
 static struct stream *
 bgp_write_packet (struct peer *peer)
 {
@@ -612,10 +692,6 @@ bgp_write_packet (struct peer *peer)
   struct stream *s = NULL;
   struct bgp_advertise *adv;
 
-  s = stream_fifo_head (peer->obuf);
-  if (s)
-    return s;
-
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       {
@@ -698,15 +774,21 @@ bgp_write_proceed (struct peer *peer)
   return 0;
 }
 
-/* Write packet to the peer. */
+/* Write packets to the peer.  As many as the socket will take are
+   gathered from peer->obuf, building more UPDATEs as needed, and
+   written with a single writev().  */
 int
 bgp_write (struct thread *thread)
 {
   struct peer *peer;
   u_char type;
   struct stream *s; 
-  int num;
-  unsigned int count = 0;
+  struct iovec iov[BGP_WRITE_PACKET_MAX];
+  int iovcnt;
+  int space;
+  size_t total;
+  size_t len;
+  ssize_t num;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
@@ -719,38 +801,81 @@ bgp_write (struct thread *thread)
       return 0;
     }
 
-  s = bgp_write_packet (peer);
-  if (!s)
-    return 0;	/* nothing to send */
-
-  sockopt_cork (peer->fd, 1);
+  /* The I/O thread writes for the peer: hand it what is queued and as
+     many more UPDATEs as it will take.  */
+  if (peer->io)
+    {
+      space = bgp_io_peer_space (peer);
+      total = 0;
+      for (s = stream_fifo_head (peer->obuf); s; s = s->next)
+	total += STREAM_READABLE (s);
+      while (total < (size_t) space && (s = bgp_write_packet (peer)) != NULL)
+	total += STREAM_READABLE (s);
+      bgp_io_peer_send (peer, total >= (size_t) space);
+      return 0;
+    }
 
-  /* Nonblocking write until TCP output buffer is full.  */
-  do
+  /* A full socket is waited out rather than given UPDATEs it cannot
+     take; only if its space cannot be told is it left to writev().  */
+  space = sockopt_send_space (peer->fd);
+  if (space == 0)
     {
-      int writenum;
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return 0;
+    }
+  if (space < 0)
+    space = BGP_WRITE_PACKET_MAX * BGP_MAX_PACKET_SIZE;
+
+  /* Gather what is queued, the first packet possibly partially
+     written already, building more until the socket would fill.  A
+     NOTIFICATION is always the last thing sent.  */
+  iovcnt = 0;
+  total = 0;
+  s = stream_fifo_head (peer->obuf);
+  while (iovcnt < (int) BGP_WRITE_PACKET_MAX && total < (size_t) space)
+    {
+      if (! s && ! (s = bgp_write_packet (peer)))
+	break;
 
-      /* Number of bytes to be sent.  */
-      writenum = stream_get_endp (s) - stream_get_getp (s);
+      len = stream_get_endp (s) - stream_get_getp (s);
+      iov[iovcnt].iov_base = STREAM_PNT (s);
+      iov[iovcnt].iov_len = len;
+      iovcnt++;
+      total += len;
 
-      /* Call write() system call.  */
-      num = write (peer->fd, STREAM_PNT (s), writenum);
-      if (num < 0)
-	{
-	  /* write failed either retry needed or error */
-	  if (ERRNO_IO_RETRY(errno))
-		break;
+      if (STREAM_DATA (s)[BGP_MARKER_SIZE + 2] == BGP_MSG_NOTIFY)
+	break;
+      s = s->next;
+    }
+
+  if (! iovcnt)
+    return 0;	/* nothing to send */
 
-          BGP_EVENT_ADD (peer, TCP_fatal_error);
+  /* Nonblocking write until TCP output buffer is full.  */
+  num = writev (peer->fd, iov, iovcnt);
+  if (num < 0)
+    {
+      /* write failed either retry needed or error */
+      if (! ERRNO_IO_RETRY(errno))
+	{
+	  BGP_EVENT_ADD (peer, TCP_fatal_error);
 	  return 0;
 	}
+      num = 0;
+    }
 
-      if (num != writenum)
+  /* Delete the packets which were sent in full, and remember how much
+     of the next one was.  */
+  while (num > 0 && (s = stream_fifo_head (peer->obuf)) != NULL)
+    {
+      len = stream_get_endp (s) - stream_get_getp (s);
+      if ((size_t) num < len)
 	{
 	  /* Partial write */
 	  stream_forward_getp (s, num);
 	  break;
 	}
+      num -= len;
 
       /* Retrieve BGP packet type. */
       stream_set_getp (s, BGP_MARKER_SIZE + 2);
@@ -769,7 +894,7 @@ bgp_write (struct thread *thread)
 
 	  /* Flush any existing events */
 	  BGP_EVENT_ADD (peer, BGP_Stop_with_error);
-	  goto done;
+	  return 0;
 
 	case BGP_MSG_KEEPALIVE:
 	  peer->keepalive_out++;
@@ -786,14 +911,10 @@ bgp_write (struct thread *thread)
       /* OK we send packet so delete it. */
       bgp_packet_delete (peer);
     }
-  while (++count < BGP_WRITE_PACKET_MAX &&
-	 (s = bgp_write_packet (peer)) != NULL);
-  
+
   if (bgp_write_proceed (peer))
     BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 
- done:
-  sockopt_cork (peer->fd, 0);
   return 0;
 }
 
@@ -956,7 +1077,9 @@ bgp_notify_send_with_data (struct peer *peer, u_char code, u_char sub_code,
   /* Set BGP packet length. */
   length = bgp_packet_set_size (s);
   
-  /* Add packet to the peer. */
+  /* Take the socket back from the I/O thread, and add packet to the
+     peer. */
+  bgp_io_peer_detach (peer);
   stream_fifo_clean (peer->obuf);
   bgp_packet_add (peer, s);
 
@@ -1529,11 +1652,14 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
       realpeer->fd = peer->fd;
       peer->fd = -1;
 
-      /* Transfer input buffer. */
+      /* Transfer input buffers. */
       stream_free (realpeer->ibuf);
       realpeer->ibuf = peer->ibuf;
       realpeer->packet_size = peer->packet_size;
       peer->ibuf = NULL;
+      stream_free (realpeer->rbuf);
+      realpeer->rbuf = peer->rbuf;
+      peer->rbuf = NULL;
       
       /* Transfer output buffer, there may be an OPEN queued to send */
       stream_fifo_free (realpeer->obuf);
@@ -1557,6 +1683,7 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
 	  return -1;
 	}
       BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      bgp_read_continue (peer);
       if (stream_fifo_head (peer->obuf))
         BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
       
@@ -2459,21 +2586,50 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
-/* BGP read utility function. */
+/* The session failed while reading: error is an errno value, or zero
+   if the peer closed it.  */
+void
+bgp_read_error (struct peer *peer, int error)
+{
+  if (error)
+    plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
+	      peer->host, safe_strerror (error));
+  else if (BGP_DEBUG (events, EVENTS))
+    plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
+		peer->host, peer->fd);
+
+  if (peer->status == Established) 
+    {
+      if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
+	{
+	  peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
+	  SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
+	}
+      else
+	peer->last_reset = PEER_DOWN_CLOSE_SESSION;
+    }
+
+  if (error)
+    BGP_EVENT_ADD (peer, TCP_fatal_error);
+  else
+    BGP_EVENT_ADD (peer, TCP_connection_closed);
+}
+
+/* BGP read utility function.  Reads as much as the socket has and
+   peer->rbuf can take.  */
 static int
 bgp_read_packet (struct peer *peer)
 {
   int nbytes;
-  int readsize;
-
-  readsize = peer->packet_size - stream_get_endp (peer->ibuf);
 
-  /* If size is zero then return. */
-  if (! readsize)
-    return 0;
+  /* Move the part of a message left at the end of the buffer to its
+     front, when there is no longer room behind it for a whole one. */
+  if (STREAM_WRITEABLE (peer->rbuf) < BGP_MAX_PACKET_SIZE)
+    stream_discard (peer->rbuf);
 
   /* Read packet from fd. */
-  nbytes = stream_read_try (peer->ibuf, peer->fd, readsize);
+  nbytes = stream_read_try (peer->rbuf, peer->fd,
+			    STREAM_WRITEABLE (peer->rbuf));
 
   /* If read byte is smaller than zero then error occurred. */
   if (nbytes < 0) 
@@ -2482,50 +2638,18 @@ bgp_read_packet (struct peer *peer)
       if (nbytes == -2)
 	return -1;
 
-      plog_err (peer->log, "%s [Error] bgp_read_packet error: %s",
-		 peer->host, safe_strerror (errno));
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_fatal_error);
+      bgp_read_error (peer, errno);
       return -1;
     }  
 
   /* When read byte is zero : clear bgp peer and return */
   if (nbytes == 0) 
     {
-      if (BGP_DEBUG (events, EVENTS))
-	plog_debug (peer->log, "%s [Event] BGP connection closed fd %d",
-		   peer->host, peer->fd);
-
-      if (peer->status == Established) 
-	{
-	  if (CHECK_FLAG (peer->sflags, PEER_STATUS_NSF_MODE))
-	    {
-	      peer->last_reset = PEER_DOWN_NSF_CLOSE_SESSION;
-	      SET_FLAG (peer->sflags, PEER_STATUS_NSF_WAIT);
-	    }
-	  else
-	    peer->last_reset = PEER_DOWN_CLOSE_SESSION;
-	}
-
-      BGP_EVENT_ADD (peer, TCP_connection_closed);
+      bgp_read_error (peer, 0);
       return -1;
     }
 
-  /* We read partial packet. */
-  if (stream_get_endp (peer->ibuf) != peer->packet_size)
-    return -1;
-
+  peer->read_count++;
   return 0;
 }
 
@@ -2551,120 +2675,82 @@ bgp_recent_clock (void)
   return recent_relative_time().tv_sec;
 }
 
-/* Starting point of packet process function. */
+/* Check the header of the message at pnt, and process it.  Unless
+   the header fails the checks, the whole message is there.  */
 int
-bgp_read (struct thread *thread)
+bgp_read_message (struct peer *peer, u_char *pnt)
 {
-  int ret;
   u_char type = 0;
-  struct peer *peer;
   bgp_size_t size;
   char notify_data_length[2];
 
-  /* Yes first of all get peer pointer. */
-  peer = THREAD_ARG (thread);
-  peer->t_read = NULL;
-
-  /* For non-blocking IO check. */
-  if (peer->status == Connect)
+  /* Get size and type. */
+  stream_reset (peer->ibuf);
+  stream_put (peer->ibuf, pnt, BGP_HEADER_SIZE);
+  stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
+  memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
+  size = stream_getw (peer->ibuf);
+  type = stream_getc (peer->ibuf);
+
+  if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
+    zlog_debug ("%s rcv message type %d, length (excl. header) %d",
+	       peer->host, type, size - BGP_HEADER_SIZE);
+
+  /* Marker check */
+  if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
+      && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
     {
-      bgp_connect_check (peer);
-      goto done;
+      bgp_notify_send (peer,
+		       BGP_NOTIFY_HEADER_ERR, 
+		       BGP_NOTIFY_HEADER_NOT_SYNC);
+      return -1;
     }
-  else
+
+  /* BGP type check. */
+  if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
+      && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
+      && type != BGP_MSG_ROUTE_REFRESH_NEW
+      && type != BGP_MSG_ROUTE_REFRESH_OLD
+      && type != BGP_MSG_CAPABILITY)
     {
-      if (peer->fd < 0)
-	{
-	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
-	  return -1;
-	}
-      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s unknown message type 0x%02x",
+		  peer->host, type);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESTYPE,
+				 &type, 1);
+      return -1;
     }
-
-  /* Read packet header to determine type of the packet */
-  if (peer->packet_size == 0)
-    peer->packet_size = BGP_HEADER_SIZE;
-
-  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+  /* Mimimum packet length check. */
+  if ((size < BGP_HEADER_SIZE)
+      || (size > BGP_MAX_PACKET_SIZE)
+      || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
+      || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
+      || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
+      || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
     {
-      ret = bgp_read_packet (peer);
-
-      /* Header read error or partial read packet. */
-      if (ret < 0) 
-	goto done;
-
-      /* Get size and type. */
-      stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
-      memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
-      size = stream_getw (peer->ibuf);
-      type = stream_getc (peer->ibuf);
-
-      if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
-	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
-		   peer->host, type, size - BGP_HEADER_SIZE);
-
-      /* Marker check */
-      if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
-	  && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
-	{
-	  bgp_notify_send (peer,
-			   BGP_NOTIFY_HEADER_ERR, 
-			   BGP_NOTIFY_HEADER_NOT_SYNC);
-	  goto done;
-	}
-
-      /* BGP type check. */
-      if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
-	  && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
-	  && type != BGP_MSG_ROUTE_REFRESH_NEW
-	  && type != BGP_MSG_ROUTE_REFRESH_OLD
-	  && type != BGP_MSG_CAPABILITY)
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s unknown message type 0x%02x",
-		      peer->host, type);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			 	     BGP_NOTIFY_HEADER_BAD_MESTYPE,
-				     &type, 1);
-	  goto done;
-	}
-      /* Mimimum packet length check. */
-      if ((size < BGP_HEADER_SIZE)
-	  || (size > BGP_MAX_PACKET_SIZE)
-	  || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
-	  || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
-	  || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
-	  || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s bad message length - %d for %s",
-		      peer->host, size, 
-		      type == 128 ? "ROUTE-REFRESH" :
-		      bgp_type_str[(int) type]);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			  	     BGP_NOTIFY_HEADER_BAD_MESLEN,
-				     (u_char *) notify_data_length, 2);
-	  goto done;
-	}
-
-      /* Adjust size to message length. */
-      peer->packet_size = size;
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s bad message length - %d for %s",
+		  peer->host, size, 
+		  type == 128 ? "ROUTE-REFRESH" :
+		  bgp_type_str[(int) type]);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESLEN,
+				 (u_char *) notify_data_length, 2);
+      return -1;
     }
 
-  ret = bgp_read_packet (peer);
-  if (ret < 0) 
-    goto done;
-
-  /* Get size and type again. */
-  size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
-  type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
+  /* Copy the rest of the message. */
+  stream_put (peer->ibuf, pnt + BGP_HEADER_SIZE, size - BGP_HEADER_SIZE);
+  peer->packet_size = size;
+  peer->read_msg_count++;
 
   /* BGP packet dump function. */
   bgp_dump_packet (peer, type, peer->ibuf);
@@ -2705,6 +2791,73 @@ bgp_read (struct thread *thread)
   if (peer->ibuf)
     stream_reset (peer->ibuf);
 
+  return 0;
+}
+
+/* Starting point of packet process function. */
+int
+bgp_read (struct thread *thread)
+{
+  struct peer *peer;
+  unsigned int count;
+  bgp_size_t size;
+  u_char *pnt;
+  u_int32_t notify_in, notify_out;
+
+  /* Yes first of all get peer pointer. */
+  peer = THREAD_ARG (thread);
+  peer->t_read = NULL;
+
+  /* For non-blocking IO check. */
+  if (peer->status == Connect)
+    {
+      bgp_connect_check (peer);
+      goto done;
+    }
+  else
+    {
+      if (peer->fd < 0)
+	{
+	  zlog_err ("bgp_read peer's fd is negative value %d", peer->fd);
+	  return -1;
+	}
+      BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
+    }
+
+  /* Read from the socket, unless whole messages from an earlier read
+     are still waiting. */
+  if (! bgp_read_framed (peer) && bgp_read_packet (peer) < 0)
+    goto done;
+
+  /* Process the whole messages read, up to a budget so that other
+     peers get their turn.  Stop if one closed the session or handed
+     the connection over to another peer. */
+  notify_in = peer->notify_in;
+  notify_out = peer->notify_out;
+  for (count = 0; count < BGP_READ_PACKET_MAX; count++)
+    {
+      if (! peer->t_read || peer->fd < 0 || ! bgp_read_framed (peer))
+	break;
+
+      pnt = STREAM_PNT (peer->rbuf);
+      size = stream_getw_from (peer->rbuf, stream_get_getp (peer->rbuf)
+					   + BGP_MARKER_SIZE);
+      if (size <= STREAM_READABLE (peer->rbuf))
+	stream_forward_getp (peer->rbuf, size);
+      if (bgp_read_message (peer, pnt) < 0)
+	break;
+
+      /* Until the session is established, let the FSM event for each
+	 message run before the next message is looked at.  Once a
+	 NOTIFICATION has gone either way, leave the rest to the Stop
+	 event.  */
+      if (peer->status != Established
+	  || peer->notify_in != notify_in || peer->notify_out != notify_out)
+	break;
+    }
+
+  bgp_read_continue (peer);
+
  done:
   if (CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
     {
@@ -24,7 +24,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_NLRI_LENGTH       1U
 #define BGP_TOTAL_ATTR_LEN    2U
 #define BGP_UNFEASIBLE_LEN    2U
-#define BGP_WRITE_PACKET_MAX 10U
+#define BGP_WRITE_PACKET_MAX 64U
+#define BGP_READ_PACKET_MAX  64U
+#define BGP_READ_BUF_SIZE    (BGP_MAX_PACKET_SIZE * 16)
 
 /* When to refresh */
 #define REFRESH_IMMEDIATE 1
@@ -40,6 +42,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 /* Packet send and receive function prototypes. */
 extern int bgp_read (struct thread *);
 extern int bgp_write (struct thread *);
+extern int bgp_read_message (struct peer *, u_char *);
+extern void bgp_read_error (struct peer *, int);
 
 extern void bgp_keepalive_send (struct peer *);
 extern void bgp_open_send (struct peer *);
@@ -35,6 +35,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "thread.h"
 #include "workqueue.h"
+#include "mempool.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -58,6 +59,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
 #include "bgpd/bgp_nht.h"
+#include "bgpd/bgp_updgrp.h"
 
 /* Extern from bgp_dump.c */
 extern const char *bgp_origin_str[];
@@ -79,7 +81,10 @@ bgp_afi_node_get (struct bgp_table *table, afi_t afi, safi_t safi, struct prefix
       prn = bgp_node_get (table, (struct prefix *) prd);
 
       if (prn->info == NULL)
-	prn->info = bgp_table_init (afi, safi);
+	{
+	  prn->info = bgp_table_init (afi, safi);
+	  ((struct bgp_table *) prn->info)->prn = prn;
+	}
       else
 	bgp_unlock_node (prn);
       table = prn->info;
@@ -87,19 +92,27 @@ bgp_afi_node_get (struct bgp_table *table, afi_t afi, safi_t safi, struct prefix
 
   rn = bgp_node_get (table, p);
 
-  if ((safi == SAFI_MPLS_VPN) || (safi == SAFI_ENCAP))
-    rn->prn = prn;
-
   return rn;
 }
 
+/* Paths and their ancillary information exist in the millions. */
+static struct mempool bgp_info_pool =
+  MEMPOOL_INIT (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+static struct mempool bgp_info_extra_pool =
+  MEMPOOL_INIT (MTYPE_BGP_ROUTE_EXTRA, sizeof (struct bgp_info_extra));
+
+/* Allocate new bgp info structure. */
+struct bgp_info *
+bgp_info_new (void)
+{
+  return mempool_alloc (&bgp_info_pool);
+}
+
 /* Allocate bgp_info_extra */
 static struct bgp_info_extra *
 bgp_info_extra_new (void)
 {
-  struct bgp_info_extra *new;
-  new = XCALLOC (MTYPE_BGP_ROUTE_EXTRA, sizeof (struct bgp_info_extra));
-  return new;
+  return mempool_alloc (&bgp_info_extra_pool);
 }
 
 static void
@@ -111,8 +124,10 @@ bgp_info_extra_free (struct bgp_info_extra **extra)
         bgp_damp_info_free ((*extra)->damp_info, 0);
       
       (*extra)->damp_info = NULL;
+
+      bgp_info_mpath_free (&(*extra)->mpath);
       
-      XFREE (MTYPE_BGP_ROUTE_EXTRA, *extra);
+      mempool_free (&bgp_info_extra_pool, *extra);
       
       *extra = NULL;
     }
@@ -138,11 +153,10 @@ bgp_info_free (struct bgp_info *binfo)
 
   bgp_unlink_nexthop (binfo);
   bgp_info_extra_free (&binfo->extra);
-  bgp_info_mpath_free (&binfo->mpath);
 
   peer_unlock (binfo->peer); /* bgp_info peer reference */
 
-  XFREE (MTYPE_BGP_ROUTE, binfo);
+  mempool_free (&bgp_info_pool, binfo);
 }
 
 struct bgp_info *
@@ -318,6 +332,29 @@ bgp_med_value (struct attr *attr, struct bgp *bgp)
     }
 }
 
+/* Does bgp_info_cmp compare the MEDs of the two paths? */
+static int
+bgp_info_med_comparable (struct bgp *bgp, struct attr *newattr,
+			 struct attr *existattr)
+{
+  int internal_as_route;
+  int confed_as_route;
+
+  internal_as_route = (aspath_count_hops (newattr->aspath) == 0
+		      && aspath_count_hops (existattr->aspath) == 0);
+  confed_as_route = (aspath_count_confeds (newattr->aspath) > 0
+		    && aspath_count_confeds (existattr->aspath) > 0
+		    && aspath_count_hops (newattr->aspath) == 0
+		    && aspath_count_hops (existattr->aspath) == 0);
+  
+  return (bgp_flag_check (bgp, BGP_FLAG_ALWAYS_COMPARE_MED)
+	  || (bgp_flag_check (bgp, BGP_FLAG_MED_CONFED)
+	      && confed_as_route)
+	  || aspath_cmp_left (newattr->aspath, existattr->aspath)
+	  || aspath_cmp_left_confed (newattr->aspath, existattr->aspath)
+	  || internal_as_route);
+}
+
 /* Compare two bgp route entity.  Return -1 if new is preferred, 1 if exist
  * is preferred, or 0 if they are the same (usually will only occur if
  * multipath is enabled */
@@ -340,8 +377,6 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
   struct in_addr exist_id;
   int new_cluster;
   int exist_cluster;
-  int internal_as_route;
-  int confed_as_route;
   int ret;
 
   /* 0. Null check. */
@@ -427,19 +462,7 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
     return 1;
 
   /* 6. MED check. */
-  internal_as_route = (aspath_count_hops (newattr->aspath) == 0
-		      && aspath_count_hops (existattr->aspath) == 0);
-  confed_as_route = (aspath_count_confeds (newattr->aspath) > 0
-		    && aspath_count_confeds (existattr->aspath) > 0
-		    && aspath_count_hops (newattr->aspath) == 0
-		    && aspath_count_hops (existattr->aspath) == 0);
-  
-  if (bgp_flag_check (bgp, BGP_FLAG_ALWAYS_COMPARE_MED)
-      || (bgp_flag_check (bgp, BGP_FLAG_MED_CONFED)
-	 && confed_as_route)
-      || aspath_cmp_left (newattr->aspath, existattr->aspath)
-      || aspath_cmp_left_confed (newattr->aspath, existattr->aspath)
-      || internal_as_route)
+  if (bgp_info_med_comparable (bgp, newattr, existattr))
     {
       new_med = bgp_med_value (new->attr, bgp);
       exist_med = bgp_med_value (exist->attr, bgp);
@@ -462,12 +485,8 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
     return 1;
 
   /* 8. IGP metric check. */
-  newm = existm = 0;
-
-  if (new->extra)
-    newm = new->extra->igpmetric;
-  if (exist->extra)
-    existm = exist->extra->igpmetric;
+  newm = bgp_info_igpmetric (new);
+  existm = bgp_info_igpmetric (exist);
 
   if (newm < existm)
     return -1;
@@ -568,20 +587,21 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
   return -1;
 }
 
+#define FILTER_EXIST_WARN(F,f,filter) \
+  if (BGP_DEBUG (update, UPDATE_IN) \
+      && !(F ## _IN (filter))) \
+    plog_warn (peer->log, "%s: Could not find configured input %s-list %s!", \
+               peer->host, #f, F ## _IN_NAME(filter));
+
+/* Incoming filters on the prefix. */
 static enum filter_type
-bgp_input_filter (struct peer *peer, struct prefix *p, struct attr *attr,
-		  afi_t afi, safi_t safi)
+bgp_input_prefix_filter (struct peer *peer, struct prefix *p,
+			 afi_t afi, safi_t safi)
 {
   struct bgp_filter *filter;
 
   filter = &peer->filter[afi][safi];
 
-#define FILTER_EXIST_WARN(F,f,filter) \
-  if (BGP_DEBUG (update, UPDATE_IN) \
-      && !(F ## _IN (filter))) \
-    plog_warn (peer->log, "%s: Could not find configured input %s-list %s!", \
-               peer->host, #f, F ## _IN_NAME(filter));
-  
   if (DISTRIBUTE_IN_NAME (filter)) {
     FILTER_EXIST_WARN(DISTRIBUTE, distribute, filter);
       
@@ -595,7 +615,19 @@ bgp_input_filter (struct peer *peer, struct prefix *p, struct attr *attr,
     if (prefix_list_apply (PREFIX_LIST_IN (filter), p) == PREFIX_DENY)
       return FILTER_DENY;
   }
-  
+
+  return FILTER_PERMIT;
+}
+
+/* Incoming filters on the attributes. */
+static enum filter_type
+bgp_input_attr_filter (struct peer *peer, struct attr *attr,
+		       afi_t afi, safi_t safi)
+{
+  struct bgp_filter *filter;
+
+  filter = &peer->filter[afi][safi];
+
   if (FILTER_LIST_IN_NAME (filter)) {
     FILTER_EXIST_WARN(FILTER_LIST, as, filter);
     
@@ -604,16 +636,8 @@ bgp_input_filter (struct peer *peer, struct prefix *p, struct attr *attr,
   }
   
   return FILTER_PERMIT;
-#undef FILTER_EXIST_WARN
 }
-
-static enum filter_type
-bgp_output_filter (struct peer *peer, struct prefix *p, struct attr *attr,
-		   afi_t afi, safi_t safi)
-{
-  struct bgp_filter *filter;
-
-  filter = &peer->filter[afi][safi];
+#undef FILTER_EXIST_WARN
 
 #define FILTER_EXIST_WARN(F,f,filter) \
   if (BGP_DEBUG (update, UPDATE_OUT) \
@@ -621,6 +645,15 @@ bgp_output_filter (struct peer *peer, struct prefix *p, struct attr *attr,
     plog_warn (peer->log, "%s: Could not find configured output %s-list %s!", \
                peer->host, #f, F ## _OUT_NAME(filter));
 
+/* Outgoing filters on the prefix. */
+static enum filter_type
+bgp_output_prefix_filter (struct peer *peer, struct prefix *p,
+			  afi_t afi, safi_t safi)
+{
+  struct bgp_filter *filter;
+
+  filter = &peer->filter[afi][safi];
+
   if (DISTRIBUTE_OUT_NAME (filter)) {
     FILTER_EXIST_WARN(DISTRIBUTE, distribute, filter);
     
@@ -635,6 +668,18 @@ bgp_output_filter (struct peer *peer, struct prefix *p, struct attr *attr,
       return FILTER_DENY;
   }
 
+  return FILTER_PERMIT;
+}
+
+/* Outgoing filters on the attributes. */
+static enum filter_type
+bgp_output_attr_filter (struct peer *peer, struct attr *attr,
+			afi_t afi, safi_t safi)
+{
+  struct bgp_filter *filter;
+
+  filter = &peer->filter[afi][safi];
+
   if (FILTER_LIST_OUT_NAME (filter)) {
     FILTER_EXIST_WARN(FILTER_LIST, as, filter);
     
@@ -643,7 +688,18 @@ bgp_output_filter (struct peer *peer, struct prefix *p, struct attr *attr,
   }
 
   return FILTER_PERMIT;
+}
 #undef FILTER_EXIST_WARN
+
+static enum filter_type
+bgp_output_filter (struct peer *peer, struct prefix *p, struct attr *attr,
+		   afi_t afi, safi_t safi)
+{
+  if (bgp_output_prefix_filter (peer, p, afi, safi) == FILTER_DENY
+      || bgp_output_attr_filter (peer, attr, afi, safi) == FILTER_DENY)
+    return FILTER_DENY;
+
+  return FILTER_PERMIT;
 }
 
 /* If community attribute includes no_export then return 1. */
@@ -796,40 +852,22 @@ bgp_import_modifier (struct peer *rsclient, struct peer *peer,
   return RMAP_PERMIT;
 }
 
+/* The part of bgp_announce_check which depends on the peer itself
+   rather than on its outbound configuration, and so is done for each
+   member of an update group. */
 static int
-bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
-		    struct attr *attr, afi_t afi, safi_t safi)
+bgp_announce_check_peer (struct bgp_info *ri, struct peer *peer,
+			 struct prefix *p, afi_t afi, safi_t safi)
 {
-  int ret;
   char buf[SU_ADDRSTRLEN];
-  struct bgp_filter *filter;
-  struct peer *from;
-  struct bgp *bgp;
-  int transparent;
-  int reflect;
   struct attr *riattr;
 
-  from = ri->peer;
-  filter = &peer->filter[afi][safi];
-  bgp = peer->bgp;
   riattr = bgp_info_mpath_count (ri) ? bgp_info_mpath_attr (ri) : ri->attr;
-  
-  if (DISABLE_BGP_ANNOUNCE)
-    return 0;
-
-  /* Do not send announces to RS-clients from the 'normal' bgp_table. */
-  if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-    return 0;
 
   /* Do not send back route to sender. */
-  if (from == peer)
+  if (ri->peer == peer)
     return 0;
 
-  /* Aggregate-address suppress check. */
-  if (ri->extra && ri->extra->suppress)
-    if (! UNSUPPRESS_MAP_NAME (filter))
-      return 0;
-
   /* Default route check.  */
   if (CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_DEFAULT_ORIGINATE))
     {
@@ -839,17 +877,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 	return 0;
     }
 
-  /* Transparency check. */
-  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
-      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-    transparent = 1;
-  else
-    transparent = 0;
-
-  /* If community is not disabled check the no-export and local. */
-  if (! transparent && bgp_community_filter (peer, riattr))
-    return 0;
-
   /* If the attribute has originator-id and it is same as remote
      peer's id. */
   if (riattr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID))
@@ -876,17 +903,44 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
           return 0;
       }
 
+  return 1;
+}
+
+/* The part of bgp_announce_check_group which does not look at the
+   prefix, but for the route-map, and so gives the same answer and the
+   same attributes for routes sharing their attributes and origin. */
+static int
+bgp_announce_check_attr (struct bgp_info *ri, struct peer *peer,
+			 struct prefix *p, struct attr *attr,
+			 afi_t afi, safi_t safi)
+{
+  int ret;
+  struct bgp_filter *filter;
+  struct peer *from;
+  struct bgp *bgp;
+  int transparent;
+  int reflect;
+  struct attr *riattr;
+
+  from = ri->peer;
+  filter = &peer->filter[afi][safi];
+  bgp = peer->bgp;
+  riattr = bgp_info_mpath_count (ri) ? bgp_info_mpath_attr (ri) : ri->attr;
+
+  /* Transparency check. */
+  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    transparent = 1;
+  else
+    transparent = 0;
+
+  /* If community is not disabled check the no-export and local. */
+  if (! transparent && bgp_community_filter (peer, riattr))
+    return 0;
+
   /* Output filter check. */
-  if (bgp_output_filter (peer, p, riattr, afi, safi) == FILTER_DENY)
-    {
-      if (BGP_DEBUG (filter, FILTER))
-	zlog (peer->log, LOG_DEBUG,
-	      "%s [Update:SEND] %s/%d is filtered",
-	      peer->host,
-	      inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-	      p->prefixlen);
-      return 0;
-    }
+  if (bgp_output_attr_filter (peer, riattr, afi, safi) == FILTER_DENY)
+    return 0;
 
 #ifdef BGP_SEND_ASPATH_CHECK
   /* AS path loop check. */
@@ -1106,6 +1160,82 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
   return 1;
 }
 
+/* The rest of bgp_announce_check, which gives the same answer and the
+   same attributes for every member of an update group.  What does not
+   depend on the prefix is kept by the group for the next route with
+   the same attributes. */
+static int
+bgp_announce_check_group (struct bgp_info *ri, struct peer *peer,
+			  struct prefix *p, struct attr *attr,
+			  afi_t afi, safi_t safi)
+{
+  char buf[SU_ADDRSTRLEN];
+  struct bgp_filter *filter;
+  struct update_group *group;
+  struct updgrp_attr *ua;
+  struct attr *riattr;
+  int ret;
+
+  filter = &peer->filter[afi][safi];
+  riattr = bgp_info_mpath_count (ri) ? bgp_info_mpath_attr (ri) : ri->attr;
+
+  if (DISABLE_BGP_ANNOUNCE)
+    return 0;
+
+  /* Do not send announces to RS-clients from the 'normal' bgp_table. */
+  if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    return 0;
+
+  /* Aggregate-address suppress check. */
+  if (ri->extra && ri->extra->suppress)
+    if (! UNSUPPRESS_MAP_NAME (filter))
+      return 0;
+
+  /* Output filter check. */
+  if (bgp_output_prefix_filter (peer, p, afi, safi) == FILTER_DENY)
+    {
+      if (BGP_DEBUG (filter, FILTER))
+	zlog (peer->log, LOG_DEBUG,
+	      "%s [Update:SEND] %s/%d is filtered",
+	      peer->host,
+	      inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+	      p->prefixlen);
+      return 0;
+    }
+
+  /* Suppressed routes go through the unsuppress-map instead, and a
+     route-map looking at the prefix has to be applied to each. */
+  bgp_updgrp_update (peer->bgp);
+  group = peer->updgrp[afi][safi];
+  if (! group
+      || (ri->extra && ri->extra->suppress)
+      || (ROUTE_MAP_OUT_NAME (filter)
+	  && bgp_route_map_prefix_dependent (ROUTE_MAP_OUT (filter))))
+    return bgp_announce_check_attr (ri, peer, p, attr, afi, safi);
+
+  ua = bgp_updgrp_attr_lookup (group, riattr, ri->peer);
+  if (ua)
+    {
+      if (! ua->out)
+	return 0;
+      bgp_attr_dup (attr, ua->out);
+      return 1;
+    }
+
+  ret = bgp_announce_check_attr (ri, peer, p, attr, afi, safi);
+  bgp_updgrp_attr_add (group, riattr, ri->peer, ret ? attr : NULL);
+  return ret;
+}
+
+static int
+bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
+		    struct attr *attr, afi_t afi, safi_t safi)
+{
+  if (! bgp_announce_check_peer (ri, peer, p, afi, safi))
+    return 0;
+  return bgp_announce_check_group (ri, peer, p, attr, afi, safi);
+}
+
 static int
 bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
         struct prefix *p, struct attr *attr, afi_t afi, safi_t safi)
@@ -1295,13 +1425,109 @@ bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
   return 1;
 }
 
-struct bgp_info_pair
+/* May the path take part in best path selection? */
+static int
+bgp_info_selectable (struct bgp *bgp, struct bgp_info *ri)
 {
-  struct bgp_info *old;
-  struct bgp_info *new;
-};
+  if (BGP_INFO_HOLDDOWN (ri))
+    return 0;
 
-static void
+  if (ri->peer &&
+      ri->peer != bgp->peer_self &&
+      !CHECK_FLAG (ri->peer->sflags, PEER_STATUS_NSF_WAIT))
+    if (ri->peer->status != Established)
+      return 0;
+
+  return 1;
+}
+
+/* Might comparing the changed path ri with the others of the prefix one
+   by one give another answer than comparing them all again?  MED is
+   only compared between paths from the same neighbour AS, so a path
+   which lost to the selected one might have beaten ri on MED, even
+   though ri beats the selected path. */
+static int
+bgp_info_changed_med_conflict (struct bgp *bgp, struct bgp_node *rn,
+			       struct bgp_info *ri)
+{
+  struct bgp_info *ri2;
+
+  for (ri2 = rn->info; ri2; ri2 = ri2->next)
+    if (! CHECK_FLAG (ri2->flags, BGP_INFO_SELECT_CHANGED)
+	&& bgp_info_selectable (bgp, ri2)
+	&& bgp_info_med_comparable (bgp, ri->attr, ri2->attr))
+      return 1;
+
+  return 0;
+}
+
+/* Best path selection when only some paths of the prefix have changed
+   since the last one, and not the path selected then.  The unchanged
+   paths all lost to that path, so only the changed ones need to be
+   compared to it, unless MED makes the comparison depend on the
+   others.  Returns 0, having changed nothing, when this does not apply
+   and all paths need to be compared. */
+static int
+bgp_best_selection_changed (struct bgp *bgp, struct bgp_node *rn,
+			    struct bgp_info_pair *result,
+			    afi_t afi, safi_t safi)
+{
+  struct bgp_info *new_select;
+  struct bgp_info *old_select;
+  struct bgp_info *ri;
+  struct bgp_info *nextri = NULL;
+  struct list mp_list;
+
+  for (old_select = rn->info; old_select; old_select = old_select->next)
+    if (CHECK_FLAG (old_select->flags, BGP_INFO_SELECTED))
+      break;
+
+  if (! old_select
+      || CHECK_FLAG (old_select->flags, BGP_INFO_SELECT_CHANGED)
+      || ! bgp_info_selectable (bgp, old_select))
+    return 0;
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_SELECT_CHANGED)
+	&& ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED)
+	&& bgp_info_selectable (bgp, ri)
+	&& bgp_info_changed_med_conflict (bgp, rn, ri))
+      return 0;
+
+  new_select = old_select;
+  for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
+    {
+      if (! CHECK_FLAG (ri->flags, BGP_INFO_SELECT_CHANGED))
+	continue;
+      UNSET_FLAG (ri->flags, BGP_INFO_SELECT_CHANGED);
+
+      if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+	{
+	  bgp_info_reap (rn, ri);
+	  continue;
+	}
+
+      if (! bgp_info_selectable (bgp, ri))
+	continue;
+
+      if (bgp_info_cmp (bgp, ri, new_select, afi, safi) == -1)
+	new_select = ri;
+    }
+
+  /* Multipath is not configured, so this only clears what may be left
+     of it, as the full selection would. */
+  bgp_mp_list_init (&mp_list);
+  bgp_info_mpath_update (rn, new_select, old_select, &mp_list, afi, safi);
+  bgp_info_mpath_aggregate_update (new_select, old_select);
+  bgp_mp_list_clear (&mp_list);
+
+  result->old = old_select;
+  result->new = new_select;
+
+  return 1;
+}
+
+void
 bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
 		    struct bgp_info_pair *result,
 		    afi_t afi, safi_t safi)
@@ -1326,9 +1552,21 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
       return;
     }
   
-  bgp_mp_list_init (&mp_list);
   do_mpath = bgp_mpath_is_configured (bgp, afi, safi);
 
+  /* Deterministic MED groups the paths by neighbour AS, and multipath
+     needs all paths equal to the best, so those compare all paths, as
+     does always-compare-med. */
+  if (! CHECK_FLAG (rn->flags, BGP_NODE_SELECT_FULL)
+      && ! do_mpath
+      && ! bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
+      && ! bgp_flag_check (bgp, BGP_FLAG_ALWAYS_COMPARE_MED)
+      && bgp_best_selection_changed (bgp, rn, result, afi, safi))
+    return;
+  UNSET_FLAG (rn->flags, BGP_NODE_SELECT_FULL);
+
+  bgp_mp_list_init (&mp_list);
+
   /* bgp deterministic-med */
   new_select = NULL;
   if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
@@ -1396,6 +1634,8 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
   new_select = NULL;
   for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
     {
+      UNSET_FLAG (ri->flags, BGP_INFO_SELECT_CHANGED);
+
       if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
 	old_select = ri;
 
@@ -1411,56 +1651,176 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn,
           continue;
         }
 
-      if (ri->peer &&
-          ri->peer != bgp->peer_self &&
-          !CHECK_FLAG (ri->peer->sflags, PEER_STATUS_NSF_WAIT))
-        if (ri->peer->status != Established)
-          continue;
+      if (ri->peer &&
+          ri->peer != bgp->peer_self &&
+          !CHECK_FLAG (ri->peer->sflags, PEER_STATUS_NSF_WAIT))
+        if (ri->peer->status != Established)
+          continue;
+
+      if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
+          && (! CHECK_FLAG (ri->flags, BGP_INFO_DMED_SELECTED)))
+	{
+	  bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
+	  continue;
+        }
+      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
+      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_SELECTED);
+
+      if ((cmpret = bgp_info_cmp (bgp, ri, new_select, afi, safi)) == -1)
+	{
+	  if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+	    bgp_mp_dmed_deselect (new_select);
+
+	  new_select = ri;
+	}
+      else if (cmpret == 1 && do_mpath
+               && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+	bgp_mp_dmed_deselect (ri);
+
+      if (do_mpath)
+        {
+          if (cmpret != 0)
+            bgp_mp_list_clear (&mp_list);
+
+          if (cmpret == 0 || cmpret == -1)
+            bgp_mp_list_add (&mp_list, ri);
+        }
+    }
+
+  if (!bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+    bgp_info_mpath_update (rn, new_select, old_select, &mp_list, afi, safi);
+
+  bgp_info_mpath_aggregate_update (new_select, old_select);
+  bgp_mp_list_clear (&mp_list);
+
+  result->old = old_select;
+  result->new = new_select;
+
+  return;
+}
+
+static void
+bgp_best_selection_reset_table (struct bgp_table *table, safi_t safi)
+{
+  struct bgp_node *rn;
+
+  if (! table)
+    return;
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    {
+      if ((safi == SAFI_MPLS_VPN || safi == SAFI_ENCAP) && rn->info)
+	bgp_best_selection_reset_table (rn->info, SAFI_UNICAST);
+      else
+	SET_FLAG (rn->flags, BGP_NODE_SELECT_FULL);
+    }
+}
+
+/* The decision process of an instance has been configured differently.
+   Have the next selection for each prefix compare all its paths, so that
+   a path selected before does not stay so merely for having won then. */
+void
+bgp_best_selection_reset (struct bgp *bgp)
+{
+  struct listnode *node, *nnode;
+  struct peer *rsclient;
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      {
+	bgp_best_selection_reset_table (bgp->rib[afi][safi], safi);
+
+	for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
+	  bgp_best_selection_reset_table (rsclient->rib[afi][safi], safi);
+      }
+}
+
+/* Is a route the peer no longer gets to be withdrawn from it?  Without
+   an Adj-RIB-Out this is reconstructed from the path selected before:
+   the peer was sent it if it passed outbound policy, and may have been
+   if its attributes have changed since. */
+static int
+bgp_adj_out_withdraw_needed (struct peer *peer, struct bgp_node *rn,
+			     struct bgp_info *old_select, int old_changed,
+			     afi_t afi, safi_t safi)
+{
+  struct bgp_adj_out *adj;
+  struct attr attr;
+  struct attr_extra extra;
+  int ret;
+
+  if (! bgp_adj_out_pending_only (peer, rn))
+    return 1;
+
+  for (adj = rn->adj_out; adj; adj = adj->next)
+    if (adj->peer == peer)
+      return 1;
+
+  if (! old_select)
+    return 0;
+  if (old_changed)
+    return 1;
+
+  memset (&attr, 0, sizeof (struct attr));
+  memset (&extra, 0, sizeof (struct attr_extra));
+  attr.extra = &extra;
+
+  ret = bgp_announce_check (old_select, peer, &rn->p, &attr, afi, safi);
+
+  bgp_attr_flush (&attr);
+  return ret;
+}
+
+/* What a peer without an Adj-RIB-Out has been sent for a node, as the
+   selected route and the current outbound policy make it.  Fills ATTR,
+   which is to be flushed, and returns 0 if nothing was sent. */
+static int
+bgp_adj_out_reconstruct (struct peer *peer, struct bgp_node *rn,
+			 struct attr *attr, afi_t afi, safi_t safi)
+{
+  struct bgp_info *ri;
 
-      if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
-          && (! CHECK_FLAG (ri->flags, BGP_INFO_DMED_SELECTED)))
-	{
-	  bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
-	  continue;
-        }
-      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
-      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_SELECTED);
+  if (peer->status != Established || ! peer->afc_nego[afi][safi]
+      || ! CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_ANNOUNCED))
+    return 0;
 
-      if ((cmpret = bgp_info_cmp (bgp, ri, new_select, afi, safi)) == -1)
-	{
-	  if (do_mpath && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-	    bgp_mp_dmed_deselect (new_select);
+  for (ri = rn->info; ri; ri = ri->next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+      break;
 
-	  new_select = ri;
-	}
-      else if (cmpret == 1 && do_mpath
-               && bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-	bgp_mp_dmed_deselect (ri);
+  if (! ri)
+    return 0;
 
-      if (do_mpath)
-        {
-          if (cmpret != 0)
-            bgp_mp_list_clear (&mp_list);
+  return bgp_announce_check (ri, peer, &rn->p, attr, afi, safi);
+}
 
-          if (cmpret == 0 || cmpret == -1)
-            bgp_mp_list_add (&mp_list, ri);
-        }
-    }
+/* Has the peer been sent a route for the node? */
+static int
+bgp_adj_out_advertised (struct peer *peer, struct bgp_node *rn,
+			afi_t afi, safi_t safi)
+{
+  struct attr attr;
+  struct attr_extra extra;
+  int ret;
 
-  if (!bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-    bgp_info_mpath_update (rn, new_select, old_select, &mp_list, afi, safi);
+  if (! bgp_adj_out_pending_only (peer, rn))
+    return bgp_adj_out_lookup (peer, &rn->p, afi, safi, rn);
 
-  bgp_info_mpath_aggregate_update (new_select, old_select);
-  bgp_mp_list_clear (&mp_list);
+  memset (&attr, 0, sizeof (struct attr));
+  memset (&extra, 0, sizeof (struct attr_extra));
+  attr.extra = &extra;
 
-  result->old = old_select;
-  result->new = new_select;
+  ret = bgp_adj_out_reconstruct (peer, rn, &attr, afi, safi);
 
-  return;
+  bgp_attr_flush (&attr);
+  return ret;
 }
 
 static int
 bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
+                               struct bgp_info *old_select, int old_changed,
                                struct bgp_node *rn, afi_t afi, safi_t safi)
 {
   struct prefix *p;
@@ -1495,7 +1855,8 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
          withdraw it. */
         if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
           bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
-        else
+        else if (bgp_adj_out_withdraw_needed (peer, rn, old_select,
+                                              old_changed, afi, safi))
           bgp_adj_out_unset (rn, peer, p, afi, safi);
         break;
       case BGP_TABLE_RSCLIENT:
@@ -1513,6 +1874,53 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
   return 0;
 }
 
+/* Announce the selected route to the members of an update group,
+   running the outbound policy once for all of them. */
+static void
+bgp_process_announce_group (struct update_group *group,
+			    struct bgp_info *selected,
+			    struct bgp_info *old_select, int old_changed,
+			    struct bgp_node *rn, afi_t afi, safi_t safi)
+{
+  struct prefix *p = &rn->p;
+  struct attr attr;
+  struct attr_extra extra;
+  struct listnode *node, *nnode;
+  struct peer *peer;
+  int announce;
+
+  memset (&attr, 0, sizeof(struct attr));
+  memset (&extra, 0, sizeof(struct attr_extra));
+  attr.extra = &extra;
+
+  announce = selected
+    && bgp_announce_check_group (selected, UPDGRP_PEER (group), p, &attr,
+				 afi, safi);
+  group->prefix_cnt++;
+
+  for (ALL_LIST_ELEMENTS (group->peers, node, nnode, peer))
+    {
+      if (peer->status != Established || ! peer->afc_nego[afi][safi])
+	continue;
+
+      /* First update is deferred until ORF or ROUTE-REFRESH is received */
+      if (CHECK_FLAG (peer->af_sflags[afi][safi],
+		      PEER_STATUS_ORF_WAIT_REFRESH))
+	continue;
+
+      if (announce && bgp_announce_check_peer (selected, peer, p, afi, safi))
+	{
+	  bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
+	  group->adv_cnt++;
+	}
+      else if (bgp_adj_out_withdraw_needed (peer, rn, old_select, old_changed,
+					    afi, safi))
+	bgp_adj_out_unset (rn, peer, p, afi, safi);
+    }
+
+  bgp_attr_flush (&attr);
+}
+
 struct bgp_process_queue 
 {
   struct bgp *bgp;
@@ -1559,8 +1967,8 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
 		UNSET_FLAG (new_select->flags, BGP_INFO_MULTIPATH_CHG);
              }
 
-            bgp_process_announce_selected (rsclient, new_select, rn,
-                                           afi, safi);
+            bgp_process_announce_selected (rsclient, new_select, NULL, 0,
+                                           rn, afi, safi);
           }
     }
   else
@@ -1573,7 +1981,8 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
 	  bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
 	  UNSET_FLAG (new_select->flags, BGP_INFO_MULTIPATH_CHG);
 	}
-      bgp_process_announce_selected (rsclient, new_select, rn, afi, safi);
+      bgp_process_announce_selected (rsclient, new_select, NULL, 0, rn,
+                                     afi, safi);
     }
 
   if (old_select && CHECK_FLAG (old_select->flags, BGP_INFO_REMOVED))
@@ -1597,6 +2006,8 @@ bgp_process_main (struct work_queue *wq, void *data)
   struct bgp_info_pair old_and_new;
   struct listnode *node, *nnode;
   struct peer *peer;
+  struct update_group *group;
+  int old_changed;
   
   /* Best path selection. */
   bgp_best_selection (bgp, rn, &old_and_new, afi, safi);
@@ -1622,6 +2033,13 @@ bgp_process_main (struct work_queue *wq, void *data)
   /* If the user did "clear ip bgp prefix x.x.x.x" this flag will be set */
   UNSET_FLAG(rn->flags, BGP_NODE_USER_CLEAR);
 
+  /* Peers without an Adj-RIB-Out may have been sent other attributes
+     for the old selection than it has now. */
+  old_changed = (old_select
+		 && (CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED)
+		     || CHECK_FLAG (old_select->flags,
+				    BGP_INFO_MULTIPATH_CHG)));
+
   if (old_select)
     bgp_info_unset_flag (rn, old_select, BGP_INFO_SELECTED);
   if (new_select)
@@ -1632,10 +2050,18 @@ bgp_process_main (struct work_queue *wq, void *data)
     }
 
 
-  /* Check each BGP peer. */
+  /* Check each update group, then the BGP peers not in one. */
+  bgp_updgrp_update (bgp);
+  if (bgp->update_groups[afi][safi])
+    for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node, group))
+      bgp_process_announce_group (group, new_select, old_select,
+				  old_changed, rn, afi, safi);
+
   for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
     {
-      bgp_process_announce_selected (peer, new_select, rn, afi, safi);
+      if (! peer->updgrp[afi][safi])
+        bgp_process_announce_selected (peer, new_select, old_select,
+                                       old_changed, rn, afi, safi);
     }
 
   /* FIB update. */
@@ -1701,8 +2127,9 @@ bgp_process_queue_init (void)
   bm->process_rsclient_queue->spec.hold = 50;
 }
 
-void
-bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
+static void
+bgp_process_schedule (struct bgp *bgp, struct bgp_node *rn,
+		      afi_t afi, safi_t safi)
 {
   struct bgp_process_queue *pqnode;
   
@@ -1754,6 +2181,24 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
   return;
 }
 
+/* Schedule best path selection for a prefix, comparing all its paths. */
+void
+bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
+{
+  SET_FLAG (rn->flags, BGP_NODE_SELECT_FULL);
+  bgp_process_schedule (bgp, rn, afi, safi);
+}
+
+/* Schedule best path selection for a prefix after a change to one of its
+   paths alone, which only that path needs to be compared for. */
+static void
+bgp_process_path (struct bgp *bgp, struct bgp_node *rn, struct bgp_info *ri,
+		  afi_t afi, safi_t safi)
+{
+  SET_FLAG (ri->flags, BGP_INFO_SELECT_CHANGED);
+  bgp_process_schedule (bgp, rn, afi, safi);
+}
+
 static int
 bgp_maximum_prefix_restart_timer (struct thread *thread)
 {
@@ -1859,7 +2304,7 @@ bgp_rib_remove (struct bgp_node *rn, struct bgp_info *ri, struct peer *peer,
   if (!CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
     bgp_info_delete (rn, ri); /* keep historical info */
     
-  bgp_process (peer->bgp, rn, afi, safi);
+  bgp_process_path (peer->bgp, rn, ri, afi, safi);
 }
 
 static void
@@ -1890,7 +2335,7 @@ info_make (int type, int sub_type, struct peer *peer, struct attr *attr,
   struct bgp_info *new;
 
   /* Make new BGP info. */
-  new = XCALLOC (MTYPE_BGP_ROUTE, sizeof (struct bgp_info));
+  new = bgp_info_new ();
   new->type = type;
   new->sub_type = sub_type;
   new->peer = peer;
@@ -2031,7 +2476,7 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
       bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
 
       /* Process change. */
-      bgp_process (bgp, rn, afi, safi);
+      bgp_process_path (bgp, rn, ri, afi, safi);
       bgp_unlock_node (rn);
 
       return;
@@ -2061,7 +2506,7 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
   bgp_unlock_node (rn);
   
   /* Process change. */
-  bgp_process (bgp, rn, afi, safi);
+  bgp_process_path (bgp, rn, new, afi, safi);
 
   return;
 
@@ -2115,13 +2560,123 @@ bgp_withdraw_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
   bgp_unlock_node (rn);
 }
 
+/* Checks on the attributes of a route, which come to the same for all
+   prefixes of an UPDATE.  Returns why the route is denied, or NULL. */
+static const char *
+bgp_update_attr_check (struct peer *peer, struct attr *attr,
+		       afi_t afi, safi_t safi)
+{
+  struct bgp *bgp = peer->bgp;
+  int aspath_loop_count = 0;
+
+  /* AS path local-as loop check. */
+  if (peer->change_local_as)
+    {
+      if (! CHECK_FLAG (peer->flags, PEER_FLAG_LOCAL_AS_NO_PREPEND))
+	aspath_loop_count = 1;
+
+      if (aspath_loop_check (attr->aspath, peer->change_local_as) > aspath_loop_count) 
+	return "as-path contains our own AS;";
+    }
+
+  /* AS path loop check. */
+  if (aspath_loop_check (attr->aspath, bgp->as) > peer->allowas_in[afi][safi]
+      || (CHECK_FLAG(bgp->config, BGP_CONFIG_CONFEDERATION)
+	  && aspath_loop_check(attr->aspath, bgp->confed_id)
+	  > peer->allowas_in[afi][safi]))
+    return "as-path contains our own AS;";
+
+  /* Route reflector originator ID check.  */
+  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
+      && IPV4_ADDR_SAME (&bgp->router_id, &attr->extra->originator_id))
+    return "originator is us;";
+
+  /* Route reflector cluster ID check.  */
+  if (bgp_cluster_filter (peer, attr))
+    return "reflected from the same cluster;";
+
+  /* Apply incoming as-path filter.  */
+  if (bgp_input_attr_filter (peer, attr, afi, safi) == FILTER_DENY)
+    return "filter;";
+
+  return NULL;
+}
+
+/* Is the next hop of a route, after the inbound route-map, unusable? */
+static int
+bgp_update_martian_nexthop (afi_t afi, safi_t safi, struct attr *attr)
+{
+  /* IPv4 unicast next hop check.  */
+  if (afi == AFI_IP && safi == SAFI_UNICAST)
+    {
+      /* Next hop must not be 0.0.0.0 nor Class D/E address. Next hop
+	 must not be my own address.  */
+      if (attr->nexthop.s_addr == 0
+	  || IPV4_CLASS_DE (ntohl (attr->nexthop.s_addr))
+	  || bgp_nexthop_self (attr))
+	return 1;
+    }
+  return 0;
+}
+
+/* Inbound policy shared by the prefixes of one UPDATE.  What does not
+   depend on the prefix is evaluated for the first of them, and reused
+   for the others. */
+struct bgp_update_policy
+{
+  int done;
+
+  /* Why every prefix is denied, before and after its own filters are
+     consulted, or NULL. */
+  const char *reason;
+  const char *reason_after;
+
+  /* The attributes after the inbound route-map, interned.  NULL if the
+     route-map has to be applied to each prefix. */
+  struct attr *attr;
+};
+
+static void
+bgp_update_policy_eval (struct peer *peer, struct prefix *p,
+			struct attr *attr, afi_t afi, safi_t safi,
+			struct bgp_update_policy *policy)
+{
+  struct bgp_filter *filter = &peer->filter[afi][safi];
+  struct attr new_attr;
+  struct attr_extra new_extra;
+
+  policy->done = 1;
+
+  policy->reason = bgp_update_attr_check (peer, attr, afi, safi);
+  if (policy->reason)
+    return;
+
+  if (ROUTE_MAP_IN_NAME (filter)
+      && bgp_route_map_prefix_dependent (ROUTE_MAP_IN (filter)))
+    return;
+
+  memset (&new_attr, 0, sizeof (struct attr));
+  memset (&new_extra, 0, sizeof (struct attr_extra));
+  new_attr.extra = &new_extra;
+  bgp_attr_dup (&new_attr, attr);
+
+  if (bgp_input_modifier (peer, p, &new_attr, afi, safi) == RMAP_DENY)
+    policy->reason_after = "route-map;";
+  else if (bgp_update_martian_nexthop (afi, safi, &new_attr))
+    policy->reason_after = "martian next-hop;";
+  else
+    policy->attr = bgp_attr_intern (&new_attr);
+
+  bgp_attr_flush (&new_attr);
+}
+
 static int
 bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	    afi_t afi, safi_t safi, int type, int sub_type,
-	    struct prefix_rd *prd, u_char *tag, int soft_reconfig)
+	    struct prefix_rd *prd, u_char *tag, int soft_reconfig,
+	    struct bgp_update_policy *policy)
 {
   int ret;
-  int aspath_loop_count = 0;
   struct bgp_node *rn;
   struct bgp *bgp;
   struct attr new_attr;
@@ -2150,81 +2705,58 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
     if (ri->peer == peer && ri->type == type && ri->sub_type == sub_type)
       break;
 
-  /* AS path local-as loop check. */
-  if (peer->change_local_as)
-    {
-      if (! CHECK_FLAG (peer->flags, PEER_FLAG_LOCAL_AS_NO_PREPEND))
-	aspath_loop_count = 1;
-
-      if (aspath_loop_check (attr->aspath, peer->change_local_as) > aspath_loop_count) 
-	{
-	  reason = "as-path contains our own AS;";
-	  goto filtered;
-	}
-    }
-
-  /* AS path loop check. */
-  if (aspath_loop_check (attr->aspath, bgp->as) > peer->allowas_in[afi][safi]
-      || (CHECK_FLAG(bgp->config, BGP_CONFIG_CONFEDERATION)
-	  && aspath_loop_check(attr->aspath, bgp->confed_id)
-	  > peer->allowas_in[afi][safi]))
-    {
-      reason = "as-path contains our own AS;";
-      goto filtered;
-    }
-
-  /* Route reflector originator ID check.  */
-  if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
-      && IPV4_ADDR_SAME (&bgp->router_id, &attr->extra->originator_id))
-    {
-      reason = "originator is us;";
-      goto filtered;
-    }
-
-  /* Route reflector cluster ID check.  */
-  if (bgp_cluster_filter (peer, attr))
+  /* Checks on the attributes alone. */
+  if (policy)
     {
-      reason = "reflected from the same cluster;";
-      goto  filtered;
+      if (! policy->done)
+	bgp_update_policy_eval (peer, p, attr, afi, safi, policy);
+      reason = policy->reason;
     }
+  else
+    reason = bgp_update_attr_check (peer, attr, afi, safi);
+  if (reason)
+    goto filtered;
 
   /* Apply incoming filter.  */
-  if (bgp_input_filter (peer, p, attr, afi, safi) == FILTER_DENY)
+  if (bgp_input_prefix_filter (peer, p, afi, safi) == FILTER_DENY)
     {
       reason = "filter;";
       goto filtered;
     }
 
-  new_attr.extra = &new_extra;
-  bgp_attr_dup (&new_attr, attr);
-
-  /* Apply incoming route-map.
-   * NB: new_attr may now contain newly allocated values from route-map "set"
-   * commands, so we need bgp_attr_flush in the error paths, until we intern
-   * the attr (which takes over the memory references) */
-  if (bgp_input_modifier (peer, p, &new_attr, afi, safi) == RMAP_DENY)
+  if (policy && policy->reason_after)
     {
-      reason = "route-map;";
-      bgp_attr_flush (&new_attr);
+      reason = policy->reason_after;
       goto filtered;
     }
 
-  /* IPv4 unicast next hop check.  */
-  if (afi == AFI_IP && safi == SAFI_UNICAST)
+  if (policy && policy->attr)
+    attr_new = bgp_attr_intern (policy->attr);
+  else
     {
-      /* Next hop must not be 0.0.0.0 nor Class D/E address. Next hop
-	 must not be my own address.  */
-      if (new_attr.nexthop.s_addr == 0
-	  || IPV4_CLASS_DE (ntohl (new_attr.nexthop.s_addr))
-	  || bgp_nexthop_self (&new_attr))
+      new_attr.extra = &new_extra;
+      bgp_attr_dup (&new_attr, attr);
+
+      /* Apply incoming route-map.
+       * NB: new_attr may now contain newly allocated values from route-map
+       * "set" commands, so we need bgp_attr_flush in the error paths, until
+       * we intern the attr (which takes over the memory references) */
+      if (bgp_input_modifier (peer, p, &new_attr, afi, safi) == RMAP_DENY)
+	{
+	  reason = "route-map;";
+	  bgp_attr_flush (&new_attr);
+	  goto filtered;
+	}
+
+      if (bgp_update_martian_nexthop (afi, safi, &new_attr))
 	{
 	  reason = "martian next-hop;";
 	  bgp_attr_flush (&new_attr);
 	  goto filtered;
 	}
-    }
 
-  attr_new = bgp_attr_intern (&new_attr);
+      attr_new = bgp_attr_intern (&new_attr);
+    }
 
   /* If the update is implicit withdraw. */
   if (ri)
@@ -2248,7 +2780,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	      if (bgp_damp_update (ri, rn, afi, safi) != BGP_DAMP_SUPPRESSED)
 	        {
                   bgp_aggregate_increment (bgp, p, ri, afi, safi);
-                  bgp_process (bgp, rn, afi, safi);
+                  bgp_process_path (bgp, rn, ri, afi, safi);
                 }
 	    }
           else /* Duplicate - odd */
@@ -2264,7 +2796,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	      if (CHECK_FLAG (ri->flags, BGP_INFO_STALE))
 		{
 		  bgp_info_unset_flag (rn, ri, BGP_INFO_STALE);
-		  bgp_process (bgp, rn, afi, safi);
+		  bgp_process_path (bgp, rn, ri, afi, safi);
 		}
 	    }
 
@@ -2368,7 +2900,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
       /* Process change. */
       bgp_aggregate_increment (bgp, p, ri, afi, safi);
 
-      bgp_process (bgp, rn, afi, safi);
+      bgp_process_path (bgp, rn, ri, afi, safi);
       bgp_unlock_node (rn);
 
       return 0;
@@ -2432,7 +2964,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
     return -1;
 
   /* Process change. */
-  bgp_process (bgp, rn, afi, safi);
+  bgp_process_path (bgp, rn, new, afi, safi);
 
   return 0;
 
@@ -2455,10 +2987,11 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   return 0;
 }
 
-int
-bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
-            afi_t afi, safi_t safi, int type, int sub_type,
-            struct prefix_rd *prd, u_char *tag, int soft_reconfig)
+static int
+bgp_update_common (struct peer *peer, struct prefix *p, struct attr *attr,
+                   afi_t afi, safi_t safi, int type, int sub_type,
+                   struct prefix_rd *prd, u_char *tag, int soft_reconfig,
+                   struct bgp_update_policy *policy)
 {
   struct peer *rsclient;
   struct listnode *node, *nnode;
@@ -2466,7 +2999,7 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
   int ret;
 
   ret = bgp_update_main (peer, p, attr, afi, safi, type, sub_type, prd, tag,
-          soft_reconfig);
+          soft_reconfig, policy);
 
   bgp = peer->bgp;
 
@@ -2481,6 +3014,15 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
   return ret;
 }
 
+int
+bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
+            afi_t afi, safi_t safi, int type, int sub_type,
+            struct prefix_rd *prd, u_char *tag, int soft_reconfig)
+{
+  return bgp_update_common (peer, p, attr, afi, safi, type, sub_type,
+                            prd, tag, soft_reconfig, NULL);
+}
+
 int
 bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr, 
 	     afi_t afi, safi_t safi, int type, int sub_type, 
@@ -2713,6 +3255,8 @@ bgp_announce_route (struct peer *peer, afi_t afi, safi_t safi)
 
   if (CHECK_FLAG(peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
     bgp_announce_table (peer, afi, safi, NULL, 1);
+
+  SET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_ANNOUNCED);
 }
 
 void
@@ -3248,7 +3792,8 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
   u_char *lim;
   struct prefix p;
   int psize;
-  int ret;
+  int ret = 0;
+  struct bgp_update_policy policy;
 
   /* Check peer status. */
   if (peer->status != Established)
@@ -3257,6 +3802,8 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
   pnt = packet->nlri;
   lim = pnt + packet->length;
 
+  memset (&policy, 0, sizeof (struct bgp_update_policy));
+
   /* RFC4771 6.3 The NLRI field in the UPDATE message is checked for
      syntactic validity.  If the field is syntactically incorrect,
      then the Error Subcode is set to Invalid Network Field. */
@@ -3277,7 +3824,8 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
                     "%s [Error] Update packet error"
                     " (wrong prefix length %u for afi %u)",
                     peer->host, p.prefixlen, packet->afi);
-          return -1;
+          ret = -1;
+          break;
         }
       
       /* Packet size overflow check. */
@@ -3290,7 +3838,8 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
                     "%s [Error] Update packet error"
                     " (prefix length %u overflows packet)",
                     peer->host, p.prefixlen);
-          return -1;
+          ret = -1;
+          break;
         }
       
       /* Defensive coding, double-check the psize fits in a struct prefix */  
@@ -3300,7 +3849,8 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
                     "%s [Error] Update packet error"
                     " (prefix length %u too large for prefix storage %zu!?!!",
                     peer->host, p.prefixlen, sizeof(p.u));
-          return -1;
+          ret = -1;
+          break;
         }
 
       /* Fetch prefix from NLRI packet. */
@@ -3352,8 +3902,9 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
 
       /* Normal process. */
       if (attr)
-	ret = bgp_update (peer, &p, attr, packet->afi, packet->safi, 
-			  ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0);
+	ret = bgp_update_common (peer, &p, attr, packet->afi, packet->safi,
+				 ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL, 0,
+				 &policy);
       else
 	ret = bgp_withdraw (peer, &p, attr, packet->afi, packet->safi, 
 			    ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, NULL, NULL);
@@ -3361,9 +3912,14 @@ bgp_nlri_parse_ip (struct peer *peer, struct attr *attr,
       /* Address family configuration mismatch or maximum-prefix count
          overflow. */
       if (ret < 0)
-	return -1;
+	break;
     }
 
+  if (policy.attr)
+    bgp_attr_unintern (&policy.attr);
+  if (ret < 0)
+    return -1;
+
   /* Packet length consistency check. */
   if (pnt != lim)
     {
@@ -6348,8 +6904,8 @@ route_vty_out_detail (struct vty *vty, struct bgp *bgp, struct prefix *p,
 	{
 	  if (! CHECK_FLAG (binfo->flags, BGP_INFO_VALID))
 	    vty_out (vty, " (inaccessible)"); 
-	  else if (binfo->extra && binfo->extra->igpmetric)
-	    vty_out (vty, " (metric %u)", binfo->extra->igpmetric);
+	  else if (bgp_info_igpmetric (binfo))
+	    vty_out (vty, " (metric %u)", bgp_info_igpmetric (binfo));
 	  if (!sockunion2str (&binfo->peer->su, buf, sizeof(buf))) {
 	    buf[0] = '?';
 	    buf[1] = 0;
@@ -6855,7 +7411,7 @@ route_vty_out_detail_header (struct vty *vty, struct bgp *bgp,
   /* advertised peer */
   for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
     {
-      if (bgp_adj_out_lookup (peer, p, afi, safi, rn))
+      if (bgp_adj_out_advertised (peer, rn, afi, safi))
 	{
 	  if (! first)
 	    vty_out (vty, "  Advertised to non peer-group peers:%s ", VTY_NEWLINE);
@@ -13500,6 +14056,8 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
   int header1 = 1;
   struct bgp *bgp;
   int header2 = 1;
+  struct attr attr;
+  struct attr_extra extra;
 
   bgp = peer->bgp;
 
@@ -13547,6 +14105,35 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
 		}
 	    }
       }
+    else if (bgp_adj_out_pending_only (peer, rn)
+	     && safi != SAFI_MPLS_VPN && safi != SAFI_ENCAP)
+      {
+	/* Show what the peer has been sent as the current outbound
+	   policy makes it. */
+	memset (&attr, 0, sizeof (struct attr));
+	memset (&extra, 0, sizeof (struct attr_extra));
+	attr.extra = &extra;
+
+	if (bgp_adj_out_reconstruct (peer, rn, &attr, afi, safi))
+	  {
+	    if (header1)
+	      {
+		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		header1 = 0;
+	      }
+	    if (header2)
+	      {
+		vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+		header2 = 0;
+	      }
+	    route_vty_out_tmp (vty, &rn->p, &attr, safi);
+	    output_count++;
+	  }
+
+	bgp_attr_flush (&attr);
+      }
     else
       {
 	for (adj = rn->adj_out; adj; adj = adj->next)
@@ -17989,4 +18576,7 @@ bgp_route_finish (void)
 {
   bgp_table_unlock (bgp_distance_table);
   bgp_distance_table = NULL;
+
+  mempool_finish (&bgp_info_extra_pool);
+  mempool_finish (&bgp_info_pool);
 }
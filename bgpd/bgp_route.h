@@ -35,50 +35,31 @@ struct bgp_info_extra
   /* Pointer to dampening structure.  */
   struct bgp_damp_info *damp_info;
 
+  /* Multipath information */
+  struct bgp_info_mpath *mpath;
+
   /* This route is suppressed with aggregation.  */
   int suppress;
 
-  /* Nexthop reachability check.  */
-  u_int32_t igpmetric;
-
   /* MPLS label.  */
   u_char tag[3];  
 };
 
+/* There is one of these for every path in the RIB, so it is kept small:
+   what best path selection and announcement look at comes first, and
+   what few paths need lives in struct bgp_info_extra. */
 struct bgp_info
 {
   /* For linked list. */
   struct bgp_info *next;
   struct bgp_info *prev;
 
-  /* For nexthop linked list */
-  LIST_ENTRY(bgp_info) nh_thread;
-
-  /* Back pointer to the prefix node */
-  struct bgp_node *net;
-
-  /* Back pointer to the nexthop structure */
-  struct bgp_nexthop_cache *nexthop;
-
-  /* Peer structure.  */
-  struct peer *peer;
-
   /* Attribute structure.  */
   struct attr *attr;
-  
-  /* Extra information */
-  struct bgp_info_extra *extra;
-  
-
-  /* Multipath information */
-  struct bgp_info_mpath *mpath;
 
-  /* Uptime.  */
-  time_t uptime;
+  /* Peer structure.  */
+  struct peer *peer;
 
-  /* reference count */
-  int lock;
-  
   /* BGP information status.  */
   u_int16_t flags;
 #define BGP_INFO_IGP_CHANGED    (1 << 0)
@@ -94,6 +75,7 @@ struct bgp_info
 #define BGP_INFO_COUNTED	(1 << 10)
 #define BGP_INFO_MULTIPATH      (1 << 11)
 #define BGP_INFO_MULTIPATH_CHG  (1 << 12)
+#define BGP_INFO_SELECT_CHANGED (1 << 13)
 
   /* BGP route type.  This can be static, RIP, OSPF, BGP etc.  */
   u_char type;
@@ -105,6 +87,23 @@ struct bgp_info
 #define BGP_ROUTE_STATIC       1
 #define BGP_ROUTE_AGGREGATE    2
 #define BGP_ROUTE_REDISTRIBUTE 3 
+
+  /* reference count */
+  int lock;
+
+  /* Back pointer to the prefix node */
+  struct bgp_node *net;
+
+  /* Uptime.  */
+  time_t uptime;
+
+  /* Extra information */
+  struct bgp_info_extra *extra;
+
+  /* Back pointer to the nexthop structure, and the other paths
+     through it. */
+  struct bgp_nexthop_cache *nexthop;
+  LIST_ENTRY(bgp_info) nh_thread;
 };
 
 /* BGP static route configuration. */
@@ -195,6 +194,13 @@ enum bgp_path_type
   BGP_PATH_MULTIPATH
 };
 
+/* The paths selected before and after best path selection. */
+struct bgp_info_pair
+{
+  struct bgp_info *old;
+  struct bgp_info *new;
+};
+
 /* Prototypes. */
 extern void bgp_route_init (void);
 extern void bgp_route_finish (void);
@@ -211,6 +217,7 @@ extern void bgp_clear_route_all (struct peer *);
 extern void bgp_clear_adj_in (struct peer *, afi_t, safi_t);
 extern void bgp_clear_stale_route (struct peer *, afi_t, safi_t);
 
+extern struct bgp_info *bgp_info_new (void);
 extern struct bgp_info *bgp_info_lock (struct bgp_info *);
 extern struct bgp_info *bgp_info_unlock (struct bgp_info *);
 extern void bgp_info_add (struct bgp_node *rn, struct bgp_info *ri);
@@ -218,6 +225,8 @@ extern void bgp_info_delete (struct bgp_node *rn, struct bgp_info *ri);
 extern struct bgp_info_extra *bgp_info_extra_get (struct bgp_info *);
 extern void bgp_info_set_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
 extern void bgp_info_unset_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
+extern void bgp_best_selection (struct bgp *, struct bgp_node *,
+				struct bgp_info_pair *, afi_t, safi_t);
 
 extern int bgp_nlri_parse_ip (struct peer *, struct attr *, struct bgp_nlri *);
 
@@ -249,6 +258,7 @@ extern int bgp_withdraw (struct peer *, struct prefix *, struct attr *,
 
 /* for bgp_nexthop and bgp_damp */
 extern void bgp_process (struct bgp *, struct bgp_node *, afi_t, safi_t);
+extern void bgp_best_selection_reset (struct bgp *);
 extern int bgp_config_write_network (struct vty *, struct bgp *, afi_t, safi_t, int *);
 extern int bgp_config_write_distance (struct vty *, struct bgp *, afi_t, safi_t, int *);
 
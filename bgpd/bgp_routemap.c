@@ -53,6 +53,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_ecommunity.h"
 #include "bgpd/bgp_lcommunity.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
 
 /* Memo of route-map commands.
 
@@ -2696,6 +2697,32 @@ bgp_route_set_delete (struct vty *vty, struct route_map_index *index,
   return CMD_SUCCESS;
 }
 
+/* Rules whose outcome is not decided by the attributes alone. */
+static int
+bgp_route_map_prefix_rule (struct route_map_rule_cmd *cmd)
+{
+  return (cmd == &route_match_ip_address_cmd
+          || cmd == &route_match_ip_address_prefix_list_cmd
+          || cmd == &route_match_ipv6_address_cmd
+          || cmd == &route_match_ipv6_address_prefix_list_cmd
+          || cmd == &route_match_probability_cmd);
+}
+
+/* Must the route map be applied to each prefix on its own, or does it
+   come to the same for all prefixes sharing their attributes? */
+int
+bgp_route_map_prefix_dependent (struct route_map *map)
+{
+  return route_map_uses_rule (map, bgp_route_map_prefix_rule);
+}
+
+/* A rule of a route map has been added, changed or removed. */
+static void
+bgp_route_map_event (route_map_event_t event, const char *name)
+{
+  bgp_updgrp_policy_change ();
+}
+
 /* Hook function for updating route_map assignment. */
 static void
 bgp_route_map_update (const char *unused)
@@ -2716,6 +2743,8 @@ bgp_route_map_update (const char *unused)
   if (bm->bgp == NULL)          /* may be called during cleanup */
     return;
 
+  bgp_updgrp_policy_change ();
+
   /* For neighbor route-map updates. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
@@ -4503,6 +4532,7 @@ bgp_route_map_init (void)
   route_map_init_vty ();
   route_map_add_hook (bgp_route_map_update);
   route_map_delete_hook (bgp_route_map_update);
+  route_map_event_hook (bgp_route_map_event);
 
   route_map_install_match (&route_match_peer_cmd);
   route_map_install_match (&route_match_local_pref_cmd);
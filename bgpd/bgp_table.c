@@ -25,6 +25,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "sockunion.h"
 #include "vty.h"
 #include "filter.h"
+#include "mempool.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -68,6 +69,10 @@ bgp_table_finish (struct bgp_table **rt)
     }
 }
 
+/* Nodes of all BGP tables. */
+static struct mempool bgp_node_pool =
+  MEMPOOL_INIT (MTYPE_BGP_NODE, sizeof (struct bgp_node));
+
 /*
  * bgp_node_create
  */
@@ -75,7 +80,7 @@ static struct route_node *
 bgp_node_create (route_table_delegate_t *delegate, struct route_table *table)
 {
   struct bgp_node *node;
-  node = XCALLOC (MTYPE_BGP_NODE, sizeof (struct bgp_node));
+  node = mempool_alloc (&bgp_node_pool);
   return bgp_node_to_rnode (node);
 }
 
@@ -88,7 +93,14 @@ bgp_node_destroy (route_table_delegate_t *delegate,
 {
   struct bgp_node *bgp_node;
   bgp_node = bgp_node_from_rnode (node);
-  XFREE (MTYPE_BGP_NODE, bgp_node);
+  mempool_free (&bgp_node_pool, bgp_node);
+}
+
+/* Release the nodes' pool, once every table is gone. */
+void
+bgp_node_pool_finish (void)
+{
+  mempool_finish (&bgp_node_pool);
 }
 
 /*
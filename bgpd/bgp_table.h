@@ -42,6 +42,10 @@ struct bgp_table
   /* The owner of this 'bgp_table' structure. */
   struct peer *owner;
 
+  /* For a table of MPLS VPN or ENCAP routes, the node of their route
+     distinguisher in the table above. */
+  struct bgp_node *prn;
+
   struct route_table *route_table;
 };
 
@@ -57,15 +61,15 @@ struct bgp_node
    */
   ROUTE_NODE_FIELDS
 
-  struct bgp_adj_out *adj_out;
-
-  struct bgp_adj_in *adj_in;
-
-  struct bgp_node *prn;
-
+  /* Fills the padding after the lock of the route node. */
   u_char flags;
 #define BGP_NODE_PROCESS_SCHEDULED	(1 << 0)
 #define BGP_NODE_USER_CLEAR             (1 << 1)
+#define BGP_NODE_SELECT_FULL            (1 << 2)
+
+  struct bgp_adj_out *adj_out;
+
+  struct bgp_adj_in *adj_in;
 };
 
 /*
@@ -83,6 +87,7 @@ extern struct bgp_table *bgp_table_init (afi_t, safi_t);
 extern void bgp_table_lock (struct bgp_table *);
 extern void bgp_table_unlock (struct bgp_table *);
 extern void bgp_table_finish (struct bgp_table **);
+extern void bgp_node_pool_finish (void);
 
 
 /*
@@ -118,6 +123,18 @@ bgp_node_table (struct bgp_node *node)
   return bgp_node_to_rnode (node)->table->info;
 }
 
+/*
+ * bgp_node_prn
+ *
+ * Returns the route distinguisher node an MPLS VPN or ENCAP node is
+ * under, or NULL.
+ */
+static inline struct bgp_node *
+bgp_node_prn (struct bgp_node *node)
+{
+  return bgp_node_table (node)->prn;
+}
+
 /*
  * bgp_node_parent_nolock
  *
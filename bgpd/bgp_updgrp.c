@@ -0,0 +1,614 @@
+/* BGP update groups
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "command.h"
+#include "linklist.h"
+#include "hash.h"
+#include "jhash.h"
+#include "memory.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "stream.h"
+#include "log.h"
+#include "filter.h"
+#include "routemap.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+#include "bgpd/bgp_nexthop.h"
+#include "bgpd/bgp_debug.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+
+/* Per address family flags which change what is sent to a peer. */
+#define PEER_UPDGRP_AF_FLAGS \
+  (PEER_FLAG_SEND_COMMUNITY | PEER_FLAG_SEND_EXT_COMMUNITY \
+   | PEER_FLAG_SEND_LARGE_COMMUNITY | PEER_FLAG_NEXTHOP_SELF \
+   | PEER_FLAG_NEXTHOP_SELF_ALL | PEER_FLAG_REFLECTOR_CLIENT \
+   | PEER_FLAG_RSERVER_CLIENT | PEER_FLAG_AS_PATH_UNCHANGED \
+   | PEER_FLAG_NEXTHOP_UNCHANGED | PEER_FLAG_MED_UNCHANGED \
+   | PEER_FLAG_REMOVE_PRIVATE_AS | PEER_FLAG_NEXTHOP_LOCAL_UNCHANGED)
+
+/* Peer flags and capabilities which change how UPDATEs are encoded. */
+#define PEER_UPDGRP_FLAGS \
+  (PEER_FLAG_LOCAL_AS_NO_PREPEND | PEER_FLAG_LOCAL_AS_REPLACE_AS)
+#define PEER_UPDGRP_CAPS  (PEER_CAP_AS4_RCV)
+
+/* Labelled address families encode a per-path tag with each prefix, so
+   their messages are not shared. */
+#define UPDGRP_SAFI_SHARED(S) ((S) == SAFI_UNICAST || (S) == SAFI_MULTICAST)
+
+static int
+updgrp_name_same (const char *n1, const char *n2)
+{
+  if (! n1 || ! n2)
+    return n1 == n2;
+  return strcmp (n1, n2) == 0;
+}
+
+static int
+updgrp_su_same (union sockunion *su1, union sockunion *su2)
+{
+  if (! su1 || ! su2)
+    return su1 == su2;
+  return sockunion_same (su1, su2);
+}
+
+/* Whether p2 is to be sent exactly what p1 is sent.  Everything
+   bgp_announce_check and bgp_packet_attribute look at must match,
+   except what bgp_announce_check_peer checks for each peer anyway. */
+static int
+updgrp_peer_same (struct peer *p1, struct peer *p2, afi_t afi, safi_t safi)
+{
+  struct bgp_filter *f1 = &p1->filter[afi][safi];
+  struct bgp_filter *f2 = &p2->filter[afi][safi];
+
+  if (p1->sort != p2->sort
+      || p1->as != p2->as
+      || p1->local_as != p2->local_as
+      || p1->change_local_as != p2->change_local_as
+      || (p1->flags & PEER_UPDGRP_FLAGS) != (p2->flags & PEER_UPDGRP_FLAGS)
+      || (p1->cap & PEER_UPDGRP_CAPS) != (p2->cap & PEER_UPDGRP_CAPS)
+      || ((p1->af_flags[afi][safi] & PEER_UPDGRP_AF_FLAGS)
+          != (p2->af_flags[afi][safi] & PEER_UPDGRP_AF_FLAGS)))
+    return 0;
+
+  if (! updgrp_name_same (f1->dlist[FILTER_OUT].name,
+                          f2->dlist[FILTER_OUT].name)
+      || ! updgrp_name_same (f1->plist[FILTER_OUT].name,
+                             f2->plist[FILTER_OUT].name)
+      || ! updgrp_name_same (f1->aslist[FILTER_OUT].name,
+                             f2->aslist[FILTER_OUT].name)
+      || ! updgrp_name_same (f1->map[RMAP_OUT].name, f2->map[RMAP_OUT].name)
+      || ! updgrp_name_same (f1->usmap.name, f2->usmap.name))
+    return 0;
+
+  /* Next hops we set, and the local address "set ip next-hop
+     peer-address" uses. */
+  if (! IPV4_ADDR_SAME (&p1->nexthop.v4, &p2->nexthop.v4)
+      || ! IPV6_ADDR_SAME (&p1->nexthop.v6_global, &p2->nexthop.v6_global)
+      || ! IPV6_ADDR_SAME (&p1->nexthop.v6_local, &p2->nexthop.v6_local)
+      || p1->shared_network != p2->shared_network
+      || ! updgrp_su_same (p1->su_local, p2->su_local))
+    return 0;
+
+  /* Next hops passed on unchanged to EBGP peers on the same subnet. */
+  if (p1->sort == BGP_PEER_EBGP && ! bgp_multiaccess_same (p1, p2))
+    return 0;
+
+  return 1;
+}
+
+static struct update_group *
+updgrp_new (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct update_group *group;
+
+  group = XCALLOC (MTYPE_BGP_UPDGRP, sizeof (struct update_group));
+  group->id = ++bgp->updgrp_id;
+  group->bgp = bgp;
+  group->afi = afi;
+  group->safi = safi;
+  group->peers = list_new ();
+  group->uptime = bgp_clock ();
+  return group;
+}
+
+static unsigned int
+updgrp_attr_key (void *p)
+{
+  struct updgrp_attr *ua = p;
+
+  return jhash_2words ((u_int32_t) (uintptr_t) ua->attr,
+                       (u_int32_t) (uintptr_t) ua->from, 0);
+}
+
+static int
+updgrp_attr_cmp (const void *p1, const void *p2)
+{
+  const struct updgrp_attr *ua1 = p1;
+  const struct updgrp_attr *ua2 = p2;
+
+  return ua1->attr == ua2->attr && ua1->from == ua2->from;
+}
+
+static void
+updgrp_attr_free (void *p)
+{
+  struct updgrp_attr *ua = p;
+
+  bgp_attr_unintern (&ua->attr);
+  if (ua->out)
+    bgp_attr_unintern (&ua->out);
+  if (ua->from)
+    peer_unlock (ua->from);
+  XFREE (MTYPE_BGP_UPDGRP_ATTR, ua);
+}
+
+static void
+updgrp_attr_flush (struct update_group *group)
+{
+  if (group->attr_cache)
+    hash_clean (group->attr_cache, updgrp_attr_free);
+}
+
+static void
+updgrp_packets_flush (struct update_group *group)
+{
+  int i;
+
+  for (i = 0; i < BGP_UPDGRP_PACKET_MAX; i++)
+    if (group->packets[i])
+      {
+        bgp_updgrp_packet_free (group->packets[i]);
+        group->packets[i] = NULL;
+      }
+  group->packet_next = 0;
+}
+
+static void
+updgrp_free (struct update_group *group)
+{
+  updgrp_packets_flush (group);
+  if (group->attr_cache)
+    {
+      updgrp_attr_flush (group);
+      hash_free (group->attr_cache);
+    }
+  list_delete (group->peers);
+  XFREE (MTYPE_BGP_UPDGRP, group);
+}
+
+/* Something peers are grouped on may have changed: regroup them before
+   the groups are next used. */
+void
+bgp_updgrp_reset (struct bgp *bgp)
+{
+  if (bgp)
+    bgp->updgrp_stale = 1;
+}
+
+void
+bgp_updgrp_reset_all (void)
+{
+  struct listnode *node;
+  struct bgp *bgp;
+
+  if (! bm->bgp)
+    return;
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, node, bgp))
+    bgp_updgrp_reset (bgp);
+}
+
+/* Regroup the instance's Established peers, if needed.  A group keeps
+   its number and statistics as long as one of its members is still
+   grouped the same way. */
+void
+bgp_updgrp_update (struct bgp *bgp)
+{
+  struct list *old, *groups;
+  struct listnode *node, *gnode;
+  struct update_group *group, *prev;
+  struct peer *peer;
+  afi_t afi;
+  safi_t safi;
+
+  if (! bgp->updgrp_stale)
+    return;
+  bgp->updgrp_stale = 0;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      {
+        old = bgp->update_groups[afi][safi];
+        groups = list_new ();
+
+        if (old)
+          for (ALL_LIST_ELEMENTS_RO (old, node, group))
+            {
+              list_delete_all_node (group->peers);
+              updgrp_packets_flush (group);
+              updgrp_attr_flush (group);
+            }
+
+        for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
+          {
+            prev = peer->updgrp[afi][safi];
+            peer->updgrp[afi][safi] = NULL;
+
+            if (peer->status != Established || ! peer->afc_nego[afi][safi])
+              continue;
+
+            for (ALL_LIST_ELEMENTS_RO (groups, gnode, group))
+              if (updgrp_peer_same (UPDGRP_PEER (group), peer, afi, safi))
+                break;
+
+            if (! gnode)
+              {
+                /* Groups left over are still empty. */
+                if (prev && ! listcount (prev->peers))
+                  {
+                    listnode_delete (old, prev);
+                    group = prev;
+                  }
+                else
+                  group = updgrp_new (bgp, afi, safi);
+                listnode_add (groups, group);
+              }
+
+            if (BGP_DEBUG (normal, NORMAL) && group != prev)
+              zlog_debug ("%s %s moves to update group %u", peer->host,
+                          afi_safi_print (afi, safi), group->id);
+
+            listnode_add (group->peers, peer);
+            peer->updgrp[afi][safi] = group;
+          }
+
+        if (old)
+          {
+            for (ALL_LIST_ELEMENTS_RO (old, node, group))
+              updgrp_free (group);
+            list_delete (old);
+          }
+        bgp->update_groups[afi][safi] = groups;
+      }
+}
+
+/* Take a peer which is going away out of its groups at once. */
+void
+bgp_updgrp_peer_remove (struct peer *peer)
+{
+  struct update_group *group;
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      {
+        group = peer->updgrp[afi][safi];
+        if (! group)
+          continue;
+
+        peer->updgrp[afi][safi] = NULL;
+        listnode_delete (group->peers, peer);
+        if (! listcount (group->peers))
+          {
+            listnode_delete (peer->bgp->update_groups[afi][safi], group);
+            updgrp_free (group);
+          }
+      }
+}
+
+void
+bgp_updgrp_finish (struct bgp *bgp)
+{
+  struct listnode *node;
+  struct update_group *group;
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (bgp->update_groups[afi][safi])
+        {
+          for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node,
+                                     group))
+            updgrp_free (group);
+          list_delete (bgp->update_groups[afi][safi]);
+          bgp->update_groups[afi][safi] = NULL;
+        }
+}
+
+/* A route-map, filter or other list used by outbound policy has
+   changed: forget what it made of the attributes of routes. */
+void
+bgp_updgrp_policy_change (void)
+{
+  struct listnode *mnode, *node;
+  struct bgp *bgp;
+  struct update_group *group;
+  afi_t afi;
+  safi_t safi;
+
+  if (! bm->bgp)
+    return;
+
+  for (ALL_LIST_ELEMENTS_RO (bm->bgp, mnode, bgp))
+    for (afi = AFI_IP; afi < AFI_MAX; afi++)
+      for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+        if (bgp->update_groups[afi][safi])
+          for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node,
+                                     group))
+            updgrp_attr_flush (group);
+}
+
+/* What the group's outbound policy made of the attributes of routes
+   from the peer, if it is still known. */
+struct updgrp_attr *
+bgp_updgrp_attr_lookup (struct update_group *group, struct attr *attr,
+                        struct peer *from)
+{
+  struct updgrp_attr key;
+  struct updgrp_attr *ua;
+
+  if (! group->attr_cache)
+    return NULL;
+
+  key.attr = attr;
+  key.from = from;
+  ua = hash_lookup (group->attr_cache, &key);
+  if (ua)
+    group->attr_hit++;
+  return ua;
+}
+
+/* Remember what the group's outbound policy made of the attributes of
+   routes from the peer: OUT, or nothing if they are not sent. */
+void
+bgp_updgrp_attr_add (struct update_group *group, struct attr *attr,
+                     struct peer *from, struct attr *out)
+{
+  struct updgrp_attr *ua;
+
+  group->attr_miss++;
+
+  if (! group->attr_cache)
+    group->attr_cache = hash_create (updgrp_attr_key, updgrp_attr_cmp);
+  else if (group->attr_cache->count >= BGP_UPDGRP_ATTR_MAX)
+    updgrp_attr_flush (group);
+
+  ua = XCALLOC (MTYPE_BGP_UPDGRP_ATTR, sizeof (struct updgrp_attr));
+  ua->attr = bgp_attr_intern (attr);
+  ua->from = from ? peer_lock (from) : NULL;
+  ua->out = out ? bgp_attr_intern (out) : NULL;
+  hash_get (group->attr_cache, ua, hash_alloc_intern);
+}
+
+/* Start recording the UPDATE being built for a peer, if other members
+   of its group may be able to use it. */
+struct updgrp_packet *
+bgp_updgrp_packet_new (struct peer *peer, afi_t afi, safi_t safi,
+                       struct attr *attr, struct peer *from)
+{
+  struct update_group *group = peer->updgrp[afi][safi];
+  struct updgrp_packet *pkt;
+
+  if (! group || listcount (group->peers) < 2 || ! UPDGRP_SAFI_SHARED (safi))
+    return NULL;
+
+  pkt = XCALLOC (MTYPE_BGP_UPDGRP_PACKET, sizeof (struct updgrp_packet));
+  pkt->attr = bgp_attr_intern (attr);
+  pkt->from = from ? peer_lock (from) : NULL;
+  return pkt;
+}
+
+void
+bgp_updgrp_packet_note (struct updgrp_packet *pkt, struct prefix *p)
+{
+  if (pkt->count == pkt->size)
+    {
+      pkt->size = pkt->size ? pkt->size * 2 : 64;
+      pkt->prefix = XREALLOC (MTYPE_BGP_UPDGRP_PACKET, pkt->prefix,
+                              pkt->size * sizeof (struct prefix));
+    }
+  prefix_copy (&pkt->prefix[pkt->count++], p);
+}
+
+void
+bgp_updgrp_packet_free (struct updgrp_packet *pkt)
+{
+  if (pkt->s)
+    stream_free (pkt->s);
+  if (pkt->attr)
+    bgp_attr_unintern (&pkt->attr);
+  if (pkt->from)
+    peer_unlock (pkt->from);
+  if (pkt->prefix)
+    XFREE (MTYPE_BGP_UPDGRP_PACKET, pkt->prefix);
+  XFREE (MTYPE_BGP_UPDGRP_PACKET, pkt);
+}
+
+/* Keep the UPDATE just built for a peer, replacing the group's oldest. */
+void
+bgp_updgrp_packet_add (struct peer *peer, afi_t afi, safi_t safi,
+                       struct updgrp_packet *pkt, struct stream *s)
+{
+  struct update_group *group = peer->updgrp[afi][safi];
+
+  if (! group || ! pkt->count)
+    {
+      bgp_updgrp_packet_free (pkt);
+      return;
+    }
+
+  pkt->s = stream_dup (s);
+
+  if (group->packets[group->packet_next])
+    bgp_updgrp_packet_free (group->packets[group->packet_next]);
+  group->packets[group->packet_next] = pkt;
+  group->packet_next = (group->packet_next + 1) % BGP_UPDGRP_PACKET_MAX;
+  group->packet_built++;
+}
+
+/* Find an UPDATE another member of the peer's group built, which carries
+   exactly the routes the peer would put first into its next one. */
+struct updgrp_packet *
+bgp_updgrp_packet_lookup (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group *group;
+  struct updgrp_packet *pkt;
+  struct bgp_advertise *adv, *next;
+  struct peer *from;
+  u_int32_t n;
+  int i;
+
+  bgp_updgrp_update (peer->bgp);
+
+  group = peer->updgrp[afi][safi];
+  if (! group || listcount (group->peers) < 2 || ! UPDGRP_SAFI_SHARED (safi))
+    return NULL;
+
+  adv = BGP_ADV_FIFO_HEAD (&peer->sync[afi][safi]->update);
+  if (! adv || ! adv->baa)
+    return NULL;
+  from = adv->binfo ? adv->binfo->peer : NULL;
+
+  for (i = 0; i < BGP_UPDGRP_PACKET_MAX; i++)
+    {
+      pkt = group->packets[i];
+      if (! pkt || pkt->attr != adv->baa->attr || pkt->from != from
+          || ! prefix_same (&pkt->prefix[0], &adv->rn->p))
+        continue;
+
+      /* bgp_update_packet follows the oldest advertisement with the
+         others sharing its attributes, in the order they are linked. */
+      n = 1;
+      for (next = adv->baa->adv; next && n < pkt->count; next = next->next)
+        if (next != adv)
+          {
+            if (! prefix_same (&pkt->prefix[n], &next->rn->p))
+              break;
+            n++;
+          }
+
+      if (n == pkt->count)
+        {
+          group->packet_reused++;
+          return pkt;
+        }
+    }
+  return NULL;
+}
+
+static void
+updgrp_show (struct vty *vty, struct update_group *group)
+{
+  struct peer *peer = UPDGRP_PEER (group);
+  struct bgp_filter *filter = &peer->filter[group->afi][group->safi];
+  u_int32_t af_flags = peer->af_flags[group->afi][group->safi];
+  char timebuf[BGP_UPTIME_LEN];
+  struct listnode *node;
+
+  vty_out (vty, "Update group %u, %s, up %s%s", group->id,
+           afi_safi_print (group->afi, group->safi),
+           peer_uptime (group->uptime, timebuf, BGP_UPTIME_LEN), VTY_NEWLINE);
+
+  vty_out (vty, "  %s peers in AS %u",
+           peer->sort == BGP_PEER_IBGP ? "Internal"
+           : peer->sort == BGP_PEER_CONFED ? "Confederation" : "External",
+           peer->as);
+  if (CHECK_FLAG (af_flags, PEER_FLAG_REFLECTOR_CLIENT))
+    vty_out (vty, ", route-reflector clients");
+  if (CHECK_FLAG (af_flags, PEER_FLAG_RSERVER_CLIENT))
+    vty_out (vty, ", route-server clients");
+  if (CHECK_FLAG (af_flags, PEER_FLAG_NEXTHOP_SELF))
+    vty_out (vty, ", next-hop-self");
+  vty_out (vty, "%s", VTY_NEWLINE);
+
+  if (filter->map[RMAP_OUT].name)
+    vty_out (vty, "  Outbound route-map: %s%s", filter->map[RMAP_OUT].name,
+             VTY_NEWLINE);
+  if (filter->plist[FILTER_OUT].name)
+    vty_out (vty, "  Outbound prefix-list: %s%s",
+             filter->plist[FILTER_OUT].name, VTY_NEWLINE);
+  if (filter->dlist[FILTER_OUT].name)
+    vty_out (vty, "  Outbound distribute-list: %s%s",
+             filter->dlist[FILTER_OUT].name, VTY_NEWLINE);
+  if (filter->aslist[FILTER_OUT].name)
+    vty_out (vty, "  Outbound filter-list: %s%s",
+             filter->aslist[FILTER_OUT].name, VTY_NEWLINE);
+  if (filter->usmap.name)
+    vty_out (vty, "  Unsuppress-map: %s%s", filter->usmap.name, VTY_NEWLINE);
+
+  vty_out (vty, "  Prefixes evaluated: %u, advertisements queued: %u%s",
+           group->prefix_cnt, group->adv_cnt, VTY_NEWLINE);
+  vty_out (vty, "  UPDATEs built: %u, reused by other members: %u%s",
+           group->packet_built, group->packet_reused, VTY_NEWLINE);
+  vty_out (vty, "  Outbound policy applied: %u, result reused: %u%s",
+           group->attr_miss, group->attr_hit, VTY_NEWLINE);
+
+  vty_out (vty, "  Members: %d%s", listcount (group->peers), VTY_NEWLINE);
+  for (ALL_LIST_ELEMENTS_RO (group->peers, node, peer))
+    vty_out (vty, "    %s%s", peer->host, VTY_NEWLINE);
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+DEFUN (show_ip_bgp_update_groups,
+       show_ip_bgp_update_groups_cmd,
+       "show ip bgp update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Groups of peers sharing their outbound policy\n")
+{
+  struct bgp *bgp;
+  struct listnode *node;
+  struct update_group *group;
+  afi_t afi;
+  safi_t safi;
+
+  bgp = bgp_get_default ();
+  if (! bgp)
+    {
+      vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  bgp_updgrp_update (bgp);
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      if (bgp->update_groups[afi][safi])
+        for (ALL_LIST_ELEMENTS_RO (bgp->update_groups[afi][safi], node, group))
+          updgrp_show (vty, group);
+
+  return CMD_SUCCESS;
+}
+
+void
+bgp_updgrp_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_update_groups_cmd);
+}
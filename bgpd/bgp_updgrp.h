@@ -0,0 +1,119 @@
+/* BGP update groups
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_BGP_UPDGRP_H
+#define _QUAGGA_BGP_UPDGRP_H
+
+/* UPDATE messages an update group keeps for its members to reuse. */
+#define BGP_UPDGRP_PACKET_MAX 32
+
+/* An UPDATE message built for one member of an update group.  Members
+   are fed the same advertisements in the same order, so the next
+   message of another member usually carries the same routes and can be
+   sent as is. */
+struct updgrp_packet
+{
+  /* The message. */
+  struct stream *s;
+
+  /* Attributes it carries, and the peer the first route came from,
+     which the attribute encoding depends on. */
+  struct attr *attr;
+  struct peer *from;
+
+  /* Prefixes it carries, in order. */
+  u_int32_t count;
+  u_int32_t size;
+  struct prefix *prefix;
+};
+
+/* Attributes of routes to a group which have gone through its outbound
+   policy, beyond which the group forgets them all. */
+#define BGP_UPDGRP_ATTR_MAX 16384
+
+/* What the outbound policy of a group makes of the attributes of routes
+   from a peer.  Holds a reference to each. */
+struct updgrp_attr
+{
+  struct attr *attr;
+  struct peer *from;
+
+  /* The attributes sent, or NULL if such routes are not sent. */
+  struct attr *out;
+};
+
+/* Established peers of an instance which share everything in their
+   outbound configuration for an address family, and so are sent the
+   same routes with the same attributes. */
+struct update_group
+{
+  u_int32_t id;
+
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  /* Member peers.  Outbound policy is evaluated against the first. */
+  struct list *peers;
+
+  /* Recently built UPDATE messages. */
+  struct updgrp_packet *packets[BGP_UPDGRP_PACKET_MAX];
+  int packet_next;
+
+  /* Outbound policy results, by attributes and origin. */
+  struct hash *attr_cache;
+
+  /* Statistics. */
+  time_t uptime;
+  u_int32_t prefix_cnt;
+  u_int32_t adv_cnt;
+  u_int32_t packet_built;
+  u_int32_t packet_reused;
+  u_int32_t attr_hit;
+  u_int32_t attr_miss;
+};
+
+#define UPDGRP_PEER(G) ((struct peer *) listgetdata (listhead ((G)->peers)))
+
+extern void bgp_updgrp_init (void);
+extern void bgp_updgrp_reset (struct bgp *);
+extern void bgp_updgrp_reset_all (void);
+extern void bgp_updgrp_update (struct bgp *);
+extern void bgp_updgrp_peer_remove (struct peer *);
+extern void bgp_updgrp_finish (struct bgp *);
+extern void bgp_updgrp_policy_change (void);
+
+extern struct updgrp_attr *bgp_updgrp_attr_lookup (struct update_group *,
+                                                   struct attr *,
+                                                   struct peer *);
+extern void bgp_updgrp_attr_add (struct update_group *, struct attr *,
+                                 struct peer *, struct attr *);
+
+extern struct updgrp_packet *bgp_updgrp_packet_new (struct peer *, afi_t,
+                                                    safi_t, struct attr *,
+                                                    struct peer *);
+extern void bgp_updgrp_packet_note (struct updgrp_packet *, struct prefix *);
+extern void bgp_updgrp_packet_add (struct peer *, afi_t, safi_t,
+                                   struct updgrp_packet *, struct stream *);
+extern void bgp_updgrp_packet_free (struct updgrp_packet *);
+extern struct updgrp_packet *bgp_updgrp_packet_lookup (struct peer *, afi_t,
+                                                       safi_t);
+
+#endif /* _QUAGGA_BGP_UPDGRP_H */
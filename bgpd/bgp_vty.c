@@ -50,7 +50,9 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
 #include "bgpd/bgp_mpath.h"
+#include "bgpd/bgp_io.h"
 
 /* Utility function to get address family from current node.  */
 afi_t
@@ -994,6 +996,36 @@ DEFUN (no_bgp_deterministic_med,
   return CMD_SUCCESS;
 }
 
+/* "bgp adj-rib-out pending-only" configuration. */
+DEFUN (bgp_adj_out_pending,
+       bgp_adj_out_pending_cmd,
+       "bgp adj-rib-out pending-only",
+       "BGP specific commands\n"
+       "Routes advertised to peers\n"
+       "Keep only advertisements not yet sent, not the routes sent\n")
+{
+  struct bgp *bgp;
+
+  bgp = vty->index;
+  bgp_adj_out_pending_set (bgp);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_adj_out_pending,
+       no_bgp_adj_out_pending_cmd,
+       "no bgp adj-rib-out pending-only",
+       NO_STR
+       "BGP specific commands\n"
+       "Routes advertised to peers\n"
+       "Keep only advertisements not yet sent, not the routes sent\n")
+{
+  struct bgp *bgp;
+
+  bgp = vty->index;
+  bgp_adj_out_pending_unset (bgp);
+  return CMD_SUCCESS;
+}
+
 /* "bgp graceful-restart" configuration. */
 DEFUN (bgp_graceful_restart,
        bgp_graceful_restart_cmd,
@@ -8643,6 +8675,18 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 	   p->update_out + p->keepalive_out + p->refresh_out + p->dynamic_cap_out,
 	   p->open_in + p->notify_in + p->update_in + p->keepalive_in + p->refresh_in +
 	   p->dynamic_cap_in, VTY_NEWLINE);
+  if (p->read_count)
+    vty_out (vty, "    Messages per read: %u.%02u (%u reads)%s",
+	     p->read_msg_count / p->read_count,
+	     (p->read_msg_count % p->read_count) * 100 / p->read_count,
+	     p->read_count, VTY_NEWLINE);
+  if (p->attr_cache_hit + p->attr_cache_miss)
+    vty_out (vty, "    Path attributes parsed already: %u of %u (%u%%)%s",
+	     p->attr_cache_hit, p->attr_cache_hit + p->attr_cache_miss,
+	     (unsigned int) ((u_int64_t) p->attr_cache_hit * 100
+			     / (p->attr_cache_hit + p->attr_cache_miss)),
+	     VTY_NEWLINE);
+  bgp_io_peer_show (vty, p);
 
   /* advertisement-interval */
   vty_out (vty, "  Minimum time between advertisement runs is %d seconds%s",
@@ -10114,6 +10158,10 @@ bgp_vty_init (void)
   install_element (BGP_NODE, &bgp_deterministic_med_cmd);
   install_element (BGP_NODE, &no_bgp_deterministic_med_cmd);
 
+  /* "bgp adj-rib-out pending-only" commands */
+  install_element (BGP_NODE, &bgp_adj_out_pending_cmd);
+  install_element (BGP_NODE, &no_bgp_adj_out_pending_cmd);
+
   /* "bgp graceful-restart" commands */
   install_element (BGP_NODE, &bgp_graceful_restart_cmd);
   install_element (BGP_NODE, &no_bgp_graceful_restart_cmd);
@@ -11443,6 +11491,7 @@ community_list_set_vty (struct vty *vty, int argc, const char **argv,
       return CMD_WARNING;
     }
 
+  bgp_updgrp_policy_change ();
   return CMD_SUCCESS;
 }
 
@@ -11487,6 +11536,7 @@ community_list_unset_vty (struct vty *vty, int argc, const char **argv,
       return CMD_WARNING;
     }
 
+  bgp_updgrp_policy_change ();
   return CMD_SUCCESS;
 }
 
@@ -11797,6 +11847,7 @@ lcommunity_list_set_vty (struct vty *vty, int argc, const char **argv,
       community_list_perror (vty, ret);
       return CMD_WARNING;
     }
+  bgp_updgrp_policy_change ();
   return CMD_SUCCESS;
 }
 
@@ -11840,6 +11891,7 @@ lcommunity_list_unset_vty (struct vty *vty, int argc, const char **argv,
       return CMD_WARNING;
     }
 
+  bgp_updgrp_policy_change ();
   return CMD_SUCCESS;
 }
 
@@ -12147,6 +12199,7 @@ extcommunity_list_set_vty (struct vty *vty, int argc, const char **argv,
       community_list_perror (vty, ret);
       return CMD_WARNING;
     }
+  bgp_updgrp_policy_change ();
   return CMD_SUCCESS;
 }
 
@@ -12190,6 +12243,7 @@ extcommunity_list_unset_vty (struct vty *vty, int argc, const char **argv,
       return CMD_WARNING;
     }
 
+  bgp_updgrp_policy_change ();
   return CMD_SUCCESS;
 }
 
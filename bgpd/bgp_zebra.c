@@ -110,7 +110,7 @@ bgp_interface_delete (int command, struct zclient *zclient,
   if (! ifp)
     return 0;
 
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
 
   if (BGP_DEBUG(zebra, ZEBRA))
     zlog_debug("Zebra rcvd: interface delete %s", ifp->name);
@@ -62,6 +62,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_vty.h"
 #include "bgpd/bgp_mpath.h"
 #include "bgpd/bgp_nht.h"
+#include "bgpd/bgp_updgrp.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -125,6 +126,9 @@ int
 bgp_flag_set (struct bgp *bgp, int flag)
 {
   SET_FLAG (bgp->flags, flag);
+  bgp_updgrp_reset (bgp);
+  if (CHECK_FLAG (flag, BGP_FLAG_DECISION))
+    bgp_best_selection_reset (bgp);
   return 0;
 }
 
@@ -132,6 +136,9 @@ int
 bgp_flag_unset (struct bgp *bgp, int flag)
 {
   UNSET_FLAG (bgp->flags, flag);
+  bgp_updgrp_reset (bgp);
+  if (CHECK_FLAG (flag, BGP_FLAG_DECISION))
+    bgp_best_selection_reset (bgp);
   return 0;
 }
 
@@ -314,6 +321,7 @@ bgp_confederation_id_set (struct bgp *bgp, as_t as)
   already_confed = bgp_config_check (bgp, BGP_CONFIG_CONFEDERATION);
   bgp->confed_id = as;
   bgp_config_set (bgp, BGP_CONFIG_CONFEDERATION);
+  bgp_updgrp_reset (bgp);
 
   /* If we were doing confederation already, this is just an external
      AS change.  Just Reset EBGP sessions, not CONFED sessions.  If we
@@ -369,6 +377,7 @@ bgp_confederation_id_unset (struct bgp *bgp)
 
   bgp->confed_id = 0;
   bgp_config_unset (bgp, BGP_CONFIG_CONFEDERATION);
+  bgp_updgrp_reset (bgp);
       
   for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
     {
@@ -519,6 +528,8 @@ bgp_default_local_preference_set (struct bgp *bgp, u_int32_t local_pref)
     return -1;
 
   bgp->default_local_pref = local_pref;
+  bgp_updgrp_reset (bgp);
+  bgp_best_selection_reset (bgp);
 
   return 0;
 }
@@ -530,6 +541,54 @@ bgp_default_local_preference_unset (struct bgp *bgp)
     return -1;
 
   bgp->default_local_pref = BGP_DEFAULT_LOCAL_PREF;
+  bgp_updgrp_reset (bgp);
+  bgp_best_selection_reset (bgp);
+
+  return 0;
+}
+
+/* Reset the sessions of an instance whose Adj-RIB-Out mode changes, so
+   that no peer is left with routes recorded in the other mode. */
+static void
+bgp_adj_out_pending_reset (struct bgp *bgp)
+{
+  struct peer *peer;
+  struct listnode *node, *nnode;
+
+  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+    {
+      if (BGP_IS_VALID_STATE_FOR_NOTIF (peer->status))
+	{
+	  peer->last_reset = PEER_DOWN_ADJ_OUT_CHANGE;
+	  bgp_notify_send (peer, BGP_NOTIFY_CEASE,
+			   BGP_NOTIFY_CEASE_CONFIG_CHANGE);
+	}
+      else
+	BGP_EVENT_ADD (peer, BGP_Stop);
+    }
+}
+
+/* bgp adj-rib-out pending-only */
+int
+bgp_adj_out_pending_set (struct bgp *bgp)
+{
+  if (bgp_flag_check (bgp, BGP_FLAG_ADJ_RIB_OUT_PENDING))
+    return 0;
+
+  bgp_flag_set (bgp, BGP_FLAG_ADJ_RIB_OUT_PENDING);
+  bgp_adj_out_pending_reset (bgp);
+
+  return 0;
+}
+
+int
+bgp_adj_out_pending_unset (struct bgp *bgp)
+{
+  if (! bgp_flag_check (bgp, BGP_FLAG_ADJ_RIB_OUT_PENDING))
+    return 0;
+
+  bgp_flag_unset (bgp, BGP_FLAG_ADJ_RIB_OUT_PENDING);
+  bgp_adj_out_pending_reset (bgp);
 
   return 0;
 }
@@ -872,6 +931,7 @@ peer_new (struct bgp *bgp)
 
   /* Create buffers.  */
   peer->ibuf = stream_new (BGP_MAX_PACKET_SIZE);
+  peer->rbuf = stream_new (BGP_READ_BUF_SIZE);
   peer->obuf = stream_fifo_new ();
 
   /* We use a larger buffer for peer->work in the event that:
@@ -1290,6 +1350,7 @@ peer_delete (struct peer *peer)
   peer->last_reset = PEER_DOWN_NEIGHBOR_DELETE;
   bgp_stop (peer);
   bgp_fsm_change_status (peer, Deleted);
+  bgp_updgrp_peer_remove (peer);
   
   /* Remove from NHT */
   bgp_unlink_nexthop_by_peer (peer);
@@ -1342,6 +1403,12 @@ peer_delete (struct peer *peer)
       peer->ibuf = NULL;
     }
 
+  if (peer->rbuf)
+    {
+      stream_free (peer->rbuf);
+      peer->rbuf = NULL;
+    }
+
   if (peer->obuf)
     {
       stream_fifo_free (peer->obuf);
@@ -1866,6 +1933,8 @@ peer_group_bind (struct bgp *bgp, union sockunion *su,
   struct peer *peer;
   int first_member = 0;
 
+  bgp_updgrp_reset (bgp);
+
   /* Check peer group's address family.  */
   if (! group->conf->afc[afi][safi])
     return BGP_ERR_PEER_GROUP_AF_UNCONFIGURED;
@@ -2005,6 +2074,8 @@ int
 peer_group_unbind (struct bgp *bgp, struct peer *peer,
 		   struct peer_group *group, afi_t afi, safi_t safi)
 {
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->af_group[afi][safi])
       return 0;
 
@@ -2319,6 +2390,7 @@ bgp_free (struct bgp *bgp)
   afi_t afi;
   safi_t safi;
 
+  bgp_updgrp_finish (bgp);
   list_delete (bgp->group);
   list_delete (bgp->peer);
   list_delete (bgp->rsclient);
@@ -2633,6 +2705,8 @@ peer_flag_modify (struct peer *peer, u_int32_t flag, int set)
   struct listnode *node, *nnode;
   struct peer_flag_action action;
 
+  bgp_updgrp_reset (peer->bgp);
+
   memset (&action, 0, sizeof (struct peer_flag_action));
   size = sizeof peer_flag_action_list / sizeof (struct peer_flag_action);
 
@@ -2736,6 +2810,8 @@ peer_af_flag_modify (struct peer *peer, afi_t afi, safi_t safi, u_int32_t flag,
   struct peer_group *group;
   struct peer_flag_action action;
 
+  bgp_updgrp_reset (peer->bgp);
+
   memset (&action, 0, sizeof (struct peer_flag_action));
   size = sizeof peer_af_flag_action_list / sizeof (struct peer_flag_action);
   
@@ -3603,6 +3679,8 @@ peer_local_as_set (struct peer *peer, as_t as, int no_prepend, int replace_as)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (peer_sort (peer) != BGP_PEER_EBGP
       && peer_sort (peer) != BGP_PEER_INTERNAL)
     return BGP_ERR_LOCAL_AS_ALLOWED_ONLY_FOR_EBGP;
@@ -3681,6 +3759,8 @@ peer_local_as_unset (struct peer *peer)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (peer_group_active (peer))
     return BGP_ERR_INVALID_FOR_PEER_GROUP_MEMBER;
 
@@ -3838,6 +3918,8 @@ peer_distribute_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3885,6 +3967,8 @@ peer_distribute_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -3950,6 +4034,8 @@ peer_distribute_update (const char *name)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  bgp_updgrp_policy_change ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -3998,6 +4084,8 @@ peer_prefix_list_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4044,6 +4132,8 @@ peer_prefix_list_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4109,6 +4199,8 @@ peer_prefix_list_update (struct prefix_list *plist)
   safi_t safi;
   int direct;
 
+  bgp_updgrp_policy_change ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -4156,6 +4248,8 @@ peer_aslist_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4199,6 +4293,8 @@ peer_aslist_unset (struct peer *peer,afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4263,6 +4359,8 @@ peer_aslist_update (void)
   struct peer_group *group;
   struct bgp_filter *filter;
 
+  bgp_updgrp_policy_change ();
+
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
       for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
@@ -4311,6 +4409,8 @@ peer_route_map_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4358,6 +4458,8 @@ peer_route_map_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4419,6 +4521,8 @@ peer_unsuppress_map_set (struct peer *peer, afi_t afi, safi_t safi,
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
 
@@ -4460,6 +4564,8 @@ peer_unsuppress_map_unset (struct peer *peer, afi_t afi, safi_t safi)
   struct peer_group *group;
   struct listnode *node, *nnode;
 
+  bgp_updgrp_reset (peer->bgp);
+
   if (! peer->afc[afi][safi])
     return BGP_ERR_PEER_INACTIVE;
   
@@ -5417,6 +5523,10 @@ bgp_config_write (struct vty *vty)
       if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
 	vty_out (vty, " bgp deterministic-med%s", VTY_NEWLINE);
 
+      /* BGP Adj-RIB-Out mode. */
+      if (bgp_flag_check (bgp, BGP_FLAG_ADJ_RIB_OUT_PENDING))
+	vty_out (vty, " bgp adj-rib-out pending-only%s", VTY_NEWLINE);
+
       /* BGP graceful-restart. */
       if (bgp->stalepath_time != BGP_DEFAULT_STALEPATH_TIME)
 	vty_out (vty, " bgp graceful-restart stalepath-time %d%s",
@@ -5561,6 +5671,7 @@ bgp_init (void)
   bgp_scan_vty_init();
   bgp_mplsvpn_init ();
   bgp_encap_init ();
+  bgp_updgrp_init ();
 
   /* Access list initialize. */
   access_list_init ();
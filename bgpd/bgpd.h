@@ -29,6 +29,10 @@ typedef u_int32_t as_t;
 typedef u_int16_t as16_t; /* we may still encounter 16 Bit asnums */
 typedef u_int16_t bgp_size_t;
 
+struct update_group;
+struct bgp_io;
+struct bgp_attr_cache;
+
 /* BGP master for system wide configurations and variables.  */
 struct bgp_master
 {
@@ -125,6 +129,14 @@ struct bgp
 #define BGP_FLAG_ASPATH_MULTIPATH_RELAX   (1 << 14)
 #define BGP_FLAG_DELETING                 (1 << 15)
 #define BGP_FLAG_RR_ALLOW_OUTBOUND_POLICY (1 << 16)
+#define BGP_FLAG_ADJ_RIB_OUT_PENDING      (1 << 17)
+
+  /* Flags which change how paths compare in best path selection. */
+#define BGP_FLAG_DECISION \
+  (BGP_FLAG_ALWAYS_COMPARE_MED | BGP_FLAG_DETERMINISTIC_MED \
+   | BGP_FLAG_MED_MISSING_AS_WORST | BGP_FLAG_MED_CONFED \
+   | BGP_FLAG_COMPARE_ROUTER_ID | BGP_FLAG_ASPATH_IGNORE \
+   | BGP_FLAG_ASPATH_CONFED | BGP_FLAG_ASPATH_MULTIPATH_RELAX)
 
   /* BGP Per AF flags */
   u_int16_t af_flags[AFI_MAX][SAFI_MAX];
@@ -179,6 +191,11 @@ struct bgp
     u_int16_t maxpaths_ebgp;
     u_int16_t maxpaths_ibgp;
   } maxpaths[AFI_MAX][SAFI_MAX];
+
+  /* Update groups, rebuilt when stale. */
+  struct list *update_groups[AFI_MAX][SAFI_MAX];
+  u_int32_t updgrp_id;
+  u_char updgrp_stale;
 };
 
 /* BGP peer-group support. */
@@ -317,8 +334,12 @@ struct peer
   /* Peer specific RIB when configured as route-server-client. */
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 
+  /* Update group the peer is in, if Established. */
+  struct update_group *updgrp[AFI_MAX][SAFI_MAX];
+
   /* Packet receive and send buffer. */
   struct stream *ibuf;
+  struct stream *rbuf;		/* Read from the socket, not yet framed. */
   struct stream_fifo *obuf;
   struct stream *work;
 
@@ -328,6 +349,12 @@ struct peer
    */
   struct stream *scratch;
 
+  /* The I/O thread's side of the session, if it serves it. */
+  struct bgp_io *io;
+
+  /* Path attributes recently received, as parsed. */
+  struct bgp_attr_cache *attr_cache;
+
   /* Status of the peer. */
   int status;
   int ostatus;
@@ -456,6 +483,7 @@ struct peer
 #define PEER_STATUS_PREFIX_LIMIT      (1 << 4) /* exceed prefix-limit */
 #define PEER_STATUS_EOR_SEND          (1 << 5) /* end-of-rib send to peer */
 #define PEER_STATUS_EOR_RECEIVED      (1 << 6) /* end-of-rib received from peer */
+#define PEER_STATUS_ANNOUNCED         (1 << 7) /* table announced to peer */
 
   /* Default attribute value for the peer. */
   u_int32_t config;
@@ -507,6 +535,10 @@ struct peer
   u_int32_t refresh_out;	/* Route Refresh output count */
   u_int32_t dynamic_cap_in;	/* Dynamic Capability input count.  */
   u_int32_t dynamic_cap_out;	/* Dynamic Capability output count.  */
+  u_int32_t read_count;		/* Socket reads which returned data.  */
+  u_int32_t read_msg_count;	/* Messages framed from those reads.  */
+  u_int32_t attr_cache_hit;	/* Path attributes found parsed already.  */
+  u_int32_t attr_cache_miss;	/* Path attributes parsed.  */
 
   /* BGP state count */
   u_int32_t established;	/* Established */
@@ -570,6 +602,7 @@ struct peer
 #define PEER_DOWN_PASSIVE_CHANGE        20 /* neighbor passive command */
 #define PEER_DOWN_MULTIHOP_CHANGE       21 /* neighbor multihop command */
 #define PEER_DOWN_NSF_CLOSE_SESSION     22 /* NSF tcp session close */
+#define PEER_DOWN_ADJ_OUT_CHANGE        23 /* bgp adj-rib-out command */
 
   /* The kind of route-map Flags.*/
   u_char rmap_type;
@@ -876,6 +909,7 @@ extern void bgp_master_init (void);
 
 extern void bgp_init (void);
 extern void bgp_route_map_init (void);
+extern int bgp_route_map_prefix_dependent (struct route_map *);
 
 extern int bgp_option_set (int);
 extern int bgp_option_unset (int);
@@ -910,6 +944,9 @@ extern int bgp_timers_unset (struct bgp *);
 extern int bgp_default_local_preference_set (struct bgp *, u_int32_t);
 extern int bgp_default_local_preference_unset (struct bgp *);
 
+extern int bgp_adj_out_pending_set (struct bgp *);
+extern int bgp_adj_out_pending_unset (struct bgp *);
+
 extern int peer_rsclient_active (struct peer *);
 
 extern int peer_remote_as (struct bgp *, union sockunion *, as_t *, afi_t, safi_t);
@@ -84,7 +84,16 @@
  *
  * If the connection to the FPM goes down for some reason, the client
  * (zebra) should send the FPM a complete copy of the forwarding
- * table(s) when it reconnects.
+ * table(s) when it reconnects, unless the two resynchronize as
+ * described for FPM_MSG_TYPE_SYNC.
+ *
+ * Optionally, many routes may be sent in one message, see
+ * FPM_MSG_TYPE_NETLINK_BATCH. Routes
+ * with the same nexthops may then refer to a nexthop group defined
+ * earlier on the connection instead of carrying the nexthops
+ * themselves. A group is defined again, with replace semantics, when
+ * its nexthops change, which changes the routes using it too. Groups
+ * are not deleted; the FPM may drop those no route refers to.
  */
 
 /*
@@ -102,6 +111,11 @@
  */
 #define FPM_MAX_MSG_LEN 4096
 
+/*
+ * Largest batch message, see below.
+ */
+#define FPM_MAX_BATCH_MSG_LEN (64 * 1024 - FPM_MSG_ALIGNTO)
+
 #ifdef __SUNPRO_C
 #pragma pack(1)
 #endif
@@ -151,8 +165,55 @@ typedef enum fpm_msg_type_e_ {
    */
   FPM_MSG_TYPE_NETLINK = 1,
   FPM_MSG_TYPE_PROTOBUF = 2,
+
+  /*
+   * The payload is a series of netlink messages, each aligned and
+   * complete, up to FPM_MAX_BATCH_MSG_LEN in all.
+   *
+   * RTM_NEWNEXTHOP messages define nexthop groups as for the Linux
+   * kernel: one object with an NHA_ID and NHA_GATEWAY and/or NHA_OIF
+   * for each nexthop, followed by the group with an NHA_ID and
+   * NHA_GROUP. Routes after them in the stream refer to the group
+   * with RTA_NH_ID instead of carrying nexthops.
+   */
+  FPM_MSG_TYPE_NETLINK_BATCH = 3,
+
+  /*
+   * The payload is an fpm_sync_msg_t.
+   *
+   * Each route message zebra sends carries a generation number, in
+   * nlmsg_seq or in the generation field of the protobuf message,
+   * which goes up with every route sent. A client which has been
+   * configured to resynchronize sends this message first when it
+   * connects, with an epoch it picked when it started and the last
+   * generation it sent. The FPM answers with the epoch and the
+   * generation of the last route message it applied from that client,
+   * or with anything else if it has not kept the routes. If the epoch
+   * is the client's and the client still knows which routes changed
+   * since the generation, it sends only those; otherwise it sends the
+   * complete table(s) again.
+   */
+  FPM_MSG_TYPE_SYNC = 5,
 } fpm_msg_type_e;
 
+/*
+ * Payload of FPM_MSG_TYPE_SYNC, in network byte order.
+ */
+typedef struct fpm_sync_msg_t_
+{
+  uint32_t epoch;
+  uint32_t generation;
+} fpm_sync_msg_t;
+
+/*
+ * fpm_msg_type_is_batch
+ */
+static inline int
+fpm_msg_type_is_batch (uint8_t msg_type)
+{
+  return (msg_type == FPM_MSG_TYPE_NETLINK_BATCH);
+}
+
 /*
  * The FPM message header is aligned to the same boundary as netlink
  * messages (4). This means that a netlink message does not need
@@ -265,13 +326,18 @@ fpm_msg_hdr_ok (const fpm_msg_hdr_t *hdr)
 
   msg_len = fpm_msg_len (hdr);
 
-  if (msg_len < FPM_MSG_HDR_LEN || msg_len > FPM_MAX_MSG_LEN)
+  if (msg_len < FPM_MSG_HDR_LEN)
+    return 0;
+
+  if (msg_len > (fpm_msg_type_is_batch (hdr->msg_type) ?
+		 FPM_MAX_BATCH_MSG_LEN : FPM_MAX_MSG_LEN))
     return 0;
 
   /*
    * Netlink messages must be aligned properly.
    */
-  if (hdr->msg_type == FPM_MSG_TYPE_NETLINK &&
+  if ((hdr->msg_type == FPM_MSG_TYPE_NETLINK ||
+       hdr->msg_type == FPM_MSG_TYPE_NETLINK_BATCH) &&
       fpm_msg_align (msg_len) != msg_len)
     return 0;
 
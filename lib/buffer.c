@@ -495,3 +495,114 @@ buffer_write(struct buffer *b, int fd, const void *p, size_t size)
   }
   return b->head ? BUFFER_PENDING : BUFFER_EMPTY;
 }
+
+buffer_status_t
+buffer_writev(struct buffer *b, int fd, const struct iovec *iov, int iovcnt)
+{
+  ssize_t nbytes;
+  size_t written;
+  int i;
+
+  if (b->head)
+    /* Buffer is not empty, so do not attempt to write the new data. */
+    nbytes = 0;
+  else if ((nbytes = writev(fd, iov, iovcnt)) < 0)
+    {
+      if (ERRNO_IO_RETRY(errno))
+        nbytes = 0;
+      else
+        {
+	  zlog_warn("%s: writev error on fd %d: %s",
+		    __func__, fd, safe_strerror(errno));
+	  return BUFFER_ERROR;
+	}
+    }
+  /* Add any remaining data to the buffer, resuming in whichever chunk the
+     kernel stopped. */
+  written = nbytes;
+  for (i = 0; i < iovcnt; i++)
+    {
+      if (written >= iov[i].iov_len)
+	{
+	  written -= iov[i].iov_len;
+	  continue;
+	}
+      buffer_put(b, ((const char *)iov[i].iov_base)+written,
+		 iov[i].iov_len-written);
+      written = 0;
+    }
+  return b->head ? BUFFER_PENDING : BUFFER_EMPTY;
+}
+
+buffer_status_t
+buffer_writev_func(struct buffer *b, buffer_writev_func_t func, void *arg,
+		   const struct iovec *iov, int iovcnt)
+{
+  ssize_t nbytes;
+  size_t written;
+  int i;
+
+  if (b->head)
+    /* Buffer is not empty, so do not attempt to write the new data. */
+    nbytes = 0;
+  else if ((nbytes = func(arg, iov, iovcnt)) < 0)
+    {
+      if (ERRNO_IO_RETRY(errno))
+        nbytes = 0;
+      else
+	return BUFFER_ERROR;
+    }
+  written = nbytes;
+  for (i = 0; i < iovcnt; i++)
+    {
+      if (written >= iov[i].iov_len)
+	{
+	  written -= iov[i].iov_len;
+	  continue;
+	}
+      buffer_put(b, ((const char *)iov[i].iov_base)+written,
+		 iov[i].iov_len-written);
+      written = 0;
+    }
+  return b->head ? BUFFER_PENDING : BUFFER_EMPTY;
+}
+
+buffer_status_t
+buffer_flush_func(struct buffer *b, buffer_writev_func_t func, void *arg)
+{
+#define MAX_CHUNKS 16
+  struct buffer_data *d;
+  struct iovec iov[MAX_CHUNKS];
+  int iovcnt = 0;
+  ssize_t nbytes;
+  size_t written;
+
+  for (d = b->head; d && (iovcnt < MAX_CHUNKS); d = d->next, iovcnt++)
+    {
+      iov[iovcnt].iov_base = d->data+d->sp;
+      iov[iovcnt].iov_len = d->cp-d->sp;
+    }
+  if (!iovcnt)
+    return BUFFER_EMPTY;
+
+  if ((nbytes = func(arg, iov, iovcnt)) < 0)
+    return ERRNO_IO_RETRY(errno) ? BUFFER_PENDING : BUFFER_ERROR;
+
+  /* Free written buffer data. */
+  written = nbytes;
+  while (written > 0 && (d = b->head))
+    {
+      if (written < d->cp-d->sp)
+        {
+	  d->sp += written;
+	  return BUFFER_PENDING;
+	}
+      written -= (d->cp-d->sp);
+      if (!(b->head = d->next))
+        b->tail = NULL;
+      BUFFER_DATA_FREE(d);
+    }
+
+  return b->head ? BUFFER_PENDING : BUFFER_EMPTY;
+#undef MAX_CHUNKS
+}
@@ -73,10 +73,28 @@ typedef enum
 extern buffer_status_t buffer_write(struct buffer *, int fd,
 				    const void *, size_t);
 
+/* Like buffer_write, but gathers several chunks into a single writev
+   call.  Any data that cannot be written immediately is added to the
+   buffer queue, in order. */
+extern buffer_status_t buffer_writev(struct buffer *, int fd,
+				     const struct iovec *, int iovcnt);
+
 /* This function attempts to flush some (but perhaps not all) of 
    the queued data to the given file descriptor. */
 extern buffer_status_t buffer_flush_available(struct buffer *, int fd);
 
+/* The same as buffer_writev and buffer_flush_available, but writing
+   through a writev-like function rather than to a file descriptor.  The
+   function returns the number of bytes it took, which may be fewer than
+   offered, or -1 with errno set on error. */
+typedef ssize_t (*buffer_writev_func_t) (void *arg, const struct iovec *,
+					 int iovcnt);
+extern buffer_status_t buffer_writev_func(struct buffer *,
+					  buffer_writev_func_t, void *arg,
+					  const struct iovec *, int iovcnt);
+extern buffer_status_t buffer_flush_func(struct buffer *,
+					 buffer_writev_func_t, void *arg);
+
 /* The following 2 functions (buffer_flush_all and buffer_flush_window)
    are for use in lib/vty.c only.  They should not be used elsewhere. */
 
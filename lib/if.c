@@ -36,10 +36,21 @@
 #include "buffer.h"
 #include "str.h"
 #include "log.h"
+#include "hash.h"
+#include "jhash.h"
 
 /* List of interfaces in only the default VRF */
 struct list *iflist;
 
+/* Interfaces of all VRFs by VRF and name, and by VRF and ifindex.  Those
+   without an ifindex are only in the first. */
+static struct hash *ifname_hash;
+static struct hash *ifindex_hash;
+
+/* VRFs whose interface lists are initialized, the last of which to be
+   terminated frees the hashes. */
+static unsigned int if_hash_users;
+
 /* One for each program.  This structure is needed to store hooks. */
 struct if_master
 {
@@ -112,6 +123,69 @@ if_cmp_func (struct interface *ifp1, struct interface *ifp2)
   return 0;
 }
 
+static unsigned int
+if_name_hash_key (void *arg)
+{
+  struct interface *ifp = arg;
+
+  return jhash (ifp->name, strlen (ifp->name), ifp->vrf_id);
+}
+
+static int
+if_name_hash_cmp (const void *a, const void *b)
+{
+  const struct interface *ifp1 = a, *ifp2 = b;
+
+  return (ifp1->vrf_id == ifp2->vrf_id && strcmp (ifp1->name, ifp2->name) == 0);
+}
+
+static unsigned int
+if_index_hash_key (void *arg)
+{
+  struct interface *ifp = arg;
+
+  return jhash_2words (ifp->ifindex, ifp->vrf_id, 0);
+}
+
+static int
+if_index_hash_cmp (const void *a, const void *b)
+{
+  const struct interface *ifp1 = a, *ifp2 = b;
+
+  return (ifp1->vrf_id == ifp2->vrf_id && ifp1->ifindex == ifp2->ifindex);
+}
+
+/* Put the interface in the ifindex hash, unless another interface of the
+   VRF has its ifindex already. */
+static void
+if_index_hash_add (struct interface *ifp)
+{
+  if (ifp->ifindex != IFINDEX_INTERNAL)
+    hash_get (ifindex_hash, ifp, hash_alloc_intern);
+}
+
+/* Take the interface out of the ifindex hash, and put in its place any
+   other interface of the VRF with the same ifindex. */
+static void
+if_index_hash_del (struct interface *ifp)
+{
+  struct listnode *node;
+  struct interface *oifp;
+
+  if (ifp->ifindex == IFINDEX_INTERNAL
+      || hash_lookup (ifindex_hash, ifp) != ifp)
+    return;
+
+  hash_release (ifindex_hash, ifp);
+
+  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (ifp->vrf_id), node, oifp))
+    if (oifp != ifp && oifp->ifindex == ifp->ifindex)
+      {
+	hash_get (ifindex_hash, oifp, hash_alloc_intern);
+	break;
+      }
+}
+
 /* Create new interface structure. */
 struct interface *
 if_create_vrf (const char *name, int namelen, vrf_id_t vrf_id)
@@ -128,7 +202,10 @@ if_create_vrf (const char *name, int namelen, vrf_id_t vrf_id)
   ifp->name[namelen] = '\0';
   ifp->vrf_id = vrf_id;
   if (if_lookup_by_name_vrf (ifp->name, vrf_id) == NULL)
-    listnode_add_sort (intf_list, ifp);
+    {
+      listnode_add_sort (intf_list, ifp);
+      hash_get (ifname_hash, ifp, hash_alloc_intern);
+    }
   else
     zlog_err("if_create(%s): corruption detected -- interface with this "
              "name exists already in VRF %u!", ifp->name, vrf_id);
@@ -163,6 +240,9 @@ void
 if_delete (struct interface *ifp)
 {
   listnode_delete (vrf_iflist (ifp->vrf_id), ifp);
+  if_index_hash_del (ifp);
+  if (hash_lookup (ifname_hash, ifp) == ifp)
+    hash_release (ifname_hash, ifp);
 
   if_delete_retain(ifp);
 
@@ -189,19 +269,41 @@ if_add_hook (int type, int (*func)(struct interface *ifp))
   }
 }
 
+/* Set the ifindex of an interface, which is looked up by it. */
+void
+if_set_index (struct interface *ifp, ifindex_t ifindex)
+{
+  if (ifp->ifindex == ifindex)
+    return;
+
+  if_index_hash_del (ifp);
+  ifp->ifindex = ifindex;
+  if_index_hash_add (ifp);
+}
+
 /* Interface existance check by index. */
 struct interface *
 if_lookup_by_index_vrf (ifindex_t ifindex, vrf_id_t vrf_id)
 {
   struct listnode *node;
   struct interface *ifp;
+  struct interface key;
 
-  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
+  /* Interfaces without an ifindex are not hashed by it. */
+  if (ifindex == IFINDEX_INTERNAL)
     {
-      if (ifp->ifindex == ifindex)
-	return ifp;
+      for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
+	if (ifp->ifindex == ifindex)
+	  return ifp;
+      return NULL;
     }
-  return NULL;
+
+  if (! ifindex_hash)
+    return NULL;
+
+  key.ifindex = ifindex;
+  key.vrf_id = vrf_id;
+  return hash_lookup (ifindex_hash, &key);
 }
 
 struct interface *
@@ -244,16 +346,10 @@ ifname2ifindex (const char *name)
 struct interface *
 if_lookup_by_name_vrf (const char *name, vrf_id_t vrf_id)
 {
-  struct listnode *node;
-  struct interface *ifp;
-  
-  if (name)
-    for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-      {
-        if (strcmp(name, ifp->name) == 0)
-          return ifp;
-      }
-  return NULL;
+  if (! name)
+    return NULL;
+
+  return if_lookup_by_name_len_vrf (name, strlen (name), vrf_id);
 }
 
 struct interface *
@@ -265,18 +361,15 @@ if_lookup_by_name (const char *name)
 struct interface *
 if_lookup_by_name_len_vrf (const char *name, size_t namelen, vrf_id_t vrf_id)
 {
-  struct listnode *node;
-  struct interface *ifp;
+  struct interface key;
 
-  if (namelen > INTERFACE_NAMSIZ)
+  if (namelen > INTERFACE_NAMSIZ || ! ifname_hash)
     return NULL;
 
-  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-    {
-      if (!memcmp(name, ifp->name, namelen) && (ifp->name[namelen] == '\0'))
-	return ifp;
-    }
-  return NULL;
+  memcpy (key.name, name, namelen);
+  key.name[namelen] = '\0';
+  key.vrf_id = vrf_id;
+  return hash_lookup (ifname_hash, &key);
 }
 
 struct interface *
@@ -289,26 +382,17 @@ if_lookup_by_name_len(const char *name, size_t namelen)
 struct interface *
 if_lookup_exact_address_vrf (struct in_addr src, vrf_id_t vrf_id)
 {
-  struct listnode *node;
-  struct listnode *cnode;
-  struct interface *ifp;
-  struct prefix *p;
+  struct prefix p;
+  struct list *matches;
   struct connected *c;
 
-  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-    {
-      for (ALL_LIST_ELEMENTS_RO (ifp->connected, cnode, c))
-	{
-	  p = c->address;
+  p.family = AF_INET;
+  p.prefixlen = IPV4_MAX_BITLEN;
+  p.u.prefix4 = src;
 
-	  if (p && p->family == AF_INET)
-	    {
-	      if (IPV4_ADDR_SAME (&p->u.prefix4, &src))
-		return ifp;
-	    }	      
-	}
-    }
-  return NULL;
+  matches = connected_match_address (&p, vrf_id);
+  c = matches ? listnode_head (matches) : NULL;
+  return c ? c->ifp : NULL;
 }
 
 struct interface *
@@ -321,34 +405,17 @@ if_lookup_exact_address (struct in_addr src)
 struct interface *
 if_lookup_address_vrf (struct in_addr src, vrf_id_t vrf_id)
 {
-  struct listnode *node;
   struct prefix addr;
-  int bestlen = 0;
-  struct listnode *cnode;
-  struct interface *ifp;
+  struct list *matches;
   struct connected *c;
-  struct interface *match;
 
   addr.family = AF_INET;
   addr.u.prefix4 = src;
   addr.prefixlen = IPV4_MAX_BITLEN;
 
-  match = NULL;
-
-  for (ALL_LIST_ELEMENTS_RO (vrf_iflist (vrf_id), node, ifp))
-    {
-      for (ALL_LIST_ELEMENTS_RO (ifp->connected, cnode, c))
-	{
-	  if (c->address && (c->address->family == AF_INET) &&
-	      prefix_match(CONNECTED_PREFIX(c), &addr) &&
-	      (c->address->prefixlen > bestlen))
-	    {
-	      bestlen = c->address->prefixlen;
-	      match = ifp;
-	    }
-	}
-    }
-  return match;
+  matches = connected_match_subnet (&addr, vrf_id);
+  c = matches ? listnode_head (matches) : NULL;
+  return c ? c->ifp : NULL;
 }
 
 struct interface *
@@ -795,10 +862,161 @@ connected_new (void)
   return XCALLOC (MTYPE_CONNECTED, sizeof (struct connected));
 }
 
+/* The connected addresses of the interfaces of a VRF, by subnet and by
+   address.  Each node holds the list of those at its prefix. */
+struct if_connected
+{
+  struct route_table *subnet[AFI_MAX];
+  struct route_table *address[AFI_MAX];
+};
+
+static void
+connected_index_node (struct route_table *table, struct prefix *p,
+                      struct connected *ifc, struct route_node **rnp)
+{
+  struct route_node *rn;
+
+  rn = route_node_get (table, p);
+  if (rn->info)
+    route_unlock_node (rn);
+  else
+    rn->info = list_new ();
+
+  listnode_add (rn->info, ifc);
+  *rnp = rn;
+}
+
+static void
+connected_unindex_node (struct connected *ifc, struct route_node **rnp)
+{
+  struct route_node *rn = *rnp;
+
+  if (! rn)
+    return;
+
+  listnode_delete (rn->info, ifc);
+  if (list_isempty ((struct list *) rn->info))
+    {
+      list_delete (rn->info);
+      rn->info = NULL;
+      route_unlock_node (rn);
+    }
+  *rnp = NULL;
+}
+
+/* Put the address in its VRF's index, under its prefix as it is now. */
+static void
+connected_index (struct connected *ifc)
+{
+  struct if_connected *conn;
+  struct prefix p;
+  afi_t afi;
+
+  if (! ifc->address || ! ifc->ifp || ifc->subnet_rn)
+    return;
+
+  afi = family2afi (ifc->address->family);
+  if (afi != AFI_IP && afi != AFI_IP6)
+    return;
+
+  conn = vrf_connected (ifc->ifp->vrf_id);
+  if (! conn)
+    return;
+
+  if (CONNECTED_PEER (ifc) && ! ifc->destination)
+    return;
+
+  prefix_copy (&p, CONNECTED_PREFIX (ifc));
+  apply_mask (&p);
+  connected_index_node (conn->subnet[afi], &p, ifc, &ifc->subnet_rn);
+
+  prefix_copy (&p, ifc->address);
+  p.prefixlen = (afi == AFI_IP) ? IPV4_MAX_BITLEN : IPV6_MAX_BITLEN;
+  connected_index_node (conn->address[afi], &p, ifc, &ifc->address_rn);
+}
+
+static void
+connected_unindex (struct connected *ifc)
+{
+  connected_unindex_node (ifc, &ifc->subnet_rn);
+  connected_unindex_node (ifc, &ifc->address_rn);
+}
+
+/* Add a connected address to the interface. */
+void
+connected_add (struct interface *ifp, struct connected *ifc)
+{
+  listnode_add (ifp->connected, ifc);
+  connected_index (ifc);
+}
+
+/* Take a connected address off the interface, without freeing it. */
+void
+connected_delete (struct interface *ifp, struct connected *ifc)
+{
+  listnode_delete (ifp->connected, ifc);
+  connected_unindex (ifc);
+}
+
+/* Index the connected address again after its address, destination or
+   flags changed. */
+void
+connected_reindex (struct connected *ifc)
+{
+  connected_unindex (ifc);
+  connected_index (ifc);
+}
+
+struct list *
+connected_match_subnet (struct prefix *p, vrf_id_t vrf_id)
+{
+  struct if_connected *conn;
+  struct route_node *rn;
+  afi_t afi;
+
+  afi = family2afi (p->family);
+  if ((afi != AFI_IP && afi != AFI_IP6) || ! (conn = vrf_connected (vrf_id)))
+    return NULL;
+
+  rn = route_node_match (conn->subnet[afi], p);
+  if (! rn)
+    return NULL;
+  route_unlock_node (rn);
+
+  if (rn->p.prefixlen == 0)
+    return NULL;
+  return rn->info;
+}
+
+struct list *
+connected_match_address (struct prefix *p, vrf_id_t vrf_id)
+{
+  struct if_connected *conn;
+  struct route_node *rn;
+  struct prefix host;
+  afi_t afi;
+
+  afi = family2afi (p->family);
+  if ((afi != AFI_IP && afi != AFI_IP6) || ! (conn = vrf_connected (vrf_id)))
+    return NULL;
+
+  prefix_copy (&host, p);
+  host.prefixlen = (afi == AFI_IP) ? IPV4_MAX_BITLEN : IPV6_MAX_BITLEN;
+
+  rn = route_node_lookup (conn->address[afi], &host);
+  if (! rn)
+    return NULL;
+  route_unlock_node (rn);
+
+  return rn->info;
+}
+
 /* Free connected structure. */
 void
 connected_free (struct connected *connected)
 {
+  connected_unindex (connected);
+
   if (connected->address)
     prefix_free (connected->address);
 
@@ -870,7 +1088,7 @@ connected_delete_by_prefix (struct interface *ifp, struct prefix *p)
 
       if (connected_same_prefix (ifc->address, p))
 	{
-	  listnode_delete (ifp->connected, ifc);
+	  connected_delete (ifp, ifc);
 	  return ifc;
 	}
     }
@@ -925,7 +1143,7 @@ connected_add_by_prefix (struct interface *ifp, struct prefix *p,
     }
 
   /* Add connected address to the interface. */
-  listnode_add (ifp->connected, ifc);
+  connected_add (ifp, ifc);
   return ifc;
 }
 
@@ -1043,10 +1261,44 @@ if_init (vrf_id_t vrf_id, struct list **intf_list)
 
   (*intf_list)->cmp = (int (*)(void *, void *))if_cmp_func;
 
+  if (! if_hash_users++)
+    {
+      ifname_hash = hash_create (if_name_hash_key, if_name_hash_cmp);
+      ifindex_hash = hash_create (if_index_hash_key, if_index_hash_cmp);
+    }
+
   if (vrf_id == VRF_DEFAULT)
     iflist = *intf_list;
 }
 
+void
+if_connected_init (struct if_connected **conn)
+{
+  afi_t afi;
+
+  *conn = XCALLOC (MTYPE_CONNECTED_INDEX, sizeof (struct if_connected));
+  for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+    {
+      (*conn)->subnet[afi] = route_table_init ();
+      (*conn)->address[afi] = route_table_init ();
+    }
+}
+
+/* After if_terminate, which took the addresses out. */
+void
+if_connected_terminate (struct if_connected **conn)
+{
+  afi_t afi;
+
+  for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+    {
+      route_table_finish ((*conn)->subnet[afi]);
+      route_table_finish ((*conn)->address[afi]);
+    }
+  XFREE (MTYPE_CONNECTED_INDEX, *conn);
+  *conn = NULL;
+}
+
 void
 if_terminate (vrf_id_t vrf_id, struct list **intf_list)
 {
@@ -1066,6 +1318,13 @@ if_terminate (vrf_id_t vrf_id, struct list **intf_list)
 
   if (vrf_id == VRF_DEFAULT)
     iflist = NULL;
+
+  if (! --if_hash_users)
+    {
+      hash_free (ifname_hash);
+      hash_free (ifindex_hash);
+      ifname_hash = ifindex_hash = NULL;
+    }
 }
 
 const char *
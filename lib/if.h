@@ -201,7 +201,8 @@ struct interface
   char name[INTERFACE_NAMSIZ + 1];
 
   /* Interface index (should be IFINDEX_INTERNAL for non-kernel or
-     deleted interfaces). */
+     deleted interfaces).  Set it with if_set_index, which keeps the
+     interface findable by it. */
   ifindex_t ifindex;
 #define IFINDEX_INTERNAL	0
 
@@ -299,6 +300,11 @@ struct connected
 
   /* Label for Linux 2.2.X and upper. */
   char *label;
+
+  /* Where the address is in its VRF's index of connected addresses,
+     by subnet and by address; see connected_add. */
+  struct route_node *subnet_rn;
+  struct route_node *address_rn;
 };
 
 /* Does the destination field contain a peer address? */
@@ -396,6 +402,9 @@ extern struct interface *if_get_by_name_len_vrf(const char *ifname,
                                 size_t namelen, vrf_id_t vrf_id);
 
 
+/* Set the ifindex of the interface, see struct interface. */
+extern void if_set_index (struct interface *, ifindex_t);
+
 /* Delete the interface, but do not free the structure, and leave it in the
    interface list.  It is often advisable to leave the pseudo interface 
    structure because there may be configuration information attached. */
@@ -415,6 +424,9 @@ extern int if_is_multicast (struct interface *);
 extern void if_add_hook (int, int (*)(struct interface *));
 extern void if_init (vrf_id_t, struct list **);
 extern void if_terminate (vrf_id_t, struct list **);
+struct if_connected;
+extern void if_connected_init (struct if_connected **);
+extern void if_connected_terminate (struct if_connected **);
 extern void if_dump_all (void);
 extern const char *if_flag_dump(unsigned long);
 extern const char *if_link_type_str (enum zebra_link_type);
@@ -435,6 +447,8 @@ extern ifindex_t ifname2ifindex_vrf(const char *ifname, vrf_id_t vrf_id);
 extern struct connected *connected_new (void);
 extern void connected_free (struct connected *);
 extern void connected_add (struct interface *, struct connected *);
+extern void connected_delete (struct interface *, struct connected *);
+extern void connected_reindex (struct connected *);
 extern struct connected  *connected_add_by_prefix (struct interface *,
                                             struct prefix *,
                                             struct prefix *);
@@ -443,6 +457,14 @@ extern struct connected  *connected_delete_by_prefix (struct interface *,
 extern struct connected  *connected_lookup_address (struct interface *, 
                                              struct in_addr);
 
+/* Look up the connected addresses of any interface of the VRF: those
+   whose subnet is the most specific to cover the given address, not
+   counting default routes, or those with the address itself.  The list
+   is the index's own, to be walked but not kept; NULL if there are
+   none. */
+extern struct list *connected_match_subnet (struct prefix *, vrf_id_t);
+extern struct list *connected_match_address (struct prefix *, vrf_id_t);
+
 #ifndef HAVE_IF_NAMETOINDEX
 extern ifindex_t if_nametoindex (const char *);
 #endif
@@ -899,6 +899,8 @@ static const struct zebra_desc_table command_types[] = {
   DESC_ENTRY	(ZEBRA_NEXTHOP_REGISTER),
   DESC_ENTRY	(ZEBRA_NEXTHOP_UNREGISTER),
   DESC_ENTRY	(ZEBRA_NEXTHOP_UPDATE),
+  DESC_ENTRY	(ZEBRA_ROUTE_BULK),
+  DESC_ENTRY	(ZEBRA_RING_SETUP),
 };
 #undef DESC_ENTRY
 
@@ -484,3 +484,17 @@ mtype_stats_alloc (int type)
 {
   return mstat[type].alloc;
 }
+
+/* Account for an object of a type carved out of memory allocated
+   otherwise, as by a memory pool. */
+void
+mtype_stats_inc (int type)
+{
+  alloc_inc (type);
+}
+
+void
+mtype_stats_dec (int type)
+{
+  alloc_dec (type);
+}
@@ -90,6 +90,10 @@ extern void log_memstats_stderr (const char *);
 /* return number of allocations outstanding for the type */
 extern unsigned long mtype_stats_alloc (int);
 
+/* count an object allocated or freed other than through the above */
+extern void mtype_stats_inc (int);
+extern void mtype_stats_dec (int);
+
 /* Human friendly string for given byte count */
 #define MTYPE_MEMSTR_LEN 20
 extern const char *mtype_memstr (char *, size_t, unsigned long);
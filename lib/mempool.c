@@ -0,0 +1,106 @@
+/*
+ * Pools of fixed-size objects.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "memory.h"
+#include "mempool.h"
+
+/* Objects are aligned for any member a structure may have. */
+#define MEMPOOL_ALIGN		8
+#define MEMPOOL_ROUND(S)	(((S) + MEMPOOL_ALIGN - 1) & ~(MEMPOOL_ALIGN - 1))
+
+struct mempool_chunk
+{
+  struct mempool_chunk *next;
+};
+
+/* Objects on the free list hold the next one. */
+struct mempool_free
+{
+  struct mempool_free *next;
+};
+
+/* Allocate a chunk and put all its objects on the free list. */
+static void
+mempool_grow (struct mempool *pool)
+{
+  struct mempool_chunk *chunk;
+  struct mempool_free *obj;
+  size_t size, offset;
+
+  size = MEMPOOL_ROUND (MAX (pool->size, sizeof (struct mempool_free)));
+  offset = MEMPOOL_ROUND (sizeof (struct mempool_chunk));
+  assert (offset + size <= MEMPOOL_CHUNK_SIZE);
+
+  chunk = XMALLOC (MTYPE_MEMPOOL_CHUNK, MEMPOOL_CHUNK_SIZE);
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+
+  for (; offset + size <= MEMPOOL_CHUNK_SIZE; offset += size)
+    {
+      obj = (struct mempool_free *) ((char *) chunk + offset);
+      obj->next = pool->free;
+      pool->free = obj;
+    }
+}
+
+void *
+mempool_alloc (struct mempool *pool)
+{
+  struct mempool_free *obj;
+
+  if (! pool->free)
+    mempool_grow (pool);
+
+  obj = pool->free;
+  pool->free = obj->next;
+
+  memset (obj, 0, pool->size);
+  mtype_stats_inc (pool->mtype);
+  return obj;
+}
+
+void
+mempool_free (struct mempool *pool, void *ptr)
+{
+  struct mempool_free *obj = ptr;
+
+  if (! obj)
+    return;
+
+  obj->next = pool->free;
+  pool->free = obj;
+  mtype_stats_dec (pool->mtype);
+}
+
+void
+mempool_finish (struct mempool *pool)
+{
+  struct mempool_chunk *chunk;
+
+  while ((chunk = pool->chunks) != NULL)
+    {
+      pool->chunks = chunk->next;
+      XFREE (MTYPE_MEMPOOL_CHUNK, chunk);
+    }
+  pool->free = NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * Pools of fixed-size objects.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_MEMPOOL_H
+#define _ZEBRA_MEMPOOL_H
+
+/* Bytes of each chunk objects are carved out of. */
+#define MEMPOOL_CHUNK_SIZE	65536
+
+struct mempool_chunk;
+
+/* Objects of one size, carved out of chunks which are allocated as
+   needed and kept until the pool is finished.  For structures which
+   exist in the millions, this saves the bookkeeping and rounding the
+   system allocator adds to each allocation.  Objects handed out are
+   counted against the memory type of the pool, so that they still show
+   up in "show memory".  Not thread safe. */
+struct mempool
+{
+  /* Memory type objects are accounted as, and their size. */
+  int mtype;
+  size_t size;
+
+  /* Chunks allocated, and the objects in them not handed out. */
+  struct mempool_chunk *chunks;
+  void *free;
+};
+
+#define MEMPOOL_INIT(T, S)	{ (T), (S), NULL, NULL }
+
+/* Zeroed object from the pool, and return one to it. */
+extern void *mempool_alloc (struct mempool *);
+extern void mempool_free (struct mempool *, void *);
+
+/* Release the chunks of a pool, none of whose objects may be in use. */
+extern void mempool_finish (struct mempool *);
+
+#endif /* _ZEBRA_MEMPOOL_H */
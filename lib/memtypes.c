@@ -27,6 +27,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_IF,			"Interface"			},
   { MTYPE_CONNECTED,		"Connected" 			},
   { MTYPE_CONNECTED_LABEL,	"Connected interface label"	},
+  { MTYPE_CONNECTED_INDEX,	"Connected address index"	},
   { MTYPE_BUFFER,		"Buffer"			},
   { MTYPE_BUFFER_DATA,		"Buffer data"			},
   { MTYPE_STREAM,		"Stream"			},
@@ -73,6 +74,8 @@ struct memory_list memory_list_lib[] =
   { MTYPE_VRF_NAME,		"VRF name"			},
   { MTYPE_VRF_BITMAP,		"VRF bit-map"			},
   { MTYPE_IF_LINK_PARAMS,       "Informational Link Parameters" },
+  { MTYPE_ZRING,		"Zserv shared memory ring"	},
+  { MTYPE_MEMPOOL_CHUNK,	"Memory pool chunk"		},
   { -1, NULL },
 };
 
@@ -88,7 +91,13 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_RIB_TABLE_INFO,	"RIB table info"		},
   { MTYPE_NETLINK_NAME,	"Netlink name"			},
   { MTYPE_NETLINK_RCVBUF,	"Netlink receive buffer"	},
+  { MTYPE_NETLINK_BATCH,	"Netlink route batch"		},
   { MTYPE_RNH,		        "Nexthop tracking object"	},
+  { MTYPE_ZSERV_PENDING,	"Pending redistribution"	},
+  { MTYPE_ZSERV_REPLAY,		"Redistribution replay"		},
+  { MTYPE_DPLANE_CTX,		"Dataplane route change"	},
+  { MTYPE_NHG,			"Nexthop group"			},
+  { MTYPE_RESOLVE,		"Nexthop resolution cache"	},
   { -1, NULL },
 };
 
@@ -120,6 +129,11 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
   { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
   { MTYPE_BGP_MPATH_INFO,	"BGP multipath info"		},
+  { MTYPE_BGP_UPDGRP,		"BGP update group"		},
+  { MTYPE_BGP_UPDGRP_PACKET,	"BGP update group packet"	},
+  { MTYPE_BGP_UPDGRP_ATTR,	"BGP update group attributes"	},
+  { MTYPE_BGP_IO,		"BGP I/O thread peer"		},
+  { MTYPE_BGP_ATTR_CACHE,	"BGP attribute parse cache"	},
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
@@ -129,13 +129,13 @@ copy_nexthops (struct nexthop **tnh, struct nexthop *nh)
   for (nh1 = nh; nh1; nh1 = nh1->next)
     {
       nexthop = nexthop_new();
-      nexthop->flags = nh->flags;
-      nexthop->type = nh->type;
-      nexthop->ifindex = nh->ifindex;
-      if (nh->ifname)
-	nexthop->ifname = XSTRDUP(0, nh->ifname);
-      memcpy(&(nexthop->gate), &(nh->gate), sizeof(union g_addr));
-      memcpy(&(nexthop->src), &(nh->src), sizeof(union g_addr));
+      nexthop->flags = nh1->flags;
+      nexthop->type = nh1->type;
+      nexthop->ifindex = nh1->ifindex;
+      if (nh1->ifname)
+	nexthop->ifname = XSTRDUP(0, nh1->ifname);
+      memcpy(&(nexthop->gate), &(nh1->gate), sizeof(union g_addr));
+      memcpy(&(nexthop->src), &(nh1->src), sizeof(union g_addr));
       nexthop_add(tnh, nexthop);
 
       if (CHECK_FLAG(nh1->flags, NEXTHOP_FLAG_RECURSIVE))
@@ -864,6 +864,47 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+static int
+route_map_uses_rule_depth (struct route_map *map,
+                           int (*func) (struct route_map_rule_cmd *),
+                           int depth)
+{
+  struct route_map_index *index;
+  struct route_map_rule *rule;
+
+  if (map == NULL)
+    return 0;
+
+  /* Too deep for route_map_apply to get there either, but do not
+     claim to know. */
+  if (depth > RMAP_RECURSION_LIMIT)
+    return 1;
+
+  for (index = map->head; index; index = index->next)
+    {
+      for (rule = index->match_list.head; rule; rule = rule->next)
+        if ((*func) (rule->cmd))
+          return 1;
+      for (rule = index->set_list.head; rule; rule = rule->next)
+        if ((*func) (rule->cmd))
+          return 1;
+      if (index->nextrm
+          && route_map_uses_rule_depth (route_map_lookup_by_name (index->nextrm),
+                                        func, depth + 1))
+        return 1;
+    }
+  return 0;
+}
+
+/* Does a match or set rule of the route map, or of one it calls,
+   satisfy the function? */
+int
+route_map_uses_rule (struct route_map *map,
+                     int (*func) (struct route_map_rule_cmd *))
+{
+  return route_map_uses_rule_depth (map, func, 0);
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
@@ -194,6 +194,11 @@ extern route_map_result_t route_map_apply (struct route_map *map,
                                            route_map_object_t object_type,
                                            void *object);
 
+/* Does a match or set rule of the route map, or of one it calls,
+   satisfy the function? */
+extern int route_map_uses_rule (struct route_map *map,
+                                int (*func) (struct route_map_rule_cmd *));
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
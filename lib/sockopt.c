@@ -567,6 +567,25 @@ sockopt_tcp_rtt (int sock)
 #endif
 }
 
+/* Bytes which can still be queued on the socket without blocking, or
+   -1 where the system can't tell. */
+int
+sockopt_send_space (int sock)
+{
+#ifdef SIOCOUTQ
+  int size, queued;
+  socklen_t len = sizeof (size);
+
+  if (getsockopt (sock, SOL_SOCKET, SO_SNDBUF, &size, &len) != 0
+      || ioctl (sock, SIOCOUTQ, &queued) != 0)
+    return -1;
+
+  return size > queued ? size - queued : 0;
+#else
+  return -1;
+#endif
+}
+
 int
 sockopt_tcp_signature (int sock, union sockunion *su, const char *password)
 {
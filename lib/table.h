@@ -79,14 +79,16 @@ struct route_table
   struct route_node *parent;			\
   struct route_node *link[2];			\
 						\
-  /* Lock of this radix */			\
-  unsigned int lock;				\
-						\
   /* Each node of route. */			\
   void *info;					\
 						\
   /* Aggregation. */				\
-  void *aggregate;
+  void *aggregate;				\
+						\
+  /* Lock of this radix.  Last, so that small	\
+     fields of a structure embedding these	\
+     fill the padding after it. */		\
+  unsigned int lock;
 
 
 /* Each routing entry. */
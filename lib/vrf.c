@@ -101,6 +101,9 @@ struct vrf
   /* Master list of interfaces belonging to this VRF */
   struct list *iflist;
 
+  /* Their connected addresses, by prefix */
+  struct if_connected *connected;
+
   /* User data */
   void *info;
 };
@@ -155,6 +158,7 @@ vrf_get (vrf_id_t vrf_id)
 
   /* Initialize interfaces. */
   if_init (vrf_id, &vrf->iflist);
+  if_connected_init (&vrf->connected);
 
   zlog_info ("VRF %u is created.", vrf_id);
 
@@ -176,6 +180,7 @@ vrf_delete (struct vrf *vrf)
     (*vrf_master.vrf_delete_hook) (vrf->vrf_id, &vrf->info);
 
   if_terminate (vrf->vrf_id, &vrf->iflist);
+  if_connected_terminate (&vrf->connected);
 
   if (vrf->name)
     XFREE (MTYPE_VRF_NAME, vrf->name);
@@ -417,6 +422,14 @@ vrf_iflist_get (vrf_id_t vrf_id)
    return vrf->iflist;
 }
 
+/* Look up the connected address index in a VRF. */
+struct if_connected *
+vrf_connected (vrf_id_t vrf_id)
+{
+   struct vrf * vrf = vrf_lookup (vrf_id);
+   return vrf ? vrf->connected : NULL;
+}
+
 /*
  * VRF bit-map
  */
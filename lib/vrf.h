@@ -108,6 +108,9 @@ extern void *vrf_info_lookup (vrf_id_t);
 extern struct list *vrf_iflist (vrf_id_t);
 /* Get the interface list of the specified VRF. Create one if not find. */
 extern struct list *vrf_iflist_get (vrf_id_t);
+/* Look up the index of the connected addresses of the specified VRF. */
+struct if_connected;
+extern struct if_connected *vrf_connected (vrf_id_t);
 
 /*
  * VRF bit-map: maintaining flags, one bit per VRF ID
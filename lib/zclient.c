@@ -32,9 +32,10 @@
 #include "zclient.h"
 #include "memory.h"
 #include "table.h"
+#include "zring.h"
 
 /* Zebra client events. */
-enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
+enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_PROCESS, ZCLIENT_CONNECT};
 
 /* Prototype for event manager. */
 static void zclient_event (enum event, struct zclient *);
@@ -51,8 +52,10 @@ zclient_new (struct thread_master *master)
   struct zclient *zclient;
   zclient = XCALLOC (MTYPE_ZCLIENT, sizeof (struct zclient));
 
+  zclient->rbuf = stream_new (ZEBRA_READ_BUF_SIZ);
   zclient->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->bulk = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->wb = buffer_new(0);
   zclient->master = master;
 
@@ -67,10 +70,14 @@ zclient_new (struct thread_master *master)
 void
 zclient_free (struct zclient *zclient)
 {
+  if (zclient->rbuf)
+    stream_free(zclient->rbuf);
   if (zclient->ibuf)
     stream_free(zclient->ibuf);
   if (zclient->obuf)
     stream_free(zclient->obuf);
+  if (zclient->bulk)
+    stream_free(zclient->bulk);
   if (zclient->wb)
     buffer_free(zclient->wb);
 
@@ -121,14 +128,28 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_bulk);
 
   /* Reset streams. */
+  stream_reset(zclient->rbuf);
   stream_reset(zclient->ibuf);
   stream_reset(zclient->obuf);
+  stream_reset(zclient->bulk);
+
+  /* Capabilities are renegotiated on the next connection. */
+  zclient->capabilities = 0;
 
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
 
+#ifdef HAVE_ZAPI_RING
+  if (zclient->ring)
+    {
+      zring_free (zclient->ring);
+      zclient->ring = NULL;
+    }
+#endif /* HAVE_ZAPI_RING */
+
   /* Close socket. */
   if (zclient->sock >= 0)
     {
@@ -278,16 +299,103 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+#ifdef HAVE_ZAPI_RING
+static int zclient_ring_flush (struct thread *);
+
+static ssize_t
+zclient_ring_put (void *arg, const struct iovec *iov, int iovcnt)
 {
-  if (zclient->sock < 0)
+  struct zclient *zclient = arg;
+
+  return zring_writev (zclient->ring, iov, iovcnt);
+}
+
+/* The ring is full: wait for zebra to make room. */
+static void
+zclient_ring_wait (struct zclient *zclient)
+{
+  THREAD_OFF(zclient->t_write);
+  if (zring_producer_sleep (zclient->ring))
+    zclient->t_write = thread_add_read (zclient->master, zclient_ring_flush,
+                                        zclient, zclient->ring->space_efd);
+  else
+    zclient->t_write = thread_add_event (zclient->master, zclient_ring_flush,
+                                         zclient, 0);
+}
+
+static int
+zclient_ring_flush (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG(thread);
+
+  zclient->t_write = NULL;
+  if (zclient->sock < 0 || ! zclient->ring)
     return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+
+  zring_doorbell_clear (zclient->ring->space_efd);
+  if (buffer_flush_func (zclient->wb, zclient_ring_put, zclient)
+      == BUFFER_PENDING)
+    zclient_ring_wait (zclient);
+  return 0;
+}
+
+/* Offer zebra the shared memory ring for the rest of this connection.
+   Everything written before this went over the socket, so only switch
+   while nothing is queued there. */
+static int
+zclient_ring_start (struct zclient *zclient)
+{
+  struct stream *s = zclient->obuf;
+  struct zring *ring;
+  ssize_t nbyte;
+
+  if (stream_get_endp (zclient->bulk) || ! buffer_empty (zclient->wb))
+    return -1;
+
+  if (! (ring = zring_create (0)))
+    return -1;
+
+  stream_reset (s);
+  zclient_create_header (s, ZEBRA_RING_SETUP, VRF_DEFAULT);
+  nbyte = zring_send_fds (zclient->sock, STREAM_DATA (s),
+                          stream_get_endp (s), ring);
+  if (nbyte != (ssize_t) stream_get_endp (s))
+    {
+      zring_free (ring);
+      if (nbyte > 0)
+        {
+          zlog_warn ("%s: short write to zclient fd %d, closing",
+                     __func__, zclient->sock);
+          zclient_failed (zclient);
+        }
+      return -1;
+    }
+
+  if (zclient_debug)
+    zlog_debug ("zclient using shared memory ring");
+  zclient->ring = ring;
+  return 0;
+}
+#endif /* HAVE_ZAPI_RING */
+
+static int
+zclient_writev (struct zclient *zclient, struct iovec *iov, int iovcnt)
+{
+#ifdef HAVE_ZAPI_RING
+  if (zclient->ring)
+    {
+      if (buffer_writev_func (zclient->wb, zclient_ring_put, zclient,
+                              iov, iovcnt) == BUFFER_PENDING
+          && ! zclient->t_write)
+        zclient_ring_wait (zclient);
+      return 0;
+    }
+#endif /* HAVE_ZAPI_RING */
+
+  switch (buffer_writev(zclient->wb, zclient->sock, iov, iovcnt))
     {
     case BUFFER_ERROR:
-      zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
+      zlog_warn("%s: buffer_writev failed to zclient fd %d, closing",
       		 __func__, zclient->sock);
       return zclient_failed(zclient);
       break;
@@ -302,6 +410,88 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+/* Send the pending ZEBRA_ROUTE_BULK message, if any. */
+static int
+zclient_bulk_flush (struct zclient *zclient)
+{
+  struct iovec iov;
+  int ret;
+
+  THREAD_OFF(zclient->t_bulk);
+  if (zclient->sock < 0)
+    return -1;
+  if (! stream_get_endp (zclient->bulk))
+    return 0;
+
+  iov.iov_base = STREAM_DATA(zclient->bulk);
+  iov.iov_len = stream_get_endp(zclient->bulk);
+  ret = zclient_writev (zclient, &iov, 1);
+  stream_reset (zclient->bulk);
+  return ret;
+}
+
+static int
+zclient_bulk_flush_event (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_bulk = NULL;
+  return zclient_bulk_flush (zclient);
+}
+
+int
+zclient_send_message(struct zclient *zclient)
+{
+  struct iovec iov[2];
+  int iovcnt = 0;
+  int ret;
+
+  if (zclient->sock < 0)
+    return -1;
+
+  /* Routes coalesced so far must reach zebra ahead of this message. */
+  if (stream_get_endp (zclient->bulk))
+    {
+      THREAD_OFF(zclient->t_bulk);
+      iov[iovcnt].iov_base = STREAM_DATA(zclient->bulk);
+      iov[iovcnt++].iov_len = stream_get_endp(zclient->bulk);
+    }
+  iov[iovcnt].iov_base = STREAM_DATA(zclient->obuf);
+  iov[iovcnt++].iov_len = stream_get_endp(zclient->obuf);
+
+  ret = zclient_writev (zclient, iov, iovcnt);
+  stream_reset (zclient->bulk);
+  return ret;
+}
+
+/* Send the route message in zclient->obuf, whose prefix starts at
+   prefix_offset.  If zebra accepts ZEBRA_ROUTE_BULK, the route is
+   coalesced with any preceding routes that share its attributes, and the
+   bulk message goes out at the end of the current event. */
+static int
+zclient_send_route (struct zclient *zclient, size_t prefix_offset)
+{
+  if (zclient->sock < 0)
+    return -1;
+
+  if (! CHECK_FLAG (zclient->capabilities, ZEBRA_CAPA_ROUTE_BULK))
+    return zclient_send_message (zclient);
+
+  if (zapi_bulk_append (zclient->bulk, zclient->obuf, prefix_offset) < 0)
+    {
+      /* Attributes differ or the bulk message is full. */
+      if (zclient_bulk_flush (zclient) < 0)
+        return -1;
+      if (zapi_bulk_append (zclient->bulk, zclient->obuf, prefix_offset) < 0)
+        return zclient_send_message (zclient);
+    }
+
+  if (! zclient->t_bulk)
+    zclient->t_bulk = thread_add_event (zclient->master,
+                                        zclient_bulk_flush_event, zclient, 0);
+  return 0;
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command, vrf_id_t vrf_id)
 {
@@ -339,6 +529,168 @@ zclient_read_header (struct stream *s, int sock, u_int16_t *size, u_char *marker
   return 0;
 }
 
+/*
+ * ZEBRA_ROUTE_BULK carries many route messages of the same command whose
+ * bodies differ only in the prefix.  The body bytes before and after the
+ * prefix are sent once, followed by the list of prefixes:
+ *
+ *  0 1 2 3 4 5 6 7 8 9 A B C D E F 0 1 2 3 4 5 6 7 8 9 A B C D E F
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |         Command (2)           | Head length   |   Head ...    |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |         Tail length (2)       |   Tail ...                    |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |         Count (2)             | Prefix length | Prefix ...    |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * The receiver rebuilds each route message as head, prefix length,
+ * prefix and tail, and handles it exactly as if it had arrived on its
+ * own.  Command is one of ZEBRA_IPV{4,6}_ROUTE_{ADD,DELETE}.
+ */
+
+/* Append the route message in msg (including its header) to the bulk
+   message being built in bulk.  Returns -1 if the route cannot join it,
+   because its command, VRF or attributes differ, or there is no room. */
+int
+zapi_bulk_append (struct stream *bulk, struct stream *msg,
+                  size_t prefix_offset)
+{
+  u_char *m = STREAM_DATA (msg);
+  size_t mlen = stream_get_endp (msg);
+  size_t head_len, tail, tail_len, psize, countp;
+  u_int16_t command, count;
+  vrf_id_t vrf_id;
+
+  if (prefix_offset < ZEBRA_HEADER_SIZE || prefix_offset >= mlen)
+    return -1;
+
+  psize = PSIZE (m[prefix_offset]);
+  tail = prefix_offset + 1 + psize;
+  if (tail > mlen)
+    return -1;
+  head_len = prefix_offset - ZEBRA_HEADER_SIZE;
+  tail_len = mlen - tail;
+  if (head_len > UCHAR_MAX)
+    return -1;
+
+  vrf_id = stream_getw_from (msg, 4);
+  command = stream_getw_from (msg, 6);
+
+  if (stream_get_endp (bulk) == 0)
+    {
+      if (ZEBRA_HEADER_SIZE + 7 + head_len + tail_len + 1 + psize
+          > STREAM_SIZE (bulk))
+        return -1;
+      zclient_create_header (bulk, ZEBRA_ROUTE_BULK, vrf_id);
+      stream_putw (bulk, command);
+      stream_putc (bulk, head_len);
+      stream_put (bulk, m + ZEBRA_HEADER_SIZE, head_len);
+      stream_putw (bulk, tail_len);
+      stream_put (bulk, m + tail, tail_len);
+      stream_putw (bulk, 0);
+    }
+  else
+    {
+      u_char *b = STREAM_DATA (bulk);
+      size_t bhead = ZEBRA_HEADER_SIZE + 3;
+
+      if (stream_getw_from (bulk, 4) != vrf_id
+          || stream_getw_from (bulk, ZEBRA_HEADER_SIZE) != command
+          || b[ZEBRA_HEADER_SIZE + 2] != head_len
+          || memcmp (b + bhead, m + ZEBRA_HEADER_SIZE, head_len)
+          || stream_getw_from (bulk, bhead + head_len) != tail_len
+          || memcmp (b + bhead + head_len + 2, m + tail, tail_len))
+        return -1;
+      if (STREAM_WRITEABLE (bulk) < 1 + psize)
+        return -1;
+    }
+
+  countp = ZEBRA_HEADER_SIZE + 5 + head_len + tail_len;
+  count = stream_getw_from (bulk, countp);
+  if (count == UINT16_MAX)
+    return -1;
+
+  stream_put (bulk, m + prefix_offset, 1 + psize);
+  stream_putw_at (bulk, countp, count + 1);
+  stream_putw_at (bulk, 0, stream_get_endp (bulk));
+  return 0;
+}
+
+/* Start walking a ZEBRA_ROUTE_BULK body of the given length, read from
+   the current position of s. */
+int
+zapi_bulk_iter_init (struct zapi_bulk_iter *it, struct stream *s,
+                     u_int16_t length)
+{
+  it->end = stream_get_getp (s) + length;
+  if (length < 7)
+    return -1;
+
+  it->command = stream_getw (s);
+  switch (it->command)
+    {
+    case ZEBRA_IPV4_ROUTE_ADD:
+    case ZEBRA_IPV4_ROUTE_DELETE:
+    case ZEBRA_IPV6_ROUTE_ADD:
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      break;
+    default:
+      return -1;
+    }
+
+  it->head_len = stream_getc (s);
+  it->head = stream_get_getp (s);
+  if (it->head + it->head_len + 2 > it->end)
+    return -1;
+  stream_forward_getp (s, it->head_len);
+
+  it->tail_len = stream_getw (s);
+  it->tail = stream_get_getp (s);
+  if (it->tail + it->tail_len + 2 > it->end)
+    return -1;
+  stream_forward_getp (s, it->tail_len);
+
+  it->count = stream_getw (s);
+  it->index = 0;
+  return 0;
+}
+
+/* Rebuild the next route message body of the bulk message into msg, with
+   msg's getp at the start of the body.  Returns 1 if a message was built,
+   0 at the end of the bulk message, and -1 if it is malformed. */
+int
+zapi_bulk_iter_next (struct zapi_bulk_iter *it, struct stream *bulk,
+                     struct stream *msg)
+{
+  u_char plen, maxlen;
+  size_t psize;
+
+  if (it->index >= it->count)
+    return 0;
+
+  if (stream_get_getp (bulk) + 1 > it->end)
+    return -1;
+  plen = stream_getc (bulk);
+  maxlen = (it->command == ZEBRA_IPV4_ROUTE_ADD
+            || it->command == ZEBRA_IPV4_ROUTE_DELETE)
+           ? IPV4_MAX_BITLEN : IPV6_MAX_BITLEN;
+  psize = PSIZE (plen);
+  if (plen > maxlen || stream_get_getp (bulk) + psize > it->end)
+    return -1;
+  if (it->head_len + 1 + psize + it->tail_len > STREAM_SIZE (msg))
+    return -1;
+
+  stream_reset (msg);
+  stream_put (msg, STREAM_DATA (bulk) + it->head, it->head_len);
+  stream_putc (msg, plen);
+  stream_put (msg, STREAM_PNT (bulk), psize);
+  stream_forward_getp (bulk, psize);
+  stream_put (msg, STREAM_DATA (bulk) + it->tail, it->tail_len);
+
+  it->index++;
+  return 1;
+}
+
 /* Send simple Zebra message. */
 static int
 zebra_message_send (struct zclient *zclient, int command, vrf_id_t vrf_id)
@@ -368,6 +720,8 @@ zebra_hello_send (struct zclient *zclient)
       /* The VRF ID in the HELLO message is always 0. */
       zclient_create_header (s, ZEBRA_HELLO, VRF_DEFAULT);
       stream_putc (s, zclient->redist_default);
+      /* Zebra answers with the subset of these it also supports. */
+      stream_putc (s, ZEBRA_CAPA_SUPPORTED);
       stream_putw_at (s, 0, stream_get_endp (s));
       return zclient_send_message(zclient);
     }
@@ -540,6 +894,7 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
 {
   int i;
   int psize;
+  size_t prefix_offset;
   struct stream *s;
 
   /* Reset stream. */
@@ -556,6 +911,7 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
 
   /* Put prefix information. */
   psize = PSIZE (p->prefixlen);
+  prefix_offset = stream_get_endp (s);
   stream_putc (s, p->prefixlen);
   stream_write (s, (u_char *) & p->prefix, psize);
 
@@ -596,7 +952,7 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zclient_send_message(zclient);
+  return zclient_send_route (zclient, prefix_offset);
 }
 
 #ifdef HAVE_IPV6
@@ -606,6 +962,7 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
 {
   int i;
   int psize;
+  size_t prefix_offset;
   struct stream *s;
 
   /* Reset stream. */
@@ -622,6 +979,7 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
   
   /* Put prefix information. */
   psize = PSIZE (p->prefixlen);
+  prefix_offset = stream_get_endp (s);
   stream_putc (s, p->prefixlen);
   stream_write (s, (u_char *)&p->prefix, psize);
 
@@ -654,7 +1012,7 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zclient_send_message(zclient);
+  return zclient_send_route (zclient, prefix_offset);
 }
 #endif /* HAVE_IPV6 */
 
@@ -863,7 +1221,7 @@ zebra_interface_if_set_value (struct stream *s, struct interface *ifp)
   u_char link_params_status = 0;
 
   /* Read interface's index. */
-  ifp->ifindex = stream_getl (s);
+  if_set_index (ifp, stream_getl (s));
   ifp->status = stream_getc (s);
 
   /* Read interface's value. */
@@ -1030,6 +1388,7 @@ zebra_interface_address_read (int type, struct stream *s, vrf_id_t vrf_id)
 		    prefix2str (ifc->address, buf, sizeof buf));
 	       UNSET_FLAG(ifc->flags, ZEBRA_IFA_PEER);
 	     }
+	   connected_reindex (ifc);
 	 }
     }
   else
@@ -1042,102 +1401,13 @@ zebra_interface_address_read (int type, struct stream *s, vrf_id_t vrf_id)
 }
 
 
-/* Zebra client message read function. */
-static int
-zclient_read (struct thread *thread)
-{
-  size_t already;
-  uint16_t length, command;
-  uint8_t marker, version;
-  vrf_id_t vrf_id;
-  struct zclient *zclient;
-
-  /* Get socket to zebra. */
-  zclient = THREAD_ARG (thread);
-  zclient->t_read = NULL;
-
-  /* Read zebra header (if we don't have it already). */
-  if ((already = stream_get_endp(zclient->ibuf)) < ZEBRA_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (zclient_debug)
-	   zlog_debug ("zclient connection closed socket [%d].", zclient->sock);
-	  return zclient_failed(zclient);
-	}
-      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zclient_event (ZCLIENT_READ, zclient);
-	  return 0;
-	}
-      already = ZEBRA_HEADER_SIZE;
-    }
-
-  /* Reset to read from the beginning of the incoming packet. */
-  stream_set_getp(zclient->ibuf, 0);
-
-  /* Fetch header values. */
-  length = stream_getw (zclient->ibuf);
-  marker = stream_getc (zclient->ibuf);
-  version = stream_getc (zclient->ibuf);
-  vrf_id = stream_getw (zclient->ibuf);
-  command = stream_getw (zclient->ibuf);
-  
-  if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, zclient->sock, marker, version);
-      return zclient_failed(zclient);
-    }
-  
-  if (length < ZEBRA_HEADER_SIZE) 
-    {
-      zlog_err("%s: socket %d message length %u is less than %d ",
-	       __func__, zclient->sock, length, ZEBRA_HEADER_SIZE);
-      return zclient_failed(zclient);
-    }
-
-  /* Length check. */
-  if (length > STREAM_SIZE(zclient->ibuf))
-    {
-      struct stream *ns;
-      zlog_warn("%s: message size %u exceeds buffer size %lu, expanding...",
-	        __func__, length, (u_long)STREAM_SIZE(zclient->ibuf));
-      ns = stream_new(length);
-      stream_copy(ns, zclient->ibuf);
-      stream_free (zclient->ibuf);
-      zclient->ibuf = ns;
-    }
-
-  /* Read rest of zebra packet. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try(zclient->ibuf, zclient->sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (zclient_debug)
-	    zlog_debug("zclient connection closed socket [%d].", zclient->sock);
-	  return zclient_failed(zclient);
-	}
-      if (nbyte != (ssize_t)(length-already))
-	{
-	  /* Try again later. */
-	  zclient_event (ZCLIENT_READ, zclient);
-	  return 0;
-	}
-    }
-
-  length -= ZEBRA_HEADER_SIZE;
-
-  if (zclient_debug)
-    zlog_debug("zclient 0x%p command 0x%x VRF %u\n", (void *)zclient, command, vrf_id);
+static int zclient_read_bulk (struct zclient *, uint16_t, vrf_id_t);
 
+/* Hand one message in zclient->ibuf to the daemon's callback. */
+static void
+zclient_dispatch (struct zclient *zclient, uint16_t command, uint16_t length,
+                  vrf_id_t vrf_id)
+{
   switch (command)
     {
     case ZEBRA_ROUTER_ID_UPDATE:
@@ -1191,21 +1461,181 @@ zclient_read (struct thread *thread)
       if (zclient->nexthop_update)
 	(*zclient->nexthop_update) (command, zclient, length, vrf_id);
       break;
+    case ZEBRA_HELLO:
+      if (length >= 1)
+        zclient->capabilities = stream_getc (zclient->ibuf)
+                                & ZEBRA_CAPA_SUPPORTED;
+#ifdef HAVE_ZAPI_RING
+      if (CHECK_FLAG (zclient->capabilities, ZEBRA_CAPA_SHM_RING)
+          && zclient_ring_start (zclient) < 0)
+        UNSET_FLAG (zclient->capabilities, ZEBRA_CAPA_SHM_RING);
+#endif /* HAVE_ZAPI_RING */
+      if (zclient_debug)
+        zlog_debug ("zclient capabilities 0x%x", zclient->capabilities);
+      break;
+    case ZEBRA_ROUTE_BULK:
+      zclient_read_bulk (zclient, length, vrf_id);
+      break;
     default:
       break;
     }
 
+}
+
+/* Split a ZEBRA_ROUTE_BULK message into its route messages and dispatch
+   each one in turn, as if it had been read on its own. */
+static int
+zclient_read_bulk (struct zclient *zclient, uint16_t length, vrf_id_t vrf_id)
+{
+  struct zapi_bulk_iter it;
+  struct stream *bulk = zclient->ibuf;
+  struct stream *msg;
+  int ret;
+
+  if (zapi_bulk_iter_init (&it, bulk, length) < 0)
+    {
+      zlog_err ("%s: socket %d malformed bulk message", __func__,
+                zclient->sock);
+      return -1;
+    }
+
+  msg = stream_new (STREAM_SIZE (bulk));
+  zclient->ibuf = msg;
+  while ((ret = zapi_bulk_iter_next (&it, bulk, msg)) > 0)
+    {
+      zclient_dispatch (zclient, it.command, stream_get_endp (msg), vrf_id);
+      if (zclient->sock < 0)
+        break;
+    }
+  zclient->ibuf = bulk;
+  stream_free (msg);
+
+  /* zclient_stop only reset the stream we swapped in. */
   if (zclient->sock < 0)
-    /* Connection was closed during packet processing. */
-    return -1;
+    stream_reset (bulk);
 
-  /* Register read thread. */
-  stream_reset(zclient->ibuf);
-  zclient_event (ZCLIENT_READ, zclient);
+  if (ret < 0)
+    zlog_err ("%s: socket %d malformed bulk message", __func__,
+              zclient->sock);
+  return ret;
+}
 
+/* Handle the complete messages waiting in zclient->rbuf, at most
+   ZEBRA_READ_MSG_BUDGET of them, then wait for more data or, if the
+   budget ran out, come back after other threads have had a turn. */
+static int
+zclient_process (struct zclient *zclient)
+{
+  struct stream *rbuf = zclient->rbuf;
+  int budget = ZEBRA_READ_MSG_BUDGET;
+  size_t getp;
+  uint16_t length, command;
+  uint8_t marker, version;
+  vrf_id_t vrf_id;
+
+  while (STREAM_READABLE (rbuf) >= ZEBRA_HEADER_SIZE)
+    {
+      if (budget-- == 0)
+        {
+          /* More messages are ready, but let other threads run first. */
+          zclient_event (ZCLIENT_PROCESS, zclient);
+          return 0;
+        }
+
+      /* Fetch header values. */
+      getp = stream_get_getp (rbuf);
+      length = stream_getw_from (rbuf, getp);
+      marker = stream_getc_from (rbuf, getp + 2);
+      version = stream_getc_from (rbuf, getp + 3);
+      vrf_id = stream_getw_from (rbuf, getp + 4);
+      command = stream_getw_from (rbuf, getp + 6);
+
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
+        {
+          zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+                   __func__, zclient->sock, marker, version);
+          return zclient_failed(zclient);
+        }
+
+      if (length < ZEBRA_HEADER_SIZE) 
+        {
+          zlog_err("%s: socket %d message length %u is less than %d ",
+                   __func__, zclient->sock, length, ZEBRA_HEADER_SIZE);
+          return zclient_failed(zclient);
+        }
+
+      /* Wait for the rest of this message. */
+      if (STREAM_READABLE (rbuf) < length)
+        break;
+
+      stream_forward_getp (rbuf, ZEBRA_HEADER_SIZE);
+      length -= ZEBRA_HEADER_SIZE;
+
+      /* Length check. */
+      if (length > STREAM_SIZE(zclient->ibuf))
+        {
+          zlog_warn("%s: message size %u exceeds buffer size %lu, expanding...",
+                    __func__, length, (u_long)STREAM_SIZE(zclient->ibuf));
+          stream_free (zclient->ibuf);
+          zclient->ibuf = stream_new(length);
+        }
+
+      /* Hand the body to the callbacks on its own. */
+      stream_reset (zclient->ibuf);
+      stream_put (zclient->ibuf, STREAM_PNT (rbuf), length);
+      stream_forward_getp (rbuf, length);
+
+      if (zclient_debug)
+        zlog_debug("zclient 0x%p command 0x%x VRF %u\n", (void *)zclient, command, vrf_id);
+
+      zclient_dispatch (zclient, command, length, vrf_id);
+
+      if (zclient->sock < 0)
+        /* Connection was closed during packet processing. */
+        return -1;
+    }
+
+  /* Keep any partial message at the front of the buffer. */
+  stream_discard (rbuf);
+  zclient_event (ZCLIENT_READ, zclient);
   return 0;
 }
 
+static int
+zclient_process_event (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_read = NULL;
+  if (zclient->sock < 0)
+    return -1;
+  return zclient_process (zclient);
+}
+
+/* Zebra client message read function. */
+static int
+zclient_read (struct thread *thread)
+{
+  struct zclient *zclient;
+  ssize_t nbyte;
+
+  /* Get socket to zebra. */
+  zclient = THREAD_ARG (thread);
+  zclient->t_read = NULL;
+
+  /* Read whatever the socket has for us, as many messages as fit. */
+  nbyte = stream_read_try (zclient->rbuf, zclient->sock,
+                           STREAM_WRITEABLE (zclient->rbuf));
+  if (nbyte == 0 || nbyte == -1)
+    {
+      if (zclient_debug)
+        zlog_debug ("zclient connection closed socket [%d].", zclient->sock);
+      return zclient_failed(zclient);
+    }
+
+  return zclient_process (zclient);
+}
+
 void
 zclient_redistribute (int command, struct zclient *zclient, int type,
     vrf_id_t vrf_id)
@@ -1276,6 +1706,10 @@ zclient_event (enum event event, struct zclient *zclient)
       zclient->t_read = 
 	thread_add_read (zclient->master, zclient_read, zclient, zclient->sock);
       break;
+    case ZCLIENT_PROCESS:
+      zclient->t_read =
+	thread_add_event (zclient->master, zclient_process_event, zclient, 0);
+      break;
     }
 }
 
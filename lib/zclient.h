@@ -37,6 +37,12 @@
 /* Zebra header size. */
 #define ZEBRA_HEADER_SIZE             8
 
+/* Socket read buffer, large enough for any message. */
+#define ZEBRA_READ_BUF_SIZ            65536
+
+/* Messages handled per read wakeup before yielding to other threads. */
+#define ZEBRA_READ_MSG_BUDGET         256
+
 /* Structure for the zebra client. */
 struct zclient
 {
@@ -53,6 +59,9 @@ struct zclient
   /* Connection failure count. */
   int fail;
 
+  /* Data read from zebra but not yet handled. */
+  struct stream *rbuf;
+
   /* Input buffer for zebra message. */
   struct stream *ibuf;
 
@@ -69,6 +78,18 @@ struct zclient
   /* Thread to write buffered data to zebra. */
   struct thread *t_write;
 
+  /* Capabilities agreed with zebra in the HELLO exchange. */
+  u_char capabilities;
+
+  /* Pending ZEBRA_ROUTE_BULK message and the event which flushes it. */
+  struct stream *bulk;
+  struct thread *t_bulk;
+
+  /* Shared memory ring carrying our messages to zebra, if agreed.  While
+     it is in use, wb holds whatever did not fit and t_write waits for
+     zebra to make room. */
+  struct zring *ring;
+
   /* Redistribute information. */
   u_char redist_default;
   vrf_bitmap_t redist[ZEBRA_ROUTE_MAX];
@@ -101,6 +122,15 @@ struct zclient
 #define ZAPI_MESSAGE_MTU      0x10
 #define ZAPI_MESSAGE_TAG      0x20
 
+/* Zserv capability flags, exchanged in ZEBRA_HELLO. */
+#define ZEBRA_CAPA_ROUTE_BULK 0x01
+#define ZEBRA_CAPA_SHM_RING   0x02
+#ifdef HAVE_ZAPI_RING
+#define ZEBRA_CAPA_SUPPORTED  (ZEBRA_CAPA_ROUTE_BULK | ZEBRA_CAPA_SHM_RING)
+#else
+#define ZEBRA_CAPA_SUPPORTED  (ZEBRA_CAPA_ROUTE_BULK)
+#endif /* HAVE_ZAPI_RING */
+
 /* Zserv protocol message header */
 struct zserv_header
 {
@@ -178,6 +208,27 @@ extern int zclient_read_header (struct stream *s, int sock, u_int16_t *size,
 				u_char *marker, u_char *version,
 				u_int16_t *vrf_id, u_int16_t *cmd);
 
+/* ZEBRA_ROUTE_BULK encoding, shared by zebra and its clients. */
+extern int zapi_bulk_append (struct stream *bulk, struct stream *msg,
+                             size_t prefix_offset);
+
+struct zapi_bulk_iter
+{
+  u_int16_t command;
+  size_t head;
+  u_char head_len;
+  size_t tail;
+  u_int16_t tail_len;
+  u_int16_t count;
+  u_int16_t index;
+  size_t end;
+};
+
+extern int zapi_bulk_iter_init (struct zapi_bulk_iter *, struct stream *,
+                                u_int16_t length);
+extern int zapi_bulk_iter_next (struct zapi_bulk_iter *, struct stream *bulk,
+                                struct stream *msg);
+
 extern struct interface *zebra_interface_add_read (struct stream *,
     vrf_id_t);
 extern struct interface *zebra_interface_state_read (struct stream *,
@@ -0,0 +1,420 @@
+/*
+ * Shared memory ring transport for zserv messages.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#ifdef HAVE_ZAPI_RING
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "memory.h"
+#include "log.h"
+#include "zring.h"
+
+#define ZRING_MAGIC		0x5a52494eU	/* "ZRIN" */
+#define ZRING_CACHELINE		64
+
+/* Layout of the shared memory.  The producer and consumer indices live
+   on cache lines of their own, so that each side only ever dirties the
+   line it owns.  Both indices count bytes ever written or read and wrap
+   naturally; head - tail is the amount of data in the ring. */
+struct zring_shm
+{
+  u_int32_t magic;
+  u_int32_t size;
+
+  /* Set by each side just before it waits on its doorbell. */
+  u_int32_t consumer_sleeping;
+  u_int32_t producer_sleeping;
+  u_char pad0[ZRING_CACHELINE - 4 * sizeof (u_int32_t)];
+
+  /* Written by the producer only. */
+  u_int64_t head;
+  u_char pad1[ZRING_CACHELINE - sizeof (u_int64_t)];
+
+  /* Written by the consumer only. */
+  u_int64_t tail;
+  u_char pad2[ZRING_CACHELINE - sizeof (u_int64_t)];
+
+  u_char data[];
+};
+
+#define LOAD_ACQUIRE(p)		__atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define LOAD_RELAXED(p)		__atomic_load_n ((p), __ATOMIC_RELAXED)
+#define STORE_RELEASE(p, v)	__atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define STORE_RELAXED(p, v)	__atomic_store_n ((p), (v), __ATOMIC_RELAXED)
+#define EXCHANGE(p, v)		__atomic_exchange_n ((p), (v), __ATOMIC_SEQ_CST)
+#define FENCE()			__atomic_thread_fence (__ATOMIC_SEQ_CST)
+
+static void
+zring_doorbell_ring (int efd)
+{
+  u_int64_t one = 1;
+
+  /* The only possible failure is an overflowing counter, which still
+     leaves the eventfd readable, so the wakeup is not lost. */
+  if (write (efd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+    zlog_warn ("%s: eventfd %d: %s", __func__, efd, safe_strerror (errno));
+}
+
+void
+zring_doorbell_clear (int efd)
+{
+  u_int64_t count;
+
+  if (read (efd, &count, sizeof (count)) < 0 && errno != EAGAIN)
+    zlog_warn ("%s: eventfd %d: %s", __func__, efd, safe_strerror (errno));
+}
+
+static struct zring *
+zring_map (int memfd, int data_efd, int space_efd, size_t map_len)
+{
+  struct zring *ring;
+  void *shm;
+
+  shm = mmap (NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (shm == MAP_FAILED)
+    {
+      zlog_warn ("%s: mmap: %s", __func__, safe_strerror (errno));
+      return NULL;
+    }
+
+  ring = XCALLOC (MTYPE_ZRING, sizeof (struct zring));
+  ring->shm = shm;
+  ring->map_len = map_len;
+  ring->memfd = memfd;
+  ring->data_efd = data_efd;
+  ring->space_efd = space_efd;
+  return ring;
+}
+
+struct zring *
+zring_create (size_t size)
+{
+  struct zring *ring;
+  size_t map_len;
+  int memfd, data_efd = -1, space_efd = -1;
+
+  if (! size)
+    size = ZRING_SIZE_DEFAULT;
+  assert ((size & (size - 1)) == 0);
+  map_len = sizeof (struct zring_shm) + size;
+
+  memfd = memfd_create ("zserv-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0)
+    {
+      zlog_warn ("%s: memfd_create: %s", __func__, safe_strerror (errno));
+      return NULL;
+    }
+  if (ftruncate (memfd, map_len) < 0)
+    {
+      zlog_warn ("%s: ftruncate: %s", __func__, safe_strerror (errno));
+      goto fail;
+    }
+#ifdef F_ADD_SEALS
+  /* zebra maps this memory too; make sure it cannot be pulled out from
+     under it. */
+  if (fcntl (memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    {
+      zlog_warn ("%s: sealing memfd: %s", __func__, safe_strerror (errno));
+      goto fail;
+    }
+#endif /* F_ADD_SEALS */
+
+  data_efd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  space_efd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (data_efd < 0 || space_efd < 0)
+    {
+      zlog_warn ("%s: eventfd: %s", __func__, safe_strerror (errno));
+      goto fail;
+    }
+
+  if (! (ring = zring_map (memfd, data_efd, space_efd, map_len)))
+    goto fail;
+
+  ring->size = size;
+  ring->shm->size = size;
+  /* zebra has not started reading yet, so the first write must ring. */
+  ring->shm->consumer_sleeping = 1;
+  STORE_RELEASE (&ring->shm->magic, ZRING_MAGIC);
+  return ring;
+
+fail:
+  close (memfd);
+  if (data_efd >= 0)
+    close (data_efd);
+  if (space_efd >= 0)
+    close (space_efd);
+  return NULL;
+}
+
+struct zring *
+zring_attach (int memfd, int data_efd, int space_efd)
+{
+  struct zring *ring = NULL;
+  struct stat st;
+  u_int32_t size;
+  int seals;
+
+  if (fstat (memfd, &st) < 0)
+    {
+      zlog_warn ("%s: fstat: %s", __func__, safe_strerror (errno));
+      goto fail;
+    }
+  if (st.st_size < (off_t) sizeof (struct zring_shm))
+    {
+      zlog_warn ("%s: ring is too small (%lld bytes)", __func__,
+                 (long long) st.st_size);
+      goto fail;
+    }
+  /* A client which could shrink the ring would have zebra fault on it. */
+  seals = fcntl (memfd, F_GET_SEALS);
+  if (seals < 0 || ! (seals & F_SEAL_SHRINK))
+    {
+      zlog_warn ("%s: ring memory is not sealed", __func__);
+      goto fail;
+    }
+
+  if (! (ring = zring_map (memfd, data_efd, space_efd, st.st_size)))
+    goto fail;
+
+  size = LOAD_ACQUIRE (&ring->shm->size);
+  if (LOAD_ACQUIRE (&ring->shm->magic) != ZRING_MAGIC
+      || size == 0 || (size & (size - 1)) != 0
+      || size > st.st_size - sizeof (struct zring_shm))
+    {
+      zlog_warn ("%s: bad ring header", __func__);
+      zring_free (ring);
+      return NULL;
+    }
+  ring->size = size;
+  return ring;
+
+fail:
+  close (memfd);
+  close (data_efd);
+  close (space_efd);
+  return NULL;
+}
+
+void
+zring_free (struct zring *ring)
+{
+  munmap (ring->shm, ring->map_len);
+  close (ring->memfd);
+  close (ring->data_efd);
+  close (ring->space_efd);
+  XFREE (MTYPE_ZRING, ring);
+}
+
+ssize_t
+zring_writev (struct zring *ring, const struct iovec *iov, int iovcnt)
+{
+  struct zring_shm *shm = ring->shm;
+  u_int64_t head, tail;
+  size_t space, written = 0;
+  int i;
+
+  head = LOAD_RELAXED (&shm->head);
+  tail = LOAD_ACQUIRE (&shm->tail);
+  space = ring->size - (size_t) (head - tail);
+
+  for (i = 0; i < iovcnt && space; i++)
+    {
+      const u_char *src = iov[i].iov_base;
+      size_t len = MIN (iov[i].iov_len, space);
+
+      while (len)
+        {
+          size_t off = (head + written) & (ring->size - 1);
+          size_t chunk = MIN (len, ring->size - off);
+
+          memcpy (shm->data + off, src, chunk);
+          src += chunk;
+          len -= chunk;
+          written += chunk;
+          space -= chunk;
+        }
+    }
+
+  if (! written)
+    return 0;
+
+  STORE_RELEASE (&shm->head, head + written);
+
+  /* Pairs with the fence in zring_consumer_sleep: either zebra sees the
+     new head before it sleeps, or we see that it is asleep. */
+  FENCE ();
+  if (LOAD_RELAXED (&shm->consumer_sleeping)
+      && EXCHANGE (&shm->consumer_sleeping, 0))
+    zring_doorbell_ring (ring->data_efd);
+
+  return written;
+}
+
+ssize_t
+zring_read (struct zring *ring, void *buf, size_t len)
+{
+  struct zring_shm *shm = ring->shm;
+  u_int64_t head, tail;
+  size_t used, read = 0;
+  u_char *dst = buf;
+
+  tail = LOAD_RELAXED (&shm->tail);
+  head = LOAD_ACQUIRE (&shm->head);
+  used = (size_t) (head - tail);
+  if (used > ring->size)
+    return -1;
+
+  len = MIN (len, used);
+  while (read < len)
+    {
+      size_t off = (tail + read) & (ring->size - 1);
+      size_t chunk = MIN (len - read, ring->size - off);
+
+      memcpy (dst + read, shm->data + off, chunk);
+      read += chunk;
+    }
+
+  if (! read)
+    return 0;
+
+  STORE_RELEASE (&shm->tail, tail + read);
+
+  FENCE ();
+  if (LOAD_RELAXED (&shm->producer_sleeping)
+      && EXCHANGE (&shm->producer_sleeping, 0))
+    zring_doorbell_ring (ring->space_efd);
+
+  return read;
+}
+
+int
+zring_consumer_sleep (struct zring *ring)
+{
+  struct zring_shm *shm = ring->shm;
+
+  STORE_RELAXED (&shm->consumer_sleeping, 1);
+  FENCE ();
+  if (LOAD_ACQUIRE (&shm->head) != LOAD_RELAXED (&shm->tail))
+    {
+      STORE_RELAXED (&shm->consumer_sleeping, 0);
+      return 0;
+    }
+  return 1;
+}
+
+int
+zring_producer_sleep (struct zring *ring)
+{
+  struct zring_shm *shm = ring->shm;
+
+  STORE_RELAXED (&shm->producer_sleeping, 1);
+  FENCE ();
+  if (LOAD_RELAXED (&shm->head) - LOAD_ACQUIRE (&shm->tail) < ring->size)
+    {
+      STORE_RELAXED (&shm->producer_sleeping, 0);
+      return 0;
+    }
+  return 1;
+}
+
+ssize_t
+zring_send_fds (int sock, const void *data, size_t len, struct zring *ring)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  int *fds;
+  union
+  {
+    char buf[CMSG_SPACE (ZRING_NFDS * sizeof (int))];
+    struct cmsghdr align;
+  } control;
+
+  memset (&msg, 0, sizeof (msg));
+  memset (&control, 0, sizeof (control));
+  iov.iov_base = (void *) data;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (ZRING_NFDS * sizeof (int));
+  fds = (int *) CMSG_DATA (cmsg);
+  fds[ZRING_FD_MEM] = ring->memfd;
+  fds[ZRING_FD_DATA] = ring->data_efd;
+  fds[ZRING_FD_SPACE] = ring->space_efd;
+
+  return sendmsg (sock, &msg, 0);
+}
+
+ssize_t
+zring_recv_fds (int sock, void *buf, size_t len, int *fds, int *nfds)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  ssize_t nbyte;
+  union
+  {
+    char buf[CMSG_SPACE (ZRING_NFDS * sizeof (int))];
+    struct cmsghdr align;
+  } control;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  if ((nbyte = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC)) < 0)
+    return nbyte;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    {
+      int *cfds, n, i;
+
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        continue;
+
+      cfds = (int *) CMSG_DATA (cmsg);
+      n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+      for (i = 0; i < n; i++)
+        {
+          if (*nfds < ZRING_NFDS)
+            fds[(*nfds)++] = cfds[i];
+          else
+            close (cfds[i]);
+        }
+    }
+
+  return nbyte;
+}
+
+#endif /* HAVE_ZAPI_RING */
@@ -0,0 +1,114 @@
+/*
+ * Shared memory ring transport for zserv messages.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_ZRING_H
+#define _QUAGGA_ZRING_H
+
+#ifdef HAVE_ZAPI_RING
+
+/* A single producer, single consumer byte ring in a memfd shared between
+ * a protocol daemon (the producer) and zebra (the consumer).  The ring
+ * carries the same byte stream the zserv socket would, so message
+ * framing is unchanged.
+ *
+ * Each side owns one eventfd "doorbell".  A side only rings the other's
+ * doorbell when the other has said it is about to sleep, so while both
+ * are busy, messages move without any system calls at all.
+ */
+
+/* Default ring size, must be a power of 2. */
+#define ZRING_SIZE_DEFAULT	(1 << 20)
+
+/* Descriptors handed from the daemon to zebra, in this order. */
+#define ZRING_FD_MEM		0
+#define ZRING_FD_DATA		1
+#define ZRING_FD_SPACE		2
+#define ZRING_NFDS		3
+
+struct zring_shm;
+
+struct zring
+{
+  /* Shared header and data area. */
+  struct zring_shm *shm;
+  size_t map_len;
+
+  /* Ring size, copied out of shared memory when the ring is set up so
+     the peer cannot change it under us. */
+  u_int32_t size;
+
+  /* memfd backing the ring. */
+  int memfd;
+
+  /* Rung by the producer when data is added for a sleeping consumer. */
+  int data_efd;
+
+  /* Rung by the consumer when space is freed for a sleeping producer. */
+  int space_efd;
+};
+
+/* Producer side: create a new ring of the given size (0 for the
+   default). */
+extern struct zring *zring_create (size_t size);
+
+/* Consumer side: map a ring created by zring_create in another process.
+   The descriptors are owned by the ring from here on, even on failure. */
+extern struct zring *zring_attach (int memfd, int data_efd, int space_efd);
+
+/* Unmap the ring and close its descriptors. */
+extern void zring_free (struct zring *);
+
+/* Producer: copy as much of the given data as fits into the ring and
+   return the number of bytes written, ringing the data doorbell if the
+   consumer is asleep. */
+extern ssize_t zring_writev (struct zring *, const struct iovec *,
+                             int iovcnt);
+
+/* Consumer: copy up to len bytes out of the ring and return the number
+   of bytes read, or -1 if the shared indices are corrupt.  Rings the
+   space doorbell if the producer is asleep. */
+extern ssize_t zring_read (struct zring *, void *buf, size_t len);
+
+/* Announce that the consumer is about to wait on data_efd.  Returns 1 if
+   it should wait, or 0 if data arrived in the meantime. */
+extern int zring_consumer_sleep (struct zring *);
+
+/* Announce that the producer is about to wait on space_efd.  Returns 1
+   if it should wait, or 0 if space was freed in the meantime. */
+extern int zring_producer_sleep (struct zring *);
+
+/* Reset a doorbell after it has woken us. */
+extern void zring_doorbell_clear (int efd);
+
+/* Send len bytes of data on a unix socket, with the ring's descriptors
+   attached. */
+extern ssize_t zring_send_fds (int sock, const void *data, size_t len,
+                               struct zring *);
+
+/* Read from a unix socket like read(2).  Any descriptors which come
+   along are appended to fds, which has room for ZRING_NFDS, and counted
+   in *nfds; those which do not fit are closed. */
+extern ssize_t zring_recv_fds (int sock, void *buf, size_t len,
+                               int *fds, int *nfds);
+
+#endif /* HAVE_ZAPI_RING */
+
+#endif /* _QUAGGA_ZRING_H */
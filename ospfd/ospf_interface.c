@@ -352,40 +352,6 @@ ospf_if_free (struct ospf_interface *oi)
 }
 
 
-/*
-*  check if interface with given address is configured and
-*  return it if yes.  special treatment for PtP networks.
-*/
-struct ospf_interface *
-ospf_if_is_configured (struct ospf *ospf, struct in_addr *address)
-{
-  struct listnode *node, *nnode;
-  struct ospf_interface *oi;
-  struct prefix_ipv4 addr;
-
-  addr.family = AF_INET;
-  addr.prefix = *address;
-  addr.prefixlen = IPV4_MAX_PREFIXLEN;
-
-  for (ALL_LIST_ELEMENTS (ospf->oiflist, node, nnode, oi))
-    if (oi->type != OSPF_IFTYPE_VIRTUALLINK)
-      {
-        if (oi->type == OSPF_IFTYPE_POINTOPOINT)
-	  {
-	    /* special leniency: match if addr is anywhere on peer subnet */
-	    if (prefix_match(CONNECTED_PREFIX(oi->connected),
-			     (struct prefix *)&addr))
-	      return oi;
-	  }
-        else
-	  {
-	    if (IPV4_ADDR_SAME (address, &oi->address->u.prefix4))
-	      return oi;
-	  }
-      }
-  return NULL;
-}
-
 int
 ospf_if_is_up (struct ospf_interface *oi)
 {
@@ -894,7 +860,6 @@ ospf_vl_new (struct ospf *ospf, struct ospf_vl_data *vl_data)
   UNSET_FLAG(vi->status, ZEBRA_INTERFACE_LINKDETECTION);
   co = connected_new ();
   co->ifp = vi;
-  listnode_add (vi->connected, co);
 
   p = prefix_ipv4_new ();
   p->family = AF_INET;
@@ -902,6 +867,7 @@ ospf_vl_new (struct ospf *ospf, struct ospf_vl_data *vl_data)
   p->prefixlen = 0;
  
   co->address = (struct prefix *)p;
+  connected_add (vi, co);
   
   voi = ospf_if_new (ospf, vi, co->address);
   if (voi == NULL)
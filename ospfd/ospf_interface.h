@@ -260,8 +260,6 @@ extern struct ospf_interface *ospf_if_addr_local (struct in_addr);
 extern struct ospf_interface *ospf_if_lookup_recv_if (struct ospf *,
 						      struct in_addr,
 						      struct interface *);
-extern struct ospf_interface *ospf_if_is_configured (struct ospf *,
-						     struct in_addr *);
 
 extern struct ospf_if_params *ospf_lookup_if_params (struct interface *,
 						     struct in_addr);
@@ -391,25 +391,10 @@ rip_filter (int rip_distribute, struct prefix_ipv4 *p, struct rip_interface *ri)
 static int
 rip_nexthop_check (struct in_addr *addr)
 {
-  struct listnode *node;
-  struct listnode *cnode;
-  struct interface *ifp;
-  struct connected *ifc;
-  struct prefix *p;
-
   /* If nexthop address matches local configured address then it is
      invalid nexthop. */
-  for (ALL_LIST_ELEMENTS_RO (iflist, node, ifp))
-    {
-      for (ALL_LIST_ELEMENTS_RO (ifp->connected, cnode, ifc))
-	{	    
-	  p = ifc->address;
-
-	  if (p->family == AF_INET
-	      && IPV4_ADDR_SAME (&p->u.prefix4, addr))
-	    return -1;
-	}
-    }
+  if (if_lookup_exact_address (*addr))
+    return -1;
   return 0;
 }
 
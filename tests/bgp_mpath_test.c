@@ -35,6 +35,7 @@
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
 #include "bgpd/bgp_mpath.h"
 
 #define VT100_RESET "\x1b[0m"
@@ -365,6 +366,114 @@ testcase_t test_bgp_info_mpath_update = {
   .cleanup = cleanup_bgp_info_mpath_update,
 };
 
+/*=========================================================
+ * Testcase for bgp_best_selection
+ */
+
+struct bgp test_bp_bgp;
+
+/* S from AS 2 is selected; X from AS 1 lost to it on router-id.  N from
+   AS 1 beats S on router-id but loses to X on MED, so all three compared
+   again select S. */
+struct peer test_bp_peer[] = {
+  { .as = 2, .sort = BGP_PEER_IBGP, .status = Established,
+    .bgp = &test_bp_bgp },
+  { .as = 1, .sort = BGP_PEER_IBGP, .status = Established,
+    .bgp = &test_bp_bgp },
+  { .as = 1, .sort = BGP_PEER_IBGP, .status = Established,
+    .bgp = &test_bp_bgp },
+};
+struct attr test_bp_attr[3];
+struct bgp_info test_bp_info[] = {
+  { .peer = &test_bp_peer[0], .attr = &test_bp_attr[0],
+    .flags = BGP_INFO_VALID },
+  { .peer = &test_bp_peer[1], .attr = &test_bp_attr[1],
+    .flags = BGP_INFO_VALID },
+  { .peer = &test_bp_peer[2], .attr = &test_bp_attr[2],
+    .flags = BGP_INFO_VALID },
+};
+struct bgp_node test_bp_rn;
+
+static int
+setup_bgp_best_selection (testcase_t *t)
+{
+  int i;
+
+  test_bp_bgp.maxpaths[AFI_IP][SAFI_UNICAST].maxpaths_ebgp =
+    BGP_DEFAULT_MAXPATHS;
+  test_bp_bgp.maxpaths[AFI_IP][SAFI_UNICAST].maxpaths_ibgp =
+    BGP_DEFAULT_MAXPATHS;
+
+  inet_aton ("2.2.2.2", &test_bp_peer[0].remote_id);
+  inet_aton ("3.3.3.3", &test_bp_peer[1].remote_id);
+  inet_aton ("1.1.1.1", &test_bp_peer[2].remote_id);
+
+  test_bp_attr[0].aspath = aspath_str2aspath ("2");
+  test_bp_attr[1].aspath = aspath_str2aspath ("1");
+  test_bp_attr[2].aspath = aspath_str2aspath ("1");
+  for (i = 0; i < 3; i++)
+    if (test_bp_attr[i].aspath == NULL)
+      return -1;
+
+  test_bp_attr[1].med = 5;
+  test_bp_attr[1].flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+  test_bp_attr[2].med = 10;
+  test_bp_attr[2].flag |= ATTR_FLAG_BIT (BGP_ATTR_MULTI_EXIT_DISC);
+
+  str2prefix ("42.2.2.0/24", &test_bp_rn.p);
+  bgp_info_add (&test_bp_rn, &test_bp_info[0]);
+  bgp_info_add (&test_bp_rn, &test_bp_info[1]);
+  SET_FLAG (test_bp_info[0].flags, BGP_INFO_SELECTED);
+  return 0;
+}
+
+static int
+run_bgp_best_selection (testcase_t *t)
+{
+  struct bgp_info_pair pair;
+  int test_result = TEST_PASSED;
+
+  /* Only N has changed since S was selected. */
+  bgp_info_add (&test_bp_rn, &test_bp_info[2]);
+  SET_FLAG (test_bp_info[2].flags, BGP_INFO_SELECT_CHANGED);
+
+  bgp_best_selection (&test_bp_bgp, &test_bp_rn, &pair,
+		      AFI_IP, SAFI_UNICAST);
+  EXPECT_TRUE (pair.old == &test_bp_info[0], test_result);
+  EXPECT_TRUE (pair.new == &test_bp_info[0], test_result);
+  EXPECT_TRUE (!CHECK_FLAG (test_bp_info[2].flags, BGP_INFO_SELECT_CHANGED),
+	       test_result);
+
+  /* From AS 3, N is not compared with X on MED and is selected. */
+  aspath_free (test_bp_attr[2].aspath);
+  test_bp_attr[2].aspath = aspath_str2aspath ("3");
+  SET_FLAG (test_bp_info[2].flags, BGP_INFO_SELECT_CHANGED);
+
+  bgp_best_selection (&test_bp_bgp, &test_bp_rn, &pair,
+		      AFI_IP, SAFI_UNICAST);
+  EXPECT_TRUE (pair.new == &test_bp_info[2], test_result);
+
+  return test_result;
+}
+
+static int
+cleanup_bgp_best_selection (testcase_t *t)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    aspath_free (test_bp_attr[i].aspath);
+
+  return 0;
+}
+
+testcase_t test_bgp_best_selection = {
+  .desc = "Test bgp_best_selection",
+  .setup = setup_bgp_best_selection,
+  .run = run_bgp_best_selection,
+  .cleanup = cleanup_bgp_best_selection,
+};
+
 /*=========================================================
  * Set up testcase vector
  */
@@ -372,6 +481,7 @@ testcase_t *all_tests[] = {
   &test_bgp_cfg_maximum_paths,
   &test_bgp_mp_list,
   &test_bgp_info_mpath_update,
+  &test_bgp_best_selection,
 };
 
 int all_tests_count = (sizeof(all_tests)/sizeof(testcase_t *));
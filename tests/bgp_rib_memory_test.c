@@ -0,0 +1,181 @@
+/*
+ * Test program which measures the memory bgpd takes per path for a RIB
+ * of many prefixes, each learned from several iBGP peers whose nexthops
+ * resolve through the IGP.
+ *
+ * This file is part of Quagga
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+/* malloc.h is generally obsolete, however GNU Libc mallinfo wants it. */
+#if !defined(HAVE_STDLIB_H) || (defined(GNU_LINUX) && defined(HAVE_MALLINFO))
+#include <malloc.h>
+#endif /* !HAVE_STDLIB_H || HAVE_MALLINFO */
+
+#include "vty.h"
+#include "stream.h"
+#include "privs.h"
+#include "memory.h"
+#include "zclient.h"
+#include "filter.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_nexthop.h"
+#include "bgpd/bgp_nht.h"
+
+#define PREFIXES 1000000
+#define PATHS 10
+
+/* need these to link in libbgp */
+struct thread_master *master = NULL;
+struct zclient *zclient;
+struct zebra_privs_t bgpd_privs =
+{
+  .user = NULL,
+  .group = NULL,
+  .vty_group = NULL,
+};
+
+/* Bytes handed out by the system allocator. */
+static unsigned long
+heap_used (void)
+{
+#ifdef HAVE_MALLINFO
+  struct mallinfo minfo = mallinfo ();
+
+  return (unsigned long) minfo.uordblks + (unsigned long) minfo.hblkhd;
+#else
+  return 0;
+#endif /* HAVE_MALLINFO */
+}
+
+int
+main (int argc, char **argv)
+{
+  struct bgp_table *table;
+  struct peer *peers;
+  struct attr attr;
+  struct attr **attrs;
+  struct prefix p;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct timeval tv_start, tv_stop;
+  unsigned long heap_start, heap_stop, paths;
+  unsigned int nprefix = PREFIXES;
+  unsigned int npath = PATHS;
+  unsigned int i, j;
+
+  if (argc > 1)
+    nprefix = strtoul (argv[1], NULL, 10);
+  if (argc > 2)
+    npath = strtoul (argv[2], NULL, 10);
+  if (nprefix == 0 || nprefix > (1 << 24) || npath == 0 || npath > 250)
+    {
+      fprintf (stderr, "usage: %s [prefixes [paths]]\n", argv[0]);
+      return 1;
+    }
+
+  master = thread_master_create ();
+  bgp_attr_init ();
+  bgp_scan_init ();
+
+  table = bgp_table_init (AFI_IP, SAFI_UNICAST);
+
+  /* One iBGP peer per path, each with its own nexthop. */
+  peers = XCALLOC (MTYPE_TMP, npath * sizeof (struct peer));
+  attrs = XCALLOC (MTYPE_TMP, npath * sizeof (struct attr *));
+  for (j = 0; j < npath; j++)
+    {
+      peers[j].sort = BGP_PEER_IBGP;
+      peers[j].status = Established;
+
+      memset (&attr, 0, sizeof (struct attr));
+      bgp_attr_default_set (&attr, BGP_ORIGIN_IGP);
+      attr.nexthop.s_addr = htonl (0x0a000001 + (j << 8));
+      attrs[j] = bgp_attr_intern (&attr);
+      bgp_attr_extra_free (&attr);
+    }
+
+  heap_start = heap_used ();
+  gettimeofday (&tv_start, NULL);
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = AF_INET;
+  p.prefixlen = 24;
+
+  for (i = 0; i < nprefix; i++)
+    {
+      p.u.prefix4.s_addr = htonl (0x10000000 + (i << 8));
+      rn = bgp_node_get (table, &p);
+
+      for (j = 0; j < npath; j++)
+	{
+	  ri = bgp_info_new ();
+	  ri->type = ZEBRA_ROUTE_BGP;
+	  ri->sub_type = BGP_ROUTE_NORMAL;
+	  ri->peer = &peers[j];
+	  ri->attr = bgp_attr_intern (attrs[j]);
+	  ri->uptime = time (NULL);
+	  ri->net = rn;
+
+	  bgp_ensure_nexthop (ri, NULL, 0);
+
+	  /* Have the nexthop resolve through the IGP, as zebra would
+	     report it. */
+	  if (i == 0)
+	    {
+	      SET_FLAG (ri->nexthop->flags,
+			BGP_NEXTHOP_VALID | BGP_NEXTHOP_REGISTERED);
+	      ri->nexthop->metric = 10 + j;
+	      bgp_ensure_nexthop (ri, NULL, 0);
+	    }
+
+	  SET_FLAG (ri->flags, BGP_INFO_VALID);
+	  bgp_info_add (rn, ri);
+	}
+
+      bgp_unlock_node (rn);
+    }
+
+  gettimeofday (&tv_stop, NULL);
+  heap_stop = heap_used ();
+  paths = (unsigned long) nprefix * npath;
+
+  printf ("%u prefixes x %u paths\n", nprefix, npath);
+  printf ("struct bgp_node %lu bytes, struct bgp_info %lu bytes, "
+	  "struct bgp_info_extra %lu bytes\n",
+	  (unsigned long) sizeof (struct bgp_node),
+	  (unsigned long) sizeof (struct bgp_info),
+	  (unsigned long) sizeof (struct bgp_info_extra));
+  printf ("%lu nodes, %lu paths, %lu path extras\n",
+	  mtype_stats_alloc (MTYPE_BGP_NODE),
+	  mtype_stats_alloc (MTYPE_BGP_ROUTE),
+	  mtype_stats_alloc (MTYPE_BGP_ROUTE_EXTRA));
+#ifdef HAVE_MALLINFO
+  printf ("%lu bytes allocated, %.1f bytes per path\n",
+	  heap_stop - heap_start, (double) (heap_stop - heap_start) / paths);
+#endif /* HAVE_MALLINFO */
+  printf ("built in %lu ms\n",
+	  (unsigned long) ((tv_stop.tv_sec - tv_start.tv_sec) * 1000
+			   + (tv_stop.tv_usec - tv_start.tv_usec) / 1000));
+
+  return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Tests for the index of connected addresses.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "memory.h"
+#include "linklist.h"
+#include "prefix.h"
+#include "command.h"
+#include "if.h"
+#include "vrf.h"
+
+struct thread_master *master;
+
+static int failed;
+
+static void
+check (int ok, const char *what)
+{
+  if (! ok)
+    {
+      printf ("%s: failed\n", what);
+      failed++;
+    }
+}
+
+static struct connected *
+add (struct interface *ifp, const char *str)
+{
+  struct prefix p;
+
+  str2prefix (str, &p);
+  return connected_add_by_prefix (ifp, &p, NULL);
+}
+
+static void
+del (struct interface *ifp, const char *str)
+{
+  struct prefix p;
+
+  str2prefix (str, &p);
+  connected_free (connected_delete_by_prefix (ifp, &p));
+}
+
+/* The number of connected addresses a lookup finds, and whether one of
+   them is on the given interface. */
+static int
+count (struct list *matches, struct interface *ifp, int *found)
+{
+  struct listnode *node;
+  struct connected *ifc;
+
+  *found = 0;
+  if (! matches)
+    return 0;
+  for (ALL_LIST_ELEMENTS_RO (matches, node, ifc))
+    if (ifc->ifp == ifp)
+      *found = 1;
+  return listcount (matches);
+}
+
+static struct list *
+match_address (const char *str)
+{
+  struct prefix p;
+
+  str2prefix (str, &p);
+  return connected_match_address (&p, VRF_DEFAULT);
+}
+
+static struct list *
+match_subnet (const char *str)
+{
+  struct prefix p;
+
+  str2prefix (str, &p);
+  return connected_match_subnet (&p, VRF_DEFAULT);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct interface *eth0, *eth1;
+  struct in_addr addr;
+  int found0, found1;
+
+  cmd_init (1);
+  vrf_init ();
+
+  eth0 = if_get_by_name ("eth0");
+  eth1 = if_get_by_name ("eth1");
+
+  /* Both interfaces have the same address, and eth0 a wider subnet
+     as well. */
+  add (eth0, "10.0.0.1/24");
+  add (eth1, "10.0.0.1/24");
+  add (eth0, "10.1.0.1/16");
+
+  check (count (match_address ("10.0.0.1/32"), eth0, &found0) == 2
+	 && count (match_address ("10.0.0.1/32"), eth1, &found1) == 2
+	 && found0 && found1,
+	 "a shared address finds both interfaces");
+  check (count (match_subnet ("10.0.0.77/32"), eth0, &found0) == 2
+	 && count (match_subnet ("10.0.0.77/32"), eth1, &found1) == 2
+	 && found0 && found1,
+	 "a shared subnet finds both interfaces");
+  check (count (match_subnet ("10.1.2.3/32"), eth0, &found0) == 1 && found0,
+	 "the most specific subnet is found");
+  check (match_address ("10.0.0.2/32") == NULL,
+	 "an address no interface has is not found");
+  check (match_subnet ("192.168.0.1/32") == NULL,
+	 "an address outside every subnet is not found");
+
+  /* Removing the address from one interface leaves the other's. */
+  del (eth0, "10.0.0.1/24");
+  check (count (match_address ("10.0.0.1/32"), eth1, &found1) == 1 && found1,
+	 "the remaining interface has the address");
+  check (count (match_subnet ("10.0.0.77/32"), eth1, &found1) == 1 && found1,
+	 "the remaining interface has the subnet");
+  inet_aton ("10.0.0.1", &addr);
+  check (if_lookup_exact_address (addr) == eth1,
+	 "the address is looked up on the remaining interface");
+
+  del (eth1, "10.0.0.1/24");
+  check (match_address ("10.0.0.1/32") == NULL,
+	 "a removed address is not found");
+  check (match_subnet ("10.0.0.77/32") == NULL,
+	 "a removed subnet is not found");
+  inet_aton ("10.1.2.3", &addr);
+  check (if_lookup_address (addr) == eth0,
+	 "the other subnet is still found");
+
+  vrf_terminate ();
+  check (mtype_stats_alloc (MTYPE_CONNECTED) == 0
+	 && mtype_stats_alloc (MTYPE_CONNECTED_INDEX) == 0,
+	 "the index is freed");
+
+  if (failed)
+    return 1;
+  printf ("connected: all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Tests for pools of fixed-size objects.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "memory.h"
+#include "mempool.h"
+
+struct thread_master *master;
+
+/* Enough objects to span several chunks. */
+#define OBJECTS 10000
+
+struct obj
+{
+  struct obj *self;
+  u_int32_t val;
+  u_char pad[13];
+};
+
+static int failed;
+
+static void
+check (int ok, const char *what)
+{
+  if (! ok)
+    {
+      printf ("%s: failed\n", what);
+      failed++;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  struct mempool pool = MEMPOOL_INIT (MTYPE_TMP, sizeof (struct obj));
+  struct obj **objs;
+  struct obj *o;
+  unsigned long base, chunks;
+  int i, zeroed, aligned, intact;
+
+  objs = XCALLOC (MTYPE_TMP, OBJECTS * sizeof (struct obj *));
+  base = mtype_stats_alloc (MTYPE_TMP);
+
+  zeroed = aligned = 1;
+  for (i = 0; i < OBJECTS; i++)
+    {
+      o = objs[i] = mempool_alloc (&pool);
+      if (o->self || o->val)
+	zeroed = 0;
+      if ((uintptr_t) o % 8)
+	aligned = 0;
+      o->self = o;
+      o->val = i;
+      memset (o->pad, 0xff, sizeof (o->pad));
+    }
+  check (zeroed, "objects are zeroed");
+  check (aligned, "objects are aligned");
+  check (mtype_stats_alloc (MTYPE_TMP) == base + OBJECTS,
+	 "objects are counted");
+  chunks = mtype_stats_alloc (MTYPE_MEMPOOL_CHUNK);
+  check (chunks > 1 && chunks * MEMPOOL_CHUNK_SIZE
+			< 2 * OBJECTS * sizeof (struct obj),
+	 "chunks are filled");
+
+  /* No two objects overlap. */
+  intact = 1;
+  for (i = 0; i < OBJECTS; i++)
+    if (objs[i]->self != objs[i] || objs[i]->val != (u_int32_t) i)
+      intact = 0;
+  check (intact, "objects are distinct");
+
+  /* Freed objects are reused, and zeroed again. */
+  for (i = 0; i < OBJECTS; i += 2)
+    mempool_free (&pool, objs[i]);
+  check (mtype_stats_alloc (MTYPE_TMP) == base + OBJECTS / 2,
+	 "freed objects are uncounted");
+
+  zeroed = 1;
+  for (i = 0; i < OBJECTS; i += 2)
+    {
+      o = objs[i] = mempool_alloc (&pool);
+      if (o->self || o->val)
+	zeroed = 0;
+    }
+  check (zeroed, "reused objects are zeroed");
+  check (mtype_stats_alloc (MTYPE_MEMPOOL_CHUNK) == chunks,
+	 "freed objects are reused");
+
+  mempool_free (&pool, NULL);
+  for (i = 0; i < OBJECTS; i++)
+    mempool_free (&pool, objs[i]);
+  check (mtype_stats_alloc (MTYPE_TMP) == base, "all objects are freed");
+
+  mempool_finish (&pool);
+  check (mtype_stats_alloc (MTYPE_MEMPOOL_CHUNK) == 0, "chunks are released");
+
+  XFREE (MTYPE_TMP, objs);
+
+  if (failed)
+    return 1;
+  printf ("mempool: all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * ZEBRA_ROUTE_BULK encoding tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+#include "stream.h"
+#include "zclient.h"
+#include "prng.h"
+
+struct thread_master *master;
+
+#define ROUTES 5000
+
+/* Build an IPv4 route message as zapi_ipv4_route() does, returning the
+   offset of its prefix. */
+static size_t
+build_route (struct stream *s, u_int16_t cmd, struct prefix_ipv4 *p,
+             u_int32_t metric)
+{
+  size_t prefix_offset;
+
+  stream_reset (s);
+  zclient_create_header (s, cmd, VRF_DEFAULT);
+  stream_putc (s, ZEBRA_ROUTE_BGP);
+  stream_putc (s, 0);
+  stream_putc (s, ZAPI_MESSAGE_NEXTHOP | ZAPI_MESSAGE_METRIC);
+  stream_putw (s, SAFI_UNICAST);
+  prefix_offset = stream_get_endp (s);
+  stream_putc (s, p->prefixlen);
+  stream_write (s, (u_char *) &p->prefix, PSIZE (p->prefixlen));
+  stream_putc (s, 1);
+  stream_putc (s, ZEBRA_NEXTHOP_IPV4);
+  stream_putl (s, 0x0a000001);
+  stream_putl (s, metric);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  return prefix_offset;
+}
+
+static void
+random_prefix (struct prng *prng, struct prefix_ipv4 *p)
+{
+  memset (p, 0, sizeof (*p));
+  p->family = AF_INET;
+  p->prefixlen = prng_rand (prng) % (IPV4_MAX_BITLEN + 1);
+  p->prefix.s_addr = prng_rand (prng);
+  apply_mask_ipv4 (p);
+}
+
+/* Push routes through bulk messages and check that every route message
+   comes back out of the iterator byte for byte, in order. */
+static void
+test_roundtrip (void)
+{
+  struct stream *msg, *bulk, *out;
+  struct prng *prng;
+  struct prefix_ipv4 p[ROUTES];
+  int sent = 0, received = 0, bulks = 0;
+  size_t offset;
+
+  msg = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  bulk = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  out = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  prng = prng_new (0);
+
+  while (received < ROUTES)
+    {
+      struct zapi_bulk_iter it;
+      int ret;
+      int start = sent;
+
+      /* Fill one bulk message, changing the metric every 1000 routes so
+         that some bulk messages end early on an attribute change. */
+      while (sent < ROUTES)
+        {
+          random_prefix (prng, &p[sent]);
+          offset = build_route (msg, ZEBRA_IPV4_ROUTE_ADD, &p[sent],
+                                sent / 1000);
+          if (zapi_bulk_append (bulk, msg, offset) < 0)
+            break;
+          sent++;
+        }
+      assert (sent > start);
+
+      /* Walk the bulk message as a receiver would. */
+      stream_set_getp (bulk, ZEBRA_HEADER_SIZE);
+      assert (stream_getw_from (bulk, 6) == ZEBRA_ROUTE_BULK);
+      assert (stream_getw_from (bulk, 0) == stream_get_endp (bulk));
+      ret = zapi_bulk_iter_init (&it, bulk,
+                                 stream_get_endp (bulk) - ZEBRA_HEADER_SIZE);
+      assert (ret == 0);
+      assert (it.command == ZEBRA_IPV4_ROUTE_ADD);
+      assert (it.count == sent - start);
+
+      while ((ret = zapi_bulk_iter_next (&it, bulk, out)) > 0)
+        {
+          build_route (msg, ZEBRA_IPV4_ROUTE_ADD, &p[received],
+                       received / 1000);
+          assert (stream_get_endp (out)
+                  == stream_get_endp (msg) - ZEBRA_HEADER_SIZE);
+          assert (!memcmp (STREAM_DATA (out),
+                           STREAM_DATA (msg) + ZEBRA_HEADER_SIZE,
+                           stream_get_endp (out)));
+          received++;
+        }
+      assert (ret == 0);
+      assert (stream_get_getp (bulk) == stream_get_endp (bulk));
+
+      stream_reset (bulk);
+      bulks++;
+    }
+
+  printf ("%d routes in %d bulk messages\n", received, bulks);
+  prng_free (prng);
+  stream_free (msg);
+  stream_free (bulk);
+  stream_free (out);
+}
+
+/* Different commands must never share a bulk message, and truncated bulk
+   messages must be rejected. */
+static void
+test_mismatch (void)
+{
+  struct stream *msg, *bulk, *out;
+  struct prefix_ipv4 p;
+  struct zapi_bulk_iter it;
+  size_t offset;
+
+  msg = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  bulk = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  out = stream_new (ZEBRA_MAX_PACKET_SIZ);
+
+  str2prefix_ipv4 ("192.0.2.0/24", &p);
+  offset = build_route (msg, ZEBRA_IPV4_ROUTE_ADD, &p, 1);
+  assert (zapi_bulk_append (bulk, msg, offset) == 0);
+  offset = build_route (msg, ZEBRA_IPV4_ROUTE_DELETE, &p, 1);
+  assert (zapi_bulk_append (bulk, msg, offset) < 0);
+  offset = build_route (msg, ZEBRA_IPV4_ROUTE_ADD, &p, 2);
+  assert (zapi_bulk_append (bulk, msg, offset) < 0);
+  offset = build_route (msg, ZEBRA_IPV4_ROUTE_ADD, &p, 1);
+  assert (zapi_bulk_append (bulk, msg, offset) == 0);
+
+  /* Chop off the last prefix byte. */
+  stream_set_getp (bulk, ZEBRA_HEADER_SIZE);
+  assert (zapi_bulk_iter_init (&it, bulk, stream_get_endp (bulk)
+                               - ZEBRA_HEADER_SIZE - 1) == 0);
+  assert (zapi_bulk_iter_next (&it, bulk, out) == 1);
+  assert (zapi_bulk_iter_next (&it, bulk, out) == -1);
+
+  printf ("mismatch test passed\n");
+  stream_free (msg);
+  stream_free (bulk);
+  stream_free (out);
+}
+
+int
+main (void)
+{
+  test_roundtrip ();
+  test_mismatch ();
+  return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * Shared memory ring transport tests.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+#include "zring.h"
+#include "prng.h"
+
+struct thread_master *master;
+
+#ifdef HAVE_ZAPI_RING
+
+#include <poll.h>
+
+#define RING_SIZE 4096
+#define TOTAL (1024 * 1024)
+
+static int
+doorbell_rung (int efd)
+{
+  struct pollfd pfd = { .fd = efd, .events = POLLIN };
+
+  if (poll (&pfd, 1, 0) != 1)
+    return 0;
+  zring_doorbell_clear (efd);
+  return 1;
+}
+
+/* Stream a pattern through a small ring in random sized pieces, so that
+   reads and writes wrap around its end at every possible offset, and
+   check the doorbells ring exactly when the other side said it would
+   sleep. */
+static void
+test_stream (void)
+{
+  struct zring *tx, *rx;
+  struct prng *prng;
+  u_char wbuf[3000], rbuf[3000];
+  size_t sent = 0, received = 0;
+  int wakeups = 0;
+
+  tx = zring_create (RING_SIZE);
+  assert (tx);
+  rx = zring_attach (dup (tx->memfd), dup (tx->data_efd),
+                     dup (tx->space_efd));
+  assert (rx);
+  assert (rx->size == RING_SIZE);
+  prng = prng_new (0);
+
+  /* Nothing there yet: the consumer sleeps. */
+  assert (zring_consumer_sleep (rx) == 1);
+
+  while (received < TOTAL)
+    {
+      ssize_t n;
+      size_t len, i;
+      int round, full = 0;
+
+      /* Two writes, each split over two chunks, which may fill the
+         ring. */
+      for (round = 0; round < 2; round++)
+        {
+          struct iovec iov[2];
+
+          len = prng_rand (prng) % sizeof (wbuf) + 1;
+          len = MIN (len, TOTAL - sent);
+          for (i = 0; i < len; i++)
+            wbuf[i] = (sent + i) * 7;
+          iov[0].iov_base = wbuf;
+          iov[0].iov_len = len / 2;
+          iov[1].iov_base = wbuf + len / 2;
+          iov[1].iov_len = len - len / 2;
+          n = zring_writev (tx, iov, 2);
+          assert (n >= 0 && (size_t) n <= len);
+          sent += n;
+
+          /* The consumer went to sleep on an empty ring at the end of
+             the last round, so only the first write may wake it. */
+          if (round == 0 && n)
+            {
+              assert (doorbell_rung (rx->data_efd));
+              wakeups++;
+            }
+          else
+            assert (! doorbell_rung (rx->data_efd));
+
+          if ((size_t) n < len)
+            {
+              assert (sent - received == RING_SIZE);
+              assert (zring_producer_sleep (tx) == 1);
+              full = 1;
+              break;
+            }
+        }
+
+      /* Read back some of it, then drain the ring completely. */
+      len = prng_rand (prng) % sizeof (rbuf) + 1;
+      do
+        {
+          n = zring_read (rx, rbuf, len);
+          assert (n >= 0 && (size_t) n <= len);
+          for (i = 0; i < (size_t) n; i++)
+            assert (rbuf[i] == (u_char) ((received + i) * 7));
+          received += n;
+          len = sizeof (rbuf);
+        }
+      while (n > 0);
+      assert (received == sent);
+
+      /* The producer is woken only if it had said it would sleep. */
+      assert (doorbell_rung (tx->space_efd) == full);
+      assert (zring_consumer_sleep (rx) == 1);
+    }
+
+  printf ("%lu bytes through a %d byte ring, %d wakeups\n",
+          (u_long) received, RING_SIZE, wakeups);
+  prng_free (prng);
+  zring_free (tx);
+  zring_free (rx);
+}
+
+/* The consumer must refuse indices which claim more data than the ring
+   holds. */
+static void
+test_corrupt (void)
+{
+  struct zring *tx, *rx;
+  u_char buf[16];
+  struct iovec iov = { .iov_base = buf, .iov_len = sizeof (buf) };
+  u_int64_t *head;
+
+  tx = zring_create (RING_SIZE);
+  rx = zring_attach (dup (tx->memfd), dup (tx->data_efd),
+                     dup (tx->space_efd));
+  assert (tx && rx);
+
+  memset (buf, 0, sizeof (buf));
+  assert (zring_writev (tx, &iov, 1) == sizeof (buf));
+
+  /* The producer index is the first field of the second cache line. */
+  head = (u_int64_t *) ((char *) tx->shm + 64);
+  *head += RING_SIZE;
+  assert (zring_read (rx, buf, sizeof (buf)) == -1);
+
+  printf ("corruption test passed\n");
+  zring_free (tx);
+  zring_free (rx);
+}
+
+/* A ring in memory the client could shrink is refused, even one whose
+   file cannot be sealed at all. */
+static void
+test_unsealed (void)
+{
+  struct zring *tx, *rx;
+  struct stat st;
+  FILE *file;
+  int fd;
+
+  tx = zring_create (RING_SIZE);
+  assert (tx);
+  assert (fstat (tx->memfd, &st) == 0);
+
+  /* A valid ring, but in a plain file. */
+  file = tmpfile ();
+  assert (file);
+  fd = dup (fileno (file));
+  fclose (file);
+  assert (write (fd, tx->shm, st.st_size) == st.st_size);
+
+  rx = zring_attach (fd, dup (tx->data_efd), dup (tx->space_efd));
+  assert (rx == NULL);
+
+  printf ("unsealed ring test passed\n");
+  zring_free (tx);
+}
+
+int
+main (void)
+{
+  test_stream ();
+  test_corrupt ();
+  test_unsealed ();
+  return 0;
+}
+
+#else /* HAVE_ZAPI_RING */
+
+int
+main (void)
+{
+  /* Tell automake this test was skipped. */
+  return 77;
+}
+
+#endif /* HAVE_ZAPI_RING */
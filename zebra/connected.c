@@ -67,7 +67,7 @@ connected_withdraw (struct connected *ifc)
 
   if (!CHECK_FLAG (ifc->conf, ZEBRA_IFC_CONFIGURED))
     {
-      listnode_delete (ifc->ifp->connected, ifc);
+      connected_delete (ifc->ifp, ifc);
       connected_free (ifc);
     }
 }
@@ -86,7 +86,7 @@ connected_announce (struct interface *ifp, struct connected *ifc)
         UNSET_FLAG (ifc->flags, ZEBRA_IFA_UNNUMBERED);
     }
 
-  listnode_add (ifp->connected, ifc);
+  connected_add (ifp, ifc);
 
   /* Update interface address information to protocol daemon. */
   if (ifc->address->family == AF_INET)
@@ -42,6 +42,7 @@
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/irdp.h"
+#include "zebra/zebra_nhg.h"
 
 #if defined (HAVE_RTADV)
 /* Order is intentional.  Matches RFC4191.  This array is also used for
@@ -578,7 +579,7 @@ if_delete_update (struct interface *ifp)
 		  /* Remove from interface address list (unconditionally). */
 		  if (!CHECK_FLAG (ifc->conf, ZEBRA_IFC_CONFIGURED))
 		    {
-		      listnode_delete (ifp->connected, ifc);
+		      connected_delete (ifp, ifc);
 		      connected_free (ifc);
                     }
                   else
@@ -604,7 +605,7 @@ if_delete_update (struct interface *ifp)
 		last = node;
 	      else
 		{
-		  listnode_delete (ifp->connected, ifc);
+		  connected_delete (ifp, ifc);
 		  connected_free (ifc);
 		}
 	    }
@@ -622,7 +623,7 @@ if_delete_update (struct interface *ifp)
      while processing the deletion.  Each client daemon is responsible
      for setting ifindex to IFINDEX_INTERNAL after processing the
      interface deletion message. */
-  ifp->ifindex = IFINDEX_INTERNAL;
+  if_set_index (ifp, IFINDEX_INTERNAL);
 }
 
 /* Interface is up. */
@@ -693,6 +694,8 @@ if_down (struct interface *ifp)
 	}
     }
 
+  zebra_nhg_if_down (ifp);
+
   /* Examine all static routes which direct to the interface. */
   rib_update (ifp->vrf_id);
 }
@@ -2305,7 +2308,7 @@ ip_address_install (struct vty *vty, struct interface *ifp,
 	ifc->label = XSTRDUP (MTYPE_CONNECTED_LABEL, label);
 
       /* Add to linked list. */
-      listnode_add (ifp->connected, ifc);
+      connected_add (ifp, ifc);
     }
 
   /* This address is configured from zebra. */
@@ -2376,7 +2379,7 @@ ip_address_uninstall (struct vty *vty, struct interface *ifp,
   if (! CHECK_FLAG (ifc->conf, ZEBRA_IFC_QUEUED)
       || ! CHECK_FLAG (ifp->status, ZEBRA_INTERFACE_ACTIVE))
     {
-      listnode_delete (ifp->connected, ifc);
+      connected_delete (ifp, ifc);
       connected_free (ifc);
       return CMD_WARNING;
     }
@@ -2484,7 +2487,7 @@ ipv6_address_install (struct vty *vty, struct interface *ifp,
 	ifc->label = XSTRDUP (MTYPE_CONNECTED_LABEL, label);
 
       /* Add to linked list. */
-      listnode_add (ifp->connected, ifc);
+      connected_add (ifp, ifc);
     }
 
   /* This address is configured from zebra. */
@@ -2555,7 +2558,7 @@ ipv6_address_uninstall (struct vty *vty, struct interface *ifp,
   if (! CHECK_FLAG (ifc->conf, ZEBRA_IFC_QUEUED)
       || ! CHECK_FLAG (ifp->status, ZEBRA_INTERFACE_ACTIVE))
     {
-      listnode_delete (ifp->connected, ifc);
+      connected_delete (ifp, ifc);
       connected_free (ifc);
       return CMD_WARNING;
     }
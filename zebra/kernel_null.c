@@ -29,8 +29,47 @@
 #include "zebra/redistribute.h"
 #include "zebra/connected.h"
 #include "zebra/rib.h"
+#include "zebra/zebra_dplane.h"
 
-int kernel_route_rib (struct prefix *a, struct rib *old, struct rib *new) { return 0; }
+/* Time each route change is made to take, in microseconds, to stand in
+   for the system calls a real kernel layer makes. */
+unsigned int kernel_null_delay = 0;
+
+int
+kernel_route_rib (struct prefix *p, struct rib *old, struct rib *new)
+{
+  struct rib *rib = new ? new : old;
+
+  if (kernel_null_delay)
+    usleep (kernel_null_delay);
+
+  /* Account for it as a kernel which answered at once. */
+  fib_stats.requests++;
+  fib_stats.writes++;
+  fib_stats.outstanding++;
+  rib_fib_result (rib->vrf_id, p, new, new ? new->seq : 0, NULL,
+                  new != NULL, 0);
+  return 0;
+}
+
+void kernel_route_flush (void) { return; }
+void kernel_route_sync (void) { return; }
+
+void kernel_dplane_prepare (struct dplane_ctx *ctx) { return; }
+
+void
+kernel_dplane_route (struct dplane_ctx *ctx)
+{
+  if (kernel_null_delay)
+    usleep (kernel_null_delay);
+  ctx->error = 0;
+}
+
+void kernel_dplane_sync (void) { return; }
+void kernel_dplane_finish (struct dplane_ctx *ctx) { return; }
+
+int kernel_nhg_install (struct nhg_entry *nhe) { return -1; }
+void kernel_nhg_uninstall (struct nhg_entry *nhe) { return; }
 
 int kernel_add_route (struct prefix_ipv4 *a, struct in_addr *b, int c, int d)
 { return 0; }
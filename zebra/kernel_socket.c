@@ -40,6 +40,7 @@
 #include "zebra/debug.h"
 #include "zebra/kernel_socket.h"
 #include "zebra/rib.h"
+#include "zebra/zebra_dplane.h"
 
 extern struct zebra_privs_t zserv_privs;
 extern struct zebra_t zebrad;
@@ -288,6 +289,9 @@ static const struct message rtm_flag_str[] =
 /* Kernel routing update socket. */
 int routing_sock = -1;
 
+/* The dataplane thread's, only ever written to. */
+int dplane_routing_sock = -1;
+
 /* Yes I'm checking ugly routing socket behavior. */
 /* #define DEBUG */
 
@@ -348,7 +352,7 @@ ifan_read (struct if_announcemsghdr *ifan)
       ifp = if_get_by_name_len(ifan->ifan_name,
 			       strnlen(ifan->ifan_name,
 				       sizeof(ifan->ifan_name)));
-      ifp->ifindex = ifan->ifan_index;
+      if_set_index (ifp, ifan->ifan_index);
 
       if_get_metric (ifp);
       if_add_update (ifp);
@@ -536,7 +540,7 @@ ifm_read (struct if_msghdr *ifm)
        * Fill in newly created interface structure, or larval
        * structure with ifindex IFINDEX_INTERNAL.
        */
-      ifp->ifindex = ifm->ifm_index;
+      if_set_index (ifp, ifm->ifm_index);
       
 #ifdef HAVE_BSD_IFI_LINK_STATE /* translate BSD kernel msg for link-state */
       bsd_linkdetect_translate(ifm);
@@ -1059,56 +1063,47 @@ rtm_read (struct rt_msghdr *rtm)
 #endif /* HAVE_IPV6 */
 }
 
-/* Interface function for the kernel routing table updates.  Support
- * for RTM_CHANGE will be needed.
+/* Build a routing message in msg, for rtm_write or the dataplane
+ * thread.  Returns its length, or -1 if there is no gateway to give
+ * the kernel.  Main thread only, as it looks at the interfaces.
  * Exported only for rt_socket.c
  */
 int
-rtm_write (int message,
+rtm_build (int message,
 	   union sockunion *dest,
 	   union sockunion *mask,
 	   union sockunion *gate,
 	   unsigned int index,
 	   int zebra_flags,
-	   int metric)
+	   int metric,
+	   struct rtm_buf *msg)
 {
-  int ret;
   caddr_t pnt;
   struct interface *ifp;
 
   /* Sequencial number of routing message. */
   static int msg_seq = 0;
 
-  /* Struct of rt_msghdr and buffer for storing socket's data. */
-  struct 
-  {
-    struct rt_msghdr rtm;
-    char buf[512];
-  } msg;
-  
-  if (routing_sock < 0)
-    return ZEBRA_ERR_EPERM;
-
   /* Clear and set rt_msghdr values */
-  memset (&msg, 0, sizeof (struct rt_msghdr));
-  msg.rtm.rtm_version = RTM_VERSION;
-  msg.rtm.rtm_type = message;
-  msg.rtm.rtm_seq = msg_seq++;
-  msg.rtm.rtm_addrs = RTA_DST;
-  msg.rtm.rtm_addrs |= RTA_GATEWAY;
-  msg.rtm.rtm_flags = RTF_UP;
-  msg.rtm.rtm_index = index;
+  memset (msg, 0, sizeof (struct rt_msghdr));
+  msg->rtm.rtm_version = RTM_VERSION;
+  msg->rtm.rtm_type = message;
+  msg->rtm.rtm_seq = msg_seq++;
+  msg->rtm.rtm_addrs = RTA_DST;
+  msg->rtm.rtm_addrs |= RTA_GATEWAY;
+  msg->rtm.rtm_flags = RTF_UP;
+  msg->rtm.rtm_index = index;
 
   if (metric != 0)
     {
-      msg.rtm.rtm_rmx.rmx_hopcount = metric;
-      msg.rtm.rtm_inits |= RTV_HOPCOUNT;
+      msg->rtm.rtm_rmx.rmx_hopcount = metric;
+      msg->rtm.rtm_inits |= RTV_HOPCOUNT;
     }
 
   ifp = if_lookup_by_index (index);
 
   if (gate && (message == RTM_ADD || message == RTM_CHANGE))
-    msg.rtm.rtm_flags |= RTF_GATEWAY;
+    msg->rtm.rtm_flags |= RTF_GATEWAY;
 
   /* When RTF_CLONING is unavailable on BSD, should we set some
    * other flag instead?
@@ -1116,7 +1111,7 @@ rtm_write (int message,
 #ifdef RTF_CLONING
   if (! gate && (message == RTM_ADD || message == RTM_CHANGE) && ifp &&
       (ifp->flags & IFF_POINTOPOINT) == 0)
-    msg.rtm.rtm_flags |= RTF_CLONING;
+    msg->rtm.rtm_flags |= RTF_CLONING;
 #endif /* RTF_CLONING */
 
   /* If no protocol specific gateway is specified, use link
@@ -1138,51 +1133,82 @@ rtm_write (int message,
     }
 
   if (mask)
-    msg.rtm.rtm_addrs |= RTA_NETMASK;
+    msg->rtm.rtm_addrs |= RTA_NETMASK;
   else if (message == RTM_ADD || message == RTM_CHANGE)
-    msg.rtm.rtm_flags |= RTF_HOST;
+    msg->rtm.rtm_flags |= RTF_HOST;
 
   /* Tagging route with flags */
-  msg.rtm.rtm_flags |= (RTF_PROTO1);
+  msg->rtm.rtm_flags |= (RTF_PROTO1);
 
   /* Additional flags. */
   if (zebra_flags & ZEBRA_FLAG_BLACKHOLE)
-    msg.rtm.rtm_flags |= RTF_BLACKHOLE;
+    msg->rtm.rtm_flags |= RTF_BLACKHOLE;
   if (zebra_flags & ZEBRA_FLAG_REJECT)
-    msg.rtm.rtm_flags |= RTF_REJECT;
+    msg->rtm.rtm_flags |= RTF_REJECT;
 
 
 #define SOCKADDRSET(X,R) \
-  if (msg.rtm.rtm_addrs & (R)) \
+  if (msg->rtm.rtm_addrs & (R)) \
     { \
       int len = SAROUNDUP (X); \
       memcpy (pnt, (caddr_t)(X), len); \
       pnt += len; \
     }
 
-  pnt = (caddr_t) msg.buf;
+  pnt = (caddr_t) msg->buf;
 
   /* Write each socket data into rtm message buffer */
   SOCKADDRSET (dest, RTA_DST);
   SOCKADDRSET (gate, RTA_GATEWAY);
   SOCKADDRSET (mask, RTA_NETMASK);
 
-  msg.rtm.rtm_msglen = pnt - (caddr_t) &msg;
+  msg->rtm.rtm_msglen = pnt - (caddr_t) msg;
+  return msg->rtm.rtm_msglen;
+}
 
-  ret = write (routing_sock, &msg, msg.rtm.rtm_msglen);
+/* The result of a routing message write which failed with errnum.
+ * Exported only for rt_socket.c
+ */
+int
+rtm_write_error (int errnum)
+{
+  if (errnum == EEXIST)
+    return ZEBRA_ERR_RTEXIST;
+  if (errnum == ENETUNREACH)
+    return ZEBRA_ERR_RTUNREACH;
+  if (errnum == ESRCH)
+    return ZEBRA_ERR_RTNOEXIST;
+
+  zlog_warn ("%s: write : %s (%d)", __func__, safe_strerror (errnum), errnum);
+  return ZEBRA_ERR_KERNEL;
+}
 
-  if (ret != msg.rtm.rtm_msglen) 
-    {
-      if (errno == EEXIST) 
-	return ZEBRA_ERR_RTEXIST;
-      if (errno == ENETUNREACH)
-	return ZEBRA_ERR_RTUNREACH;
-      if (errno == ESRCH)
-	return ZEBRA_ERR_RTNOEXIST;
-      
-      zlog_warn ("%s: write : %s (%d)", __func__, safe_strerror (errno), errno);
-      return ZEBRA_ERR_KERNEL;
-    }
+/* Interface function for the kernel routing table updates.  Support
+ * for RTM_CHANGE will be needed.
+ * Exported only for rt_socket.c
+ */
+int
+rtm_write (int message,
+	   union sockunion *dest,
+	   union sockunion *mask,
+	   union sockunion *gate,
+	   unsigned int index,
+	   int zebra_flags,
+	   int metric)
+{
+  struct rtm_buf msg;
+  int len;
+
+  if (routing_sock < 0)
+    return ZEBRA_ERR_EPERM;
+
+  len = rtm_build (message, dest, mask, gate, index, zebra_flags, metric,
+                   &msg);
+  if (len < 0)
+    return -1;
+
+  if (write (routing_sock, &msg, len) != len)
+    return rtm_write_error (errno);
   return ZEBRA_ERR_NOERROR;
 }
 
@@ -1345,6 +1371,17 @@ routing_socket (struct zebra_vrf *zvrf)
   /*if (fcntl (routing_sock, F_SETFL, O_NONBLOCK) < 0) 
     zlog_warn ("Can't set O_NONBLOCK to routing socket");*/
     
+  /* The dataplane thread writes its changes to a socket of its own, and
+     has no use for the kernel's messages. */
+  if (zebra_dplane_running ())
+    {
+      dplane_routing_sock = socket (AF_ROUTE, SOCK_RAW, 0);
+      if (dplane_routing_sock < 0)
+        zlog_warn ("Can't init dataplane routing socket");
+      else
+        shutdown (dplane_routing_sock, SHUT_RD);
+    }
+
   if ( zserv_privs.change (ZPRIVS_LOWER) )
     zlog_err ("routing_socket: Can't lower privileges");
 
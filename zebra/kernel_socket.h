@@ -26,8 +26,20 @@
 extern void rtm_read (struct rt_msghdr *);
 extern int ifam_read (struct ifa_msghdr *);
 extern int ifm_read (struct if_msghdr *);
+/* A routing message, as built by rtm_build. */
+struct rtm_buf
+{
+  struct rt_msghdr rtm;
+  char buf[512];
+};
+
+extern int rtm_build (int, union sockunion *, union sockunion *,
+                      union sockunion *, unsigned int, int, int,
+                      struct rtm_buf *);
 extern int rtm_write (int, union sockunion *, union sockunion *,
                       union sockunion *, unsigned int, int, int);
+extern int rtm_write_error (int);
+extern int dplane_routing_sock;
 extern const struct message rtm_type_str[];
 
 #endif /* __ZEBRA_KERNEL_SOCKET_H */
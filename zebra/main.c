@@ -41,6 +41,8 @@
 #include "zebra/irdp.h"
 #include "zebra/rtadv.h"
 #include "zebra/zebra_fpm.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/redistribute.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -80,6 +82,7 @@ struct option longopts[] =
   { "vty_port",    required_argument, NULL, 'P'},
   { "retain",      no_argument,       NULL, 'r'},
   { "dryrun",      no_argument,       NULL, 'C'},
+  { "dplane",      no_argument,       NULL, 'D'},
 #ifdef HAVE_NETLINK
   { "nl-bufsize",  required_argument, NULL, 's'},
 #endif /* HAVE_NETLINK */
@@ -137,6 +140,7 @@ usage (char *progname, int status)
 	      "-k, --keep_kernel  Don't delete old routes which installed by "\
 				  "zebra.\n"\
 	      "-C, --dryrun       Check configuration for validity and exit\n"\
+	      "-D, --dplane       Program the kernel from a separate thread\n"\
 	      "-A, --vty_addr     Set vty's bind address\n"\
 	      "-P, --vty_port     Set vty's port number\n"\
 	      "-r, --retain       When program terminates, retain added route "\
@@ -251,6 +255,7 @@ zebra_vrf_disable (vrf_id_t vrf_id, void **info)
 
   assert (zvrf);
 
+  zebra_redistribute_vrf_close (vrf_id);
   rib_close_table (zvrf->table[AFI_IP][SAFI_UNICAST]);
   rib_close_table (zvrf->table[AFI_IP6][SAFI_UNICAST]);
 
@@ -291,6 +296,7 @@ main (int argc, char **argv)
   char *vty_addr = NULL;
   int vty_port = ZEBRA_VTY_PORT;
   int dryrun = 0;
+  int dplane_mode = 0;
   int batch_mode = 0;
   int daemon_mode = 0;
   char *config_file = NULL;
@@ -312,9 +318,9 @@ main (int argc, char **argv)
       int opt;
   
 #ifdef HAVE_NETLINK  
-      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:ru:g:vs:C", longopts, 0);
+      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:ru:g:vs:CD", longopts, 0);
 #else
-      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:ru:g:vC", longopts, 0);
+      opt = getopt_long (argc, argv, "bdkf:F:i:z:hA:P:ru:g:vCD", longopts, 0);
 #endif /* HAVE_NETLINK */
 
       if (opt == EOF)
@@ -335,6 +341,9 @@ main (int argc, char **argv)
 	case 'C':
 	  dryrun = 1;
 	  break;
+	case 'D':
+	  dplane_mode = 1;
+	  break;
 	case 'f':
 	  config_file = optarg;
 	  break;
@@ -420,6 +429,11 @@ main (int argc, char **argv)
   /* For debug purpose. */
   /* SET_FLAG (zebra_debug_event, ZEBRA_DEBUG_EVENT); */
 
+  /* Route programming moves to the dataplane thread before the VRFs
+     are enabled. */
+  if (dplane_mode)
+    zebra_dplane_init ();
+
   /* Initialize VRF module, and make kernel routing socket. */
   zebra_vrf_init ();
 
@@ -466,6 +480,18 @@ main (int argc, char **argv)
   /* Output pid of zebra. */
   pid_output (pid_file);
 
+  /* The dataplane thread would not survive daemon(), so it is only
+     started now.  It keeps the privileges it is started with. */
+  if (zebra_dplane_running ())
+    {
+      if (zserv_privs.change (ZPRIVS_RAISE))
+        zlog_err ("Can't raise privileges");
+      if (zebra_dplane_start () < 0)
+        zlog_warn ("Programming the kernel from the main thread");
+      if (zserv_privs.change (ZPRIVS_LOWER))
+        zlog_err ("Can't lower privileges");
+    }
+
   /* After we have successfully acquired the pidfile, we can be sure
   *  about being the only copy of zebra process, which is submitting
   *  changes to the FIB.
@@ -31,6 +31,9 @@
 #include "linklist.h"
 #include "log.h"
 #include "vrf.h"
+#include "memory.h"
+#include "thread.h"
+#include "buffer.h"
 
 #include "zebra/rib.h"
 #include "zebra/zserv.h"
@@ -138,47 +141,251 @@ zebra_redistribute_default (struct zserv *client, vrf_id_t vrf_id)
 #endif /* HAVE_IPV6 */
 }
 
-/* Redistribute routes. */
-static void
-zebra_redistribute (struct zserv *client, int type, vrf_id_t vrf_id)
+/* Replay of the routes of one type in one VRF to a client which has
+   just asked for them.  The replay walks the tables a batch at a time,
+   pausing whenever the client's socket is full, so that a full table
+   neither stalls zebra nor piles up in the client's write buffer.
+   Changes made meanwhile are sent by redistribute_add/delete as usual,
+   since the client's redistribute flag is already set; the replay sends
+   whatever is selected when it reaches a node. */
+struct zebra_replay
+{
+  int type;
+  vrf_id_t vrf_id;
+  afi_t afi;
+  route_table_iter_t iter;
+
+  /* Routes sent so far. */
+  u_int32_t sent;
+};
+
+/* Nodes visited before yielding to other threads. */
+#define ZEBRA_REPLAY_BATCH 512
+
+static int zebra_redistribute_replay (struct thread *);
+
+/* Send the selected route of the given type at rn, if there is one. */
+static int
+zebra_redistribute_node (struct zserv *client, int type, struct route_node *rn)
 {
   struct rib *newrib;
+
+  RNODE_FOREACH_RIB (rn, newrib)
+    {
+      if (IS_ZEBRA_DEBUG_EVENT)
+        zlog_debug("%s: checking: selected=%d, type=%d, distance=%d, zebra_check_addr=%d",
+                   __func__, CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED),
+                   newrib->type, newrib->distance, zebra_check_addr (&rn->p));
+      if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
+          && newrib->type == type
+          && newrib->distance != DISTANCE_INFINITY
+          && zebra_check_addr (&rn->p))
+        {
+          if (rn->p.family == AF_INET)
+            {
+              client->redist_v4_add_cnt++;
+              zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p,
+                                     newrib);
+            }
+#ifdef HAVE_IPV6
+          else
+            {
+              client->redist_v6_add_cnt++;
+              zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p,
+                                     newrib);
+            }
+#endif /* HAVE_IPV6 */
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/* Point the replay at the table for its address family, if it has one. */
+static void
+zebra_replay_table (struct zebra_replay *replay)
+{
   struct route_table *table;
-  struct route_node *rn;
 
-  table = zebra_vrf_table (AFI_IP, SAFI_UNICAST, vrf_id);
+  table = zebra_vrf_table (replay->afi, SAFI_UNICAST, replay->vrf_id);
   if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      RNODE_FOREACH_RIB (rn, newrib)
+    route_table_iter_init (&replay->iter, table);
+  else
+    replay->iter.state = RT_ITER_STATE_DONE;
+}
+
+static void
+zebra_replay_free (struct zserv *client, struct zebra_replay *replay)
+{
+  route_table_iter_cleanup (&replay->iter);
+  listnode_delete (client->replay, replay);
+  XFREE (MTYPE_ZSERV_REPLAY, replay);
+}
+
+static void
+zebra_replay_schedule (struct zserv *client)
+{
+  if (! client->t_replay && client->replay && listcount (client->replay))
+    client->t_replay = thread_add_event (zebrad.master,
+                                         zebra_redistribute_replay, client, 0);
+}
+
+/* Send the next batch of the client's oldest replay. */
+static int
+zebra_redistribute_replay (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  struct zebra_replay *replay;
+  struct route_node *rn;
+  int n = 0;
+
+  client->t_replay = NULL;
+
+  while (client->replay && listcount (client->replay)
+         && n < ZEBRA_REPLAY_BATCH)
+    {
+      /* Wait for the socket to take what was written so far; the write
+         thread resumes us once the buffer is empty. */
+      if (client->t_suicide || client->t_write)
+        return 0;
+
+      replay = listgetdata (listhead (client->replay));
+
+      while (n < ZEBRA_REPLAY_BATCH && ! client->t_write
+             && (rn = route_table_iter_next (&replay->iter)))
         {
-          if (IS_ZEBRA_DEBUG_EVENT)
-            zlog_debug("%s: checking: selected=%d, type=%d, distance=%d, zebra_check_addr=%d",
-                       __func__, CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED),
-                       newrib->type, newrib->distance, zebra_check_addr (&rn->p));
-          if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
-              && newrib->type == type
-              && newrib->distance != DISTANCE_INFINITY
-              && zebra_check_addr (&rn->p))
-	    {
-	      client->redist_v4_add_cnt++;
-              zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
-            }
+          n++;
+          if (rn->info)
+            replay->sent += zebra_redistribute_node (client, replay->type, rn);
+        }
+
+      if (! route_table_iter_is_done (&replay->iter))
+        {
+          route_table_iter_pause (&replay->iter);
+          continue;
         }
 
 #ifdef HAVE_IPV6
-  table = zebra_vrf_table (AFI_IP6, SAFI_UNICAST, vrf_id);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      RNODE_FOREACH_RIB (rn, newrib)
-	if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && zebra_check_addr (&rn->p))
-	  {
-	    client->redist_v6_add_cnt++;
-	    zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
-	  }
+      if (replay->afi == AFI_IP)
+        {
+          replay->afi = AFI_IP6;
+          zebra_replay_table (replay);
+          continue;
+        }
 #endif /* HAVE_IPV6 */
+
+      if (IS_ZEBRA_DEBUG_EVENT)
+        zlog_debug ("%s: sent %u %s routes in vrf %u to %s", __func__,
+                    replay->sent, zebra_route_string (replay->type),
+                    replay->vrf_id, zebra_route_string (client->proto));
+      client->replay_cnt++;
+      client->replay_route_cnt += replay->sent;
+      zebra_replay_free (client, replay);
+    }
+
+  if (! client->t_write)
+    zebra_replay_schedule (client);
+  return 0;
+}
+
+/* Start replaying the routes of a type the client has just asked for. */
+static void
+zebra_redistribute (struct zserv *client, int type, vrf_id_t vrf_id)
+{
+  struct zebra_replay *replay;
+
+  if (! client->replay)
+    client->replay = list_new ();
+
+  replay = XCALLOC (MTYPE_ZSERV_REPLAY, sizeof (struct zebra_replay));
+  replay->type = type;
+  replay->vrf_id = vrf_id;
+  replay->afi = AFI_IP;
+  zebra_replay_table (replay);
+  listnode_add (client->replay, replay);
+
+  zebra_replay_schedule (client);
+}
+
+/* Forget the replay of a type the client no longer wants. */
+static void
+zebra_redistribute_cancel (struct zserv *client, int type, vrf_id_t vrf_id)
+{
+  struct listnode *node, *nnode;
+  struct zebra_replay *replay;
+
+  if (! client->replay)
+    return;
+
+  for (ALL_LIST_ELEMENTS (client->replay, node, nnode, replay))
+    if (replay->type == type && replay->vrf_id == vrf_id)
+      zebra_replay_free (client, replay);
+}
+
+/* The VRF is going away, and its tables with it.  Any replay still
+   walking them is over: the client has been sent what there was, and
+   is told about the routes being closed as usual. */
+void
+zebra_redistribute_vrf_close (vrf_id_t vrf_id)
+{
+  struct listnode *node, *rnode, *rnnode;
+  struct zserv *client;
+  struct zebra_replay *replay;
+
+  for (ALL_LIST_ELEMENTS_RO (zebrad.client_list, node, client))
+    if (client->replay)
+      for (ALL_LIST_ELEMENTS (client->replay, rnode, rnnode, replay))
+        if (replay->vrf_id == vrf_id)
+          zebra_replay_free (client, replay);
+}
+
+/* The client's socket has room again. */
+void
+zebra_redistribute_resume (struct zserv *client)
+{
+  zebra_replay_schedule (client);
+}
+
+void
+zebra_redistribute_free (struct zserv *client)
+{
+  struct zebra_replay *replay;
+
+  THREAD_OFF (client->t_replay);
+  if (! client->replay)
+    return;
+
+  while (listcount (client->replay))
+    {
+      replay = listgetdata (listhead (client->replay));
+      zebra_replay_free (client, replay);
+    }
+  list_free (client->replay);
+  client->replay = NULL;
+}
+
+void
+zebra_redistribute_show (struct vty *vty, struct zserv *client)
+{
+  struct listnode *node;
+  struct zebra_replay *replay;
+  char buf[PREFIX_STRLEN];
+
+  vty_out (vty, "Redist Replay: %u done, %u routes sent%s",
+           client->replay_cnt, client->replay_route_cnt, VTY_NEWLINE);
+  if (! client->replay)
+    return;
+
+  for (ALL_LIST_ELEMENTS_RO (client->replay, node, replay))
+    {
+      vty_out (vty, "  %s vrf %u %s: %u routes sent",
+               zebra_route_string (replay->type), replay->vrf_id,
+               afi2str (replay->afi), replay->sent);
+      if (replay->iter.state == RT_ITER_STATE_PAUSED)
+        vty_out (vty, ", next after %s",
+                 prefix2str (&replay->iter.pause_prefix, buf, sizeof (buf)));
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
 }
 
 void
@@ -278,6 +485,7 @@ zebra_redistribute_delete (int command, struct zserv *client, int length,
     return;
 
   vrf_bitmap_unset (client->redist[type], vrf_id);
+  zebra_redistribute_cancel (client, type, vrf_id);
 }
 
 void
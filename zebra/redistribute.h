@@ -24,6 +24,7 @@
 #define _ZEBRA_REDISTRIBUTE_H
 
 #include "table.h"
+#include "vty.h"
 #include "zserv.h"
 
 extern void zebra_redistribute_add (int, struct zserv *, int, vrf_id_t);
@@ -34,6 +35,11 @@ extern void zebra_redistribute_default_add (int, struct zserv *, int,
 extern void zebra_redistribute_default_delete (int, struct zserv *, int,
     vrf_id_t);
 
+extern void zebra_redistribute_resume (struct zserv *);
+extern void zebra_redistribute_vrf_close (vrf_id_t);
+extern void zebra_redistribute_free (struct zserv *);
+extern void zebra_redistribute_show (struct vty *, struct zserv *);
+
 extern void redistribute_add (struct prefix *, struct rib *new, struct rib *old);
 extern void redistribute_delete (struct prefix *, struct rib *);
 
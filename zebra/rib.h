@@ -32,6 +32,8 @@
 
 #define DISTANCE_INFINITY  255
 
+struct nhg_entry;
+
 struct rib
 {
   /* Link list. */
@@ -40,6 +42,9 @@ struct rib
   
   /* Nexthop structure */
   struct nexthop *nexthop;
+
+  /* Nexthop group shared with other routes, while in the FIB. */
+  struct nhg_entry *nhe;
   
   /* Refrence count. */
   unsigned long refcnt;
@@ -80,13 +85,24 @@ struct rib
 #define RIB_ENTRY_REMOVED	(1 << 0)
 #define RIB_ENTRY_CHANGED	(1 << 1)
 #define RIB_ENTRY_SELECTED_FIB	(1 << 2)
+#define RIB_ENTRY_STALE		(1 << 3)
 
   /* Nexthop information. */
   u_char nexthop_num;
   u_char nexthop_active_num;
   u_char nexthop_fib_num;
+
+  /* Generation of nhe which the kernel route points at, 0 if none. */
+  u_int32_t nhe_gen;
+
+  /* Set when the rib enters the table, so that a kernel result for a
+     freed rib is not taken for a later one at the same address. */
+  u_int32_t seq;
 };
 
+#define RIB_SYSTEM_ROUTE(R) \
+        ((R)->type == ZEBRA_ROUTE_KERNEL || (R)->type == ZEBRA_ROUTE_CONNECT)
+
 /* meta-queue structure:
  * sub-queue 0: connected, kernel
  * sub-queue 1: static
@@ -128,6 +144,19 @@ typedef struct rib_dest_t_
    */
   TAILQ_ENTRY(rib_dest_t_) fpm_q_entries;
 
+  /*
+   * Linkage to keep the dest on the FPM's list of the dests it was
+   * sent, in the order they were sent, and the generation of the last
+   * message about it.
+   */
+  TAILQ_ENTRY(rib_dest_t_) fpm_log_entries;
+  u_int32_t fpm_gen;
+
+  /*
+   * Resolution cache entries for the gateways of these routes.
+   */
+  struct list *resolve;
+
 } rib_dest_t;
 
 #define RIB_ROUTE_QUEUED(x)	(1 << (x))
@@ -149,6 +178,12 @@ typedef struct rib_dest_t_
  */
 #define RIB_DEST_UPDATE_FPM    (1 << (ZEBRA_MAX_QINDEX + 2))
 
+/*
+ * This flag is set while the dest is on the FPM's list of the dests it
+ * was sent, which it may have to send again when it reconnects.
+ */
+#define RIB_DEST_FPM_LOGGED    (1 << (ZEBRA_MAX_QINDEX + 3))
+
 /*
  * Macro to iterate over each route for a destination (prefix).
  */
@@ -275,6 +310,30 @@ struct rtadv
 };
 #endif /* HAVE_RTADV */
 
+/* Counters for route changes handed to the kernel. */
+struct fib_stats
+{
+  /* Route changes sent, and the number of writes they took. */
+  unsigned long requests;
+  unsigned long writes;
+
+  /* Results reported back by the kernel. */
+  unsigned long completed;
+  unsigned long failed;
+
+  /* Changes sent but not yet answered. */
+  unsigned long outstanding;
+  unsigned long outstanding_max;
+
+  /* Completions per second: the last full second, and the best seen. */
+  unsigned long rate;
+  unsigned long rate_max;
+  time_t rate_time;
+  unsigned long rate_count;
+};
+
+extern struct fib_stats fib_stats;
+
 #ifdef HAVE_NETLINK
 /* Socket interface to kernel */
 struct nlsock
@@ -311,6 +370,8 @@ struct zebra_vrf
   struct nlsock netlink;     /* kernel messages */
   struct nlsock netlink_cmd; /* command channel */
   struct thread *t_netlink;
+  struct nl_batch *nl_batch; /* route changes awaiting the kernel */
+  struct nlsock netlink_dplane; /* dataplane thread's channel */
 #endif
 
   /* 2nd pointer type used primarily to quell a warning on
@@ -328,6 +389,13 @@ struct zebra_vrf
 
   /* Recursive Nexthop table */
   struct route_table *rnh_table[AFI_MAX];
+
+  /* Unicast prefixes whose FIB route changed since the rnh table was
+     last evaluated */
+  struct route_table *rnh_changed[AFI_MAX];
+
+  /* Where the gateways of the unicast routes resolve */
+  struct route_table *resolve_table[AFI_MAX];
 };
 
 /*
@@ -444,8 +512,14 @@ extern struct rib *rib_lookup_ipv4 (struct prefix_ipv4 *, vrf_id_t);
 extern void rib_update (vrf_id_t);
 extern void rib_weed_tables (void);
 extern void rib_sweep_route (void);
+extern unsigned long rib_mark_stale (int type);
+extern unsigned long rib_sweep_stale (int type);
 extern void rib_close_table (struct route_table *);
 extern void rib_close (void);
+extern void rib_queue_node (struct route_node *);
+extern void rib_fib_result (vrf_id_t, struct prefix *, struct rib *,
+                            u_int32_t seq, struct nexthop *fib,
+                            int install, int error);
 extern void rib_init (void);
 extern unsigned long rib_score_proto (u_char proto);
 
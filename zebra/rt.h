@@ -32,4 +32,35 @@ extern int kernel_add_route (struct prefix_ipv4 *, struct in_addr *, int, int);
 extern int kernel_address_add_ipv4 (struct interface *, struct connected *);
 extern int kernel_address_delete_ipv4 (struct interface *, struct connected *);
 
+/* Send on any route changes kernel_route_rib is still holding back. */
+extern void kernel_route_flush (void);
+
+/* Wait until every route change handed to kernel_route_rib has been
+   applied by the kernel. */
+extern void kernel_route_sync (void);
+
+/* Route programming from the dataplane thread, see zebra_dplane.c.
+   kernel_dplane_prepare runs on the main thread when a change is
+   queued, and puts everything the kernel needs to be told into the
+   context.  On the dataplane thread, kernel_dplane_route starts on a
+   context's change, and what the kernel answered must be in the context
+   by the time kernel_dplane_sync has returned.  Neither may touch
+   anything but the contexts and the kernel layer's own dataplane state:
+   no RIB, interface or VRF state, and no logging.  kernel_dplane_finish
+   then runs on the main thread again, sets ctx->error from the answers
+   and reports on them. */
+struct dplane_ctx;
+extern void kernel_dplane_prepare (struct dplane_ctx *);
+extern void kernel_dplane_route (struct dplane_ctx *);
+extern void kernel_dplane_sync (void);
+extern void kernel_dplane_finish (struct dplane_ctx *);
+
+/* Shared nexthop groups, see zebra_nhg.c.  kernel_nhg_install puts the
+   group into the kernel, or brings it up to date there if NHG_CHANGED
+   is set, and returns -1 if the kernel layer cannot program it so that
+   its routes have to carry their own nexthops. */
+struct nhg_entry;
+extern int kernel_nhg_install (struct nhg_entry *);
+extern void kernel_nhg_uninstall (struct nhg_entry *);
+
 #endif /* _ZEBRA_RT_H */
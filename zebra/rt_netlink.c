@@ -45,9 +45,15 @@
 #include "zebra/redistribute.h"
 #include "zebra/interface.h"
 #include "zebra/debug.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nhg.h"
 
 #include "rt_netlink.h"
 
+#ifdef HAVE_LINUX_NEXTHOP_H
+#include <linux/nexthop.h>
+#endif /* HAVE_LINUX_NEXTHOP_H */
+
 static const struct message nlmsg_str[] = {
   {RTM_NEWROUTE, "RTM_NEWROUTE"},
   {RTM_DELROUTE, "RTM_DELROUTE"},
@@ -58,6 +64,11 @@ static const struct message nlmsg_str[] = {
   {RTM_NEWADDR,  "RTM_NEWADDR"},
   {RTM_DELADDR,  "RTM_DELADDR"},
   {RTM_GETADDR,  "RTM_GETADDR"},
+#ifdef HAVE_LINUX_NEXTHOP_H
+  {RTM_NEWNEXTHOP, "RTM_NEWNEXTHOP"},
+  {RTM_DELNEXTHOP, "RTM_DELNEXTHOP"},
+  {RTM_GETNEXTHOP, "RTM_GETNEXTHOP"},
+#endif /* HAVE_LINUX_NEXTHOP_H */
   {0, NULL}
 };
 
@@ -72,6 +83,8 @@ static struct {
   size_t size;
 } nl_rcvbuf;
 
+static void netlink_batch_sync (struct zebra_vrf *);
+
 /* Note: on netlink systems, there should be a 1-to-1 mapping between interface
    names and ifindex values. */
 static void
@@ -96,7 +109,7 @@ set_ifindex(struct interface *ifp, ifindex_t ifi_index)
 	  if_delete_update(oifp);
         }
     }
-  ifp->ifindex = ifi_index;
+  if_set_index (ifp, ifi_index);
 }
 
 #ifndef SO_RCVBUFFORCE
@@ -392,7 +405,9 @@ netlink_parse_info (int (*filter) (struct sockaddr_nl *, struct nlmsghdr *,
            * linux sets the originators port-id for {NEW|DEL}ADDR messages,
            * so this has to be checked here. */
           if (nl != &zvrf->netlink_cmd
-              && h->nlmsg_pid == zvrf->netlink_cmd.snl.nl_pid
+              && (h->nlmsg_pid == zvrf->netlink_cmd.snl.nl_pid
+                  || (zvrf->netlink_dplane.sock >= 0
+                      && h->nlmsg_pid == zvrf->netlink_dplane.snl.nl_pid))
               && (h->nlmsg_type != RTM_NEWADDR && h->nlmsg_type != RTM_DELADDR))
             {
               if (IS_ZEBRA_DEBUG_KERNEL)
@@ -1279,6 +1294,8 @@ interface_lookup_netlink (struct zebra_vrf *zvrf)
 {
   int ret;
 
+  netlink_batch_sync (zvrf);
+
   /* Get interface information. */
   ret = netlink_request (AF_PACKET, RTM_GETLINK, &zvrf->netlink_cmd);
   if (ret < 0)
@@ -1315,6 +1332,8 @@ netlink_route_read (struct zebra_vrf *zvrf)
 {
   int ret;
 
+  netlink_batch_sync (zvrf);
+
   /* Get IPv4 routing table. */
   ret = netlink_request (AF_INET, RTM_GETROUTE, &zvrf->netlink_cmd);
   if (ret < 0)
@@ -1428,6 +1447,9 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl, struct zebra_vrf *zvrf)
   };
   int save_errno;
 
+  if (nl == &zvrf->netlink_cmd)
+    netlink_batch_sync (zvrf);
+
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
@@ -1464,6 +1486,723 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl, struct zebra_vrf *zvrf)
   return netlink_parse_info (netlink_talk_filter, nl, zvrf);
 }
 
+/* Route changes are not sent to the kernel one at a time, waiting for
+ * the answer to each.  They are packed into a buffer which is written
+ * out when it fills up or the RIB work queue runs dry, and the kernel's
+ * answers are read back as they arrive.
+ *
+ * Only the last message of each write asks for an ACK.  The kernel
+ * reports errors whether asked to or not, and handles the messages of
+ * a write in order, so any answer also completes every earlier request
+ * still waiting.  This keeps the answers to a large write from
+ * overrunning the command socket's receive buffer.
+ */
+
+/* Size of the send buffer. */
+#define NL_BATCH_BUF_SIZE	65536
+
+/* Requests which may be waiting for an answer at once. */
+#define NL_BATCH_OUTSTANDING	8192
+
+/* A routing table change message. */
+struct nl_route_req
+{
+  struct nlmsghdr n;
+  struct rtmsg r;
+  char buf[NL_PKT_BUF_SIZE];
+};
+
+struct nl_request
+{
+  u_int32_t seq;
+  int cmd;
+  struct prefix p;
+  struct rib *rib;
+  u_int32_t rib_seq;
+
+  /* For nexthop object changes, the group they are for. */
+  u_int32_t nh_id;
+};
+
+struct nl_batch
+{
+  struct zebra_vrf *zvrf;
+
+  /* Messages not yet written, and the offset of the last of them. */
+  char buf[NL_BATCH_BUF_SIZE];
+  size_t len;
+  size_t last;
+
+  /* Requests in sequence order, oldest first.  The last 'unsent' of
+     them are still in buf. */
+  struct nl_request req[NL_BATCH_OUTSTANDING];
+  unsigned int head;
+  unsigned int count;
+  unsigned int unsent;
+
+  struct thread *t_flush;
+  struct thread *t_read;
+
+  /* Does the kernel have nexthop objects? */
+  int nhg;
+};
+
+static int netlink_batch_read (struct thread *);
+static void netlink_nhg_result (struct nl_batch *, struct nl_request *, int);
+
+/* Errors that occur because of races in link handling. */
+static int
+netlink_route_error_benign (int cmd, int error)
+{
+  return ((cmd == RTM_DELROUTE && (error == ENODEV || error == ESRCH))
+          || (cmd == RTM_NEWROUTE && error == EEXIST));
+}
+
+/* Pass the kernel's answer to a request on to the RIB. */
+static void
+netlink_batch_result (struct nl_batch *nb, struct nl_request *req,
+                      int error)
+{
+  if (req->nh_id)
+    {
+      netlink_nhg_result (nb, req, error);
+      return;
+    }
+
+  if (netlink_route_error_benign (req->cmd, error))
+    {
+      if (IS_ZEBRA_DEBUG_KERNEL)
+        zlog_debug ("%s: error: %s type=%s(%u), seq=%u",
+                    nb->zvrf->netlink_cmd.name, safe_strerror (error),
+                    lookup (nlmsg_str, req->cmd), req->cmd, req->seq);
+      error = 0;
+    }
+
+  rib_fib_result (nb->zvrf->vrf_id, &req->p, req->rib, req->rib_seq, NULL,
+                  req->cmd == RTM_NEWROUTE, error);
+}
+
+/* Complete the requests up to and including seq, all of which succeeded
+   except possibly the last. */
+static void
+netlink_batch_complete (struct nl_batch *nb, u_int32_t seq, int error)
+{
+  while (nb->count > nb->unsent)
+    {
+      struct nl_request *req = &nb->req[nb->head];
+      int32_t diff = req->seq - seq;
+
+      if (diff > 0)
+        break;
+
+      nb->head = (nb->head + 1) % NL_BATCH_OUTSTANDING;
+      nb->count--;
+      netlink_batch_result (nb, req, diff == 0 ? error : 0);
+    }
+}
+
+/* Give up on the answers to everything which was written. */
+static void
+netlink_batch_abandon (struct nl_batch *nb)
+{
+  if (nb->count > nb->unsent)
+    zlog_err ("%s: lost the answers to %u route changes",
+              nb->zvrf->netlink_cmd.name, nb->count - nb->unsent);
+  while (nb->count > nb->unsent)
+    netlink_batch_complete (nb, nb->req[nb->head].seq, 0);
+}
+
+/* Write out the buffered messages. */
+static void
+netlink_batch_flush (struct nl_batch *nb)
+{
+  struct nlsock *nl = &nb->zvrf->netlink_cmd;
+  struct sockaddr_nl snl;
+  struct iovec iov = {
+    .iov_base = nb->buf,
+    .iov_len = nb->len
+  };
+  struct msghdr msg = {
+    .msg_name = (void *) &snl,
+    .msg_namelen = sizeof snl,
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+  };
+  int status;
+  int save_errno;
+
+  THREAD_OFF (nb->t_flush);
+  if (! nb->len)
+    return;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  /* Request an acknowledgement for the last message only. */
+  ((struct nlmsghdr *) (nb->buf + nb->last))->nlmsg_flags |= NLM_F_ACK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("netlink_batch_flush: %s %u messages, %lu bytes", nl->name,
+                nb->unsent, (u_long) nb->len);
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  do
+    status = sendmsg (nl->sock, &msg, 0);
+  while (status < 0 && errno == EINTR);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  nb->len = 0;
+  fib_stats.writes++;
+
+  if (status < 0)
+    {
+      zlog (NULL, LOG_ERR, "netlink_batch_flush sendmsg() error: %s",
+            safe_strerror (save_errno));
+
+      /* None of the unsent requests will be answered; they are the
+         newest, so take them off the end. */
+      while (nb->unsent)
+        {
+          nb->count--;
+          nb->unsent--;
+          netlink_batch_result (nb, &nb->req[(nb->head + nb->count)
+                                             % NL_BATCH_OUTSTANDING],
+                                save_errno);
+        }
+      return;
+    }
+
+  nb->unsent = 0;
+  if (! nb->t_read)
+    nb->t_read = thread_add_read (zebrad.master, netlink_batch_read, nb,
+                                  nl->sock);
+}
+
+static int
+netlink_batch_flush_event (struct thread *thread)
+{
+  struct nl_batch *nb = THREAD_ARG (thread);
+
+  nb->t_flush = NULL;
+  netlink_batch_flush (nb);
+  return 0;
+}
+
+/* Read one lot of answers from the command socket.  Returns -1 with
+   errno set if there was nothing to read or the read failed. */
+static int
+netlink_batch_recv (struct nl_batch *nb, int flags)
+{
+  struct nlsock *nl = &nb->zvrf->netlink_cmd;
+  struct iovec iov = {
+    .iov_base = nl_rcvbuf.p,
+    .iov_len = nl_rcvbuf.size,
+  };
+  struct sockaddr_nl snl;
+  struct msghdr msg = {
+    .msg_name = (void *) &snl,
+    .msg_namelen = sizeof snl,
+    .msg_iov = &iov,
+    .msg_iovlen = 1
+  };
+  struct nlmsghdr *h;
+  int status;
+
+  status = recvmsg (nl->sock, &msg, flags);
+  if (status < 0)
+    {
+      if (errno == ENOBUFS)
+        {
+          /* Answers were dropped, so there is no telling which of the
+             outstanding requests worked. */
+          zlog (NULL, LOG_ERR, "%s recvmsg overrun: %s",
+                nl->name, safe_strerror (errno));
+          netlink_batch_abandon (nb);
+          return 0;
+        }
+      return -1;
+    }
+
+  if (status == 0)
+    {
+      zlog (NULL, LOG_ERR, "%s EOF", nl->name);
+      errno = EPIPE;
+      return -1;
+    }
+
+  for (h = (struct nlmsghdr *) nl_rcvbuf.p;
+       NLMSG_OK (h, (unsigned int) status);
+       h = NLMSG_NEXT (h, status))
+    {
+      struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA (h);
+
+      if (h->nlmsg_type != NLMSG_ERROR)
+        {
+          netlink_talk_filter (&snl, h, nb->zvrf->vrf_id);
+          continue;
+        }
+
+      if (h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+        {
+          zlog (NULL, LOG_ERR, "%s error: message truncated", nl->name);
+          continue;
+        }
+
+      if (IS_ZEBRA_DEBUG_KERNEL && err->error == 0)
+        zlog_debug ("%s: %s ACK: type=%s(%u), seq=%u, pid=%u",
+                    __func__, nl->name,
+                    lookup (nlmsg_str, err->msg.nlmsg_type),
+                    err->msg.nlmsg_type, err->msg.nlmsg_seq,
+                    err->msg.nlmsg_pid);
+
+      netlink_batch_complete (nb, err->msg.nlmsg_seq, -err->error);
+    }
+
+  return 0;
+}
+
+/* Read answers as they arrive. */
+static int
+netlink_batch_read (struct thread *thread)
+{
+  struct nl_batch *nb = THREAD_ARG (thread);
+  struct nlsock *nl = &nb->zvrf->netlink_cmd;
+
+  nb->t_read = NULL;
+
+  while (nb->count > nb->unsent)
+    if (netlink_batch_recv (nb, MSG_DONTWAIT) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+          break;
+        zlog (NULL, LOG_ERR, "%s recvmsg error: %s", nl->name,
+              safe_strerror (errno));
+        netlink_batch_abandon (nb);
+      }
+
+  if (nb->count > nb->unsent)
+    nb->t_read = thread_add_read (zebrad.master, netlink_batch_read, nb,
+                                  nl->sock);
+  return 0;
+}
+
+/* Write out everything buffered and wait for the answers to all of
+   it. */
+static void
+netlink_batch_drain (struct nl_batch *nb)
+{
+  netlink_batch_flush (nb);
+
+  while (nb->count)
+    if (netlink_batch_recv (nb, 0) < 0 && errno != EINTR)
+      {
+        zlog (NULL, LOG_ERR, "%s recvmsg error: %s",
+              nb->zvrf->netlink_cmd.name, safe_strerror (errno));
+        netlink_batch_abandon (nb);
+      }
+
+  THREAD_READ_OFF (nb->t_read);
+}
+
+/* Finish with queued route changes before using the command socket
+   synchronously, so that their answers are not mistaken for others. */
+static void
+netlink_batch_sync (struct zebra_vrf *zvrf)
+{
+  if (zvrf->nl_batch)
+    netlink_batch_drain (zvrf->nl_batch);
+}
+
+/* Queue a route change for the kernel, or with nh_id, a change to a
+   nexthop object of that group. */
+static int
+netlink_batch_add (struct nlmsghdr *n, struct zebra_vrf *zvrf, int cmd,
+                   struct prefix *p, struct rib *rib, u_int32_t nh_id)
+{
+  struct nl_batch *nb = zvrf->nl_batch;
+  struct nl_request *req;
+
+  if (! nb)
+    return netlink_talk (n, &zvrf->netlink_cmd, zvrf);
+
+  if (nb->len + NLMSG_ALIGN (n->nlmsg_len) > NL_BATCH_BUF_SIZE)
+    netlink_batch_flush (nb);
+
+  /* Too much in flight: wait for the oldest answers. */
+  if (nb->count == NL_BATCH_OUTSTANDING)
+    {
+      netlink_batch_flush (nb);
+      while (nb->count == NL_BATCH_OUTSTANDING)
+        if (netlink_batch_recv (nb, 0) < 0 && errno != EINTR)
+          {
+            zlog (NULL, LOG_ERR, "%s recvmsg error: %s",
+                  zvrf->netlink_cmd.name, safe_strerror (errno));
+            netlink_batch_abandon (nb);
+          }
+    }
+
+  n->nlmsg_seq = ++zvrf->netlink_cmd.seq;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("netlink_batch_add: %s type %s(%u), seq=%u",
+                zvrf->netlink_cmd.name, lookup (nlmsg_str, n->nlmsg_type),
+                n->nlmsg_type, n->nlmsg_seq);
+
+  nb->last = nb->len;
+  memcpy (nb->buf + nb->len, n, n->nlmsg_len);
+  nb->len += NLMSG_ALIGN (n->nlmsg_len);
+
+  req = &nb->req[(nb->head + nb->count) % NL_BATCH_OUTSTANDING];
+  req->seq = n->nlmsg_seq;
+  req->cmd = cmd;
+  if (p)
+    prefix_copy (&req->p, p);
+  req->rib = (cmd == RTM_NEWROUTE) ? rib : NULL;
+  req->rib_seq = req->rib ? rib->seq : 0;
+  req->nh_id = nh_id;
+  nb->count++;
+  nb->unsent++;
+
+  if (! nh_id)
+    {
+      fib_stats.requests++;
+      if (++fib_stats.outstanding > fib_stats.outstanding_max)
+        fib_stats.outstanding_max = fib_stats.outstanding;
+    }
+
+  /* Changes made by the RIB work queue are flushed when it has no more
+     to do, others at the end of the current event. */
+  if (! nb->t_flush
+      && ! (zebrad.ribq && listcount (zebrad.ribq->items)))
+    nb->t_flush = thread_add_event (zebrad.master, netlink_batch_flush_event,
+                                    nb, 0);
+  return 0;
+}
+
+static struct nl_batch *
+netlink_batch_new (struct zebra_vrf *zvrf)
+{
+  struct nl_batch *nb;
+
+  nb = XCALLOC (MTYPE_NETLINK_BATCH, sizeof (struct nl_batch));
+  nb->zvrf = zvrf;
+  return nb;
+}
+
+static void
+netlink_batch_free (struct nl_batch *nb)
+{
+  if (nb->zvrf->netlink_cmd.sock >= 0)
+    netlink_batch_drain (nb);
+  THREAD_OFF (nb->t_flush);
+  THREAD_OFF (nb->t_read);
+  XFREE (MTYPE_NETLINK_BATCH, nb);
+}
+
+/* Shared nexthop groups, see zebra_nhg.c.  A group is a kernel nexthop
+ * object with the group's ID, made up of one object for each of its
+ * nexthops, with the IDs after it.  Routes using the group point at it
+ * with RTA_NH_ID, so a change to the group is a few messages however
+ * many routes use it.  The changes are queued on the command socket
+ * with the route changes, in order.
+ */
+
+#ifdef HAVE_LINUX_NEXTHOP_H
+
+/* A nexthop object change message. */
+struct nl_nhg_req
+{
+  struct nlmsghdr n;
+  struct nhmsg nhm;
+  char buf[NL_PKT_BUF_SIZE];
+};
+
+static void
+netlink_nhg_result (struct nl_batch *nb, struct nl_request *req, int error)
+{
+  struct nhg_entry *nhe;
+
+  if (! error || (req->cmd == RTM_DELNEXTHOP && error == ENOENT))
+    return;
+
+  zlog_err ("%s: %s for nexthop group %u failed: %s",
+            nb->zvrf->netlink_cmd.name, lookup (nlmsg_str, req->cmd),
+            req->nh_id, safe_strerror (error));
+
+  /* Put it in again, with every route using it, the next time one of
+     them is processed. */
+  if (req->cmd == RTM_NEWNEXTHOP
+      && (nhe = zebra_nhg_lookup_id (req->nh_id)) != NULL)
+    {
+      UNSET_FLAG (nhe->status, NHG_INSTALLED);
+      nhe->gen++;
+    }
+}
+
+static void
+netlink_nhg_msg (struct nl_nhg_req *req, int cmd, u_int32_t id, int family)
+{
+  memset (req, 0, sizeof *req - NL_PKT_BUF_SIZE);
+
+  req->n.nlmsg_len = NLMSG_LENGTH (sizeof (struct nhmsg));
+  req->n.nlmsg_flags = NLM_F_REQUEST;
+  req->n.nlmsg_type = cmd;
+  req->nhm.nh_family = family;
+
+  /* The kernel takes a protocol only when adding. */
+  if (cmd == RTM_NEWNEXTHOP)
+    {
+      req->n.nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+      req->nhm.nh_protocol = RTPROT_ZEBRA;
+    }
+
+  addattr32 (&req->n, sizeof *req, NHA_ID, id);
+}
+
+static void
+netlink_nhg_delete (struct zebra_vrf *zvrf, u_int32_t id, u_int32_t group)
+{
+  struct nl_nhg_req req;
+
+  netlink_nhg_msg (&req, RTM_DELNEXTHOP, id, AF_UNSPEC);
+  netlink_batch_add (&req.n, zvrf, RTM_DELNEXTHOP, NULL, NULL, group);
+}
+
+/* Add or replace the object for one member of the group. */
+static void
+netlink_nhg_member (struct zebra_vrf *zvrf, struct nhg_entry *nhe,
+                    u_int32_t id, struct nexthop *nexthop)
+{
+  struct nl_nhg_req req;
+  int family;
+  int bytelen = 0;
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFNAME:
+      family = AF_INET;
+      bytelen = 4;
+      break;
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      family = AF_INET6;
+      bytelen = 16;
+      break;
+#endif /* HAVE_IPV6 */
+    default:
+      family = afi2family (nhe->afi);
+      break;
+    }
+
+  netlink_nhg_msg (&req, RTM_NEWNEXTHOP, id, family);
+  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ONLINK))
+    req.nhm.nh_flags |= RTNH_F_ONLINK;
+  addattr32 (&req.n, sizeof req, NHA_OIF, nexthop->ifindex);
+  if (bytelen)
+    addattr_l (&req.n, sizeof req, NHA_GATEWAY, &nexthop->gate, bytelen);
+
+  netlink_batch_add (&req.n, zvrf, RTM_NEWNEXTHOP, NULL, NULL, nhe->id);
+}
+
+/* Can the group be a kernel object?  Only if there is an interface for
+   each of its nexthops. */
+static int
+netlink_nhg_usable (struct zebra_vrf *zvrf, struct nhg_entry *nhe)
+{
+  struct nexthop *nexthop;
+
+  if (! zvrf || ! zvrf->nl_batch || ! zvrf->nl_batch->nhg || ! nhe->fib)
+    return 0;
+
+  for (nexthop = nhe->fib; nexthop; nexthop = nexthop->next)
+    if (! nexthop->ifindex)
+      return 0;
+  return 1;
+}
+
+int
+kernel_nhg_install (struct nhg_entry *nhe)
+{
+  struct zebra_vrf *zvrf = vrf_info_lookup (nhe->vrf_id);
+  struct nl_nhg_req req;
+  struct nexthop_grp grp[MULTIPATH_NUM];
+  struct nexthop *nexthop;
+  unsigned int i;
+
+  if (! netlink_nhg_usable (zvrf, nhe))
+    {
+      /* Its routes have to carry their own nexthops again. */
+      if (CHECK_FLAG (nhe->status, NHG_INSTALLED))
+        nhe->gen++;
+      return -1;
+    }
+
+  /* Routes pointing at it from before are not there any more. */
+  if (! CHECK_FLAG (nhe->status, NHG_INSTALLED))
+    nhe->gen++;
+
+  memset (grp, 0, sizeof grp);
+  for (i = 0, nexthop = nhe->fib; nexthop; nexthop = nexthop->next, i++)
+    {
+      grp[i].id = nhe->id + 1 + i;
+      netlink_nhg_member (zvrf, nhe, grp[i].id, nexthop);
+    }
+
+  netlink_nhg_msg (&req, RTM_NEWNEXTHOP, nhe->id, AF_UNSPEC);
+  addattr_l (&req.n, sizeof req, NHA_GROUP, grp,
+             i * sizeof (struct nexthop_grp));
+  netlink_batch_add (&req.n, zvrf, RTM_NEWNEXTHOP, NULL, NULL, nhe->id);
+
+  /* Members the group no longer has. */
+  for (; i < nhe->kernel_num; i++)
+    netlink_nhg_delete (zvrf, nhe->id + 1 + i, nhe->id);
+
+  nhe->kernel_num = nhe->fib_num;
+  SET_FLAG (nhe->status, NHG_INSTALLED);
+  UNSET_FLAG (nhe->status, NHG_CHANGED);
+  return 0;
+}
+
+void
+kernel_nhg_uninstall (struct nhg_entry *nhe)
+{
+  struct zebra_vrf *zvrf = vrf_info_lookup (nhe->vrf_id);
+  unsigned int i;
+
+  if (zvrf && zvrf->nl_batch)
+    {
+      netlink_nhg_delete (zvrf, nhe->id, nhe->id);
+      for (i = 0; i < nhe->kernel_num; i++)
+        netlink_nhg_delete (zvrf, nhe->id + 1 + i, nhe->id);
+    }
+
+  nhe->kernel_num = 0;
+  UNSET_FLAG (nhe->status, NHG_INSTALLED);
+}
+
+/* Objects left by an earlier zebra are kept, as the routes it left are
+   (see rib_sweep_route), but their IDs are not handed out again. */
+static int
+netlink_nhg_probe_filter (struct sockaddr_nl *snl, struct nlmsghdr *h,
+                          vrf_id_t vrf_id)
+{
+  struct nhmsg *nhm;
+  struct rtattr *tb[NHA_MAX + 1];
+  u_int32_t id;
+  int len;
+
+  if (h->nlmsg_type != RTM_NEWNEXTHOP)
+    return 0;
+
+  len = h->nlmsg_len - NLMSG_LENGTH (sizeof (struct nhmsg));
+  if (len < 0)
+    return -1;
+
+  nhm = NLMSG_DATA (h);
+  memset (tb, 0, sizeof tb);
+  netlink_parse_rtattr (tb, NHA_MAX, (struct rtattr *) ((char *) nhm
+                        + NLMSG_ALIGN (sizeof (struct nhmsg))), len);
+  if (! tb[NHA_ID])
+    return 0;
+
+  id = *(u_int32_t *) RTA_DATA (tb[NHA_ID]);
+  zebra_nhg_id_reserve (id);
+  return 0;
+}
+
+/* Find out whether the kernel has nexthop objects, and which IDs are
+   taken already. */
+static void
+netlink_nhg_probe (struct zebra_vrf *zvrf)
+{
+  struct nlsock *nl = &zvrf->netlink_cmd;
+  struct sockaddr_nl snl;
+  struct
+  {
+    struct nlmsghdr n;
+    struct nhmsg nhm;
+  } req;
+  int ret;
+  int save_errno;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  memset (&req, 0, sizeof req);
+  req.n.nlmsg_len = sizeof req;
+  req.n.nlmsg_type = RTM_GETNEXTHOP;
+  req.n.nlmsg_flags = NLM_F_DUMP | NLM_F_REQUEST;
+  req.n.nlmsg_pid = nl->snl.nl_pid;
+  req.n.nlmsg_seq = ++nl->seq;
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  ret = sendto (nl->sock, (void *) &req, sizeof req, 0,
+                (struct sockaddr *) &snl, sizeof snl);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  if (ret < 0)
+    {
+      zlog (NULL, LOG_ERR, "%s sendto failed: %s", nl->name,
+            safe_strerror (save_errno));
+      return;
+    }
+
+  if (netlink_parse_info (netlink_nhg_probe_filter, nl, zvrf) < 0)
+    {
+      zlog_info ("%s: no nexthop objects, routes carry their own nexthops",
+                 nl->name);
+      return;
+    }
+
+  zvrf->nl_batch->nhg = 1;
+}
+
+#else /* HAVE_LINUX_NEXTHOP_H */
+
+static void
+netlink_nhg_result (struct nl_batch *nb, struct nl_request *req, int error)
+{
+  return;
+}
+
+static int
+netlink_nhg_usable (struct zebra_vrf *zvrf, struct nhg_entry *nhe)
+{
+  return 0;
+}
+
+int
+kernel_nhg_install (struct nhg_entry *nhe)
+{
+  return -1;
+}
+
+void
+kernel_nhg_uninstall (struct nhg_entry *nhe)
+{
+  return;
+}
+
+static void
+netlink_nhg_probe (struct zebra_vrf *zvrf)
+{
+  return;
+}
+
+#endif /* HAVE_LINUX_NEXTHOP_H */
+
 /* This function takes a nexthop as argument and adds
  * the appropriate netlink attributes to an existing
  * netlink message.
@@ -1670,12 +2409,14 @@ _netlink_route_debug(
     }
 }
 
-/* Routing table change via netlink interface. */
+/* Build the netlink message for a routing table change.  Returns 0 if
+   there is nothing to tell the kernel. */
 static int
-netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
+netlink_route_build (int cmd, struct prefix *p, struct rib *rib,
+                     struct zebra_vrf *zvrf, u_int32_t nh_id,
+                     struct nl_route_req *req)
 {
   int bytelen;
-  struct sockaddr_nl snl;
   struct nexthop *nexthop = NULL, *tnexthop;
   int recursing;
   int nexthop_num;
@@ -1683,27 +2424,18 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
   int family = PREFIX_FAMILY(p);
   const char *routedesc;
 
-  struct
-  {
-    struct nlmsghdr n;
-    struct rtmsg r;
-    char buf[NL_PKT_BUF_SIZE];
-  } req;
-
-  struct zebra_vrf *zvrf = vrf_info_lookup (rib->vrf_id);
-
-  memset (&req, 0, sizeof req - NL_PKT_BUF_SIZE);
+  memset (req, 0, sizeof *req - NL_PKT_BUF_SIZE);
 
   bytelen = (family == AF_INET ? 4 : 16);
 
-  req.n.nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg));
-  req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE | NLM_F_REQUEST;
-  req.n.nlmsg_type = cmd;
-  req.r.rtm_family = family;
-  req.r.rtm_table = rib->table;
-  req.r.rtm_dst_len = p->prefixlen;
-  req.r.rtm_protocol = RTPROT_ZEBRA;
-  req.r.rtm_scope = RT_SCOPE_LINK;
+  req->n.nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg));
+  req->n.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE | NLM_F_REQUEST;
+  req->n.nlmsg_type = cmd;
+  req->r.rtm_family = family;
+  req->r.rtm_table = rib->table;
+  req->r.rtm_dst_len = p->prefixlen;
+  req->r.rtm_protocol = RTPROT_ZEBRA;
+  req->r.rtm_scope = RT_SCOPE_LINK;
 
   if ((rib->flags & ZEBRA_FLAG_BLACKHOLE) || (rib->flags & ZEBRA_FLAG_REJECT))
     discard = 1;
@@ -1715,20 +2447,20 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
       if (discard)
         {
           if (rib->flags & ZEBRA_FLAG_BLACKHOLE)
-            req.r.rtm_type = RTN_BLACKHOLE;
+            req->r.rtm_type = RTN_BLACKHOLE;
           else if (rib->flags & ZEBRA_FLAG_REJECT)
-            req.r.rtm_type = RTN_UNREACHABLE;
+            req->r.rtm_type = RTN_UNREACHABLE;
           else
             assert (RTN_BLACKHOLE != RTN_UNREACHABLE);  /* false */
         }
       else
-        req.r.rtm_type = RTN_UNICAST;
+        req->r.rtm_type = RTN_UNICAST;
     }
 
-  addattr_l (&req.n, sizeof req, RTA_DST, &p->u.prefix, bytelen);
+  addattr_l (&req->n, sizeof *req, RTA_DST, &p->u.prefix, bytelen);
 
   /* Metric. */
-  addattr32 (&req.n, sizeof req, RTA_PRIORITY, NL_DEFAULT_ROUTE_METRIC);
+  addattr32 (&req->n, sizeof *req, RTA_PRIORITY, NL_DEFAULT_ROUTE_METRIC);
 
   if (rib->mtu || rib->nexthop_mtu)
     {
@@ -1740,7 +2472,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
       rta->rta_type = RTA_METRICS;
       rta->rta_len = RTA_LENGTH(0);
       rta_addattr_l (rta, NL_PKT_BUF_SIZE, RTAX_MTU, &mtu, sizeof mtu);
-      addattr_l (&req.n, NL_PKT_BUF_SIZE, RTA_METRICS, RTA_DATA (rta),
+      addattr_l (&req->n, NL_PKT_BUF_SIZE, RTA_METRICS, RTA_DATA (rta),
                  RTA_PAYLOAD (rta));
     }
 
@@ -1773,11 +2505,66 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
 
       if (nexthop->type != NEXTHOP_TYPE_IFINDEX &&
           nexthop->type != NEXTHOP_TYPE_IFNAME)
-        req.r.rtm_scope = RT_SCOPE_UNIVERSE;
+        req->r.rtm_scope = RT_SCOPE_UNIVERSE;
 
       nexthop_num++;
     }
 
+  /* A route zebra installed before it was restarted may point at a
+     nexthop group; it is removed by prefix alone, as those are below. */
+  if (cmd == RTM_DELROUTE && nexthop_num
+      && CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELFROUTE))
+    goto skip;
+
+#ifdef HAVE_LINUX_NEXTHOP_H
+  /* The nexthops are in the group the route points at.  Those are the
+     ones in the FIB, as below. */
+  if (nh_id)
+    {
+      union g_addr *src = NULL;
+
+      nexthop_num = 0;
+      for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+        {
+          if (nexthop_num >= MULTIPATH_NUM)
+            break;
+
+          if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+            continue;
+
+          if ((cmd == RTM_NEWROUTE
+               && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+              || (cmd == RTM_DELROUTE
+                  && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)))
+            {
+              if (! src && family == AF_INET && nexthop->src.ipv4.s_addr)
+                src = &nexthop->src;
+
+              if (cmd == RTM_NEWROUTE)
+                SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+
+              nexthop_num++;
+            }
+        }
+
+      if (IS_ZEBRA_DEBUG_KERNEL)
+        {
+          char buf[PREFIX_STRLEN];
+          zlog_debug ("netlink_route_multipath() (nexthop group): %s %s "
+                      "vrf %u group %u", lookup (nlmsg_str, cmd),
+                      prefix2str (p, buf, sizeof(buf)), zvrf->vrf_id, nh_id);
+        }
+
+      /* A route is removed by prefix alone: the kernel may have
+         dropped the group already, along with an interface. */
+      if (cmd == RTM_NEWROUTE)
+        addattr32 (&req->n, sizeof *req, RTA_NH_ID, nh_id);
+      if (src && cmd == RTM_NEWROUTE)
+        addattr_l (&req->n, sizeof *req, RTA_PREFSRC, &src->ipv4, bytelen);
+    }
+  else
+#endif /* HAVE_LINUX_NEXTHOP_H */
+
   /* Singlepath case. */
   if (nexthop_num == 1 || MULTIPATH_NUM == 1)
     {
@@ -1796,8 +2583,8 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
 
               _netlink_route_debug(cmd, p, nexthop, routedesc, family, zvrf);
               _netlink_route_build_singlepath(routedesc, bytelen,
-                                              nexthop, &req.n, &req.r,
-                                              sizeof req);
+                                              nexthop, &req->n, &req->r,
+                                              sizeof *req);
 
               if (cmd == RTM_NEWROUTE)
                 SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
@@ -1846,10 +2633,10 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
             }
         }
       if (src)
-        addattr_l (&req.n, sizeof req, RTA_PREFSRC, &src->ipv4, bytelen);
+        addattr_l (&req->n, sizeof *req, RTA_PREFSRC, &src->ipv4, bytelen);
 
       if (rta->rta_len > RTA_LENGTH (0))
-        addattr_l (&req.n, NL_PKT_BUF_SIZE, RTA_MULTIPATH, RTA_DATA (rta),
+        addattr_l (&req->n, NL_PKT_BUF_SIZE, RTA_MULTIPATH, RTA_DATA (rta),
                    RTA_PAYLOAD (rta));
     }
 
@@ -1862,27 +2649,268 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib)
     }
 
 skip:
+  return 1;
+}
 
-  /* Destination netlink address. */
-  memset (&snl, 0, sizeof snl);
-  snl.nl_family = AF_NETLINK;
+/* Routing table change via netlink interface.  replace is set when
+   the route is in the kernel already. */
+static int
+netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
+                         int replace)
+{
+  struct nl_route_req req;
+  struct zebra_vrf *zvrf = vrf_info_lookup (rib->vrf_id);
+  struct nhg_entry *nhe = rib->nhe;
+  u_int32_t nh_id = 0;
 
-  /* Talk to netlink socket. */
-  return netlink_talk (&req.n, &zvrf->netlink_cmd, zvrf);
+  if (cmd == RTM_NEWROUTE)
+    {
+      if (nhe && netlink_nhg_usable (zvrf, nhe)
+          && ((CHECK_FLAG (nhe->status, NHG_INSTALLED)
+               && ! CHECK_FLAG (nhe->status, NHG_CHANGED))
+              || kernel_nhg_install (nhe) == 0))
+        nh_id = nhe->id;
+    }
+  else if (nhe && rib->nhe_gen)
+    nh_id = nhe->id;
+
+  if (! netlink_route_build (cmd, p, rib, zvrf, nh_id, &req))
+    return 0;
+
+  /* The route points at the group already, and that has just been
+     brought up to date. */
+  if (nh_id && replace && rib->nhe_gen == nhe->gen)
+    return 0;
+
+  rib->nhe_gen = (cmd == RTM_NEWROUTE && nh_id) ? nhe->gen : 0;
+
+  /* Queue for the kernel, the answer comes back to rib_fib_result. */
+  return netlink_batch_add (&req.n, zvrf, cmd, p, rib, 0);
 }
 
 int
 kernel_route_rib (struct prefix *p, struct rib *old, struct rib *new)
 {
   if (!old && new)
-    return netlink_route_multipath (RTM_NEWROUTE, p, new);
+    return netlink_route_multipath (RTM_NEWROUTE, p, new, 0);
   if (old && !new)
-    return netlink_route_multipath (RTM_DELROUTE, p, old);
+    return netlink_route_multipath (RTM_DELROUTE, p, old, 0);
 
    /* Replace, can be done atomically if metric does not change;
     * netlink uses [prefix, tos, priority] to identify prefix.
     * Now metric is not sent to kernel, so we can just do atomic replace. */
-  return netlink_route_multipath (RTM_NEWROUTE, p, new);
+  return netlink_route_multipath (RTM_NEWROUTE, p, new, old == new);
+}
+
+/* The dataplane thread's side, see zebra_dplane.c.  It has a netlink
+ * socket of its own in each VRF, so it never shares one with the main
+ * thread.  The main thread builds the message for each change, and the
+ * dataplane thread packs those for one socket into a write as above.
+ * As the kernel has dealt with the whole write by the time sendmsg
+ * returns, the answers are simply read back straight away.
+ */
+
+/* Messages in one write. */
+#define NL_DPLANE_MAX		1024
+
+/* Only used by the dataplane thread. */
+static struct
+{
+  int sock;
+
+  /* Messages not yet written, and the offset of the last of them. */
+  char buf[NL_BATCH_BUF_SIZE];
+  size_t len;
+  size_t last;
+
+  /* Their contexts.  Message i has sequence number seq + i. */
+  struct dplane_ctx *ctx[NL_DPLANE_MAX];
+  unsigned int count;
+  u_int32_t seq;
+
+  /* The last sequence number used. */
+  u_int32_t next_seq;
+
+  char rcvbuf[2 * NL_PKT_BUF_SIZE];
+} nl_dplane;
+
+/* Build the message for the change, on the main thread. */
+void
+kernel_dplane_prepare (struct dplane_ctx *ctx)
+{
+  struct nl_route_req req;
+  struct rib *rib;
+  int cmd;
+
+  /* As in kernel_route_rib, a replace is a single RTM_NEWROUTE. */
+  if (ctx->new)
+    {
+      cmd = RTM_NEWROUTE;
+      rib = ctx->new;
+    }
+  else
+    {
+      cmd = RTM_DELROUTE;
+      rib = ctx->old;
+    }
+
+  if (! ctx->zvrf || ctx->zvrf->netlink_dplane.sock < 0)
+    {
+      ctx->error = EBADF;
+      return;
+    }
+
+  if (! netlink_route_build (cmd, &ctx->p, rib, ctx->zvrf, 0, &req))
+    return;
+
+  ctx->sock = ctx->zvrf->netlink_dplane.sock;
+  ctx->msg = XMALLOC (MTYPE_DPLANE_CTX, req.n.nlmsg_len);
+  memcpy (ctx->msg, &req.n, req.n.nlmsg_len);
+  ctx->msg_len = req.n.nlmsg_len;
+}
+
+/* Write out the buffered messages and collect the answers. */
+static void
+netlink_dplane_flush (void)
+{
+  struct sockaddr_nl snl;
+  struct iovec iov;
+  struct msghdr msg = {
+    .msg_name = (void *) &snl,
+    .msg_namelen = sizeof snl,
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+  };
+  unsigned int done = 0;
+  int status;
+
+  if (! nl_dplane.count)
+    return;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+  iov.iov_base = nl_dplane.buf;
+  iov.iov_len = nl_dplane.len;
+
+  /* Request an acknowledgement for the last message only. */
+  ((struct nlmsghdr *) (nl_dplane.buf + nl_dplane.last))->nlmsg_flags
+    |= NLM_F_ACK;
+
+  do
+    status = sendmsg (nl_dplane.sock, &msg, 0);
+  while (status < 0 && errno == EINTR);
+
+  if (status < 0)
+    {
+      int save_errno = errno;
+
+      for (; done < nl_dplane.count; done++)
+        nl_dplane.ctx[done]->error = save_errno;
+      goto out;
+    }
+
+  while (done < nl_dplane.count)
+    {
+      struct nlmsghdr *h;
+
+      iov.iov_base = nl_dplane.rcvbuf;
+      iov.iov_len = sizeof nl_dplane.rcvbuf;
+      msg.msg_namelen = sizeof snl;
+      status = recvmsg (nl_dplane.sock, &msg, 0);
+      if (status < 0 && errno == EINTR)
+        continue;
+
+      /* If the answers were lost, there is no telling which changes
+         worked; count on the rest having done so. */
+      if (status <= 0)
+        break;
+
+      for (h = (struct nlmsghdr *) nl_dplane.rcvbuf;
+           NLMSG_OK (h, (unsigned int) status);
+           h = NLMSG_NEXT (h, status))
+        {
+          struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA (h);
+          u_int32_t i;
+
+          if (h->nlmsg_type != NLMSG_ERROR
+              || h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+            continue;
+
+          i = err->msg.nlmsg_seq - nl_dplane.seq;
+          if (i < done || i >= nl_dplane.count)
+            continue;
+
+          /* Anything before the answer was applied. */
+          for (; done < i; done++)
+            nl_dplane.ctx[done]->error = 0;
+          nl_dplane.ctx[i]->error = -err->error;
+          done = i + 1;
+        }
+    }
+
+  for (; done < nl_dplane.count; done++)
+    nl_dplane.ctx[done]->error = 0;
+
+ out:
+  nl_dplane.sock = -1;
+  nl_dplane.len = 0;
+  nl_dplane.count = 0;
+}
+
+void
+kernel_dplane_route (struct dplane_ctx *ctx)
+{
+  struct nlmsghdr *n = (struct nlmsghdr *) ctx->msg;
+
+  if (! n)
+    return;
+
+  if (nl_dplane.count
+      && (nl_dplane.sock != ctx->sock
+          || nl_dplane.count == NL_DPLANE_MAX
+          || nl_dplane.len + NLMSG_ALIGN (n->nlmsg_len)
+             > sizeof nl_dplane.buf))
+    netlink_dplane_flush ();
+
+  /* The sequence number goes into the context's copy too, for
+     kernel_dplane_finish to report. */
+  n->nlmsg_seq = ++nl_dplane.next_seq;
+  if (! nl_dplane.count)
+    {
+      nl_dplane.sock = ctx->sock;
+      nl_dplane.seq = n->nlmsg_seq;
+    }
+
+  nl_dplane.last = nl_dplane.len;
+  memcpy (nl_dplane.buf + nl_dplane.len, n, n->nlmsg_len);
+  nl_dplane.len += NLMSG_ALIGN (n->nlmsg_len);
+  nl_dplane.ctx[nl_dplane.count] = ctx;
+  nl_dplane.count++;
+}
+
+void
+kernel_dplane_sync (void)
+{
+  netlink_dplane_flush ();
+}
+
+/* Make sense of the kernel's answer, back on the main thread. */
+void
+kernel_dplane_finish (struct dplane_ctx *ctx)
+{
+  struct nlmsghdr *n = (struct nlmsghdr *) ctx->msg;
+
+  if (n && ctx->error
+      && netlink_route_error_benign (n->nlmsg_type, ctx->error))
+    {
+      if (IS_ZEBRA_DEBUG_KERNEL)
+        zlog_debug ("%s: error: %s type=%s(%u), seq=%u",
+                    ctx->zvrf->netlink_dplane.name,
+                    safe_strerror (ctx->error),
+                    lookup (nlmsg_str, n->nlmsg_type), n->nlmsg_type,
+                    n->nlmsg_seq);
+      ctx->error = 0;
+    }
 }
 
 /* Interface address modification. */
@@ -1965,24 +2993,26 @@ kernel_read (struct thread *thread)
 }
 
 /* Filter out messages from self that occur on listener socket,
-   caused by our actions on the command socket
+   caused by our actions on the command and dataplane sockets
  */
-static void netlink_install_filter (int sock, __u32 pid)
+static void netlink_install_filter (int sock, __u32 pid, __u32 dplane_pid)
 {
   struct sock_filter filter[] = {
     /* 0: ldh [4]	          */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_H, offsetof(struct nlmsghdr, nlmsg_type)),
-    /* 1: jeq 0x18 jt 3 jf 6  */
+    /* 1: jeq 0x18 jt 3 jf 7  */
     BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_NEWROUTE), 1, 0),
-    /* 2: jeq 0x19 jt 3 jf 6  */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 3),
+    /* 2: jeq 0x19 jt 3 jf 7  */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 4),
     /* 3: ldw [12]		  */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_W, offsetof(struct nlmsghdr, nlmsg_pid)),
-    /* 4: jeq XX  jt 5 jf 6   */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 0, 1),
-    /* 5: ret 0    (skip)     */
+    /* 4: jeq XX  jt 6 jf 5   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 1, 0),
+    /* 5: jeq YY  jt 6 jf 7   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(dplane_pid), 0, 1),
+    /* 6: ret 0    (skip)     */
     BPF_STMT(BPF_RET|BPF_K, 0),
-    /* 6: ret 0xffff (keep)   */
+    /* 7: ret 0xffff (keep)   */
     BPF_STMT(BPF_RET|BPF_K, 0xffff),
   };
 
@@ -2008,6 +3038,8 @@ kernel_init (struct zebra_vrf *zvrf)
 #endif /* HAVE_IPV6 */
   netlink_socket (&zvrf->netlink, groups, zvrf->vrf_id);
   netlink_socket (&zvrf->netlink_cmd, 0, zvrf->vrf_id);
+  if (zebra_dplane_running ())
+    netlink_socket (&zvrf->netlink_dplane, 0, zvrf->vrf_id);
 
   /* Register kernel socket. */
   if (zvrf->netlink.sock > 0)
@@ -2026,10 +3058,20 @@ kernel_init (struct zebra_vrf *zvrf)
       nl_rcvbuf.p = XMALLOC (MTYPE_NETLINK_RCVBUF, bufsize);
       nl_rcvbuf.size = bufsize;
       
-      netlink_install_filter (zvrf->netlink.sock, zvrf->netlink_cmd.snl.nl_pid);
+      netlink_install_filter (zvrf->netlink.sock,
+                              zvrf->netlink_cmd.snl.nl_pid,
+                              zvrf->netlink_dplane.sock >= 0
+                              ? zvrf->netlink_dplane.snl.nl_pid
+                              : zvrf->netlink_cmd.snl.nl_pid);
       zvrf->t_netlink = thread_add_read (zebrad.master, kernel_read, zvrf,
                                          zvrf->netlink.sock);
     }
+
+  if (zvrf->netlink_cmd.sock >= 0)
+    {
+      zvrf->nl_batch = netlink_batch_new (zvrf);
+      netlink_nhg_probe (zvrf);
+    }
 }
 
 void
@@ -2037,6 +3079,12 @@ kernel_terminate (struct zebra_vrf *zvrf)
 {
   THREAD_READ_OFF (zvrf->t_netlink);
 
+  if (zvrf->nl_batch)
+    {
+      netlink_batch_free (zvrf->nl_batch);
+      zvrf->nl_batch = NULL;
+    }
+
   if (zvrf->netlink.sock >= 0)
     {
       close (zvrf->netlink.sock);
@@ -2048,6 +3096,38 @@ kernel_terminate (struct zebra_vrf *zvrf)
       close (zvrf->netlink_cmd.sock);
       zvrf->netlink_cmd.sock = -1;
     }
+
+  if (zvrf->netlink_dplane.sock >= 0)
+    {
+      /* Let the dataplane thread finish with it first. */
+      zebra_dplane_wait ();
+      close (zvrf->netlink_dplane.sock);
+      zvrf->netlink_dplane.sock = -1;
+    }
+}
+
+/* Write out the queued route changes of every VRF. */
+void
+kernel_route_flush (void)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL && zvrf->nl_batch)
+      netlink_batch_flush (zvrf->nl_batch);
+}
+
+/* Wait for the kernel to apply all queued route changes. */
+void
+kernel_route_sync (void)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL)
+      netlink_batch_sync (zvrf);
 }
 
 /*
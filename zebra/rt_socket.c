@@ -28,18 +28,56 @@
 #include "log.h"
 #include "str.h"
 #include "privs.h"
+#include "memory.h"
 
 #include "zebra/debug.h"
 #include "zebra/rib.h"
 #include "zebra/rt.h"
 #include "zebra/kernel_socket.h"
+#include "zebra/zebra_dplane.h"
 
 extern struct zebra_privs_t zserv_privs;
 
-/* kernel socket export */
-extern int rtm_write (int message, union sockunion *dest,
-                      union sockunion *mask, union sockunion *gate,
-                      unsigned int index, int zebra_flags, int metric);
+/* The messages for a dataplane context, one per nexthop, in the order
+ * they are in ctx->msg.  Everything kernel_dplane_finish needs to report
+ * on them is kept here, so that the dataplane thread has nothing to do
+ * but write them and note the errors.
+ */
+struct rtm_dplane_req
+{
+  int cmd;
+  size_t len;
+
+  /* In the context's copy of the rib. */
+  struct nexthop *nexthop;
+  char gate_buf[INET_ADDRSTRLEN];
+
+  /* errno from the write, or 0. */
+  int error;
+};
+
+struct rtm_dplane
+{
+  unsigned int count;
+  struct rtm_dplane_req req[];
+};
+
+/* Queue msg in ctx for the dataplane thread, rather than writing it. */
+static struct rtm_dplane_req *
+rtm_dplane_add (struct dplane_ctx *ctx, int cmd, struct rtm_buf *msg,
+                int len, struct nexthop *nexthop)
+{
+  struct rtm_dplane *dp = ctx->kernel;
+  struct rtm_dplane_req *req = &dp->req[dp->count++];
+
+  memcpy (ctx->msg + ctx->msg_len, msg, len);
+  ctx->msg_len += len;
+  req->cmd = cmd;
+  req->len = len;
+  req->nexthop = nexthop;
+  strcpy (req->gate_buf, "NULL");
+  return req;
+}
 
 #ifdef HAVE_STRUCT_SOCKADDR_IN_SIN_LEN
 /* Adjust netmask socket length. Return value is a adjusted sin_len
@@ -66,10 +104,56 @@ sin_masklen (struct in_addr mask)
 }
 #endif /* HAVE_STRUCT_SOCKADDR_IN_SIN_LEN */
 
-/* Interface between zebra message and rtm message. */
+/* What became of the change of a nexthop, for kernel_rtm_ipv4.
+   Returns 1 if the nexthop is as it should be. */
 static int
-kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib)
+kernel_rtm_ipv4_result (int cmd, struct prefix *p, struct nexthop *nexthop,
+                        const char *gate_buf, int error)
+{
+  char prefix_buf[PREFIX_STRLEN];
 
+  if (IS_ZEBRA_DEBUG_RIB)
+    prefix2str (p, prefix_buf, sizeof(prefix_buf));
+
+  switch (error)
+  {
+    /* We only flag nexthops as being in FIB if rtm_write() did its work. */
+    case ZEBRA_ERR_NOERROR:
+      if (IS_ZEBRA_DEBUG_RIB)
+        zlog_debug ("%s: %s: successfully did NH %s",
+          __func__, prefix_buf, gate_buf);
+      if (cmd == RTM_ADD)
+        SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      return 1;
+
+    /* The only valid case for this error is kernel's failure to install
+     * a multipath route, which is common for FreeBSD. This should be
+     * ignored silently, but logged as an error otherwise.
+     */
+    case ZEBRA_ERR_RTEXIST:
+      if (cmd != RTM_ADD)
+        zlog_err ("%s: rtm_write() returned %d for command %d",
+          __func__, error, cmd);
+      return 0;
+
+    /* Given that our NEXTHOP_FLAG_FIB matches real kernel FIB, it isn't
+     * normal to get any other messages in ANY case.
+     */
+    case ZEBRA_ERR_RTNOEXIST:
+    case ZEBRA_ERR_RTUNREACH:
+    default:
+      zlog_err ("%s: %s: rtm_write() unexpectedly returned %d for command %s",
+        __func__, prefix2str(p, prefix_buf, sizeof(prefix_buf)),
+        error, lookup (rtm_type_str, cmd));
+      return 0;
+  }
+}
+
+/* Interface between zebra message and rtm message.  With a dataplane
+   context, the messages are queued in it rather than written. */
+static int
+kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib,
+                 struct dplane_ctx *ctx)
 {
   struct sockaddr_in *mask = NULL;
   struct sockaddr_in sin_dest, sin_mask, sin_gate;
@@ -148,13 +232,33 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib)
 	      mask = &sin_mask;
 	    }
 
-	  error = rtm_write (cmd,
-			     (union sockunion *)&sin_dest, 
-			     (union sockunion *)mask, 
-			     gate ? (union sockunion *)&sin_gate : NULL,
-			     ifindex,
-			     rib->flags,
-			     rib->metric);
+	  if (ctx)
+	    {
+	      struct rtm_buf msg;
+	      struct rtm_dplane_req *req = NULL;
+
+	      error = rtm_build (cmd,
+				 (union sockunion *)&sin_dest,
+				 (union sockunion *)mask,
+				 gate ? (union sockunion *)&sin_gate : NULL,
+				 ifindex,
+				 rib->flags,
+				 rib->metric,
+				 &msg);
+	      if (error >= 0)
+		req = rtm_dplane_add (ctx, cmd, &msg, error, nexthop);
+	      if (gate && req)
+		inet_ntop (AF_INET, &sin_gate.sin_addr, req->gate_buf,
+			   INET_ADDRSTRLEN);
+	    }
+	  else
+	    error = rtm_write (cmd,
+			       (union sockunion *)&sin_dest, 
+			       (union sockunion *)mask, 
+			       gate ? (union sockunion *)&sin_gate : NULL,
+			       ifindex,
+			       rib->flags,
+			       rib->metric);
 
            if (IS_ZEBRA_DEBUG_RIB)
            {
@@ -167,41 +271,13 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib)
              else
                inet_ntop (AF_INET, &sin_gate.sin_addr, gate_buf, INET_ADDRSTRLEN);
            }
+
+           /* Queued, kernel_dplane_finish has the result. */
+           if (ctx && error >= 0)
+             continue;
  
-           switch (error)
-           {
-             /* We only flag nexthops as being in FIB if rtm_write() did its work. */
-             case ZEBRA_ERR_NOERROR:
-               nexthop_num++;
-               if (IS_ZEBRA_DEBUG_RIB)
-                 zlog_debug ("%s: %s: successfully did NH %s",
-                   __func__, prefix_buf, gate_buf);
-               if (cmd == RTM_ADD)
-                 SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
-               break;
- 
-             /* The only valid case for this error is kernel's failure to install
-              * a multipath route, which is common for FreeBSD. This should be
-              * ignored silently, but logged as an error otherwise.
-              */
-             case ZEBRA_ERR_RTEXIST:
-               if (cmd != RTM_ADD)
-                 zlog_err ("%s: rtm_write() returned %d for command %d",
-                   __func__, error, cmd);
-               continue;
-               break;
- 
-             /* Given that our NEXTHOP_FLAG_FIB matches real kernel FIB, it isn't
-              * normal to get any other messages in ANY case.
-              */
-             case ZEBRA_ERR_RTNOEXIST:
-             case ZEBRA_ERR_RTUNREACH:
-             default:
-               zlog_err ("%s: %s: rtm_write() unexpectedly returned %d for command %s",
-                 __func__, prefix2str(p, prefix_buf, sizeof(prefix_buf)),
-                 error, lookup (rtm_type_str, cmd));
-               break;
-           }
+           nexthop_num += kernel_rtm_ipv4_result (cmd, p, nexthop, gate_buf,
+                                                  error);
          } /* if (cmd and flags make sense) */
        else
          if (IS_ZEBRA_DEBUG_RIB)
@@ -209,8 +285,9 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib)
              __func__, lookup (rtm_type_str, cmd), nexthop->flags);
      } /* for (ALL_NEXTHOPS_RO(...))*/
  
-   /* If there was no useful nexthop, then complain. */
-   if (nexthop_num == 0 && IS_ZEBRA_DEBUG_KERNEL)
+   /* If there was no useful nexthop, then complain, or have
+      kernel_dplane_finish do so. */
+   if (nexthop_num == 0 && ! ctx && IS_ZEBRA_DEBUG_KERNEL)
      zlog_debug ("%s: No useful nexthops were found in RIB entry %p", __func__, rib);
 
   return 0; /*XXX*/
@@ -243,9 +320,11 @@ sin6_masklen (struct in6_addr mask)
 }
 #endif /* SIN6_LEN */
 
-/* Interface between zebra message and rtm message. */
+/* Interface between zebra message and rtm message.  With a dataplane
+   context, the messages are queued in it rather than written. */
 static int
-kernel_rtm_ipv6 (int cmd, struct prefix *p, struct rib *rib)
+kernel_rtm_ipv6 (int cmd, struct prefix *p, struct rib *rib,
+                 struct dplane_ctx *ctx)
 {
   struct sockaddr_in6 *mask;
   struct sockaddr_in6 sin_dest, sin_mask, sin_gate;
@@ -329,13 +408,29 @@ kernel_rtm_ipv6 (int cmd, struct prefix *p, struct rib *rib)
 	  mask = &sin_mask;
 	}
 
-      error = rtm_write (cmd,
-			(union sockunion *) &sin_dest,
-			(union sockunion *) mask,
-			gate ? (union sockunion *)&sin_gate : NULL,
-			ifindex,
-			rib->flags,
-			rib->metric);
+      if (ctx)
+	{
+	  struct rtm_buf msg;
+
+	  error = rtm_build (cmd,
+			     (union sockunion *) &sin_dest,
+			     (union sockunion *) mask,
+			     gate ? (union sockunion *)&sin_gate : NULL,
+			     ifindex,
+			     rib->flags,
+			     rib->metric,
+			     &msg);
+	  if (error >= 0)
+	    rtm_dplane_add (ctx, cmd, &msg, error, nexthop);
+	}
+      else
+	error = rtm_write (cmd,
+			  (union sockunion *) &sin_dest,
+			  (union sockunion *) mask,
+			  gate ? (union sockunion *)&sin_gate : NULL,
+			  ifindex,
+			  rib->flags,
+			  rib->metric);
 
 #if 0
       if (error)
@@ -364,14 +459,15 @@ kernel_rtm_ipv6 (int cmd, struct prefix *p, struct rib *rib)
 #endif
 
 static int
-kernel_rtm (int cmd, struct prefix *p, struct rib *rib)
+kernel_rtm (int cmd, struct prefix *p, struct rib *rib,
+            struct dplane_ctx *ctx)
 {
   switch (PREFIX_FAMILY(p))
     {
     case AF_INET:
-      return kernel_rtm_ipv4 (cmd, p, rib);
+      return kernel_rtm_ipv4 (cmd, p, rib, ctx);
     case AF_INET6:
-      return kernel_rtm_ipv6 (cmd, p, rib);
+      return kernel_rtm_ipv6 (cmd, p, rib, ctx);
     }
   return 0;
 }
@@ -385,13 +481,137 @@ kernel_route_rib (struct prefix *p, struct rib *old, struct rib *new)
     zlog (NULL, LOG_ERR, "Can't raise privileges");
 
   if (old)
-    route |= kernel_rtm (RTM_DELETE, p, old);
+    route |= kernel_rtm (RTM_DELETE, p, old, NULL);
 
   if (new)
-    route |= kernel_rtm (RTM_ADD, p, new);
+    route |= kernel_rtm (RTM_ADD, p, new, NULL);
 
   if (zserv_privs.change(ZPRIVS_LOWER))
     zlog (NULL, LOG_ERR, "Can't lower privileges");
 
   return route;
 }
+
+/* Routing socket writes are synchronous, there is nothing to wait for. */
+void
+kernel_route_flush (void)
+{
+  return;
+}
+
+void
+kernel_route_sync (void)
+{
+  return;
+}
+
+static unsigned int
+rtm_nexthop_count (struct rib *rib)
+{
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+  unsigned int count = 0;
+
+  if (rib)
+    for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+      count++;
+  return count;
+}
+
+/* Build the messages for the change on the main thread, which has the
+   interfaces to look at, and queue them in the context. */
+void
+kernel_dplane_prepare (struct dplane_ctx *ctx)
+{
+  unsigned int count;
+
+  count = rtm_nexthop_count (ctx->old) + rtm_nexthop_count (ctx->new);
+  ctx->msg = XMALLOC (MTYPE_DPLANE_CTX, count * sizeof (struct rtm_buf) + 1);
+  ctx->kernel = XCALLOC (MTYPE_DPLANE_CTX, sizeof (struct rtm_dplane)
+                         + count * sizeof (struct rtm_dplane_req));
+  ctx->sock = dplane_routing_sock;
+
+  if (ctx->old)
+    kernel_rtm (RTM_DELETE, &ctx->p, ctx->old, ctx);
+
+  if (ctx->new)
+    kernel_rtm (RTM_ADD, &ctx->p, ctx->new, ctx);
+}
+
+/* From the dataplane thread, which keeps the privileges it was started
+   with.  Routing socket writes are synchronous. */
+void
+kernel_dplane_route (struct dplane_ctx *ctx)
+{
+  struct rtm_dplane *dp = ctx->kernel;
+  u_char *msg = ctx->msg;
+  unsigned int i;
+
+  if (ctx->sock < 0)
+    return;
+
+  for (i = 0; i < dp->count; i++)
+    {
+      struct rtm_dplane_req *req = &dp->req[i];
+
+      if (write (ctx->sock, msg, req->len) != (ssize_t) req->len)
+        req->error = errno;
+      msg += req->len;
+    }
+}
+
+void
+kernel_dplane_sync (void)
+{
+  return;
+}
+
+/* Report on the writes back on the main thread, as kernel_rtm would
+   have done.  Failures show in the nexthops' FIB flags alone. */
+void
+kernel_dplane_finish (struct dplane_ctx *ctx)
+{
+  struct rtm_dplane *dp = ctx->kernel;
+  unsigned int i, nexthop_num = 0;
+
+  for (i = 0; i < dp->count; i++)
+    {
+      struct rtm_dplane_req *req = &dp->req[i];
+      int error;
+
+      if (ctx->sock < 0)
+        error = ZEBRA_ERR_EPERM;
+      else if (req->error)
+        error = rtm_write_error (req->error);
+      else
+        error = ZEBRA_ERR_NOERROR;
+
+      if (PREFIX_FAMILY (&ctx->p) == AF_INET)
+        nexthop_num += kernel_rtm_ipv4_result (req->cmd, &ctx->p,
+                                               req->nexthop, req->gate_buf,
+                                               error);
+      else
+        nexthop_num++;
+    }
+
+  if (PREFIX_FAMILY (&ctx->p) == AF_INET && nexthop_num == 0
+      && IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: No useful nexthops were found in RIB entry %p",
+                __func__, ctx->new ? ctx->new : ctx->old);
+
+  XFREE (MTYPE_DPLANE_CTX, ctx->kernel);
+  ctx->error = 0;
+}
+
+/* The routing socket has no nexthop objects. */
+int
+kernel_nhg_install (struct nhg_entry *nhe)
+{
+  return -1;
+}
+
+void
+kernel_nhg_uninstall (struct nhg_entry *nhe)
+{
+  return;
+}
@@ -36,6 +36,7 @@
 #include "zebra/debug.h"
 #include "zebra/router-id.h"
 #include "zebra/interface.h"
+#include "zebra/zebra_dplane.h"
 
 /* Zebra instance */
 struct zebra_t zebrad =
@@ -49,6 +50,9 @@ pid_t pid;
 /* zebra_rib's workqueue hold time. Private export for use by test code only */
 extern int rib_process_hold_time;
 
+/* Time each kernel route change takes, in microseconds. */
+extern unsigned int kernel_null_delay;
+
 /* Pacify zclient.o in libzebra, which expects this variable. */
 struct thread_master *master;
 
@@ -63,6 +67,8 @@ struct option longopts[] =
   { "vty_port",    required_argument, NULL, 'P'},
   { "version",     no_argument,       NULL, 'v'},
   { "rib_hold",	   required_argument, NULL, 'r'},
+  { "dplane",      no_argument,       NULL, 'D'},
+  { "kernel_delay", required_argument, NULL, 'k'},
   { 0 }
 };
 
@@ -96,6 +102,8 @@ usage (char *progname, int status)
 	      "-A, --vty_addr     Set vty's bind address\n"\
 	      "-P, --vty_port     Set vty's port number\n"\
 	      "-r, --rib_hold	  Set rib-queue hold time\n"\
+	      "-D, --dplane       Program the kernel from a separate thread\n"\
+	      "-k, --kernel_delay Microseconds each kernel route change takes\n"\
               "-v, --version      Print program version\n"\
 	      "-h, --help         Display this help and exit\n"\
 	      "\n"\
@@ -122,7 +130,7 @@ DEFUN (test_interface_state,
   ifp = vty->index;
   if (ifp->ifindex == IFINDEX_INTERNAL)
     {
-      ifp->ifindex = ++test_ifindex;
+      if_set_index (ifp, ++test_ifindex);
       ifp->mtu = 1500;
       ifp->flags = IFF_BROADCAST|IFF_MULTICAST;
     }
@@ -271,6 +279,7 @@ main (int argc, char **argv)
   int vty_port = 0;
   int batch_mode = 0;
   int daemon_mode = 0;
+  int dplane_mode = 0;
   char *config_file = NULL;
   char *progname;
 
@@ -287,7 +296,7 @@ main (int argc, char **argv)
     {
       int opt;
   
-      opt = getopt_long (argc, argv, "bdf:hA:P:r:v", longopts, 0);
+      opt = getopt_long (argc, argv, "bdf:hA:P:r:vDk:", longopts, 0);
 
       if (opt == EOF)
 	break;
@@ -320,6 +329,12 @@ main (int argc, char **argv)
 	case 'r':
 	  rib_process_hold_time = atoi(optarg);
 	  break;
+	case 'D':
+	  dplane_mode = 1;
+	  break;
+	case 'k':
+	  kernel_null_delay = atoi (optarg);
+	  break;
 	case 'v':
 	  print_version (progname);
 	  exit (0);
@@ -357,6 +372,9 @@ main (int argc, char **argv)
   rib_init ();
   access_list_init ();
 
+  if (dplane_mode)
+    zebra_dplane_init ();
+
   /* Make kernel routing socket. */
   zebra_vrf_init ();
   zebra_vty_init();
@@ -378,6 +396,9 @@ main (int argc, char **argv)
       exit (1);
     }
 
+  if (zebra_dplane_running ())
+    zebra_dplane_start ();
+
   /* Needed for BSD routing socket. */
   pid = getpid ();
 
@@ -0,0 +1,376 @@
+/*
+ * Zebra kernel dataplane thread
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "log.h"
+#include "thread.h"
+#include "network.h"
+#include "vrf.h"
+#include "vty.h"
+#include "nexthop.h"
+
+#include "zebra/rib.h"
+#include "zebra/rt.h"
+#include "zebra/zserv.h"
+#include "zebra/zebra_dplane.h"
+
+/* Kernel route programming can run on its own pthread, so that
+ * rib_process and the zserv clients are not held up by the system
+ * calls.  The main thread packs each change into a dplane_ctx, with
+ * private copies of the ribs involved, has the kernel layer build the
+ * messages for it and queues it.  The dataplane thread hands the
+ * contexts to the kernel layer in batches and queues them back with the
+ * kernel's answers, waking the main thread through a pipe.  The main
+ * thread then has the kernel layer make sense of the answers and log
+ * them, and confirms or clears the nexthops' FIB flags.
+ *
+ * Only the queues are shared.  Contexts are allocated and freed by the
+ * main thread, and the kernel layer must keep its dataplane entry
+ * points to the context and its own dataplane state.  In particular
+ * they do not log, since the log is not safe to use from two threads.
+ */
+
+#ifdef HAVE_ZEBRA_DPLANE
+
+#include <pthread.h>
+#include <poll.h>
+
+/* Contexts taken off the queue by the dataplane thread in one go. */
+#define DPLANE_BATCH_MAX	1024
+
+extern struct zebra_t zebrad;
+
+static struct
+{
+  int running;
+  pthread_t thread;
+
+  /* Everything below is protected by the lock. */
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+
+  /* Contexts for the dataplane thread, oldest first. */
+  struct dplane_ctx *queue;
+  struct dplane_ctx **queue_tail;
+
+  /* Contexts with results for the main thread, oldest first. */
+  struct dplane_ctx *done;
+  struct dplane_ctx **done_tail;
+
+  /* Batches handed to the kernel layer. */
+  unsigned long batches;
+} dplane;
+
+/* Written by the dataplane thread to wake the main thread. */
+static int dplane_wakeup[2] = { -1, -1 };
+
+/* Main thread only. */
+static struct thread *dplane_t_read;
+static unsigned long dplane_batches_seen;
+static unsigned long dplane_pending;
+static unsigned long dplane_pending_max;
+
+static void *
+zebra_dplane_thread (void *arg)
+{
+  struct dplane_ctx *batch, *ctx, **tail;
+  unsigned int count;
+  int wake;
+
+  pthread_mutex_lock (&dplane.lock);
+  for (;;)
+    {
+      while (! dplane.queue)
+        pthread_cond_wait (&dplane.work, &dplane.lock);
+
+      /* Take a batch off the front of the queue. */
+      batch = dplane.queue;
+      for (tail = &batch, count = 0;
+           *tail && count < DPLANE_BATCH_MAX;
+           tail = &(*tail)->next, count++)
+        ;
+      dplane.queue = *tail;
+      if (! dplane.queue)
+        dplane.queue_tail = &dplane.queue;
+      *tail = NULL;
+      pthread_mutex_unlock (&dplane.lock);
+
+      for (ctx = batch; ctx; ctx = ctx->next)
+        kernel_dplane_route (ctx);
+      kernel_dplane_sync ();
+
+      pthread_mutex_lock (&dplane.lock);
+      wake = (dplane.done == NULL);
+      *dplane.done_tail = batch;
+      dplane.done_tail = tail;
+      dplane.batches++;
+
+      /* The main thread takes the whole list each time it is woken, so
+         only the first batch after that needs to wake it. */
+      if (wake)
+        while (write (dplane_wakeup[1], "", 1) < 0 && errno == EINTR)
+          ;
+    }
+
+  return NULL;
+}
+
+static struct rib *
+zebra_dplane_rib_dup (struct rib *rib)
+{
+  struct rib *copy;
+
+  copy = XMALLOC (MTYPE_RIB, sizeof (struct rib));
+  *copy = *rib;
+  copy->next = copy->prev = NULL;
+  copy->nexthop = NULL;
+  copy->nhe = NULL;
+  copy_nexthops (&copy->nexthop, rib->nexthop);
+  return copy;
+}
+
+static void
+zebra_dplane_rib_free (struct rib *rib)
+{
+  if (rib)
+    {
+      nexthops_free (rib->nexthop);
+      XFREE (MTYPE_RIB, rib);
+    }
+}
+
+/* Apply the results the dataplane thread has queued. */
+static void
+zebra_dplane_process (void)
+{
+  struct dplane_ctx *ctx, *done;
+  char buf[64];
+
+  while (read (dplane_wakeup[0], buf, sizeof buf) > 0)
+    ;
+
+  pthread_mutex_lock (&dplane.lock);
+  done = dplane.done;
+  dplane.done = NULL;
+  dplane.done_tail = &dplane.done;
+  fib_stats.writes += dplane.batches - dplane_batches_seen;
+  dplane_batches_seen = dplane.batches;
+  pthread_mutex_unlock (&dplane.lock);
+
+  while ((ctx = done) != NULL)
+    {
+      done = ctx->next;
+      dplane_pending--;
+      kernel_dplane_finish (ctx);
+      rib_fib_result (ctx->vrf_id, &ctx->p, ctx->rib, ctx->rib_seq,
+                      ctx->new ? ctx->new->nexthop : NULL,
+                      ctx->new != NULL, ctx->error);
+      zebra_dplane_rib_free (ctx->old);
+      zebra_dplane_rib_free (ctx->new);
+      if (ctx->msg)
+        XFREE (MTYPE_DPLANE_CTX, ctx->msg);
+      XFREE (MTYPE_DPLANE_CTX, ctx);
+    }
+}
+
+static int
+zebra_dplane_read (struct thread *thread)
+{
+  dplane_t_read = NULL;
+  zebra_dplane_process ();
+  dplane_t_read = thread_add_read (zebrad.master, zebra_dplane_read, NULL,
+                                   dplane_wakeup[0]);
+  return 0;
+}
+
+int
+zebra_dplane_init (void)
+{
+  if (dplane.running)
+    return 0;
+
+  if (pipe (dplane_wakeup) < 0)
+    {
+      zlog_err ("%s: can't create pipe: %s", __func__,
+                safe_strerror (errno));
+      return -1;
+    }
+  set_nonblocking (dplane_wakeup[0]);
+  set_nonblocking (dplane_wakeup[1]);
+
+  pthread_mutex_init (&dplane.lock, NULL);
+  pthread_cond_init (&dplane.work, NULL);
+  dplane.queue_tail = &dplane.queue;
+  dplane.done_tail = &dplane.done;
+  dplane.running = 1;
+  return 0;
+}
+
+int
+zebra_dplane_start (void)
+{
+  sigset_t all, saved;
+  int ret;
+
+  if (! dplane.running)
+    return -1;
+
+  /* Signals are for the main thread to handle.  The new thread also
+     keeps whatever privileges the caller holds now. */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &saved);
+  ret = pthread_create (&dplane.thread, NULL, zebra_dplane_thread, NULL);
+  pthread_sigmask (SIG_SETMASK, &saved, NULL);
+
+  /* Nothing can have been queued yet, so the main thread can simply
+     carry on without it. */
+  if (ret)
+    {
+      zlog_err ("%s: can't create thread: %s", __func__, safe_strerror (ret));
+      dplane.running = 0;
+      return -1;
+    }
+
+  dplane_t_read = thread_add_read (zebrad.master, zebra_dplane_read, NULL,
+                                   dplane_wakeup[0]);
+  zlog_info ("Kernel routes are programmed by the dataplane thread");
+  return 0;
+}
+
+int
+zebra_dplane_running (void)
+{
+  return dplane.running;
+}
+
+void
+zebra_dplane_route (struct route_node *rn, struct rib *old, struct rib *new)
+{
+  struct dplane_ctx *ctx;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  ctx = XCALLOC (MTYPE_DPLANE_CTX, sizeof (struct dplane_ctx));
+  prefix_copy (&ctx->p, &rn->p);
+  ctx->vrf_id = new ? new->vrf_id : old->vrf_id;
+  ctx->zvrf = vrf_info_lookup (ctx->vrf_id);
+
+  if (new)
+    {
+      /* Count on it being installed, as the kernel layer always has;
+         the result will confirm or clear this. */
+      for (ALL_NEXTHOPS_RO(new->nexthop, nexthop, tnexthop, recursing))
+        if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+            && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+          SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      ctx->new = zebra_dplane_rib_dup (new);
+      ctx->rib = new;
+      ctx->rib_seq = new->seq;
+    }
+  if (old)
+    ctx->old = zebra_dplane_rib_dup (old);
+  ctx->sock = -1;
+  kernel_dplane_prepare (ctx);
+
+  fib_stats.requests++;
+  if (++fib_stats.outstanding > fib_stats.outstanding_max)
+    fib_stats.outstanding_max = fib_stats.outstanding;
+  if (++dplane_pending > dplane_pending_max)
+    dplane_pending_max = dplane_pending;
+
+  pthread_mutex_lock (&dplane.lock);
+  *dplane.queue_tail = ctx;
+  dplane.queue_tail = &ctx->next;
+  pthread_cond_signal (&dplane.work);
+  pthread_mutex_unlock (&dplane.lock);
+}
+
+void
+zebra_dplane_wait (void)
+{
+  struct pollfd pfd = { .fd = dplane_wakeup[0], .events = POLLIN };
+
+  while (dplane_pending)
+    {
+      if (poll (&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+          zlog_err ("%s: poll: %s", __func__, safe_strerror (errno));
+          return;
+        }
+      zebra_dplane_process ();
+    }
+}
+
+void
+zebra_dplane_show (struct vty *vty)
+{
+  if (! dplane.running)
+    return;
+
+  vty_out (vty, "Dataplane thread: %lu in progress (max %lu), "
+           "%lu batches%s", dplane_pending, dplane_pending_max,
+           dplane_batches_seen, VTY_NEWLINE);
+}
+
+#else /* HAVE_ZEBRA_DPLANE */
+
+int
+zebra_dplane_init (void)
+{
+  zlog_warn ("Dataplane thread is not supported in this build");
+  return -1;
+}
+
+int
+zebra_dplane_start (void)
+{
+  return -1;
+}
+
+int
+zebra_dplane_running (void)
+{
+  return 0;
+}
+
+void
+zebra_dplane_route (struct route_node *rn, struct rib *old, struct rib *new)
+{
+  return;
+}
+
+void
+zebra_dplane_wait (void)
+{
+  return;
+}
+
+void
+zebra_dplane_show (struct vty *vty)
+{
+  return;
+}
+
+#endif /* HAVE_ZEBRA_DPLANE */
@@ -0,0 +1,90 @@
+/*
+ * Zebra kernel dataplane thread header
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_DPLANE_H
+#define _ZEBRA_DPLANE_H
+
+#include "prefix.h"
+#include "table.h"
+#include "vty.h"
+
+/* One route change on its way from the main thread to the kernel and
+ * back.  It is filled in by the main thread and not changed again
+ * except for the answers, so the dataplane thread never looks at the
+ * RIB itself.
+ */
+struct dplane_ctx
+{
+  struct dplane_ctx *next;
+
+  /* The route, and the VRF the kernel layer should program it in. */
+  struct prefix p;
+  vrf_id_t vrf_id;
+
+  /* Only the main thread looks at these: the VRF, and private copies
+     of the ribs to build the messages from and report on. */
+  struct zebra_vrf *zvrf;
+  struct rib *old;
+  struct rib *new;
+
+  /* The messages kernel_dplane_prepare made for the change, msg_len
+     bytes in all, to be written to sock by the dataplane thread.  None
+     if there is nothing to tell the kernel. */
+  int sock;
+  u_char *msg;
+  size_t msg_len;
+
+  /* The kernel layer's own, for the answers to the messages.  Freed by
+     kernel_dplane_finish. */
+  void *kernel;
+
+  /* The rib being installed and its sequence number, for the main
+     thread to find it again once the result is back.  Never
+     dereferenced by the dataplane thread. */
+  struct rib *rib;
+  u_int32_t rib_seq;
+
+  /* The kernel's answer, 0 or an errno value, as settled by
+     kernel_dplane_finish. */
+  int error;
+};
+
+/* Hand route programming to the dataplane thread.  Must be done before
+   the VRFs are enabled, so that the kernel layer can set up for it. */
+extern int zebra_dplane_init (void);
+
+/* Start the thread itself, once the process has daemonized and before
+   any route is queued.  It keeps the privileges of the caller. */
+extern int zebra_dplane_start (void);
+
+/* Is route programming handed to the dataplane thread? */
+extern int zebra_dplane_running (void);
+
+/* Queue a change of the route at rn from old to new for the kernel. */
+extern void zebra_dplane_route (struct route_node *rn, struct rib *old,
+                                struct rib *new);
+
+/* Wait until every queued change is done and its result applied. */
+extern void zebra_dplane_wait (void);
+
+extern void zebra_dplane_show (struct vty *);
+
+#endif /* _ZEBRA_DPLANE_H */
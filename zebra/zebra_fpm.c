@@ -31,6 +31,7 @@
 #include "command.h"
 
 #include "zebra/rib.h"
+#include "zebra/zebra_nhg.h"
 
 #include "fpm/fpm.h"
 #include "zebra_fpm.h"
@@ -45,7 +46,7 @@
  * Sizes of outgoing and incoming stream buffers for writing/reading
  * FPM messages.
  */
-#define ZFPM_OBUF_SIZE (2 * FPM_MAX_MSG_LEN)
+#define ZFPM_OBUF_SIZE (2 * FPM_MAX_BATCH_MSG_LEN)
 #define ZFPM_IBUF_SIZE (FPM_MAX_MSG_LEN)
 
 /*
@@ -54,6 +55,25 @@
  */
 #define ZFPM_MAX_WRITES_PER_RUN 10
 
+/*
+ * Milliseconds to let updates accumulate for before writing, when
+ * batching, so that each message carries many routes.
+ */
+#define ZFPM_BATCH_HOLD_MSEC 10
+
+/*
+ * Seconds to wait for the FPM to answer our sync message before
+ * sending it everything.
+ */
+#define ZFPM_SYNC_WAIT_SECS 3
+
+/*
+ * The most dests whose routes are gone to keep on the log, so that the
+ * FPM can be told about them again when it reconnects. Past that, an
+ * FPM which has not seen the newer ones has to be sent everything.
+ */
+#define ZFPM_LOG_MAX_DELETED 65536
+
 /*
  * Interval over which we collect statistics.
  */
@@ -87,6 +107,9 @@ typedef struct zfpm_stats_t_ {
   unsigned long nop_deletes_skipped;
   unsigned long route_adds;
   unsigned long route_dels;
+  unsigned long messages;
+  unsigned long nhg_defs;
+  unsigned long encode_usecs;
 
   unsigned long updates_triggered;
   unsigned long redundant_triggers;
@@ -105,6 +128,11 @@ typedef struct zfpm_stats_t_ {
   unsigned long t_conn_up_aborts;
   unsigned long t_conn_up_finishes;
 
+  unsigned long resyncs_incremental;
+  unsigned long resyncs_full;
+  unsigned long resync_dests_queued;
+  unsigned long log_dests_dropped;
+
 } zfpm_stats_t;
 
 /*
@@ -163,6 +191,53 @@ typedef struct zfpm_glob_t_
    */
   zfpm_msg_format_e message_format;
 
+  /*
+   * True to send many routes per message, and to have the routes refer
+   * to nexthop groups defined with them.
+   */
+  int batch;
+  int batch_nhg;
+
+  /*
+   * True to keep track of what the FPM was sent, so as to send it only
+   * what it missed when it reconnects, see FPM_MSG_TYPE_SYNC.
+   */
+  int resync;
+
+  /*
+   * Identifies this run of zebra to the FPM, and the generation of the
+   * last route message built.
+   */
+  uint32_t epoch;
+  uint32_t gen;
+
+  /*
+   * The dests the FPM was sent, oldest first. Every dest sent a message
+   * with a generation above log_floor is on it, including those whose
+   * routes were deleted since, of which there are log_deleted.
+   */
+  TAILQ_HEAD (zfpm_dest_log, rib_dest_t_) dest_log;
+  uint32_t log_floor;
+  unsigned long log_deleted;
+
+  /*
+   * True if what the FPM was sent was kept when the connection went
+   * down, and changes were queued since.
+   */
+  int state_kept;
+
+  /*
+   * True from the start of a walk sending the FPM all routes until it
+   * is done.
+   */
+  int full_pending;
+
+  /*
+   * True while waiting for the FPM to answer our sync message.
+   */
+  int sync_wait;
+  struct thread *t_sync;
+
   struct thread_master *master;
 
   zfpm_state_t state;
@@ -196,6 +271,11 @@ typedef struct zfpm_glob_t_
   struct thread *t_write;
   struct thread *t_read;
 
+  /*
+   * Timer holding back writes while updates accumulate in batch mode.
+   */
+  struct thread *t_batch;
+
   /*
    * Thread to clean up after the TCP connection to the FPM goes down
    * and the state that belongs to it.
@@ -528,6 +608,105 @@ static inline void
 zfpm_write_off (void)
 {
   THREAD_WRITE_OFF (zfpm_g->t_write);
+  THREAD_TIMER_OFF (zfpm_g->t_batch);
+}
+
+/*
+ * zfpm_dest_enqueue
+ *
+ * Put the given dest on the queue of those the FPM is to be told
+ * about.
+ */
+static inline void
+zfpm_dest_enqueue (rib_dest_t *dest)
+{
+  SET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
+  TAILQ_INSERT_TAIL (&zfpm_g->dest_q, dest, fpm_q_entries);
+}
+
+/*
+ * zfpm_log_is_deleted
+ *
+ * Returns TRUE if the last message the FPM was sent about the given
+ * logged dest was a deletion.
+ */
+static inline int
+zfpm_log_is_deleted (rib_dest_t *dest)
+{
+  return !CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+}
+
+/*
+ * zfpm_log_remove
+ */
+static void
+zfpm_log_remove (rib_dest_t *dest)
+{
+  assert (CHECK_FLAG (dest->flags, RIB_DEST_FPM_LOGGED));
+
+  if (zfpm_log_is_deleted (dest))
+    zfpm_g->log_deleted--;
+
+  TAILQ_REMOVE (&zfpm_g->dest_log, dest, fpm_log_entries);
+  UNSET_FLAG (dest->flags, RIB_DEST_FPM_LOGGED);
+}
+
+/*
+ * zfpm_log_drop_oldest
+ *
+ * Take the oldest dest off the log. The FPM has to have seen it to be
+ * resynchronized without being sent everything.
+ */
+static void
+zfpm_log_drop_oldest (void)
+{
+  rib_dest_t *dest;
+
+  dest = TAILQ_FIRST (&zfpm_g->dest_log);
+  assert (dest);
+
+  zfpm_log_remove (dest);
+  if (zfpm_g->log_floor < dest->fpm_gen)
+    zfpm_g->log_floor = dest->fpm_gen;
+  zfpm_g->stats.log_dests_dropped++;
+
+  rib_gc_dest (dest->rnode);
+}
+
+/*
+ * zfpm_log_clear
+ *
+ * Forget what the FPM was sent.
+ */
+static void
+zfpm_log_clear (void)
+{
+  while (!TAILQ_EMPTY (&zfpm_g->dest_log))
+    zfpm_log_drop_oldest ();
+
+  if (zfpm_g->log_floor < zfpm_g->gen)
+    zfpm_g->log_floor = zfpm_g->gen;
+}
+
+/*
+ * zfpm_log_dest
+ *
+ * Note that a message about the given dest, with the latest
+ * generation, has been built. The dest flags are already up to date.
+ */
+static void
+zfpm_log_dest (rib_dest_t *dest)
+{
+  assert (!CHECK_FLAG (dest->flags, RIB_DEST_FPM_LOGGED));
+
+  SET_FLAG (dest->flags, RIB_DEST_FPM_LOGGED);
+  TAILQ_INSERT_TAIL (&zfpm_g->dest_log, dest, fpm_log_entries);
+
+  if (zfpm_log_is_deleted (dest))
+    zfpm_g->log_deleted++;
+
+  while (zfpm_g->log_deleted > ZFPM_LOG_MAX_DELETED)
+    zfpm_log_drop_oldest ();
 }
 
 /*
@@ -580,6 +759,7 @@ zfpm_conn_up_thread_cb (struct thread *thread)
     }
 
   zfpm_g->stats.t_conn_up_finishes++;
+  zfpm_g->full_pending = 0;
 
  done:
   zfpm_rnodes_iter_cleanup (iter);
@@ -587,22 +767,21 @@ zfpm_conn_up_thread_cb (struct thread *thread)
 }
 
 /*
- * zfpm_connection_up
+ * zfpm_resync_full
  *
- * Called when the connection to the FPM comes up.
+ * Start thread to push existing routes to the FPM.
  */
 static void
-zfpm_connection_up (const char *detail)
+zfpm_resync_full (void)
 {
-  assert (zfpm_g->sock >= 0);
-  zfpm_read_on ();
-  zfpm_write_on ();
-  zfpm_set_state (ZFPM_STATE_ESTABLISHED, detail);
+  assert (!zfpm_g->t_conn_up);
 
   /*
-   * Start thread to push existing routes to the FPM.
+   * What the FPM was sent before does not count any more.
    */
-  assert (!zfpm_g->t_conn_up);
+  zfpm_g->full_pending = 1;
+  if (zfpm_g->log_floor < zfpm_g->gen)
+    zfpm_g->log_floor = zfpm_g->gen;
 
   zfpm_rnodes_iter_init (&zfpm_g->t_conn_up_state.iter);
 
@@ -612,6 +791,135 @@ zfpm_connection_up (const char *detail)
   zfpm_g->stats.t_conn_up_starts++;
 }
 
+/*
+ * zfpm_resync_incremental
+ *
+ * Queue the dests the FPM was sent messages about after the given
+ * generation, which it has not applied. The dests that changed while
+ * the connection was down are on the queue already.
+ */
+static void
+zfpm_resync_incremental (uint32_t gen)
+{
+  rib_dest_t *dest;
+
+  TAILQ_FOREACH_REVERSE (dest, &zfpm_g->dest_log, zfpm_dest_log,
+			 fpm_log_entries)
+    {
+      if (dest->fpm_gen <= gen)
+	break;
+
+      /*
+       * The FPM may still have the route, whatever it was sent last.
+       */
+      if (zfpm_log_is_deleted (dest))
+	{
+	  zfpm_g->log_deleted--;
+	  SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+	}
+
+      if (!CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM))
+	{
+	  zfpm_dest_enqueue (dest);
+	  zfpm_g->stats.resync_dests_queued++;
+	}
+    }
+}
+
+/*
+ * zfpm_sync_done
+ *
+ * The FPM has told us the last generation it applied from this run of
+ * zebra, or we gave up waiting for it to.
+ */
+static void
+zfpm_sync_done (int answered, uint32_t epoch, uint32_t gen)
+{
+  assert (zfpm_g->sync_wait);
+  zfpm_g->sync_wait = 0;
+  THREAD_TIMER_OFF (zfpm_g->t_sync);
+
+  if (answered && zfpm_g->state_kept && !zfpm_g->full_pending
+      && epoch == zfpm_g->epoch && gen >= zfpm_g->log_floor && gen <= zfpm_g->gen)
+    {
+      zlog_info ("FPM applied routes up to generation %u of %u, "
+		 "sending it the rest", gen, zfpm_g->gen);
+      zfpm_resync_incremental (gen);
+      zfpm_g->stats.resyncs_incremental++;
+    }
+  else
+    {
+      zlog_info ("FPM %s, sending it all routes",
+		 answered ? "cannot be resynchronized" : "did not answer");
+      zfpm_resync_full ();
+      zfpm_g->stats.resyncs_full++;
+    }
+
+  zfpm_g->state_kept = 0;
+
+  if (!zfpm_g->t_write)
+    zfpm_write_on ();
+}
+
+/*
+ * zfpm_sync_timeout_cb
+ */
+static int
+zfpm_sync_timeout_cb (struct thread *thread)
+{
+  zfpm_g->t_sync = NULL;
+  zfpm_sync_done (0, 0, 0);
+  return 0;
+}
+
+/*
+ * zfpm_sync_start
+ *
+ * Ask the FPM which routes it has, see FPM_MSG_TYPE_SYNC. No route
+ * updates are built until it answers.
+ */
+static void
+zfpm_sync_start (void)
+{
+  struct stream *s;
+
+  s = zfpm_g->obuf;
+  assert (stream_empty (s));
+
+  stream_putc (s, FPM_PROTO_VERSION);
+  stream_putc (s, FPM_MSG_TYPE_SYNC);
+  stream_putw (s, fpm_data_len_to_msg_len (sizeof (fpm_sync_msg_t)));
+  stream_putl (s, zfpm_g->epoch);
+  stream_putl (s, zfpm_g->gen);
+
+  zfpm_g->sync_wait = 1;
+  THREAD_TIMER_ON (zfpm_g->master, zfpm_g->t_sync, zfpm_sync_timeout_cb, 0,
+		   ZFPM_SYNC_WAIT_SECS);
+}
+
+/*
+ * zfpm_connection_up
+ *
+ * Called when the connection to the FPM comes up.
+ */
+static void
+zfpm_connection_up (const char *detail)
+{
+  assert (zfpm_g->sock >= 0);
+  zfpm_read_on ();
+  zfpm_write_on ();
+  zfpm_set_state (ZFPM_STATE_ESTABLISHED, detail);
+
+  if (zfpm_g->resync)
+    {
+      zfpm_sync_start ();
+      return;
+    }
+
+  zfpm_g->state_kept = 0;
+  zfpm_resync_full ();
+}
+
 /*
  * zfpm_connect_check
  *
@@ -713,6 +1021,15 @@ zfpm_conn_down_thread_cb (struct thread *thread)
   return 0;
 }
 
+/*
+ * zfpm_nhg_forget
+ */
+static void
+zfpm_nhg_forget (struct nhg_entry *nhe, void *arg)
+{
+  nhe->fpm_version = 0;
+}
+
 /*
  * zfpm_connection_down
  *
@@ -734,11 +1051,31 @@ zfpm_connection_down (const char *detail)
   stream_reset (zfpm_g->ibuf);
   stream_reset (zfpm_g->obuf);
 
+  /*
+   * The nexthop groups have to be sent again too.
+   */
+  zebra_nhg_iterate (zfpm_nhg_forget, NULL);
+
   if (zfpm_g->sock >= 0) {
     close (zfpm_g->sock);
     zfpm_g->sock = -1;
   }
 
+  zfpm_g->sync_wait = 0;
+  THREAD_TIMER_OFF (zfpm_g->t_sync);
+
+  /*
+   * Keep track of what the FPM was sent, and of what changes, to tell
+   * it only about that when it comes back.
+   */
+  if (zfpm_g->resync)
+    {
+      zfpm_g->state_kept = 1;
+      zfpm_set_state (ZFPM_STATE_IDLE, detail);
+      zfpm_start_connect_timer ("keeping routes to resynchronize");
+      return;
+    }
+
   /*
    * Start thread to clean up state after the connection goes down.
    */
@@ -832,8 +1169,19 @@ zfpm_read_cb (struct thread *thread)
 
   zfpm_debug ("Read out a full fpm message");
 
+  if (hdr->msg_type == FPM_MSG_TYPE_SYNC && zfpm_g->sync_wait
+      && fpm_msg_data_len (hdr) >= sizeof (fpm_sync_msg_t))
+    {
+      uint32_t epoch, gen;
+
+      stream_forward_getp (ibuf, FPM_MSG_HDR_LEN);
+      epoch = stream_getl (ibuf);
+      gen = stream_getl (ibuf);
+      zfpm_sync_done (1, epoch, gen);
+    }
+
   /*
-   * Just throw it away for now.
+   * Throw anything else away for now.
    */
   stream_reset (ibuf);
 
@@ -859,9 +1207,10 @@ zfpm_writes_pending (void)
     return 1;
 
   /*
-   * Check if there are any prefixes on the outbound queue.
+   * Check if there are any prefixes on the outbound queue, which we
+   * don't write out while waiting for the FPM's sync answer.
    */
-  if (!TAILQ_EMPTY (&zfpm_g->dest_q))
+  if (!TAILQ_EMPTY (&zfpm_g->dest_q) && !zfpm_g->sync_wait)
     return 1;
 
   return 0;
@@ -899,7 +1248,7 @@ zfpm_encode_route (rib_dest_t *dest, struct rib *rib, char *in_buf,
 #ifdef HAVE_NETLINK
     *msg_type = FPM_MSG_TYPE_NETLINK;
     cmd = rib ? RTM_NEWROUTE : RTM_DELROUTE;
-    len = zfpm_netlink_encode_route (cmd, dest, rib, in_buf, in_buf_len);
+    len = zfpm_netlink_encode_route (cmd, dest, rib, 0, in_buf, in_buf_len);
     assert(fpm_msg_align(len) == len);
     *msg_type = FPM_MSG_TYPE_NETLINK;
 #endif /* HAVE_NETLINK */
@@ -938,13 +1287,56 @@ zfpm_route_for_update (rib_dest_t *dest)
 }
 
 /*
- * zfpm_build_updates
+ * zfpm_dest_dequeue
  *
- * Process the outgoing queue and write messages to the outbound
- * buffer.
+ * Take a dest off the outgoing queue once the FPM has been sent what
+ * it is to be told about it.
  */
 static void
-zfpm_build_updates (void)
+zfpm_dest_dequeue (rib_dest_t *dest, int is_add)
+{
+  int sent;
+
+  /*
+   * Remove the dest from the queue, and reset the flag.
+   */
+  UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
+  TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
+
+  /*
+   * A deletion is only sent if the FPM was sent the route.
+   */
+  sent = is_add || CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+  if (sent && CHECK_FLAG (dest->flags, RIB_DEST_FPM_LOGGED))
+    zfpm_log_remove (dest);
+
+  if (is_add)
+    {
+      SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+    }
+  else
+    {
+      UNSET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
+    }
+
+  if (sent && zfpm_g->resync)
+    zfpm_log_dest (dest);
+
+  /*
+   * Delete the destination if necessary.
+   */
+  if (rib_gc_dest (dest->rnode))
+    zfpm_g->stats.dests_del_after_update++;
+}
+
+/*
+ * zfpm_build_route_updates
+ *
+ * Process the outgoing queue and write a message for each route to the
+ * outbound buffer.
+ */
+static void
+zfpm_build_route_updates (void)
 {
   struct stream *s;
   rib_dest_t *dest;
@@ -998,6 +1390,7 @@ zfpm_build_updates (void)
       }
 
     if (write_msg) {
+      dest->fpm_gen = ++zfpm_g->gen;
       data_len = zfpm_encode_route (dest, rib, (char *) data, buf_end - data,
 				    &msg_type);
 
@@ -1013,32 +1406,226 @@ zfpm_build_updates (void)
 	    zfpm_g->stats.route_adds++;
 	  else
 	    zfpm_g->stats.route_dels++;
+	  zfpm_g->stats.messages++;
 	}
     }
 
-    /*
-     * Remove the dest from the queue, and reset the flag.
-     */
-    UNSET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
-    TAILQ_REMOVE (&zfpm_g->dest_q, dest, fpm_q_entries);
+    zfpm_dest_dequeue (dest, is_add);
 
-    if (is_add)
-      {
-	SET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
-      }
-    else
-      {
-	UNSET_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM);
-      }
+  } while (1);
+
+}
+
+/*
+ * zfpm_batching
+ *
+ * Are routes to be sent many to a message? Batches are only made in
+ * the netlink format; protobuf messages are sent one route at a time
+ * whatever the configuration.
+ */
+static int
+zfpm_batching (void)
+{
+  return (zfpm_g->batch
+	  && zfpm_g->message_format == ZFPM_MSG_FORMAT_NETLINK);
+}
+
+/*
+ * zfpm_batch_nhg
+ *
+ * Returns the ID of the nexthop group the given route is to refer to
+ * in the batch being built, after adding the group's definition to the
+ * batch if the FPM does not have it as it is now. Returns 0 if the
+ * route is to carry its own nexthops.
+ */
+static uint32_t
+zfpm_batch_nhg (struct rib *rib, char *buf, size_t buf_len, size_t *len)
+{
+  struct nhg_entry *nhe;
+  int nhg_len;
 
+  if (!zfpm_g->batch_nhg || !rib || !(nhe = rib->nhe) || !nhe->fib)
+    return 0;
+
+  if (nhe->fpm_version == nhe->version)
+    return nhe->id;
+
+  switch (zfpm_g->message_format) {
+
+  case ZFPM_MSG_FORMAT_NETLINK:
+#ifdef HAVE_NETLINK
+    nhg_len = zfpm_netlink_encode_nhg (nhe, buf + *len, buf_len - *len);
+    if (nhg_len <= 0)
+      return 0;
+    *len += nhg_len;
+#endif /* HAVE_NETLINK */
+    break;
+
+  default:
+    return 0;
+  }
+
+  nhe->fpm_version = nhe->version;
+  zfpm_g->stats.nhg_defs++;
+  return nhe->id;
+}
+
+/*
+ * zfpm_batch_add
+ *
+ * Add a message about the route at the given dest to the batch being
+ * built in buf, whose first len bytes are taken.
+ *
+ * Returns 1 if it was added, 0 if there is no room for it in this
+ * batch, and -1 if it could not be encoded.
+ */
+static int
+zfpm_batch_add (rib_dest_t *dest, struct rib *rib, char *buf, size_t buf_len,
+		size_t *len)
+{
+  uint32_t nh_id;
+  int msg_len;
+
+  switch (zfpm_g->message_format) {
+
+  case ZFPM_MSG_FORMAT_NETLINK:
+#ifdef HAVE_NETLINK
     /*
-     * Delete the destination if necessary.
+     * Leave room for the route, and the group it refers to, at their
+     * largest.
      */
-    if (rib_gc_dest (dest->rnode))
-      zfpm_g->stats.dests_del_after_update++;
+    if (buf_len - *len < 2 * FPM_MAX_MSG_LEN)
+      return 0;
 
-  } while (1);
+    nh_id = zfpm_batch_nhg (rib, buf, buf_len, len);
+    msg_len = zfpm_netlink_encode_route (rib ? RTM_NEWROUTE : RTM_DELROUTE,
+					 dest, rib, nh_id, buf + *len,
+					 buf_len - *len);
+    if (msg_len <= 0)
+      return -1;
+
+    assert (fpm_msg_align (msg_len) == (size_t) msg_len);
+    *len += msg_len;
+    return 1;
+#endif /* HAVE_NETLINK */
+    break;
 
+  default:
+    break;
+  }
+
+  return -1;
+}
+
+/*
+ * zfpm_build_batch_updates
+ *
+ * Process the outgoing queue and write messages, each about many
+ * routes, to the outbound buffer.
+ */
+static void
+zfpm_build_batch_updates (void)
+{
+  struct stream *s;
+  rib_dest_t *dest;
+  struct rib *rib;
+  fpm_msg_hdr_t *hdr;
+  char *data;
+  size_t data_len, max_len;
+  uint32_t prev_gen;
+  int is_add, ret;
+
+  s = zfpm_g->obuf;
+
+  assert (stream_empty (s));
+
+  while (STREAM_WRITEABLE (s) >= FPM_MAX_BATCH_MSG_LEN
+	 && !TAILQ_EMPTY (&zfpm_g->dest_q))
+    {
+      hdr = (fpm_msg_hdr_t *) (STREAM_DATA (s) + stream_get_endp (s));
+      hdr->version = FPM_PROTO_VERSION;
+
+      data = fpm_msg_data (hdr);
+      data_len = 0;
+      max_len = FPM_MAX_BATCH_MSG_LEN - FPM_MSG_HDR_LEN;
+
+      while ((dest = TAILQ_FIRST (&zfpm_g->dest_q)))
+	{
+	  assert (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM));
+
+	  rib = zfpm_route_for_update (dest);
+	  is_add = rib ? 1 : 0;
+
+	  /*
+	   * If this is a route deletion, and we have not sent the route
+	   * to the FPM previously, skip it.
+	   */
+	  if (!is_add && !CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
+	    {
+	      zfpm_g->stats.nop_deletes_skipped++;
+	      zfpm_dest_dequeue (dest, is_add);
+	      continue;
+	    }
+
+	  prev_gen = dest->fpm_gen;
+	  dest->fpm_gen = zfpm_g->gen + 1;
+	  ret = zfpm_batch_add (dest, rib, data, max_len, &data_len);
+	  if (!ret)
+	    {
+	      dest->fpm_gen = prev_gen;
+	      break;
+	    }
+
+	  zfpm_g->gen++;
+
+	  /*
+	   * A route with no nexthop the FPM can use encodes to nothing,
+	   * and is left out of the batch.
+	   */
+	  if (ret > 0)
+	    {
+	      if (is_add)
+		zfpm_g->stats.route_adds++;
+	      else
+		zfpm_g->stats.route_dels++;
+	    }
+
+	  zfpm_dest_dequeue (dest, is_add);
+	}
+
+      if (!data_len)
+	break;
+
+      hdr->msg_type = FPM_MSG_TYPE_NETLINK_BATCH;
+      hdr->msg_len = htons (fpm_data_len_to_msg_len (data_len));
+      stream_forward_endp (s, fpm_data_len_to_msg_len (data_len));
+      zfpm_g->stats.messages++;
+    }
+}
+
+/*
+ * zfpm_build_updates
+ *
+ * Process the outgoing queue and write messages to the outbound
+ * buffer.
+ */
+static void
+zfpm_build_updates (void)
+{
+  struct timeval start, end;
+
+  if (zfpm_g->sync_wait)
+    return;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+
+  if (zfpm_batching ())
+    zfpm_build_batch_updates ();
+  else
+    zfpm_build_route_updates ();
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &end);
+  zfpm_g->stats.encode_usecs += timeval_elapsed (end, start);
 }
 
 /*
@@ -1332,6 +1919,22 @@ zfpm_conn_is_up (void)
   return 1;
 }
 
+/*
+ * zfpm_batch_hold_cb
+ *
+ * Updates have had time to accumulate, write them out.
+ */
+static int
+zfpm_batch_hold_cb (struct thread *thread)
+{
+  zfpm_g->t_batch = NULL;
+
+  if (!zfpm_g->t_write)
+    zfpm_write_on ();
+
+  return 0;
+}
+
 /*
  * zfpm_trigger_update
  *
@@ -1345,10 +1948,11 @@ zfpm_trigger_update (struct route_node *rn, const char *reason)
   char buf[PREFIX_STRLEN];
 
   /*
-   * Ignore if the connection is down. We will update the FPM about
-   * all destinations once the connection comes up.
+   * Ignore if the connection is down, unless we are to tell the FPM
+   * what changed once it comes back. Otherwise we will update the FPM
+   * about all destinations once the connection comes up.
    */
-  if (!zfpm_conn_is_up ())
+  if (!zfpm_conn_is_up () && !zfpm_g->state_kept)
     return;
 
   dest = rib_dest_from_rnode (rn);
@@ -1374,16 +1978,25 @@ zfpm_trigger_update (struct route_node *rn, const char *reason)
 		  prefix2str (&rn->p, buf, sizeof(buf)), reason);
     }
 
-  SET_FLAG (dest->flags, RIB_DEST_UPDATE_FPM);
-  TAILQ_INSERT_TAIL (&zfpm_g->dest_q, dest, fpm_q_entries);
+  zfpm_dest_enqueue (dest);
   zfpm_g->stats.updates_triggered++;
 
   /*
    * Make sure that writes are enabled.
    */
-  if (zfpm_g->t_write)
+  if (!zfpm_conn_is_up () || zfpm_g->sync_wait)
     return;
 
+  if (zfpm_g->t_write || zfpm_g->t_batch)
+    return;
+
+  if (zfpm_batching ())
+    {
+      THREAD_TIMER_MSEC_ON (zfpm_g->master, zfpm_g->t_batch,
+			    zfpm_batch_hold_cb, 0, ZFPM_BATCH_HOLD_MSEC);
+      return;
+    }
+
   zfpm_write_on ();
 }
 
@@ -1452,6 +2065,44 @@ zfpm_start_stats_timer (void)
 	     zfpm_g->last_ivl_stats.counter, VTY_NEWLINE);		\
   } while (0)
 
+/*
+ * zfpm_stats_rate
+ *
+ * Routes per message, in tenths, or nanoseconds spent encoding per
+ * route.
+ */
+static unsigned long
+zfpm_stats_rate (const zfpm_stats_t *stats, int encode_time)
+{
+  unsigned long routes;
+
+  routes = stats->route_adds + stats->route_dels;
+
+  if (encode_time)
+    return routes ? stats->encode_usecs * 1000 / routes : 0;
+
+  return stats->messages ? routes * 10 / stats->messages : 0;
+}
+
+/*
+ * zfpm_show_rate
+ */
+static void
+zfpm_show_rate (struct vty *vty, const char *label, const zfpm_stats_t *total,
+		const zfpm_stats_t *last, int encode_time)
+{
+  unsigned long t, l;
+
+  t = zfpm_stats_rate (total, encode_time);
+  l = zfpm_stats_rate (last, encode_time);
+
+  if (encode_time)
+    vty_out (vty, "%-40s %10lu %16lu%s", label, t, l, VTY_NEWLINE);
+  else
+    vty_out (vty, "%-40s %8lu.%lu %14lu.%lu%s", label, t / 10, t % 10,
+	     l / 10, l % 10, VTY_NEWLINE);
+}
+
 /*
  * zfpm_show_stats
  */
@@ -1481,6 +2132,9 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (nop_deletes_skipped);
   ZFPM_SHOW_STAT (route_adds);
   ZFPM_SHOW_STAT (route_dels);
+  ZFPM_SHOW_STAT (messages);
+  ZFPM_SHOW_STAT (nhg_defs);
+  ZFPM_SHOW_STAT (encode_usecs);
   ZFPM_SHOW_STAT (updates_triggered);
   ZFPM_SHOW_STAT (non_fpm_table_triggers);
   ZFPM_SHOW_STAT (redundant_triggers);
@@ -1494,6 +2148,16 @@ zfpm_show_stats (struct vty *vty)
   ZFPM_SHOW_STAT (t_conn_up_yields);
   ZFPM_SHOW_STAT (t_conn_up_aborts);
   ZFPM_SHOW_STAT (t_conn_up_finishes);
+  ZFPM_SHOW_STAT (resyncs_incremental);
+  ZFPM_SHOW_STAT (resyncs_full);
+  ZFPM_SHOW_STAT (resync_dests_queued);
+  ZFPM_SHOW_STAT (log_dests_dropped);
+
+  vty_out (vty, "%s", VTY_NEWLINE);
+  zfpm_show_rate (vty, "routes per message", &total_stats,
+		  &zfpm_g->last_ivl_stats, 0);
+  zfpm_show_rate (vty, "encode nsecs per route", &total_stats,
+		  &zfpm_g->last_ivl_stats, 1);
 
   if (!zfpm_g->last_stats_clear_time)
     return;
@@ -1606,6 +2270,81 @@ DEFUN ( no_fpm_remote_ip,
 }
 
 
+/*
+ * fpm_batch
+ */
+DEFUN (fpm_batch,
+       fpm_batch_cmd,
+       "fpm batch",
+       "Forwarding Plane Manager configuration\n"
+       "Send many routes in each message\n")
+{
+  zfpm_g->batch = 1;
+  zfpm_g->batch_nhg = 0;
+  return CMD_SUCCESS;
+}
+
+DEFUN (fpm_batch_nhg,
+       fpm_batch_nhg_cmd,
+       "fpm batch nexthop-group",
+       "Forwarding Plane Manager configuration\n"
+       "Send many routes in each message\n"
+       "Define shared nexthop groups for the routes to refer to\n")
+{
+  zfpm_g->batch = 1;
+  zfpm_g->batch_nhg = 1;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_fpm_batch,
+       no_fpm_batch_cmd,
+       "no fpm batch",
+       NO_STR
+       "Forwarding Plane Manager configuration\n"
+       "Send many routes in each message\n")
+{
+  zfpm_g->batch = 0;
+  zfpm_g->batch_nhg = 0;
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_fpm_batch,
+       no_fpm_batch_nhg_cmd,
+       "no fpm batch nexthop-group",
+       NO_STR
+       "Forwarding Plane Manager configuration\n"
+       "Send many routes in each message\n"
+       "Define shared nexthop groups for the routes to refer to\n")
+
+/*
+ * fpm_resync
+ */
+DEFUN (fpm_resync,
+       fpm_resync_cmd,
+       "fpm resync",
+       "Forwarding Plane Manager configuration\n"
+       "Send only the routes the FPM missed when it reconnects\n")
+{
+  if (zfpm_g->resync)
+    return CMD_SUCCESS;
+
+  zfpm_log_clear ();
+  zfpm_g->resync = 1;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_fpm_resync,
+       no_fpm_resync_cmd,
+       "no fpm resync",
+       NO_STR
+       "Forwarding Plane Manager configuration\n"
+       "Send only the routes the FPM missed when it reconnects\n")
+{
+  zfpm_g->resync = 0;
+  zfpm_log_clear ();
+  return CMD_SUCCESS;
+}
+
 /*
  * zfpm_init_message_format
  */
@@ -1682,6 +2421,13 @@ int fpm_remote_srv_write (struct vty *vty )
           zfpm_g->fpm_port != FPM_DEFAULT_PORT)
       vty_out (vty,"fpm connection ip %s port %d%s", inet_ntoa (in),zfpm_g->fpm_port,VTY_NEWLINE);
 
+   if (zfpm_g->batch)
+      vty_out (vty, "fpm batch%s%s", zfpm_g->batch_nhg ? " nexthop-group" : "",
+               VTY_NEWLINE);
+
+   if (zfpm_g->resync)
+      vty_out (vty, "fpm resync%s", VTY_NEWLINE);
+
    return 0;
 }
 
@@ -1712,6 +2458,8 @@ zfpm_init (struct thread_master *master, int enable, uint16_t port,
   memset (zfpm_g, 0, sizeof (*zfpm_g));
   zfpm_g->master = master;
   TAILQ_INIT(&zfpm_g->dest_q);
+  TAILQ_INIT(&zfpm_g->dest_log);
+  zfpm_g->epoch = (uint32_t) time (NULL) ^ ((uint32_t) getpid () << 16);
   zfpm_g->sock = -1;
   zfpm_g->state = ZFPM_STATE_IDLE;
 
@@ -1723,6 +2471,12 @@ zfpm_init (struct thread_master *master, int enable, uint16_t port,
   install_element (ENABLE_NODE, &clear_zebra_fpm_stats_cmd);
   install_element (CONFIG_NODE, &fpm_remote_ip_cmd);
   install_element (CONFIG_NODE, &no_fpm_remote_ip_cmd);
+  install_element (CONFIG_NODE, &fpm_batch_cmd);
+  install_element (CONFIG_NODE, &fpm_batch_nhg_cmd);
+  install_element (CONFIG_NODE, &no_fpm_batch_cmd);
+  install_element (CONFIG_NODE, &no_fpm_batch_nhg_cmd);
+  install_element (CONFIG_NODE, &fpm_resync_cmd);
+  install_element (CONFIG_NODE, &no_fpm_resync_cmd);
 
   zfpm_init_message_format(format);
 
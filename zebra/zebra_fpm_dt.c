@@ -127,7 +127,8 @@ zfpm_dt_benchmark_netlink_encode (int argc, const char **argv)
   }
 
   for (i = 0; i < times; i++) {
-    len = zfpm_netlink_encode_route(RTM_NEWROUTE, dest, rib, buf, sizeof(buf));
+    len = zfpm_netlink_encode_route(RTM_NEWROUTE, dest, rib, 0, buf,
+                                    sizeof(buf));
     if (len <= 0) {
       return 2;
     }
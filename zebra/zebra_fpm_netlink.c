@@ -30,6 +30,11 @@
 
 #include "rt_netlink.h"
 #include "nexthop.h"
+#include "zebra_nhg.h"
+
+#ifdef HAVE_LINUX_NEXTHOP_H
+#include <linux/nexthop.h>
+#endif /* HAVE_LINUX_NEXTHOP_H */
 
 #include "zebra_fpm_private.h"
 
@@ -128,12 +133,18 @@ typedef struct netlink_nh_info_t_
 typedef struct netlink_route_info_t_
 {
   uint16_t nlmsg_type;
+  uint32_t nlmsg_seq;
   u_char rtm_type;
   uint32_t rtm_table;
   u_char rtm_protocol;
   u_char af;
   struct prefix *prefix;
   uint32_t *metric;
+
+  /*
+   * Nexthop group the route uses instead of its own nexthops, or 0.
+   */
+  uint32_t nh_id;
   int num_nhs;
 
   /*
@@ -233,7 +244,7 @@ netlink_proto_from_route_type (int type)
  */
 static int
 netlink_route_info_fill (netlink_route_info_t *ri, int cmd,
-			 rib_dest_t *dest, struct rib *rib)
+			 rib_dest_t *dest, struct rib *rib, uint32_t nh_id)
 {
   struct nexthop *nexthop, *tnexthop;
   int recursing;
@@ -245,6 +256,7 @@ netlink_route_info_fill (netlink_route_info_t *ri, int cmd,
   ri->af = rib_dest_af (dest);
 
   ri->nlmsg_type = cmd;
+  ri->nlmsg_seq = dest->fpm_gen;
   ri->rtm_table = rib_dest_vrf (dest)->vrf_id;
   ri->rtm_protocol = RTPROT_UNSPEC;
 
@@ -290,6 +302,12 @@ netlink_route_info_fill (netlink_route_info_t *ri, int cmd,
       goto skip;
     }
 
+  if (nh_id)
+    {
+      ri->nh_id = nh_id;
+      goto skip;
+    }
+
   for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
     {
       if (ri->num_nhs >= MULTIPATH_NUM)
@@ -356,6 +374,7 @@ netlink_route_info_encode (netlink_route_info_t *ri, char *in_buf,
   req->n.nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg));
   req->n.nlmsg_flags = NLM_F_CREATE | NLM_F_REQUEST;
   req->n.nlmsg_type = ri->nlmsg_type;
+  req->n.nlmsg_seq = ri->nlmsg_seq;
   req->r.rtm_family = ri->af;
   req->r.rtm_table = ri->rtm_table;
   req->r.rtm_dst_len = ri->prefix->prefixlen;
@@ -370,6 +389,11 @@ netlink_route_info_encode (netlink_route_info_t *ri, char *in_buf,
   if (ri->metric)
     addattr32 (&req->n, in_buf_len, RTA_PRIORITY, *ri->metric);
 
+#ifdef HAVE_LINUX_NEXTHOP_H
+  if (ri->nh_id)
+    addattr32 (&req->n, in_buf_len, RTA_NH_ID, ri->nh_id);
+#endif /* HAVE_LINUX_NEXTHOP_H */
+
   if (ri->num_nhs == 0)
     goto done;
 
@@ -453,11 +477,11 @@ zfpm_log_route_info (netlink_route_info_t *ri, const char *label)
   netlink_nh_info_t *nhi;
   int i;
 
-  zfpm_debug ("%s : %s %s/%d, Proto: %s, Metric: %u", label,
-	      nl_msg_type_to_str (ri->nlmsg_type),
+  zfpm_debug ("%s : %s %s/%d, Proto: %s, Metric: %u, Nexthop group: %u",
+	      label, nl_msg_type_to_str (ri->nlmsg_type),
 	      prefix_addr_to_a (ri->prefix), ri->prefix->prefixlen,
 	      nl_rtproto_to_str (ri->rtm_protocol),
-	      ri->metric ? *ri->metric : 0);
+	      ri->metric ? *ri->metric : 0, ri->nh_id);
 
   for (i = 0; i < ri->num_nhs; i++)
     {
@@ -473,23 +497,147 @@ zfpm_log_route_info (netlink_route_info_t *ri, const char *label)
  * zfpm_netlink_encode_route
  *
  * Create a netlink message corresponding to the given route in the
- * given buffer space.
+ * given buffer space. If nh_id is not 0, the route refers to that
+ * nexthop group instead of carrying its nexthops.
  *
  * Returns the number of bytes written to the buffer. 0 or a negative
  * value indicates an error.
  */
 int
 zfpm_netlink_encode_route (int cmd, rib_dest_t *dest, struct rib *rib,
-			   char *in_buf, size_t in_buf_len)
+			   uint32_t nh_id, char *in_buf, size_t in_buf_len)
 {
   netlink_route_info_t ri_space, *ri;
 
   ri = &ri_space;
 
-  if (!netlink_route_info_fill (ri, cmd, dest, rib))
+  if (!netlink_route_info_fill (ri, cmd, dest, rib, nh_id))
     return 0;
 
   zfpm_log_route_info (ri, __FUNCTION__);
 
   return netlink_route_info_encode (ri, in_buf, in_buf_len);
 }
+
+#ifdef HAVE_LINUX_NEXTHOP_H
+
+/*
+ * netlink_nhg_msg_encode
+ *
+ * Start an RTM_NEWNEXTHOP message for the object with the given id at
+ * buf, if there is room.
+ */
+static struct nlmsghdr *
+netlink_nhg_msg_encode (char *buf, size_t buf_len, uint32_t id, u_char af)
+{
+  struct nlmsghdr *n;
+  struct nhmsg *nhm;
+
+  if (buf_len < NLMSG_SPACE (sizeof (struct nhmsg)))
+    return NULL;
+
+  n = (struct nlmsghdr *) buf;
+  memset (n, 0, NLMSG_SPACE (sizeof (struct nhmsg)));
+  n->nlmsg_len = NLMSG_LENGTH (sizeof (struct nhmsg));
+  n->nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE | NLM_F_REQUEST;
+  n->nlmsg_type = RTM_NEWNEXTHOP;
+
+  nhm = NLMSG_DATA (n);
+  nhm->nh_family = af;
+  nhm->nh_protocol = RTPROT_ZEBRA;
+
+  if (addattr32 (n, buf_len, NHA_ID, id) < 0)
+    return NULL;
+  return n;
+}
+
+/*
+ * zfpm_netlink_encode_nhg
+ *
+ * Create the netlink messages defining the given nexthop group, as it
+ * would be in the kernel: one object for each nexthop, with the IDs
+ * after the group's, then the group.
+ *
+ * Returns the number of bytes written to the buffer, 0 if the group
+ * cannot be sent this way or does not fit.
+ */
+int
+zfpm_netlink_encode_nhg (struct nhg_entry *nhe, char *in_buf,
+			 size_t in_buf_len)
+{
+  struct nexthop_grp grp[MULTIPATH_NUM];
+  struct nexthop *nexthop;
+  struct nlmsghdr *n;
+  size_t len = 0;
+  u_char af;
+  int i, gateway;
+
+  af = afi2family (nhe->afi);
+  memset (grp, 0, sizeof (grp));
+
+  for (i = 0, nexthop = nhe->fib; nexthop; nexthop = nexthop->next, i++)
+    {
+      if (i >= MULTIPATH_NUM)
+	return 0;
+
+      switch (nexthop->type)
+	{
+	case NEXTHOP_TYPE_IPV4:
+	case NEXTHOP_TYPE_IPV4_IFINDEX:
+	case NEXTHOP_TYPE_IPV4_IFNAME:
+	case NEXTHOP_TYPE_IPV6:
+	case NEXTHOP_TYPE_IPV6_IFINDEX:
+	case NEXTHOP_TYPE_IPV6_IFNAME:
+	  gateway = 1;
+	  break;
+	default:
+	  gateway = 0;
+	  break;
+	}
+      if (!gateway && !nexthop->ifindex)
+	return 0;
+
+      grp[i].id = nhe->id + 1 + i;
+      n = netlink_nhg_msg_encode (in_buf + len, in_buf_len - len, grp[i].id,
+				  af);
+      if (!n)
+	return 0;
+
+      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ONLINK))
+	((struct nhmsg *) NLMSG_DATA (n))->nh_flags |= RTNH_F_ONLINK;
+      if (nexthop->ifindex
+	  && addattr32 (n, in_buf_len - len, NHA_OIF, nexthop->ifindex) < 0)
+	return 0;
+      if (gateway
+	  && addattr_l (n, in_buf_len - len, NHA_GATEWAY, &nexthop->gate,
+			af_addr_size (af)) < 0)
+	return 0;
+
+      len += NLMSG_ALIGN (n->nlmsg_len);
+    }
+
+  if (!i)
+    return 0;
+
+  n = netlink_nhg_msg_encode (in_buf + len, in_buf_len - len, nhe->id,
+			      AF_UNSPEC);
+  if (!n || addattr_l (n, in_buf_len - len, NHA_GROUP, grp,
+		       i * sizeof (struct nexthop_grp)) < 0)
+    return 0;
+  len += NLMSG_ALIGN (n->nlmsg_len);
+
+  zfpm_debug ("%s: nexthop group %u, %d nexthops, version %u", __func__,
+	      nhe->id, i, nhe->version);
+  return len;
+}
+
+#else
+
+int
+zfpm_netlink_encode_nhg (struct nhg_entry *nhe, char *in_buf,
+			 size_t in_buf_len)
+{
+  return 0;
+}
+
+#endif /* HAVE_LINUX_NEXTHOP_H */
@@ -49,9 +49,15 @@ static inline void zfpm_debug(const char *format, ...) { return; }
 /*
  * Externs
  */
+struct nhg_entry;
+
 extern int
 zfpm_netlink_encode_route (int cmd, rib_dest_t *dest, struct rib *rib,
-			   char *in_buf, size_t in_buf_len);
+			   uint32_t nh_id, char *in_buf, size_t in_buf_len);
+
+extern int
+zfpm_netlink_encode_nhg (struct nhg_entry *nhe, char *in_buf,
+			 size_t in_buf_len);
 
 extern int
 zfpm_protobuf_encode_route (rib_dest_t *dest, struct rib *rib,
@@ -258,6 +258,11 @@ create_route_message (qpb_allocator_t *allocator, rib_dest_t *dest,
 
   fpm__message__init(msg);
 
+  if (dest->fpm_gen) {
+    msg->has_generation = 1;
+    msg->generation = dest->fpm_gen;
+  }
+
   if (!rib) {
     msg->type = FPM__MESSAGE__TYPE__DELETE_ROUTE;
     msg->delete_route = create_delete_route_message(allocator, dest, rib);
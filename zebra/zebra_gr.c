@@ -0,0 +1,256 @@
+/*
+ * Zebra graceful restart
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "log.h"
+#include "thread.h"
+#include "vty.h"
+#include "command.h"
+
+#include "zebra/rib.h"
+#include "zebra/zserv.h"
+#include "zebra/zebra_gr.h"
+
+/* Routes are marked stale rather than removed, and kept in the kernel,
+ * when zebra itself restarts (the routes it finds it had installed,
+ * which are read in as kernel routes) or when a client goes away (the
+ * routes of its type).  A route announced again at the same prefix
+ * takes over from the stale one, and the kernel is only told about it
+ * if its nexthops differ.  Whatever is still stale when the time
+ * configured for the protocol runs out is swept.  Zebra's own restart
+ * is kept under ZEBRA_ROUTE_KERNEL.
+ */
+
+extern struct zebra_t zebrad;
+
+struct zebra_gr_stats gr_stats;
+
+/* Seconds to keep stale routes for, per protocol; 0 to not keep them. */
+static u_int16_t gr_stale_time[ZEBRA_ROUTE_MAX];
+
+static struct thread *gr_t_sweep[ZEBRA_ROUTE_MAX];
+
+/* The timer is given its own slot in gr_t_sweep, which tells the
+   protocol. */
+static int
+zebra_gr_sweep (struct thread *thread)
+{
+  struct thread **t = THREAD_ARG (thread);
+  int proto = t - gr_t_sweep;
+  unsigned long count;
+
+  *t = NULL;
+  count = rib_sweep_stale (proto);
+  gr_stats.swept += count;
+  zlog_notice ("Graceful restart of %s ended, %lu stale routes removed",
+               proto == ZEBRA_ROUTE_KERNEL ? "zebra"
+                                           : zebra_route_string (proto),
+               count);
+  return 0;
+}
+
+static int
+zebra_gr_start (int proto)
+{
+  unsigned long count;
+
+  if (! gr_stale_time[proto])
+    return 0;
+
+  count = rib_mark_stale (proto);
+  gr_stats.marked += count;
+  THREAD_OFF (gr_t_sweep[proto]);
+  gr_t_sweep[proto] = thread_add_timer (zebrad.master, zebra_gr_sweep,
+                                        &gr_t_sweep[proto],
+                                        gr_stale_time[proto]);
+  zlog_notice ("Graceful restart of %s: %lu routes kept as stale for %u "
+               "seconds", proto == ZEBRA_ROUTE_KERNEL ? "zebra"
+                                                     : zebra_route_string (proto),
+               count, gr_stale_time[proto]);
+  return 1;
+}
+
+int
+zebra_gr_restart (void)
+{
+  return zebra_gr_start (ZEBRA_ROUTE_KERNEL);
+}
+
+int
+zebra_gr_client_close (int proto)
+{
+  if (proto <= ZEBRA_ROUTE_STATIC || proto >= ZEBRA_ROUTE_MAX)
+    return 0;
+  return zebra_gr_start (proto);
+}
+
+static int
+zebra_gr_set (struct vty *vty, const char *name, const char *time_str)
+{
+  int proto = ZEBRA_ROUTE_KERNEL;
+  u_int16_t stale_time = 0;
+
+  if (name)
+    {
+      proto = proto_name2num (name);
+      if (proto <= ZEBRA_ROUTE_STATIC)
+        {
+          vty_out (vty, "%% Invalid protocol name \"%s\"%s", name,
+                   VTY_NEWLINE);
+          return CMD_WARNING;
+        }
+    }
+  if (time_str)
+    VTY_GET_INTEGER_RANGE ("stale time", stale_time, time_str, 1, 3600);
+
+  gr_stale_time[proto] = stale_time;
+  return CMD_SUCCESS;
+}
+
+DEFUN (zebra_graceful_restart,
+       zebra_graceful_restart_cmd,
+       "zebra graceful-restart stale-time <1-3600>",
+       "Zebra information\n"
+       "Keep the routes zebra installed when it is restarted\n"
+       "Time to wait for the clients to announce them again\n"
+       "Seconds\n")
+{
+  return zebra_gr_set (vty, NULL, argv[0]);
+}
+
+DEFUN (no_zebra_graceful_restart,
+       no_zebra_graceful_restart_cmd,
+       "no zebra graceful-restart stale-time",
+       NO_STR
+       "Zebra information\n"
+       "Keep the routes zebra installed when it is restarted\n"
+       "Time to wait for the clients to announce them again\n")
+{
+  return zebra_gr_set (vty, NULL, NULL);
+}
+
+ALIAS (no_zebra_graceful_restart,
+       no_zebra_graceful_restart_val_cmd,
+       "no zebra graceful-restart stale-time <1-3600>",
+       NO_STR
+       "Zebra information\n"
+       "Keep the routes zebra installed when it is restarted\n"
+       "Time to wait for the clients to announce them again\n"
+       "Seconds\n")
+
+DEFUN (zebra_graceful_restart_protocol,
+       zebra_graceful_restart_protocol_cmd,
+       "zebra graceful-restart protocol PROTO stale-time <1-3600>",
+       "Zebra information\n"
+       "Keep the routes of a client which goes away\n"
+       "Routing protocol of the client\n"
+       "Protocol name\n"
+       "Time to wait for the client to announce them again\n"
+       "Seconds\n")
+{
+  return zebra_gr_set (vty, argv[0], argv[1]);
+}
+
+DEFUN (no_zebra_graceful_restart_protocol,
+       no_zebra_graceful_restart_protocol_cmd,
+       "no zebra graceful-restart protocol PROTO stale-time",
+       NO_STR
+       "Zebra information\n"
+       "Keep the routes of a client which goes away\n"
+       "Routing protocol of the client\n"
+       "Protocol name\n"
+       "Time to wait for the client to announce them again\n")
+{
+  return zebra_gr_set (vty, argv[0], NULL);
+}
+
+ALIAS (no_zebra_graceful_restart_protocol,
+       no_zebra_graceful_restart_protocol_val_cmd,
+       "no zebra graceful-restart protocol PROTO stale-time <1-3600>",
+       NO_STR
+       "Zebra information\n"
+       "Keep the routes of a client which goes away\n"
+       "Routing protocol of the client\n"
+       "Protocol name\n"
+       "Time to wait for the client to announce them again\n"
+       "Seconds\n")
+
+DEFUN (show_zebra_graceful_restart,
+       show_zebra_graceful_restart_cmd,
+       "show zebra graceful-restart",
+       SHOW_STR
+       "Zebra information\n"
+       "Stale routes kept over restarts\n")
+{
+  int i;
+
+  for (i = 0; i < ZEBRA_ROUTE_MAX; i++)
+    {
+      if (! gr_stale_time[i] && ! gr_t_sweep[i])
+        continue;
+      vty_out (vty, "%-10s stale time %u seconds",
+               i == ZEBRA_ROUTE_KERNEL ? "zebra" : zebra_route_string (i),
+               gr_stale_time[i]);
+      if (gr_t_sweep[i])
+        vty_out (vty, ", sweep in %lu seconds",
+                 thread_timer_remain_second (gr_t_sweep[i]));
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
+  vty_out (vty, "Stale routes: %lu marked, %lu kept as they were, "
+           "%lu programmed again, %lu swept%s", gr_stats.marked,
+           gr_stats.adopted, gr_stats.replaced, gr_stats.swept, VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
+int
+zebra_gr_config_write (struct vty *vty)
+{
+  int i;
+  int write = 0;
+
+  if (gr_stale_time[ZEBRA_ROUTE_KERNEL])
+    {
+      vty_out (vty, "zebra graceful-restart stale-time %u%s",
+               gr_stale_time[ZEBRA_ROUTE_KERNEL], VTY_NEWLINE);
+      write++;
+    }
+  for (i = ZEBRA_ROUTE_STATIC + 1; i < ZEBRA_ROUTE_MAX; i++)
+    if (gr_stale_time[i])
+      {
+        vty_out (vty, "zebra graceful-restart protocol %s stale-time %u%s",
+                 zebra_route_string (i), gr_stale_time[i], VTY_NEWLINE);
+        write++;
+      }
+  return write;
+}
+
+void
+zebra_gr_init (void)
+{
+  install_element (CONFIG_NODE, &zebra_graceful_restart_cmd);
+  install_element (CONFIG_NODE, &no_zebra_graceful_restart_cmd);
+  install_element (CONFIG_NODE, &no_zebra_graceful_restart_val_cmd);
+  install_element (CONFIG_NODE, &zebra_graceful_restart_protocol_cmd);
+  install_element (CONFIG_NODE, &no_zebra_graceful_restart_protocol_cmd);
+  install_element (CONFIG_NODE, &no_zebra_graceful_restart_protocol_val_cmd);
+  install_element (VIEW_NODE, &show_zebra_graceful_restart_cmd);
+}
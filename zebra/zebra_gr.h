@@ -0,0 +1,56 @@
+/*
+ * Zebra graceful restart header
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_GR_H
+#define _ZEBRA_GR_H
+
+#include "vty.h"
+
+struct zebra_gr_stats
+{
+  /* Routes marked stale, by a restart of zebra or of a client. */
+  unsigned long marked;
+
+  /* Stale routes announced again: left in the kernel as they were, or
+     programmed afresh because their nexthops differ. */
+  unsigned long adopted;
+  unsigned long replaced;
+
+  /* Stale routes nobody announced again in time. */
+  unsigned long swept;
+};
+
+extern struct zebra_gr_stats gr_stats;
+
+extern void zebra_gr_init (void);
+extern int zebra_gr_config_write (struct vty *);
+
+/* Zebra was started after reading the kernel's routes: if configured
+   to, keep the ones it installed before as stale until the clients had
+   time to announce them again.  Returns 1 if it does. */
+extern int zebra_gr_restart (void);
+
+/* The client which announced the routes of type proto has gone: if
+   configured to, keep them as stale for it to announce again when it
+   comes back.  Returns 1 if it does. */
+extern int zebra_gr_client_close (int proto);
+
+#endif /* _ZEBRA_GR_H */
@@ -0,0 +1,521 @@
+/*
+ * Zebra shared nexthop groups
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "hash.h"
+#include "jhash.h"
+#include "log.h"
+#include "vty.h"
+#include "command.h"
+#include "vrf.h"
+#include "nexthop.h"
+
+#include "zebra/rib.h"
+#include "zebra/rt.h"
+#include "zebra/zebra_nhg.h"
+
+extern char *proto_rm[AFI_MAX][ZEBRA_ROUTE_MAX+1];
+
+static struct hash *nhg_hash;
+
+/* Next ID to hand out, and the IDs of freed groups. */
+static u_int32_t nhg_id_next = 1;
+static u_int32_t *nhg_id_free;
+static unsigned int nhg_id_free_num;
+static unsigned int nhg_id_free_size;
+
+/* Last version given to a group's nexthops. */
+static u_int32_t nhg_version;
+
+/* The key of a nexthop as given: derived fields are left out. */
+static unsigned int
+zebra_nhg_nexthop_key (struct nexthop *nexthop, unsigned int key)
+{
+  key = jhash_2words (nexthop->type,
+                      CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ONLINK), key);
+  key = jhash (&nexthop->gate, sizeof (union g_addr), key);
+  key = jhash (&nexthop->src, sizeof (union g_addr), key);
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IFNAME:
+    case NEXTHOP_TYPE_IPV4_IFNAME:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      if (nexthop->ifname)
+        key = jhash_1word (string_hash_make (nexthop->ifname), key);
+      break;
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+      key = jhash_1word (nexthop->ifindex, key);
+      break;
+    default:
+      break;
+    }
+  return key;
+}
+
+/* Are two nexthops the same?  Either as given, when the interface
+   index may have been filled in by resolution, or as resolved. */
+static int
+zebra_nhg_nexthop_same (struct nexthop *a, struct nexthop *b, int resolved)
+{
+  if (a->type != b->type
+      || CHECK_FLAG (a->flags, NEXTHOP_FLAG_ONLINK)
+         != CHECK_FLAG (b->flags, NEXTHOP_FLAG_ONLINK)
+      || memcmp (&a->gate, &b->gate, sizeof (union g_addr))
+      || memcmp (&a->src, &b->src, sizeof (union g_addr)))
+    return 0;
+
+  if (resolved)
+    return a->ifindex == b->ifindex;
+
+  switch (a->type)
+    {
+    case NEXTHOP_TYPE_IFNAME:
+    case NEXTHOP_TYPE_IPV4_IFNAME:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      if (! a->ifname || ! b->ifname)
+        return a->ifname == b->ifname;
+      return ! strcmp (a->ifname, b->ifname);
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+      return a->ifindex == b->ifindex;
+    default:
+      return 1;
+    }
+}
+
+static int
+zebra_nhg_nexthops_same (struct nexthop *a, struct nexthop *b, int resolved)
+{
+  for (; a && b; a = a->next, b = b->next)
+    if (! zebra_nhg_nexthop_same (a, b, resolved))
+      return 0;
+  return a == b;
+}
+
+static unsigned int
+zebra_nhg_hash_key (void *arg)
+{
+  struct nhg_entry *nhe = arg;
+  struct nexthop *nexthop;
+  unsigned int key;
+
+  key = jhash_3words (nhe->vrf_id, nhe->afi, nhe->flags, 0);
+  for (nexthop = nhe->nexthop; nexthop; nexthop = nexthop->next)
+    key = zebra_nhg_nexthop_key (nexthop, key);
+  return key;
+}
+
+static int
+zebra_nhg_hash_cmp (const void *arg1, const void *arg2)
+{
+  const struct nhg_entry *nhe1 = arg1;
+  const struct nhg_entry *nhe2 = arg2;
+
+  return (nhe1->vrf_id == nhe2->vrf_id
+          && nhe1->afi == nhe2->afi
+          && nhe1->flags == nhe2->flags
+          && zebra_nhg_nexthops_same (nhe1->nexthop, nhe2->nexthop, 0));
+}
+
+static u_int32_t
+zebra_nhg_id_alloc (void)
+{
+  u_int32_t id;
+
+  if (nhg_id_free_num)
+    return nhg_id_free[--nhg_id_free_num];
+
+  id = nhg_id_next;
+  nhg_id_next += NHG_ID_STRIDE;
+  return id;
+}
+
+static void
+zebra_nhg_id_release (u_int32_t id)
+{
+  if (nhg_id_free_num == nhg_id_free_size)
+    {
+      nhg_id_free_size = nhg_id_free_size ? nhg_id_free_size * 2 : 64;
+      nhg_id_free = XREALLOC (MTYPE_NHG, nhg_id_free,
+                              nhg_id_free_size * sizeof (u_int32_t));
+    }
+  nhg_id_free[nhg_id_free_num++] = id;
+}
+
+void
+zebra_nhg_id_reserve (u_int32_t max)
+{
+  if (nhg_id_next <= max)
+    nhg_id_next = max + 1;
+}
+
+/* Copy the nexthops of a rib as given, without what resolution added. */
+static struct nexthop *
+zebra_nhg_copy_given (struct nexthop *nexthop)
+{
+  struct nexthop *head = NULL, *copy;
+
+  for (; nexthop; nexthop = nexthop->next)
+    {
+      copy = nexthop_new ();
+      copy->type = nexthop->type;
+      copy->flags = nexthop->flags & NEXTHOP_FLAG_ONLINK;
+      copy->ifindex = nexthop->ifindex;
+      if (nexthop->ifname)
+        copy->ifname = XSTRDUP (0, nexthop->ifname);
+      copy->gate = nexthop->gate;
+      copy->src = nexthop->src;
+      nexthop_add (&head, copy);
+    }
+  return head;
+}
+
+/* Flatten what the rib's nexthops resolved to, as the kernel layer
+   would program them. */
+static struct nexthop *
+zebra_nhg_copy_resolved (struct rib *rib, u_char *num)
+{
+  struct nexthop *head = NULL, *copy;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  *num = 0;
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    {
+      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+          || ! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+        continue;
+      if (*num >= MULTIPATH_NUM)
+        break;
+
+      copy = nexthop_new ();
+      copy->type = nexthop->type;
+      copy->flags = nexthop->flags & NEXTHOP_FLAG_ONLINK;
+      copy->ifindex = nexthop->ifindex;
+      copy->gate = nexthop->gate;
+      copy->src = nexthop->src;
+      nexthop_add (&head, copy);
+      (*num)++;
+    }
+  return head;
+}
+
+static void *
+zebra_nhg_alloc (void *arg)
+{
+  struct nhg_entry *key = arg;
+  struct nhg_entry *nhe;
+
+  nhe = XCALLOC (MTYPE_NHG, sizeof (struct nhg_entry));
+  nhe->id = zebra_nhg_id_alloc ();
+  nhe->vrf_id = key->vrf_id;
+  nhe->afi = key->afi;
+  nhe->flags = key->flags;
+  nhe->nexthop = zebra_nhg_copy_given (key->nexthop);
+  return nhe;
+}
+
+static void
+zebra_nhg_free (struct nhg_entry *nhe)
+{
+  /* The kernel may still have its members even when not installed. */
+  if (CHECK_FLAG (nhe->status, NHG_INSTALLED) || nhe->kernel_num)
+    kernel_nhg_uninstall (nhe);
+
+  hash_release (nhg_hash, nhe);
+  zebra_nhg_id_release (nhe->id);
+  nexthops_free (nhe->nexthop);
+  nexthops_free (nhe->fib);
+  XFREE (MTYPE_NHG, nhe);
+}
+
+/* Can the rib at rn share a group?  Not if its nexthops could resolve
+   differently from those of other routes with the same nexthops: when
+   a route-map looks at the prefix, or when a nexthop lies within the
+   route itself, which cannot resolve over itself. */
+static int
+zebra_nhg_shareable (struct route_node *rn, struct rib *rib)
+{
+  struct nexthop *nexthop;
+  struct prefix p;
+  afi_t afi = family2afi (rn->p.family);
+
+  if (RIB_SYSTEM_ROUTE (rib)
+      || CHECK_FLAG (rib->flags, ZEBRA_FLAG_BLACKHOLE)
+      || CHECK_FLAG (rib->flags, ZEBRA_FLAG_REJECT))
+    return 0;
+
+  if ((rib->type >= 0 && rib->type < ZEBRA_ROUTE_MAX
+       && proto_rm[AFI_IP][rib->type])
+      || proto_rm[AFI_IP][ZEBRA_ROUTE_MAX]
+#ifdef HAVE_IPV6
+      || (rib->type >= 0 && rib->type < ZEBRA_ROUTE_MAX
+          && proto_rm[AFI_IP6][rib->type])
+      || proto_rm[AFI_IP6][ZEBRA_ROUTE_MAX]
+#endif /* HAVE_IPV6 */
+      )
+    return 0;
+
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      switch (nexthop->type)
+        {
+        case NEXTHOP_TYPE_IPV4:
+        case NEXTHOP_TYPE_IPV4_IFINDEX:
+        case NEXTHOP_TYPE_IPV4_IFNAME:
+          if (afi != AFI_IP)
+            continue;
+          p.family = AF_INET;
+          p.prefixlen = IPV4_MAX_BITLEN;
+          p.u.prefix4 = nexthop->gate.ipv4;
+          break;
+#ifdef HAVE_IPV6
+        case NEXTHOP_TYPE_IPV6:
+        case NEXTHOP_TYPE_IPV6_IFINDEX:
+        case NEXTHOP_TYPE_IPV6_IFNAME:
+          if (afi != AFI_IP6)
+            continue;
+          p.family = AF_INET6;
+          p.prefixlen = IPV6_MAX_BITLEN;
+          p.u.prefix6 = nexthop->gate.ipv6;
+          break;
+#endif /* HAVE_IPV6 */
+        default:
+          continue;
+        }
+      if (prefix_match (&rn->p, &p))
+        return 0;
+    }
+
+  return 1;
+}
+
+void
+zebra_nhg_bind (struct route_node *rn, struct rib *rib)
+{
+  struct nhg_entry key;
+  struct nhg_entry *nhe = NULL;
+
+  if (zebra_nhg_shareable (rn, rib))
+    {
+      key.vrf_id = rib->vrf_id;
+      key.afi = family2afi (rn->p.family);
+      key.flags = rib->flags & ZEBRA_FLAG_INTERNAL;
+      key.nexthop = rib->nexthop;
+      nhe = hash_get (nhg_hash, &key, zebra_nhg_alloc);
+    }
+
+  if (rib->nhe != nhe)
+    {
+      if (nhe)
+        nhe->refcnt++;
+      zebra_nhg_unbind (rib);
+      rib->nhe = nhe;
+    }
+
+  if (nhe)
+    zebra_nhg_refresh (rib);
+}
+
+void
+zebra_nhg_unbind (struct rib *rib)
+{
+  struct nhg_entry *nhe = rib->nhe;
+
+  if (! nhe)
+    return;
+
+  rib->nhe = NULL;
+  rib->nhe_gen = 0;
+  if (--nhe->refcnt == 0)
+    zebra_nhg_free (nhe);
+}
+
+int
+zebra_nhg_refresh (struct rib *rib)
+{
+  struct nhg_entry *nhe = rib->nhe;
+  struct nexthop *fib;
+  u_char num;
+
+  if (! nhe)
+    return 0;
+
+  fib = zebra_nhg_copy_resolved (rib, &num);
+  if (zebra_nhg_nexthops_same (fib, nhe->fib, 1))
+    {
+      nexthops_free (fib);
+      return 0;
+    }
+
+  nexthops_free (nhe->fib);
+  nhe->fib = fib;
+  nhe->fib_num = num;
+  nhe->version = ++nhg_version;
+
+  /* One change in the kernel covers every route using the group. */
+  if (CHECK_FLAG (nhe->status, NHG_INSTALLED))
+    {
+      SET_FLAG (nhe->status, NHG_CHANGED);
+      kernel_nhg_install (nhe);
+    }
+  return 1;
+}
+
+static void
+zebra_nhg_if_down_one (struct hash_backet *backet, void *arg)
+{
+  struct nhg_entry *nhe = backet->data;
+  struct interface *ifp = arg;
+  struct nexthop *nexthop;
+
+  if (nhe->vrf_id != ifp->vrf_id
+      || ! CHECK_FLAG (nhe->status, NHG_INSTALLED))
+    return;
+
+  for (nexthop = nhe->fib; nexthop; nexthop = nexthop->next)
+    if (nexthop->ifindex == ifp->ifindex)
+      {
+        /* Put it back from scratch, and its routes with it. */
+        UNSET_FLAG (nhe->status, NHG_INSTALLED);
+        nhe->gen++;
+        return;
+      }
+}
+
+void
+zebra_nhg_if_down (struct interface *ifp)
+{
+  hash_iterate (nhg_hash, zebra_nhg_if_down_one, ifp);
+}
+
+static void
+zebra_nhg_find_id (struct hash_backet *backet, void *arg)
+{
+  struct nhg_entry *nhe = backet->data;
+  struct nhg_entry **found = arg;
+
+  if (nhe->id == (*found)->id)
+    *found = nhe;
+}
+
+struct nhg_entry *
+zebra_nhg_lookup_id (u_int32_t id)
+{
+  struct nhg_entry key;
+  struct nhg_entry *found = &key;
+
+  key.id = id;
+  hash_iterate (nhg_hash, zebra_nhg_find_id, &found);
+  return (found == &key) ? NULL : found;
+}
+
+struct nhg_iterate_arg
+{
+  void (*func) (struct nhg_entry *, void *);
+  void *arg;
+};
+
+static void
+zebra_nhg_iterate_one (struct hash_backet *backet, void *arg)
+{
+  struct nhg_iterate_arg *iter = arg;
+
+  iter->func (backet->data, iter->arg);
+}
+
+void
+zebra_nhg_iterate (void (*func) (struct nhg_entry *, void *), void *arg)
+{
+  struct nhg_iterate_arg iter = { func, arg };
+
+  hash_iterate (nhg_hash, zebra_nhg_iterate_one, &iter);
+}
+
+static void
+zebra_nhg_show_one (struct hash_backet *backet, void *arg)
+{
+  struct nhg_entry *nhe = backet->data;
+  struct vty *vty = arg;
+  struct nexthop *nexthop;
+  char buf[INET6_ADDRSTRLEN];
+
+  vty_out (vty, "ID %u: %s vrf %u, %lu routes%s%s%s", nhe->id,
+           afi2str (nhe->afi), nhe->vrf_id, nhe->refcnt,
+           CHECK_FLAG (nhe->status, NHG_INSTALLED) ? ", installed" : "",
+           CHECK_FLAG (nhe->flags, ZEBRA_FLAG_INTERNAL) ? ", internal" : "",
+           VTY_NEWLINE);
+
+  for (nexthop = nhe->fib; nexthop; nexthop = nexthop->next)
+    {
+      switch (nexthop->type)
+        {
+        case NEXTHOP_TYPE_IPV4:
+        case NEXTHOP_TYPE_IPV4_IFINDEX:
+        case NEXTHOP_TYPE_IPV4_IFNAME:
+          vty_out (vty, "  via %s",
+                   inet_ntop (AF_INET, &nexthop->gate.ipv4, buf, sizeof buf));
+          break;
+#ifdef HAVE_IPV6
+        case NEXTHOP_TYPE_IPV6:
+        case NEXTHOP_TYPE_IPV6_IFINDEX:
+        case NEXTHOP_TYPE_IPV6_IFNAME:
+          vty_out (vty, "  via %s",
+                   inet_ntop (AF_INET6, &nexthop->gate.ipv6, buf, sizeof buf));
+          break;
+#endif /* HAVE_IPV6 */
+        default:
+          vty_out (vty, "  directly connected");
+          break;
+        }
+      if (nexthop->ifindex)
+        vty_out (vty, ", %s",
+                 ifindex2ifname_vrf (nexthop->ifindex, nhe->vrf_id));
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
+}
+
+DEFUN (show_zebra_nexthop_groups,
+       show_zebra_nexthop_groups_cmd,
+       "show zebra nexthop-groups",
+       SHOW_STR
+       "Zebra information\n"
+       "Nexthop groups shared by routes in the FIB\n")
+{
+  vty_out (vty, "%lu nexthop groups%s", nhg_hash->count, VTY_NEWLINE);
+  hash_iterate (nhg_hash, zebra_nhg_show_one, vty);
+  return CMD_SUCCESS;
+}
+
+void
+zebra_nhg_init (void)
+{
+  nhg_hash = hash_create (zebra_nhg_hash_key, zebra_nhg_hash_cmp);
+  install_element (VIEW_NODE, &show_zebra_nexthop_groups_cmd);
+}
@@ -0,0 +1,103 @@
+/*
+ * Zebra shared nexthop groups header
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_NHG_H
+#define _ZEBRA_NHG_H
+
+#include "nexthop.h"
+#include "table.h"
+#include "if.h"
+
+/* The nexthops of the routes in the FIB which were given the same
+ * nexthops, in the same VRF and address family.  How those resolve does
+ * not depend on the route, except for routes zebra_nhg_bind leaves out,
+ * so the group can be changed in one go when the resolution changes,
+ * and the kernel layer can program it once for all of its routes.
+ */
+struct nhg_entry
+{
+  /* Kernel object ID.  The IDs up to id + MULTIPATH_NUM are reserved for
+     the members of the group. */
+  u_int32_t id;
+
+  /* Number of ribs using the group. */
+  unsigned long refcnt;
+
+  /* The key: the nexthops as given, and where and how they resolve. */
+  vrf_id_t vrf_id;
+  afi_t afi;
+  u_char flags;
+  struct nexthop *nexthop;
+
+  /* What they resolve to, flattened: the nexthops for the kernel. */
+  struct nexthop *fib;
+  u_char fib_num;
+
+  /* Kernel layer state. */
+  u_char status;
+#define NHG_INSTALLED		(1 << 0)
+#define NHG_CHANGED		(1 << 1)
+
+  /* Members the kernel has, when installed. */
+  u_char kernel_num;
+
+  /* Bumped each time the group is put into the kernel afresh; a rib
+     records the one its kernel route was given, in nhe_gen. */
+  u_int32_t gen;
+
+  /* Changes with fib, taken from a counter shared by all groups, so
+     that it names one set of nexthops. */
+  u_int32_t version;
+
+  /* The version last sent to the FPM, 0 if none. */
+  u_int32_t fpm_version;
+};
+
+/* IDs taken by each group. */
+#define NHG_ID_STRIDE		(1 + MULTIPATH_NUM)
+
+extern void zebra_nhg_init (void);
+
+/* Hand out IDs above max only, because the kernel has those already. */
+extern void zebra_nhg_id_reserve (u_int32_t max);
+
+/* Point rib, which is about to go into the FIB at rn, at its group and
+   bring the group's nexthops up to date.  Ribs which cannot share are
+   left without one. */
+extern void zebra_nhg_bind (struct route_node *rn, struct rib *rib);
+
+/* Drop the rib's reference to its group. */
+extern void zebra_nhg_unbind (struct rib *rib);
+
+/* Bring the group of a rib in the FIB up to date after its nexthops
+   were resolved again.  Returns 1 if that changed the group. */
+extern int zebra_nhg_refresh (struct rib *rib);
+
+/* The kernel drops nexthops over an interface which goes down, along
+   with any group left empty and the routes using it. */
+extern void zebra_nhg_if_down (struct interface *ifp);
+
+extern struct nhg_entry *zebra_nhg_lookup_id (u_int32_t id);
+
+extern void zebra_nhg_iterate (void (*func) (struct nhg_entry *, void *),
+                               void *arg);
+
+#endif /* _ZEBRA_NHG_H */
@@ -0,0 +1,340 @@
+/*
+ * Zebra recursive nexthop resolution cache
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+#include "hash.h"
+#include "jhash.h"
+#include "log.h"
+#include "vty.h"
+#include "command.h"
+#include "vrf.h"
+
+#include "zebra/rib.h"
+#include "zebra/zebra_resolve.h"
+
+/* Each gateway is looked up in the RIB once, rather than each time a
+ * route using it is processed.  The answer is kept in a table of the
+ * gateways, with the route nodes which asked for it.  Only a change to
+ * the selected route of a prefix covering the gateway can change the
+ * answer, so when rib_process changes one, the entries below it which
+ * resolved through the same or a less specific prefix are dropped and
+ * the route nodes which used them are queued again.  The others are
+ * left alone.  Entries go once no route uses their gateway.
+ */
+
+static struct
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long invalidations;
+  unsigned long requeues;
+} resolve_stats;
+
+static unsigned int
+zebra_resolve_dep_key (void *arg)
+{
+  uintptr_t p = (uintptr_t) arg;
+
+  return jhash (&p, sizeof (p), 0);
+}
+
+static int
+zebra_resolve_dep_cmp (const void *a, const void *b)
+{
+  return a == b;
+}
+
+/* The route at rn a gateway can resolve through, if any. */
+static struct rib *
+zebra_resolve_usable (struct route_node *rn)
+{
+  struct rib *rib;
+
+  RNODE_FOREACH_RIB (rn, rib)
+    {
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
+	continue;
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_SELECTED_FIB))
+	break;
+    }
+
+  if (! rib || rib->type == ZEBRA_ROUTE_BGP)
+    return NULL;
+  return rib;
+}
+
+/* Most specific node covering p with a usable route, locked. */
+static struct route_node *
+zebra_resolve_walk (struct route_table *table, struct prefix *p)
+{
+  struct route_node *rn;
+
+  rn = route_node_match (table, p);
+  while (rn)
+    {
+      route_unlock_node (rn);
+      if (zebra_resolve_usable (rn))
+	return route_lock_node (rn);
+
+      do {
+	rn = rn->parent;
+      } while (rn && rn->info == NULL);
+      if (rn)
+	route_lock_node (rn);
+    }
+  return NULL;
+}
+
+static void
+zebra_resolve_dep_requeue (struct hash_backet *backet, void *arg)
+{
+  struct route_node *rn = backet->data;
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+
+  listnode_delete (dest->resolve, arg);
+  rib_queue_node (rn);
+  resolve_stats.requeues++;
+}
+
+static void
+zebra_resolve_entry_free (struct resolve_entry *re)
+{
+  hash_free (re->deps);
+  if (re->match)
+    route_unlock_node (re->match);
+  re->node->info = NULL;
+  route_unlock_node (re->node);
+  XFREE (MTYPE_RESOLVE, re);
+}
+
+struct rib *
+zebra_resolve (struct route_node *top, afi_t afi, vrf_id_t vrf_id,
+               union g_addr *gate)
+{
+  struct zebra_vrf *zvrf;
+  struct route_table *table;
+  struct route_node *crn;
+  struct resolve_entry *re;
+  rib_dest_t *dest;
+  struct prefix p;
+
+  zvrf = vrf_info_lookup (vrf_id);
+  table = zebra_vrf_table (afi, SAFI_UNICAST, vrf_id);
+  if (! zvrf || ! table)
+    return NULL;
+
+  memset (&p, 0, sizeof (struct prefix));
+  if (afi == AFI_IP)
+    {
+      p.family = AF_INET;
+      p.prefixlen = IPV4_MAX_PREFIXLEN;
+      p.u.prefix4 = gate->ipv4;
+    }
+#ifdef HAVE_IPV6
+  else if (afi == AFI_IP6)
+    {
+      p.family = AF_INET6;
+      p.prefixlen = IPV6_MAX_PREFIXLEN;
+      p.u.prefix6 = gate->ipv6;
+    }
+#endif /* HAVE_IPV6 */
+  else
+    return NULL;
+
+  crn = route_node_get (zvrf->resolve_table[afi], &p);
+  re = crn->info;
+  if (re)
+    {
+      route_unlock_node (crn);
+
+      /* The route at the match may have gone without rib_process having
+         told us yet. */
+      if (re->match && ! zebra_resolve_usable (re->match))
+	{
+	  route_unlock_node (re->match);
+	  re->match = zebra_resolve_walk (table, &p);
+	  resolve_stats.misses++;
+	}
+      else
+	resolve_stats.hits++;
+    }
+  else
+    {
+      re = XCALLOC (MTYPE_RESOLVE, sizeof (struct resolve_entry));
+      re->node = crn;
+      re->match = zebra_resolve_walk (table, &p);
+      re->deps = hash_create_size (8, zebra_resolve_dep_key,
+				   zebra_resolve_dep_cmp);
+      crn->info = re;
+      resolve_stats.misses++;
+    }
+
+  /* It may be in the deps already from before zebra_resolve_begin. */
+  dest = rib_dest_from_rnode (top);
+  if (dest && ! (dest->resolve && listnode_lookup (dest->resolve, re)))
+    {
+      hash_get (re->deps, top, hash_alloc_intern);
+      if (! dest->resolve)
+	dest->resolve = list_new ();
+      listnode_add (dest->resolve, re);
+    }
+
+  /* A route does not resolve through itself, nor through anything less
+     specific than itself. */
+  if (top->table == table && prefix_match (&top->p, &p)
+      && (! re->match || top->p.prefixlen >= re->match->p.prefixlen))
+    return NULL;
+
+  if (! re->match)
+    return NULL;
+  return zebra_resolve_usable (re->match);
+}
+
+struct list *
+zebra_resolve_begin (struct route_node *rn)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+  struct list *old;
+
+  if (! dest)
+    return NULL;
+  old = dest->resolve;
+  dest->resolve = NULL;
+  return old;
+}
+
+void
+zebra_resolve_end (struct route_node *rn, struct list *old)
+{
+  rib_dest_t *dest = rib_dest_from_rnode (rn);
+  struct listnode *node;
+  struct resolve_entry *re;
+
+  if (! old)
+    return;
+
+  for (ALL_LIST_ELEMENTS_RO (old, node, re))
+    {
+      if (dest && dest->resolve && listnode_lookup (dest->resolve, re))
+	continue;
+
+      /* Nothing else uses the gateway, so don't keep it up to date. */
+      hash_release (re->deps, rn);
+      if (re->deps->count == 0)
+	zebra_resolve_entry_free (re);
+    }
+  list_delete (old);
+}
+
+void
+zebra_resolve_changed (struct route_node *rn)
+{
+  rib_table_info_t *info = rn->table->info;
+  struct zebra_vrf *zvrf = info->zvrf;
+  struct route_table *ctable;
+  struct route_node *crn, *top, *next;
+  struct resolve_entry *re;
+  afi_t afi;
+
+  if (info->safi != SAFI_UNICAST)
+    return;
+
+  afi = family2afi (rn->p.family);
+  if (afi != AFI_IP && afi != AFI_IP6)
+    return;
+
+  ctable = zvrf->resolve_table[afi];
+  if (! ctable->top)
+    return;
+
+  /* Everything below rn in the cache, if anything. */
+  top = route_node_get (ctable, &rn->p);
+  for (crn = route_lock_node (top); crn; crn = next)
+    {
+      re = crn->info;
+      if (re && (! re->match || re->match->p.prefixlen <= rn->p.prefixlen))
+	{
+	  /* Keep the iteration's lock on crn while the entry lets go. */
+	  route_lock_node (crn);
+	  hash_iterate (re->deps, zebra_resolve_dep_requeue, re);
+	  zebra_resolve_entry_free (re);
+	  resolve_stats.invalidations++;
+	  next = route_next_until (crn, top);
+	  route_unlock_node (crn);
+	}
+      else
+	next = route_next_until (crn, top);
+    }
+  route_unlock_node (top);
+}
+
+DEFUN (show_zebra_resolution_cache,
+       show_zebra_resolution_cache_cmd,
+       "show zebra resolution-cache",
+       SHOW_STR
+       "Zebra information\n"
+       "Recursive nexthop resolution cache\n")
+{
+  struct zebra_vrf *zvrf;
+  struct route_node *rn;
+  vrf_iter_t iter;
+  unsigned long entries[AFI_MAX], deps;
+  afi_t afi;
+
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    {
+      zvrf = vrf_iter2info (iter);
+      if (! zvrf)
+	continue;
+
+      deps = 0;
+      for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+	{
+	  entries[afi] = 0;
+	  for (rn = route_top (zvrf->resolve_table[afi]); rn;
+	       rn = route_next (rn))
+	    if (rn->info)
+	      {
+		entries[afi]++;
+		deps += ((struct resolve_entry *) rn->info)->deps->count;
+	      }
+	}
+      vty_out (vty, "VRF %u: %lu IPv4 and %lu IPv6 gateways, "
+	       "%lu dependent routes%s", zvrf->vrf_id,
+	       entries[AFI_IP], entries[AFI_IP6], deps, VTY_NEWLINE);
+    }
+
+  vty_out (vty, "Lookups: %lu hits, %lu misses%s",
+	   resolve_stats.hits, resolve_stats.misses, VTY_NEWLINE);
+  vty_out (vty, "Invalidations: %lu, routes queued again: %lu%s",
+	   resolve_stats.invalidations, resolve_stats.requeues, VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
+
+void
+zebra_resolve_init (void)
+{
+  install_element (VIEW_NODE, &show_zebra_resolution_cache_cmd);
+}
@@ -0,0 +1,64 @@
+/*
+ * Zebra recursive nexthop resolution cache header
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _ZEBRA_RESOLVE_H
+#define _ZEBRA_RESOLVE_H
+
+#include "prefix.h"
+#include "table.h"
+#include "hash.h"
+#include "linklist.h"
+
+/* Where a gateway resolves, hung off the gateway's host route in the
+ * VRF's resolve_table.
+ */
+struct resolve_entry
+{
+  struct route_node *node;
+
+  /* The route node in the unicast RIB it resolves through, or NULL. */
+  struct route_node *match;
+
+  /* The route nodes whose routes use the gateway, to be processed again
+     when this changes.  Each lists the entry in its rib_dest's resolve
+     list in turn. */
+  struct hash *deps;
+};
+
+extern void zebra_resolve_init (void);
+
+/* Look up the route a gateway of a rib at top resolves through: the
+   selected route covering it most specifically, except BGP routes.
+   NULL if there is none or if it is the route at top itself. */
+extern struct rib *zebra_resolve (struct route_node *top, afi_t afi,
+                                  vrf_id_t vrf_id, union g_addr *gate);
+
+/* rib_process brackets its lookups for the routes at rn with these, so
+   that rn stops depending on the gateways its routes no longer use. */
+extern struct list *zebra_resolve_begin (struct route_node *rn);
+extern void zebra_resolve_end (struct route_node *rn, struct list *old);
+
+/* The route selected for the FIB at rn, or its nexthops, changed: forget
+   the resolutions that may have depended on it, and queue the route
+   nodes which used them. */
+extern void zebra_resolve_changed (struct route_node *rn);
+
+#endif /* _ZEBRA_RESOLVE_H */
@@ -44,6 +44,10 @@
 #include "zebra/debug.h"
 #include "zebra/zebra_fpm.h"
 #include "zebra/zebra_rnh.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_nhg.h"
+#include "zebra/zebra_resolve.h"
+#include "zebra/zebra_gr.h"
 
 /* Default rtm_table for all clients */
 extern struct zebra_t zebrad;
@@ -54,6 +58,12 @@ extern struct zebra_t zebrad;
  */
 int rib_process_hold_time = 10;
 
+/* Route changes handed to the kernel, see rib_fib_result. */
+struct fib_stats fib_stats;
+
+/* Sequence number of the rib last linked into a table. */
+static u_int32_t rib_seq;
+
 /* Each route type's string and default distance value. */
 static const struct
 {  
@@ -280,9 +290,6 @@ static int
 nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
 		     struct route_node *top)
 {
-  struct prefix_ipv4 p;
-  struct route_table *table;
-  struct route_node *rn;
   struct rib *match;
   int resolved;
   struct nexthop *newhop;
@@ -299,114 +306,73 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
       rib->nexthop_mtu = 0;
     }
 
-  /* Make lookup prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv4));
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_PREFIXLEN;
-  p.prefix = nexthop->gate.ipv4;
+  match = zebra_resolve (top, AFI_IP, rib->vrf_id, &nexthop->gate);
+  if (! match)
+    return 0;
 
-  /* Lookup table.  */
-  table = zebra_vrf_table (AFI_IP, SAFI_UNICAST, rib->vrf_id);
-  if (! table)
+  /* If the longest prefix match for the nexthop yields
+   * a blackhole, mark it as inactive. */
+  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
+      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
+  if (match->type == ZEBRA_ROUTE_CONNECT)
     {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immediately. */
-      if (rn == top)
-	return 0;
-
-      /* Pick up selected route. */
-      RNODE_FOREACH_RIB (rn, match)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_SELECTED_FIB))
-	    break;
-	}
+      /* Directly point connected route. */
+      newhop = match->nexthop;
+      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
+	nexthop->ifindex = newhop->ifindex;
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match 
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  /* If the longest prefix match for the nexthop yields
-	   * a blackhole, mark it as inactive. */
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
-	      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
-	    return 0;
+      return 1;
+    }
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
+    {
+      resolved = 0;
+      for (newhop = match->nexthop; newhop; newhop = newhop->next)
+	if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+	    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  {
+	    if (set)
+	      {
+		SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+
+		resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
+		SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
+		/* If the resolving route specifies a gateway, use it */
+		if (newhop->type == NEXTHOP_TYPE_IPV4
+		    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IPV4_IFNAME)
+		  {
+		    resolved_hop->type = newhop->type;
+		    resolved_hop->gate.ipv4 = newhop->gate.ipv4;
+		    resolved_hop->ifindex = newhop->ifindex;
+		  }
 
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      resolved = 0;
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+		/* If the resolving route is an interface route, it
+		 * means the gateway we are looking up is connected
+		 * to that interface. Therefore, the resolved route
+		 * should have the original gateway as nexthop as it
+		 * is directly connected. */
+		if (newhop->type == NEXTHOP_TYPE_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IFNAME)
 		  {
-		    if (set)
-		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-
-			resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
-			SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
-			/* If the resolving route specifies a gateway, use it */
-			if (newhop->type == NEXTHOP_TYPE_IPV4
-			    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV4_IFNAME)
-			  {
-			    resolved_hop->type = newhop->type;
-			    resolved_hop->gate.ipv4 = newhop->gate.ipv4;
-			    resolved_hop->ifindex = newhop->ifindex;
-			  }
-
-			/* If the resolving route is an interface route, it
-			 * means the gateway we are looking up is connected
-			 * to that interface. Therefore, the resolved route
-			 * should have the original gateway as nexthop as it
-			 * is directly connected. */
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME)
-			  {
-			    resolved_hop->type = NEXTHOP_TYPE_IPV4_IFINDEX;
-			    resolved_hop->gate.ipv4 = nexthop->gate.ipv4;
-			    resolved_hop->ifindex = newhop->ifindex;
-			  }
-
-			nexthop_add(&nexthop->resolved, resolved_hop);
-		      }
-		    resolved = 1;
+		    resolved_hop->type = NEXTHOP_TYPE_IPV4_IFINDEX;
+		    resolved_hop->gate.ipv4 = nexthop->gate.ipv4;
+		    resolved_hop->ifindex = newhop->ifindex;
 		  }
-              if (resolved && set)
-                rib->nexthop_mtu = match->mtu;
-	      return resolved;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+
+		nexthop_add(&nexthop->resolved, resolved_hop);
+	      }
+	    resolved = 1;
+	  }
+      if (resolved && set)
+	rib->nexthop_mtu = match->mtu;
+      return resolved;
+    }
+  else
+    {
+      return 0;
     }
-  return 0;
 }
 
 /* If force flag is not set, do not modify falgs at all for uninstall
@@ -415,9 +381,6 @@ static int
 nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
 		     struct route_node *top)
 {
-  struct prefix_ipv6 p;
-  struct route_table *table;
-  struct route_node *rn;
   struct rib *match;
   int resolved;
   struct nexthop *newhop;
@@ -433,115 +396,74 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
       nexthop->resolved = NULL;
     }
 
-  /* Make lookup prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv6));
-  p.family = AF_INET6;
-  p.prefixlen = IPV6_MAX_PREFIXLEN;
-  p.prefix = nexthop->gate.ipv6;
+  match = zebra_resolve (top, AFI_IP6, rib->vrf_id, &nexthop->gate);
+  if (! match)
+    return 0;
 
-  /* Lookup table.  */
-  table = zebra_vrf_table (AFI_IP6, SAFI_UNICAST, rib->vrf_id);
-  if (! table)
+  /* If the longest prefix match for the nexthop yields
+   * a blackhole, mark it as inactive. */
+  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
+      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
+  if (match->type == ZEBRA_ROUTE_CONNECT)
     {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immediately. */
-      if (rn == top)
-	return 0;
+      /* Directly point connected route. */
+      newhop = match->nexthop;
 
-      /* Pick up selected route. */
-      RNODE_FOREACH_RIB (rn, match)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_SELECTED_FIB))
-	    break;
-	}
-
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  /* If the longest prefix match for the nexthop yields
-	   * a blackhole, mark it as inactive. */
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_BLACKHOLE)
-	      || CHECK_FLAG (match->flags, ZEBRA_FLAG_REJECT))
-	    return 0;
+      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
+	nexthop->ifindex = newhop->ifindex;
 
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
-
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      resolved = 0;
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+      return 1;
+    }
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
+    {
+      resolved = 0;
+      for (newhop = match->nexthop; newhop; newhop = newhop->next)
+	if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+	    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  {
+	    if (set)
+	      {
+		SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+
+		resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
+		SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
+		/* See nexthop_active_ipv4 for a description how the
+		 * resolved nexthop is constructed. */
+		if (newhop->type == NEXTHOP_TYPE_IPV6
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
 		  {
-		    if (set)
+		    resolved_hop->type = newhop->type;
+		    resolved_hop->gate.ipv6 = newhop->gate.ipv6;
+
+		    if (newhop->ifindex)
 		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-
-			resolved_hop = XCALLOC(MTYPE_NEXTHOP, sizeof (struct nexthop));
-			SET_FLAG (resolved_hop->flags, NEXTHOP_FLAG_ACTIVE);
-			/* See nexthop_active_ipv4 for a description how the
-			 * resolved nexthop is constructed. */
-			if (newhop->type == NEXTHOP_TYPE_IPV6
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
-			  {
-			    resolved_hop->type = newhop->type;
-			    resolved_hop->gate.ipv6 = newhop->gate.ipv6;
-
-			    if (newhop->ifindex)
-			      {
-				resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
-				resolved_hop->ifindex = newhop->ifindex;
-			      }
-			  }
-
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME)
-			  {
-				resolved_hop->flags |= NEXTHOP_FLAG_ONLINK;
-				resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
-				resolved_hop->gate.ipv6 = nexthop->gate.ipv6;
-				resolved_hop->ifindex = newhop->ifindex;
-			  }
-
-			nexthop_add(&nexthop->resolved, resolved_hop);
+			resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
+			resolved_hop->ifindex = newhop->ifindex;
 		      }
-		    resolved = 1;
 		  }
-	      return resolved;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+
+		if (newhop->type == NEXTHOP_TYPE_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IFNAME)
+		  {
+			resolved_hop->flags |= NEXTHOP_FLAG_ONLINK;
+			resolved_hop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
+			resolved_hop->gate.ipv6 = nexthop->gate.ipv6;
+			resolved_hop->ifindex = newhop->ifindex;
+		  }
+
+		nexthop_add(&nexthop->resolved, resolved_hop);
+	      }
+	    resolved = 1;
+	  }
+      return resolved;
+    }
+  else
+    {
+      return 0;
     }
-  return 0;
 }
 
 struct rib *
@@ -873,9 +795,6 @@ rib_match_ipv6 (struct in6_addr *addr, vrf_id_t vrf_id)
   return NULL;
 }
 
-#define RIB_SYSTEM_ROUTE(R) \
-        ((R)->type == ZEBRA_ROUTE_KERNEL || (R)->type == ZEBRA_ROUTE_CONNECT)
-
 /* This function verifies reachability of one given nexthop, which can be
  * numbered or unnumbered, IPv4 or IPv6. The result is unconditionally stored
  * in nexthop->flags field. If the 4th parameter, 'set', is non-zero,
@@ -1056,7 +975,18 @@ rib_update_kernel (struct route_node *rn, struct rib *old, struct rib *new)
    */
   zfpm_trigger_update (rn, "updating in kernel");
 
-  ret = kernel_route_rib (&rn->p, old, new);
+  if (new)
+    zebra_nhg_bind (rn, new);
+
+  if (zebra_dplane_running ())
+    zebra_dplane_route (rn, old, new);
+  else
+    ret = kernel_route_rib (&rn->p, old, new);
+
+  /* The old route is gone from the kernel, or no longer uses its
+     group, by the time the group may be removed. */
+  if (old && old != new)
+    zebra_nhg_unbind (old);
 
   /* This condition is never met, if we are using rt_socket.c */
   if (ret < 0 && new)
@@ -1073,6 +1003,87 @@ rib_update_kernel (struct route_node *rn, struct rib *old, struct rib *new)
   return ret;
 }
 
+/* Whether rib would put the same nexthops in the kernel as old has
+   there, in whatever order. */
+static int
+rib_fib_same (struct rib *old, struct rib *rib)
+{
+  struct nexthop *nexthop, *tnexthop;
+  struct nexthop *onexthop, *tonexthop;
+  int recursing, orecursing;
+  int num = 0, onum = 0;
+
+  for (ALL_NEXTHOPS_RO(old->nexthop, onexthop, tonexthop, orecursing))
+    if (CHECK_FLAG (onexthop->flags, NEXTHOP_FLAG_FIB)
+        && ! CHECK_FLAG (onexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+      onum++;
+
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    {
+      if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE)
+          || CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+        continue;
+
+      for (ALL_NEXTHOPS_RO(old->nexthop, onexthop, tonexthop, orecursing))
+        if (CHECK_FLAG (onexthop->flags, NEXTHOP_FLAG_FIB)
+            && ! CHECK_FLAG (onexthop->flags, NEXTHOP_FLAG_RECURSIVE)
+            && onexthop->ifindex == nexthop->ifindex
+            && ! memcmp (&onexthop->gate, &nexthop->gate,
+                         sizeof (union g_addr)))
+          break;
+      if (! onexthop)
+        return 0;
+      num++;
+    }
+
+  return num && num == onum;
+}
+
+/* A stale route in the FIB, old, is being replaced by rib.  If rib
+   would have the same kernel route, leave that alone and hand it over.
+   Returns 1 if it did. */
+static int
+rib_fib_adopt (struct route_node *rn, struct rib *old, struct rib *rib)
+{
+  rib_table_info_t *info = rn->table->info;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+
+  if (! CHECK_FLAG (old->status, RIB_ENTRY_STALE)
+      || info->safi != SAFI_UNICAST)
+    return 0;
+
+  if (old->nhe)
+    {
+      /* Its kernel route uses its group; rib has to get the same one,
+         as it is in the kernel now. */
+      zebra_nhg_bind (rn, rib);
+      if (rib->nhe != old->nhe || old->nhe_gen != old->nhe->gen)
+        {
+          gr_stats.replaced++;
+          return 0;
+        }
+      rib->nhe_gen = old->nhe_gen;
+      zebra_nhg_unbind (old);
+    }
+  else if (! rib_fib_same (old, rib))
+    {
+      gr_stats.replaced++;
+      return 0;
+    }
+
+  for (ALL_NEXTHOPS_RO(old->nexthop, nexthop, tnexthop, recursing))
+    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+  for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE)
+        && ! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+
+  zfpm_trigger_update (rn, "taking over stale route");
+  gr_stats.adopted++;
+  return 1;
+}
+
 /* Uninstall the route from kernel. */
 static void
 rib_uninstall (struct route_node *rn, struct rib *rib)
@@ -1111,7 +1122,8 @@ rib_can_delete_dest (rib_dest_t *dest)
    * prefix.
    */
   if (CHECK_FLAG (dest->flags, RIB_DEST_UPDATE_FPM) ||
-      CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM))
+      CHECK_FLAG (dest->flags, RIB_DEST_SENT_TO_FPM) ||
+      CHECK_FLAG (dest->flags, RIB_DEST_FPM_LOGGED))
     return 0;
 
   return 1;
@@ -1140,6 +1152,8 @@ rib_gc_dest (struct route_node *rn)
   if (IS_ZEBRA_DEBUG_RIB)
     rnode_debug (rn, "removing dest from table");
 
+  zebra_resolve_end (rn, zebra_resolve_begin (rn));
+
   dest->rnode = NULL;
   XFREE (MTYPE_RIB_DEST, dest);
   rn->info = NULL;
@@ -1203,15 +1217,20 @@ rib_process (struct route_node *rn)
   struct rib *new_selected = NULL;
   struct rib *old_fib = NULL;
   struct rib *new_fib = NULL;
+  struct rib *stale = NULL;
   int installed = 0;
   struct nexthop *nexthop = NULL, *tnexthop;
   int recursing;
   rib_table_info_t *info;
+  struct list *resolve;
 
   assert (rn);
 
   info = rn->table->info;
 
+  /* The gateways are looked up afresh below. */
+  resolve = zebra_resolve_begin (rn);
+
   RNODE_FOREACH_RIB (rn, rib)
     {
       UNSET_FLAG (rib->status, RIB_ENTRY_CHANGED);
@@ -1240,12 +1259,34 @@ rib_process (struct route_node *rn)
       if (rib->distance == DISTANCE_INFINITY)
         continue;
 
+      /* A route zebra left in the kernel before it was restarted only
+         stands in until another one is there. */
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_STALE)
+          && rib->type == ZEBRA_ROUTE_KERNEL)
+        {
+          stale = rib_choose_best(stale, rib);
+          continue;
+        }
+
       if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_FIB_OVERRIDE))
         new_fib = rib_choose_best(new_fib, rib);
       else
         new_selected = rib_choose_best(new_selected, rib);
     } /* RNODE_FOREACH_RIB_SAFE */
 
+  if (stale)
+    {
+      if (new_selected || new_fib)
+        {
+          /* Its kernel route is replaced, or taken over, below. */
+          SET_FLAG (stale->status, RIB_ENTRY_REMOVED);
+          if (! old_fib)
+            old_fib = stale;
+        }
+      else
+        new_selected = stale;
+    }
+
   /* If no FIB override route, use the selected route also for FIB */
   if (new_fib == NULL)
     new_fib = new_selected;
@@ -1265,6 +1306,7 @@ rib_process (struct route_node *rn)
     nexthop_active_update (rn, new_fib, 1);
   if (new_selected && new_selected != new_fib)
     nexthop_active_update (rn, new_selected, 1);
+  zebra_resolve_end (rn, resolve);
 
   /* Update kernel if FIB entry has changed */
   if (old_fib != new_fib
@@ -1281,12 +1323,18 @@ rib_process (struct route_node *rn)
           {
             /* Install new or replace existing FIB entry */
             SET_FLAG (new_fib->status, RIB_ENTRY_SELECTED_FIB);
-            if (! RIB_SYSTEM_ROUTE (new_fib))
+            if (! RIB_SYSTEM_ROUTE (new_fib)
+                && ! (old_fib && rib_fib_adopt (rn, old_fib, new_fib)))
               rib_update_kernel (rn, old_fib, new_fib);
           }
 
         if (info->safi == SAFI_UNICAST)
           zfpm_trigger_update (rn, "updating existing route");
+
+        /* Gateways and tracked nexthops covered by it may resolve
+           differently now. */
+        zebra_resolve_changed (rn);
+        zebra_rnh_changed (rn);
     }
   else if (old_fib == new_fib && new_fib && ! RIB_SYSTEM_ROUTE (new_fib))
     {
@@ -1302,6 +1350,23 @@ rib_process (struct route_node *rn)
           }
       if (! installed)
         rib_update_kernel (rn, NULL, new_fib);
+
+      /* Its nexthops may resolve differently now without the route
+         having changed.  The kernel only has to hear about it once for
+         every route sharing the group. */
+      else if (info->safi == SAFI_UNICAST && new_fib->nhe)
+        {
+          if (zebra_nhg_refresh (new_fib))
+            {
+              zfpm_trigger_update (rn, "nexthop group changed");
+              zebra_resolve_changed (rn);
+              zebra_rnh_changed (rn);
+            }
+
+          /* The kernel dropped the route along with the group. */
+          if (new_fib->nhe_gen && new_fib->nhe_gen != new_fib->nhe->gen)
+            rib_update_kernel (rn, new_fib, new_fib);
+        }
     }
 
   /* Redistribute SELECTED entry */
@@ -1383,10 +1448,22 @@ process_subq (struct list * subq, u_char qindex)
 static void
 meta_queue_process_complete (struct work_queue *dummy)
 {
-  zebra_evaluate_rnh_table(0, AF_INET);
+  struct zebra_vrf *zvrf;
+  vrf_iter_t iter;
+
+  /* The queue has run dry, send the kernel everything it produced. */
+  kernel_route_flush ();
+
+  /* Every VRF's tracked nexthops, including those of one disabled since
+     its routes were queued, whose clients are to learn they are gone. */
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL)
+      {
+	zebra_evaluate_rnh_changed (zvrf->vrf_id, AF_INET);
 #ifdef HAVE_IPV6
-  zebra_evaluate_rnh_table(0, AF_INET6);
+	zebra_evaluate_rnh_changed (zvrf->vrf_id, AF_INET6);
 #endif /* HAVE_IPV6 */
+      }
 }
 
 /* Dispatch the meta queue by picking, processing and unlocking the next RN from
@@ -1505,6 +1582,14 @@ rib_queue_add (struct zebra_t *zebra, struct route_node *rn)
   return;
 }
 
+/* Process the routes at rn again, if it still has any. */
+void
+rib_queue_node (struct route_node *rn)
+{
+  if (rnode_to_ribs (rn))
+    rib_queue_add (&zebrad, rn);
+}
+
 /* Create new meta queue.
    A destructor function doesn't seem to be necessary here.
  */
@@ -1616,6 +1701,8 @@ rib_link (struct route_node *rn, struct rib *rib)
       dest->rnode = rn;
     }
 
+  rib->seq = ++rib_seq;
+
   head = dest->routes;
   if (head)
     {
@@ -1675,6 +1762,7 @@ rib_unlink (struct route_node *rn, struct rib *rib)
     }
 
   /* free RIB and nexthops */
+  zebra_nhg_unbind (rib);
   nexthops_free(rib->nexthop);
   XFREE (MTYPE_RIB, rib);
 
@@ -3051,6 +3139,96 @@ rib_sweep_route (void)
         rib_weed_table (zvrf->table[AFI_IP][SAFI_UNICAST]);
         rib_weed_table (zvrf->table[AFI_IP6][SAFI_UNICAST]);
       }
+
+  /* The routes zebra installed before it was restarted are kept as
+     they are, if configured to, until the clients install them again. */
+  zebra_gr_restart ();
+}
+
+/* Mark the routes of the given type stale: of ZEBRA_ROUTE_KERNEL, only
+   those zebra installed itself before it was started. */
+static unsigned long
+rib_mark_stale_table (int type, struct route_table *table)
+{
+  struct route_node *rn;
+  struct rib *rib;
+  unsigned long n = 0;
+
+  if (table)
+    for (rn = route_top (table); rn; rn = route_next (rn))
+      RNODE_FOREACH_RIB (rn, rib)
+	{
+	  if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+	      || rib->type != type)
+	    continue;
+	  if (type == ZEBRA_ROUTE_KERNEL
+	      && ! CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELFROUTE))
+	    continue;
+
+	  SET_FLAG (rib->status, RIB_ENTRY_STALE);
+	  n++;
+	}
+  return n;
+}
+
+unsigned long
+rib_mark_stale (int type)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+  unsigned long cnt = 0;
+
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL)
+      cnt += rib_mark_stale_table (type, zvrf->table[AFI_IP][SAFI_UNICAST])
+            +rib_mark_stale_table (type, zvrf->table[AFI_IP6][SAFI_UNICAST]);
+
+  return cnt;
+}
+
+/* Remove the routes of the given type which are still stale. */
+static unsigned long
+rib_sweep_stale_table (int type, struct route_table *table)
+{
+  struct route_node *rn;
+  struct rib *rib;
+  struct rib *next;
+  unsigned long n = 0;
+
+  if (table)
+    for (rn = route_top (table); rn; rn = route_next (rn))
+      RNODE_FOREACH_RIB_SAFE (rn, rib, next)
+	{
+	  if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+	      || ! CHECK_FLAG (rib->status, RIB_ENTRY_STALE)
+	      || rib->type != type)
+	    continue;
+
+	  /* rib_process leaves kernel routes to the kernel. */
+	  if (RIB_SYSTEM_ROUTE (rib)
+	      && CHECK_FLAG (rib->status, RIB_ENTRY_SELECTED_FIB))
+	    rib_update_kernel (rn, rib, NULL);
+	  rib_delnode (rn, rib);
+	  n++;
+	}
+  return n;
+}
+
+unsigned long
+rib_sweep_stale (int type)
+{
+  vrf_iter_t iter;
+  struct zebra_vrf *zvrf;
+  unsigned long cnt = 0;
+
+  for (iter = vrf_first (); iter != VRF_ITER_INVALID; iter = vrf_next (iter))
+    if ((zvrf = vrf_iter2info (iter)) != NULL)
+      cnt += rib_sweep_stale_table (type, zvrf->table[AFI_IP][SAFI_UNICAST])
+            +rib_sweep_stale_table (type, zvrf->table[AFI_IP6][SAFI_UNICAST]);
+
+  if (cnt)
+    kernel_route_flush ();
+  return cnt;
 }
 
 /* Remove specific by protocol routes from 'table'. */
@@ -3130,6 +3308,96 @@ rib_close (void)
         rib_close_table (zvrf->table[AFI_IP][SAFI_UNICAST]);
         rib_close_table (zvrf->table[AFI_IP6][SAFI_UNICAST]);
       }
+
+  /* The removals may still be queued, make sure they are done before
+     we exit. */
+  zebra_dplane_wait ();
+  kernel_route_sync ();
+}
+
+/* Mark the nexthops which the kernel layer marked in its copy of them. */
+static void
+rib_fib_mark (struct nexthop *nexthop, struct nexthop *fib)
+{
+  for (; nexthop && fib; nexthop = nexthop->next, fib = fib->next)
+    {
+      if (CHECK_FLAG (fib->flags, NEXTHOP_FLAG_FIB))
+        SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      rib_fib_mark (nexthop->resolved, fib->resolved);
+    }
+}
+
+/* Account for the kernel's answer to a route change which was queued
+   earlier.  The route's nexthops were optimistically marked as in the
+   FIB.  When the install worked, the nexthops the kernel layer marked
+   in its own copy, fib, are marked as well; when it failed, they are
+   all unmarked.  Either way only if the rib is still there: the pointer
+   alone could be a later rib at the address of a freed one, so its
+   sequence number must match too. */
+void
+rib_fib_result (vrf_id_t vrf_id, struct prefix *p, struct rib *rib,
+                u_int32_t seq, struct nexthop *fib, int install, int error)
+{
+  time_t now = recent_relative_time ().tv_sec;
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *match;
+  struct nexthop *nexthop, *tnexthop;
+  int recursing;
+  char buf[PREFIX_STRLEN];
+
+  if (fib_stats.outstanding)
+    fib_stats.outstanding--;
+
+  if (! error)
+    {
+      fib_stats.completed++;
+      if (now != fib_stats.rate_time)
+        {
+          fib_stats.rate = (now == fib_stats.rate_time + 1)
+                           ? fib_stats.rate_count : 0;
+          fib_stats.rate_time = now;
+          fib_stats.rate_count = 0;
+        }
+      fib_stats.rate_count++;
+      if (fib_stats.rate_count > fib_stats.rate_max)
+        fib_stats.rate_max = fib_stats.rate_count;
+      if (! fib)
+        return;
+    }
+  else
+    {
+      fib_stats.failed++;
+      zlog_err ("%s: vrf %u: kernel failed to %s %s: %s", __func__, vrf_id,
+                install ? "install" : "remove",
+                prefix2str (p, buf, sizeof buf), safe_strerror (error));
+    }
+
+  if (! install || ! rib)
+    return;
+
+  table = zebra_vrf_table (family2afi (p->family), SAFI_UNICAST, vrf_id);
+  if (! table || ! (rn = route_node_lookup (table, p)))
+    return;
+
+  RNODE_FOREACH_RIB (rn, match)
+    if (match == rib && match->seq == seq)
+      {
+        if (! error)
+          rib_fib_mark (rib->nexthop, fib);
+        else
+          {
+            for (ALL_NEXTHOPS_RO(rib->nexthop, nexthop, tnexthop, recursing))
+              UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+
+            /* Routes resolving through it lose their nexthops too. */
+            zebra_resolve_changed (rn);
+            zebra_rnh_changed (rn);
+            zebra_evaluate_rnh_changed (vrf_id, p->family);
+          }
+        break;
+      }
+  route_unlock_node (rn);
 }
 
 /* Routing information base initialize. */
@@ -3137,6 +3405,9 @@ void
 rib_init (void)
 {
   rib_queue_init (&zebrad);
+  zebra_nhg_init ();
+  zebra_resolve_init ();
+  zebra_gr_init ();
 }
 
 /*
@@ -3297,6 +3568,11 @@ zebra_vrf_alloc (vrf_id_t vrf_id)
 
   zvrf->rnh_table[AFI_IP] = route_table_init();
   zvrf->rnh_table[AFI_IP6] = route_table_init();
+  zvrf->rnh_changed[AFI_IP] = route_table_init();
+  zvrf->rnh_changed[AFI_IP6] = route_table_init();
+
+  zvrf->resolve_table[AFI_IP] = route_table_init();
+  zvrf->resolve_table[AFI_IP6] = route_table_init();
 
   /* Set VRF ID */
   zvrf->vrf_id = vrf_id;
@@ -3310,6 +3586,10 @@ zebra_vrf_alloc (vrf_id_t vrf_id)
   snprintf (nl_name, 64, "netlink-cmd (vrf %u)", vrf_id);
   zvrf->netlink_cmd.sock = -1;
   zvrf->netlink_cmd.name = XSTRDUP (MTYPE_NETLINK_NAME, nl_name);
+
+  snprintf (nl_name, 64, "netlink-dplane (vrf %u)", vrf_id);
+  zvrf->netlink_dplane.sock = -1;
+  zvrf->netlink_dplane.name = XSTRDUP (MTYPE_NETLINK_NAME, nl_name);
 #endif
 
   return zvrf;
@@ -54,6 +54,8 @@
   t;                                             \
 })
 
+extern struct zebra_t zebrad;
+
 static void free_state(struct rib *rib);
 static void copy_state(struct rnh *rnh, struct rib *rib);
 static int compare_state(struct rib *r1, struct rib *r2);
@@ -182,17 +184,100 @@ zebra_remove_rnh_client (struct rnh *rnh, struct zserv *client)
     zebra_delete_rnh(rnh);
 }
 
+/* Look up the route rnh resolves through and queue the new state for its
+   clients if that changed. */
+static void
+zebra_rnh_evaluate (struct rnh *rnh, struct route_table *ptable,
+		    vrf_id_t vrfid)
+{
+  struct route_node *nrn = rnh->node;
+  struct route_node *prn;
+  struct zserv *client;
+  struct listnode *node;
+  struct rib *rib;
+
+  prn = route_node_match(ptable, &nrn->p);
+  if (!prn)
+    rib = NULL;
+  else
+    {
+      route_unlock_node (prn);
+      RNODE_FOREACH_RIB(prn, rib)
+	{
+	  if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
+	    continue;
+	  if (! CHECK_FLAG (rib->status, RIB_ENTRY_SELECTED_FIB))
+	    continue;
+
+	  if (CHECK_FLAG(rnh->flags, ZEBRA_NHT_CONNECTED))
+	    {
+	      if (rib->type == ZEBRA_ROUTE_CONNECT)
+		break;
+
+	      if (rib->type == ZEBRA_ROUTE_NHRP)
+		{
+		  struct nexthop *nexthop;
+		  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+		    if (nexthop->type == NEXTHOP_TYPE_IFINDEX ||
+			nexthop->type == NEXTHOP_TYPE_IFNAME)
+		      break;
+		  if (nexthop)
+		    break;
+		}
+	    }
+	  else
+	    break;
+	}
+    }
+
+  if (compare_state(rib, rnh->state))
+    {
+      if (IS_ZEBRA_DEBUG_NHT)
+	{
+	  char bufn[INET6_ADDRSTRLEN];
+	  char bufp[INET6_ADDRSTRLEN];
+	  prefix2str(&nrn->p, bufn, INET6_ADDRSTRLEN);
+	  if (prn)
+	    prefix2str(&prn->p, bufp, INET6_ADDRSTRLEN);
+	  else
+	    strcpy(bufp, "null");
+	  zlog_debug("rnh %s resolved through route %s - sending "
+		     "nexthop %s event to clients", bufn, bufp,
+		     rib ? "reachable" : "unreachable");
+	}
+      copy_state(rnh, rib);
+      for (ALL_LIST_ELEMENTS_RO(rnh->client_list, node, client))
+	send_client(rnh, client, vrfid);
+    }
+}
+
+void
+zebra_evaluate_rnh (struct rnh *rnh, vrf_id_t vrfid)
+{
+  struct route_table *ptable;
+
+  ptable = zebra_vrf_table(family2afi(PREFIX_FAMILY(&rnh->node->p)),
+			   SAFI_UNICAST, vrfid);
+  if (ptable)
+    zebra_rnh_evaluate (rnh, ptable, vrfid);
+}
+
+void
+zebra_flush_rnh_clients (void)
+{
+  struct listnode *node;
+  struct zserv *client;
+
+  for (ALL_LIST_ELEMENTS_RO(zebrad.client_list, node, client))
+    zebra_server_flush (client);
+}
+
 int
 zebra_evaluate_rnh_table (vrf_id_t vrfid, int family)
 {
   struct route_table *ptable;
   struct route_table *ntable;
-  struct route_node *prn;
   struct route_node *nrn;
-  struct rnh *rnh;
-  struct zserv *client;
-  struct listnode *node;
-  struct rib *rib;
 
   ntable = lookup_rnh_table(vrfid, family);
   if (!ntable)
@@ -209,64 +294,85 @@ zebra_evaluate_rnh_table (vrf_id_t vrfid, int family)
     }
 
   for (nrn = route_top (ntable); nrn; nrn = route_next (nrn))
-    {
-      if (!nrn->info)
-	  continue;
-      
-      rnh = nrn->info;
-      prn = route_node_match(ptable, &nrn->p);
-      if (!prn)
-	rib = NULL;
-      else
-	{
-	  RNODE_FOREACH_RIB(prn, rib)
-	    {
-	      if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
-		continue;
-	      if (! CHECK_FLAG (rib->status, RIB_ENTRY_SELECTED_FIB))
-		continue;
+    if (nrn->info)
+      zebra_rnh_evaluate (nrn->info, ptable, vrfid);
+  zebra_flush_rnh_clients ();
+  return 1;
+}
 
-	      if (CHECK_FLAG(rnh->flags, ZEBRA_NHT_CONNECTED))
-		{
-		  if (rib->type == ZEBRA_ROUTE_CONNECT)
-		    break;
+void
+zebra_rnh_changed (struct route_node *rn)
+{
+  rib_table_info_t *info = rn->table->info;
+  struct zebra_vrf *zvrf = info->zvrf;
+  struct route_node *crn;
+  afi_t afi;
 
-		  if (rib->type == ZEBRA_ROUTE_NHRP)
-		    {
-		      struct nexthop *nexthop;
-		      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-			if (nexthop->type == NEXTHOP_TYPE_IFINDEX ||
-			    nexthop->type == NEXTHOP_TYPE_IFNAME)
-			  break;
-		      if (nexthop)
-			break;
-		    }
-		}
-	      else
-		break;
-	    }
-	}
+  if (info->safi != SAFI_UNICAST)
+    return;
 
-      if (compare_state(rib, rnh->state))
-	{
-	  if (IS_ZEBRA_DEBUG_NHT)
-	    {
-	      char bufn[INET6_ADDRSTRLEN];
-	      char bufp[INET6_ADDRSTRLEN];
-	      prefix2str(&nrn->p, bufn, INET6_ADDRSTRLEN);
-	      if (prn)
-		prefix2str(&prn->p, bufp, INET6_ADDRSTRLEN);
-	      else
-		strcpy(bufp, "null");
-	      zlog_debug("rnh %s resolved through route %s - sending "
-			 "nexthop %s event to clients", bufn, bufp,
-			 rib ? "reachable" : "unreachable");
-	    }
-	  copy_state(rnh, rib);
-	  for (ALL_LIST_ELEMENTS_RO(rnh->client_list, node, client))
-	    send_client(rnh, client, vrfid);
-	}
+  afi = family2afi (rn->p.family);
+  if (afi != AFI_IP && afi != AFI_IP6)
+    return;
+
+  /* Nothing to evaluate, and what gets registered later is evaluated
+     then. */
+  if (! zvrf->rnh_table[afi]->top)
+    return;
+
+  crn = route_node_get (zvrf->rnh_changed[afi], &rn->p);
+  if (crn->info)
+    route_unlock_node (crn);
+  else
+    crn->info = (void *) 1;
+}
+
+int
+zebra_evaluate_rnh_changed (vrf_id_t vrfid, int family)
+{
+  struct zebra_vrf *zvrf;
+  struct route_table *ptable;
+  struct route_table *ntable;
+  struct route_table *ctable;
+  struct route_node *crn;
+  struct route_node *top;
+  struct route_node *nrn;
+  struct prefix last;
+  int covered = 0;
+
+  zvrf = zebra_vrf_lookup (vrfid);
+  ptable = zebra_vrf_table (family2afi (family), SAFI_UNICAST, vrfid);
+  if (!zvrf || !ptable)
+    return -1;
+
+  ntable = zvrf->rnh_table[family2afi (family)];
+  ctable = zvrf->rnh_changed[family2afi (family)];
+  if (!ctable->top)
+    return 0;
+
+  /* The longest match of a tracked prefix can only have changed if one
+     of the changed prefixes covers it.  Changes under one which was
+     handled already are skipped, as they come right after it. */
+  for (crn = route_top (ctable); crn; crn = route_next (crn))
+    {
+      if (!crn->info)
+	continue;
+      crn->info = NULL;
+      route_unlock_node (crn);
+
+      if (covered && prefix_match (&last, &crn->p))
+	continue;
+      prefix_copy (&last, &crn->p);
+      covered = 1;
+
+      top = route_node_get (ntable, &crn->p);
+      for (nrn = route_lock_node (top); nrn; nrn = route_next_until (nrn, top))
+	if (nrn->info)
+	  zebra_rnh_evaluate (nrn->info, ptable, vrfid);
+      route_unlock_node (top);
     }
+
+  zebra_flush_rnh_clients ();
   return 1;
 }
 
@@ -300,6 +406,7 @@ zebra_dispatch_rnh_table (vrf_id_t vrfid, int family, struct zserv *client)
 	}
       send_client(rnh, client, vrfid);
     }
+  zebra_server_flush (client);
   return 1;
 }
 
@@ -493,6 +600,9 @@ send_client (struct rnh *rnh, struct zserv *client, vrf_id_t vrf_id)
   rn = rnh->node;
   rib = rnh->state;
 
+  /* A held back route for the nexthop goes first. */
+  zserv_pending_flush (client, &rn->p);
+
   /* Get output stream. */
   s = client->obuf;
   stream_reset (s);
@@ -554,8 +664,7 @@ send_client (struct rnh *rnh, struct zserv *client, vrf_id_t vrf_id)
   stream_putw_at (s, 0, stream_get_endp (s));
 
   client->nh_last_upd_time = quagga_time(NULL);
-  client->last_write_cmd = ZEBRA_NEXTHOP_UPDATE;
-  return zebra_server_send_message(client);
+  return zebra_server_queue_message(client);
 }
 
 static void
@@ -42,6 +42,13 @@ extern void zebra_delete_rnh(struct rnh *rnh);
 extern void zebra_add_rnh_client(struct rnh *rnh, struct zserv *client, vrf_id_t vrf_id_t);
 extern void zebra_remove_rnh_client(struct rnh *rnh, struct zserv *client);
 extern int zebra_evaluate_rnh_table(vrf_id_t vrfid, int family);
+extern void zebra_evaluate_rnh(struct rnh *rnh, vrf_id_t vrfid);
+/* Record that the FIB route of the RIB node rn changed, for
+   zebra_evaluate_rnh_changed to look at the rnh entries it covers. */
+extern void zebra_rnh_changed(struct route_node *rn);
+extern int zebra_evaluate_rnh_changed(vrf_id_t vrfid, int family);
+/* Notifications to clients are queued until this is called. */
+extern void zebra_flush_rnh_clients(void);
 extern int zebra_dispatch_rnh_table(vrf_id_t vrfid, int family, struct zserv *cl);
 extern void zebra_print_rnh_table(vrf_id_t vrfid, int family, struct vty *vty);
 extern char *rnh_str(struct rnh *rnh, char *buf, int size);
@@ -6,5 +6,11 @@
 int zebra_evaluate_rnh_table (vrf_id_t vrfid, int family)
 { return 0; }
 
+void zebra_rnh_changed (struct route_node *rn)
+{}
+
+int zebra_evaluate_rnh_changed (vrf_id_t vrfid, int family)
+{ return 0; }
+
 void zebra_print_rnh_table (vrf_id_t vrfid, int family, struct vty *vty)
 {}
@@ -32,6 +32,8 @@
 
 #include "zebra/zserv.h"
 #include "zebra/zebra_rnh.h"
+#include "zebra/zebra_dplane.h"
+#include "zebra/zebra_gr.h"
 
 static int do_show_ip_route(struct vty *vty, safi_t safi, vrf_id_t vrf_id);
 static void vty_show_ip_route_detail (struct vty *vty, struct route_node *rn,
@@ -3344,6 +3346,33 @@ static_config_ipv4 (struct vty *vty, safi_t safi, const char *cmd)
   return write;
 }
 
+DEFUN (show_zebra_fib,
+       show_zebra_fib_cmd,
+       "show zebra fib",
+       SHOW_STR
+       "Zebra information\n"
+       "Route changes sent to the kernel\n")
+{
+  unsigned long rate = fib_stats.rate;
+  time_t now = recent_relative_time ().tv_sec;
+
+  /* The count for the current second is not complete yet. */
+  if (now == fib_stats.rate_time + 1)
+    rate = fib_stats.rate_count;
+  else if (now != fib_stats.rate_time)
+    rate = 0;
+
+  vty_out (vty, "Route changes: %lu sent in %lu writes, %lu completed, "
+           "%lu failed%s", fib_stats.requests, fib_stats.writes,
+           fib_stats.completed, fib_stats.failed, VTY_NEWLINE);
+  vty_out (vty, "Outstanding: %lu (max %lu)%s", fib_stats.outstanding,
+           fib_stats.outstanding_max, VTY_NEWLINE);
+  vty_out (vty, "Completion rate: %lu/s last second, %lu/s peak%s",
+           rate, fib_stats.rate_max, VTY_NEWLINE);
+  zebra_dplane_show (vty);
+  return CMD_SUCCESS;
+}
+
 DEFUN (show_ip_protocol,
        show_ip_protocol_cmd,
        "show ip protocol",
@@ -5265,6 +5294,8 @@ static int config_write_vty(struct vty *vty)
       vty_out (vty, "ip protocol %s route-map %s%s", "any",
                proto_rm[AFI_IP][ZEBRA_ROUTE_MAX], VTY_NEWLINE);
 
+  zebra_gr_config_write (vty);
+
   return 1;
 }   
 
@@ -5291,6 +5322,7 @@ zebra_vty_init (void)
   install_element (CONFIG_NODE, &ip_protocol_cmd);
   install_element (CONFIG_NODE, &no_ip_protocol_cmd);
   install_element (VIEW_NODE, &show_ip_protocol_cmd);
+  install_element (VIEW_NODE, &show_zebra_fib_cmd);
   install_element (CONFIG_NODE, &ip_route_cmd);
   install_element (CONFIG_NODE, &ip_route_tag_cmd);
   install_element (CONFIG_NODE, &ip_route_flags_cmd);
@@ -45,6 +45,7 @@
 #include "zebra/debug.h"
 #include "zebra/ipforward.h"
 #include "zebra/zebra_rnh.h"
+#include "zebra/zebra_gr.h"
 
 /* Event list of zebra. */
 enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
@@ -56,6 +57,8 @@ static void zebra_event (enum event event, int sock, struct zserv *client);
 extern struct zebra_privs_t zserv_privs;
 
 static void zebra_client_close (struct zserv *client);
+static int zebra_client_process_event (struct thread *thread);
+static void zserv_pending_drain (struct zserv *client);
 
 static int
 zserv_delayed_close(struct thread *thread)
@@ -99,6 +102,11 @@ zserv_flush_data(struct thread *thread)
       					 client, client->sock);
       break;
     case BUFFER_EMPTY:
+      /* Room again for the routes we held back, then for the rest of
+         any redistribution replay. */
+      zserv_pending_drain (client);
+      if (! client->t_write)
+        zebra_redistribute_resume (client);
       break;
     }
 
@@ -106,19 +114,13 @@ zserv_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zebra_server_send_message(struct zserv *client)
+static int
+zserv_writev (struct zserv *client, struct iovec *iov, int iovcnt)
 {
-  if (client->t_suicide)
-    return -1;
-
-  stream_set_getp(client->obuf, 0);
-  client->last_write_cmd = stream_getw_from(client->obuf, 4);
-  switch (buffer_write(client->wb, client->sock, STREAM_DATA(client->obuf),
-		       stream_get_endp(client->obuf)))
+  switch (buffer_writev(client->wb, client->sock, iov, iovcnt))
     {
     case BUFFER_ERROR:
-      zlog_warn("%s: buffer_write failed to zserv client fd %d, closing",
+      zlog_warn("%s: buffer_writev failed to zserv client fd %d, closing",
       		 __func__, client->sock);
       /* Schedule a delayed close since many of the functions that call this
          one do not check the return code.  They do not allow for the
@@ -140,6 +142,353 @@ zebra_server_send_message(struct zserv *client)
   return 0;
 }
 
+/* Send the pending ZEBRA_ROUTE_BULK message, if any. */
+static int
+zserv_bulk_flush (struct zserv *client)
+{
+  struct iovec iov;
+  int ret;
+
+  THREAD_OFF(client->t_bulk);
+  if (client->t_suicide)
+    return -1;
+  if (! stream_get_endp (client->bulk))
+    return 0;
+
+  iov.iov_base = STREAM_DATA(client->bulk);
+  iov.iov_len = stream_get_endp(client->bulk);
+  client->last_write_cmd = ZEBRA_ROUTE_BULK;
+  client->bulk_tx_cnt++;
+  ret = zserv_writev (client, &iov, 1);
+  stream_reset (client->bulk);
+  return ret;
+}
+
+static int
+zserv_bulk_flush_event (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG(thread);
+
+  client->t_bulk = NULL;
+  return zserv_bulk_flush (client);
+}
+
+int
+zebra_server_send_message(struct zserv *client)
+{
+  struct iovec iov[2];
+  int iovcnt = 0;
+  int ret;
+
+  if (client->t_suicide)
+    return -1;
+
+  /* Routes coalesced so far must reach the client ahead of this one. */
+  if (stream_get_endp (client->bulk))
+    {
+      THREAD_OFF(client->t_bulk);
+      iov[iovcnt].iov_base = STREAM_DATA(client->bulk);
+      iov[iovcnt++].iov_len = stream_get_endp(client->bulk);
+      client->bulk_tx_cnt++;
+    }
+  iov[iovcnt].iov_base = STREAM_DATA(client->obuf);
+  iov[iovcnt++].iov_len = stream_get_endp(client->obuf);
+
+  stream_set_getp(client->obuf, 0);
+  client->last_write_cmd = stream_getw_from(client->obuf, 6);
+  ret = zserv_writev (client, iov, iovcnt);
+  stream_reset (client->bulk);
+  return ret;
+}
+
+/* Queue the message in client->obuf behind whatever is waiting to be
+   written to the client, for zebra_server_flush to send in one go. */
+int
+zebra_server_queue_message (struct zserv *client)
+{
+  if (client->t_suicide)
+    return -1;
+
+  if (stream_get_endp (client->bulk))
+    {
+      THREAD_OFF(client->t_bulk);
+      buffer_put (client->wb, STREAM_DATA(client->bulk),
+                  stream_get_endp(client->bulk));
+      client->bulk_tx_cnt++;
+      stream_reset (client->bulk);
+    }
+  buffer_put (client->wb, STREAM_DATA(client->obuf),
+              stream_get_endp(client->obuf));
+  client->last_write_cmd = stream_getw_from(client->obuf, 6);
+  return 0;
+}
+
+/* Write out the messages zebra_server_queue_message queued. */
+int
+zebra_server_flush (struct zserv *client)
+{
+  /* Leave it to the write thread if the socket is already full. */
+  if (client->t_suicide || client->t_write)
+    return 0;
+
+  switch (buffer_flush_available(client->wb, client->sock))
+    {
+    case BUFFER_ERROR:
+      zlog_warn("%s: buffer_flush_available failed on zserv client fd %d, "
+      		"closing", __func__, client->sock);
+      client->t_suicide = thread_add_event(zebrad.master, zserv_delayed_close,
+					   client, 0);
+      return -1;
+    case BUFFER_PENDING:
+      client->t_write = thread_add_write(zebrad.master, zserv_flush_data,
+      					 client, client->sock);
+      break;
+    case BUFFER_EMPTY:
+      return 0;
+    }
+
+  client->last_write_time = quagga_time(NULL);
+  return 0;
+}
+
+/* Send the route message in client->obuf, whose prefix starts at
+   prefix_offset, coalescing it into a ZEBRA_ROUTE_BULK message if the
+   client accepts those. */
+static int
+zserv_send_route (struct zserv *client, size_t prefix_offset)
+{
+  if (client->t_suicide)
+    return -1;
+
+  if (! CHECK_FLAG (client->capabilities, ZEBRA_CAPA_ROUTE_BULK))
+    return zebra_server_send_message (client);
+
+  if (zapi_bulk_append (client->bulk, client->obuf, prefix_offset) < 0)
+    {
+      /* Attributes differ or the bulk message is full. */
+      if (zserv_bulk_flush (client) < 0)
+        return -1;
+      if (zapi_bulk_append (client->bulk, client->obuf, prefix_offset) < 0)
+        return zebra_server_send_message (client);
+    }
+
+  if (! client->t_bulk)
+    client->t_bulk = thread_add_event (zebrad.master, zserv_bulk_flush_event,
+                                       client, 0);
+  return 0;
+}
+
+/* A route message held back for a slow client.  Only the latest message
+   for each prefix, VRF and route type is kept, and a prefix's messages
+   are kept in the order of their last change. */
+struct zserv_pending
+{
+  struct zserv_pending *next;
+  vrf_id_t vrf_id;
+  u_char type;
+  u_int16_t prefix_offset;
+  u_int16_t length;
+  u_char data[];
+};
+
+/* Messages sent from the pending table before checking again whether the
+   client has caught up. */
+#define ZSERV_PENDING_DRAIN_BATCH 64
+
+/* Hold back the route message in client->obuf, replacing any older
+   message for the same route. */
+static void
+zserv_pending_add (struct zserv *client, struct prefix *p, u_char type,
+                   size_t prefix_offset)
+{
+  struct stream *s = client->obuf;
+  struct zserv_pending *pending, **pp;
+  struct route_node *rn;
+  afi_t afi = family2afi (p->family);
+  vrf_id_t vrf_id = stream_getw_from (s, 4);
+  int held;
+
+  if (! client->pending[afi])
+    client->pending[afi] = route_table_init ();
+
+  rn = route_node_get (client->pending[afi], p);
+  held = (rn->info != NULL);
+
+  for (pp = (struct zserv_pending **) &rn->info; *pp; pp = &(*pp)->next)
+    if ((*pp)->vrf_id == vrf_id && (*pp)->type == type)
+      break;
+
+  pending = XMALLOC (MTYPE_ZSERV_PENDING,
+                     sizeof (struct zserv_pending) + stream_get_endp (s));
+  pending->vrf_id = vrf_id;
+  pending->type = type;
+  pending->prefix_offset = prefix_offset;
+  pending->length = stream_get_endp (s);
+  memcpy (pending->data, STREAM_DATA (s), pending->length);
+
+  if (*pp)
+    {
+      /* Drop the older message and queue this one behind the other
+         route types' messages for the prefix. */
+      struct zserv_pending *old = *pp;
+
+      *pp = old->next;
+      XFREE (MTYPE_ZSERV_PENDING, old);
+      while (*pp)
+        pp = &(*pp)->next;
+      client->pending_coalesced_cnt++;
+    }
+  else if (++client->pending_cnt > client->pending_max)
+    client->pending_max = client->pending_cnt;
+  pending->next = NULL;
+  *pp = pending;
+  client->pending_queued_cnt++;
+
+  /* One lock per node that holds messages. */
+  if (held)
+    route_unlock_node (rn);
+}
+
+/* Take all the messages held for the first prefix in the table. */
+static struct zserv_pending *
+zserv_pending_pop (struct route_table *table)
+{
+  struct zserv_pending *pending;
+  struct route_node *rn;
+
+  for (rn = route_top (table); rn; rn = route_next (rn))
+    if (rn->info)
+      break;
+  if (! rn)
+    return NULL;
+
+  pending = rn->info;
+  rn->info = NULL;
+  route_unlock_node (rn);
+  route_unlock_node (rn);
+  return pending;
+}
+
+/* Send held back messages while the client keeps up with them. */
+static void
+zserv_pending_drain (struct zserv *client)
+{
+  struct zserv_pending *pending, *next;
+  afi_t afi;
+  int n;
+
+  while (client->pending_cnt && buffer_empty (client->wb)
+         && ! client->t_suicide)
+    {
+      n = 0;
+      for (afi = AFI_IP; afi < AFI_MAX && n < ZSERV_PENDING_DRAIN_BATCH; afi++)
+        while (client->pending[afi] && n < ZSERV_PENDING_DRAIN_BATCH
+               && (pending = zserv_pending_pop (client->pending[afi])))
+          for (; pending; pending = next, n++)
+            {
+              next = pending->next;
+              stream_reset (client->obuf);
+              stream_put (client->obuf, pending->data, pending->length);
+              zserv_send_route (client, pending->prefix_offset);
+              XFREE (MTYPE_ZSERV_PENDING, pending);
+              client->pending_cnt--;
+            }
+      zserv_bulk_flush (client);
+    }
+}
+
+/* Send the messages held back for prefix p ahead of a message about the
+   same prefix that is about to be sent, so the client sees them in the
+   order the changes were made.  Must be called before client->obuf is
+   built, as it is used for the held messages. */
+void
+zserv_pending_flush (struct zserv *client, struct prefix *p)
+{
+  struct zserv_pending *pending, *next;
+  struct route_node *rn;
+  struct prefix q;
+  afi_t afi = family2afi (p->family);
+
+  if (! client->pending_cnt || ! client->pending[afi])
+    return;
+
+  prefix_copy (&q, p);
+  apply_mask (&q);
+  rn = route_node_lookup (client->pending[afi], &q);
+  if (! rn)
+    return;
+  pending = rn->info;
+  rn->info = NULL;
+  route_unlock_node (rn);
+  if (pending)
+    route_unlock_node (rn);
+
+  for (; pending; pending = next)
+    {
+      next = pending->next;
+      stream_reset (client->obuf);
+      stream_put (client->obuf, pending->data, pending->length);
+      zserv_send_route (client, pending->prefix_offset);
+      XFREE (MTYPE_ZSERV_PENDING, pending);
+      client->pending_cnt--;
+    }
+}
+
+static void
+zserv_pending_free (struct zserv *client)
+{
+  struct zserv_pending *pending, *next;
+  struct route_node *rn;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    {
+      if (! client->pending[afi])
+        continue;
+      for (rn = route_top (client->pending[afi]); rn; rn = route_next (rn))
+        {
+          for (pending = rn->info; pending; pending = next)
+            {
+              next = pending->next;
+              XFREE (MTYPE_ZSERV_PENDING, pending);
+            }
+          if (rn->info)
+            {
+              rn->info = NULL;
+              route_unlock_node (rn);
+            }
+        }
+      route_table_finish (client->pending[afi]);
+      client->pending[afi] = NULL;
+    }
+  client->pending_cnt = 0;
+}
+
+/* Send a redistributed route message, or hold it back if the client has
+   not yet taken what we sent before.  A route that changes many times
+   while the client is slow then costs it one message, not one per
+   change, and our memory use is bounded by the number of routes.
+
+   Held messages are sent in prefix order once the client catches up, so
+   the client sees the latest state of each route but not the order in
+   which different prefixes changed.  Address and nexthop messages call
+   zserv_pending_flush first, so they never overtake a held route for
+   their own prefix; other messages are not ordered against held routes. */
+static int
+zserv_send_redist (struct zserv *client, struct prefix *p, u_char type,
+                   size_t prefix_offset)
+{
+  if (client->t_suicide)
+    return -1;
+
+  if (client->pending_cnt || ! buffer_empty (client->wb))
+    {
+      zserv_pending_add (client, p, type, prefix_offset);
+      return 0;
+    }
+  return zserv_send_route (client, prefix_offset);
+}
+
 void
 zserv_create_header (struct stream *s, uint16_t cmd, vrf_id_t vrf_id)
 {
@@ -311,9 +660,12 @@ zsend_interface_address (int cmd, struct zserv *client,
   if (! vrf_bitmap_check (client->ifinfo, ifp->vrf_id))
     return 0;
 
+  /* The connected route may be held back; it goes first. */
+  zserv_pending_flush (client, ifc->address);
+
   s = client->obuf;
   stream_reset (s);
-  
+
   zserv_create_header (s, cmd, ifp->vrf_id);
   stream_putl (s, ifp->ifindex);
 
@@ -408,6 +760,7 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
                        struct rib *rib)
 {
   int psize;
+  size_t prefix_offset;
   struct stream *s;
   struct nexthop *nexthop;
   unsigned long nhnummark = 0, messmark = 0;
@@ -435,6 +788,7 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
 
   /* Prefix. */
   psize = PSIZE (p->prefixlen);
+  prefix_offset = stream_get_endp (s);
   stream_putc (s, p->prefixlen);
   stream_write (s, (u_char *) & p->u.prefix, psize);
 
@@ -527,7 +881,7 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
   /* Write packet size. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zebra_server_send_message(client);
+  return zserv_send_redist (client, p, rib->type, prefix_offset);
 }
 
 #ifdef HAVE_IPV6
@@ -718,10 +1072,11 @@ zserv_nexthop_register (struct zserv *client, int sock, u_short length, vrf_id_t
       if (connected)
 	SET_FLAG(rnh->flags, ZEBRA_NHT_CONNECTED);
 
+      /* Only this one can have changed. */
+      zebra_evaluate_rnh(rnh, 0);
       zebra_add_rnh_client(rnh, client, vrf_id);
     }
-  zebra_evaluate_rnh_table(0, AF_INET);
-  zebra_evaluate_rnh_table(0, AF_INET6);
+  zebra_flush_rnh_clients();
   return 0;
 }
 
@@ -1357,12 +1712,27 @@ zread_router_id_delete (struct zserv *client, u_short length, vrf_id_t vrf_id)
 
 /* Tie up route-type and client->sock */
 static void
-zread_hello (struct zserv *client)
+zread_hello (struct zserv *client, u_short length)
 {
   /* type of protocol (lib/zebra.h) */
   u_char proto;
   proto = stream_getc (client->ibuf);
 
+  /* Newer clients append the capabilities they support.  Answer with
+     the ones we support too; older clients never see the reply. */
+  if (length >= 2)
+    {
+      struct stream *s = client->obuf;
+
+      client->capabilities = stream_getc (client->ibuf) & ZEBRA_CAPA_SUPPORTED;
+
+      stream_reset (s);
+      zserv_create_header (s, ZEBRA_HELLO, VRF_DEFAULT);
+      stream_putc (s, client->capabilities);
+      stream_putw_at (s, 0, stream_get_endp (s));
+      zebra_server_send_message (client);
+    }
+
   /* accept only dynamic routing protocols */
   if ((proto < ZEBRA_ROUTE_MAX)
   &&  (proto > ZEBRA_ROUTE_STATIC))
@@ -1407,13 +1777,51 @@ zebra_score_rib (int client_sock)
   for (i = ZEBRA_ROUTE_RIP; i < ZEBRA_ROUTE_MAX; i++)
     if (client_sock == route_type_oaths[i])
       {
-        zlog_notice ("client %d disconnected. %lu %s routes removed from the rib",
-                      client_sock, rib_score_proto (i), zebra_route_string (i));
+        if (! zebra_gr_client_close (i))
+          zlog_notice ("client %d disconnected. %lu %s routes removed from the rib",
+                        client_sock, rib_score_proto (i), zebra_route_string (i));
         route_type_oaths[i] = 0;
         break;
       }
 }
 
+#ifdef HAVE_ZAPI_RING
+/* The client has handed us a shared memory ring to read the rest of its
+   messages from.  The ring's descriptors came along with this message. */
+static void
+zread_ring_setup (struct zserv *client)
+{
+  int i;
+
+  if (! client->ring && client->ring_nfds == ZRING_NFDS
+      && CHECK_FLAG (client->capabilities, ZEBRA_CAPA_SHM_RING))
+    {
+      client->ring = zring_attach (client->ring_fds[ZRING_FD_MEM],
+                                   client->ring_fds[ZRING_FD_DATA],
+                                   client->ring_fds[ZRING_FD_SPACE]);
+      client->ring_nfds = 0;
+    }
+
+  if (! client->ring)
+    {
+      /* Whatever the client sends next goes into a ring we cannot
+         read, so there is no carrying on with this connection. */
+      zlog_warn ("%s: client %d ring setup failed, closing", __func__,
+                 client->sock);
+      for (i = 0; i < client->ring_nfds; i++)
+        close (client->ring_fds[i]);
+      client->ring_nfds = 0;
+      if (! client->t_suicide)
+        client->t_suicide = thread_add_event (zebrad.master,
+                                              zserv_delayed_close, client, 0);
+      return;
+    }
+
+  if (IS_ZEBRA_DEBUG_EVENT)
+    zlog_debug ("client %d switched to a shared memory ring", client->sock);
+}
+#endif /* HAVE_ZAPI_RING */
+
 /* Close zebra client. */
 static void
 zebra_client_close (struct zserv *client)
@@ -1430,12 +1838,27 @@ zebra_client_close (struct zserv *client)
     }
 
   /* Free stream buffers. */
+  if (client->rbuf)
+    stream_free (client->rbuf);
   if (client->ibuf)
     stream_free (client->ibuf);
   if (client->obuf)
     stream_free (client->obuf);
+  if (client->bulk)
+    stream_free (client->bulk);
   if (client->wb)
     buffer_free(client->wb);
+  zserv_pending_free (client);
+  zebra_redistribute_free (client);
+
+#ifdef HAVE_ZAPI_RING
+  if (client->ring)
+    zring_free (client->ring);
+  while (client->ring_nfds)
+    close (client->ring_fds[--client->ring_nfds]);
+  if (client->t_ring)
+    thread_cancel (client->t_ring);
+#endif /* HAVE_ZAPI_RING */
 
   /* Release threads. */
   if (client->t_read)
@@ -1444,6 +1867,10 @@ zebra_client_close (struct zserv *client)
     thread_cancel (client->t_write);
   if (client->t_suicide)
     thread_cancel (client->t_suicide);
+  if (client->t_bulk)
+    thread_cancel (client->t_bulk);
+  if (client->t_process)
+    thread_cancel (client->t_process);
 
   /* Free client structure. */
   listnode_delete (zebrad.client_list, client);
@@ -1461,8 +1888,10 @@ zebra_client_create (int sock)
 
   /* Make client input/output buffer. */
   client->sock = sock;
+  client->rbuf = stream_new (ZEBRA_READ_BUF_SIZ);
   client->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  client->bulk = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->wb = buffer_new(0);
 
   /* Set table number. */
@@ -1483,116 +1912,13 @@ zebra_client_create (int sock)
   zebra_event (ZEBRA_READ, sock, client);
 }
 
-/* Handler of zebra service request. */
-static int
-zebra_client_read (struct thread *thread)
-{
-  int sock;
-  struct zserv *client;
-  size_t already;
-  uint16_t length, command;
-  uint8_t marker, version;
-  vrf_id_t vrf_id;
-
-  /* Get thread data.  Reset reading thread because I'm running. */
-  sock = THREAD_FD (thread);
-  client = THREAD_ARG (thread);
-  client->t_read = NULL;
-
-  if (client->t_suicide)
-    {
-      zebra_client_close(client);
-      return -1;
-    }
-
-  /* Read length and command (if we don't have it already). */
-  if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed socket [%d]", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-      already = ZEBRA_HEADER_SIZE;
-    }
-
-  /* Reset to read from the beginning of the incoming packet. */
-  stream_set_getp(client->ibuf, 0);
-
-  /* Fetch header values */
-  length = stream_getw (client->ibuf);
-  marker = stream_getc (client->ibuf);
-  version = stream_getc (client->ibuf);
-  vrf_id = stream_getw (client->ibuf);
-  command = stream_getw (client->ibuf);
-
-  if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, sock, marker, version);
-      zebra_client_close (client);
-      return -1;
-    }
-  if (length < ZEBRA_HEADER_SIZE) 
-    {
-      zlog_warn("%s: socket %d message length %u is less than header size %d",
-	        __func__, sock, length, ZEBRA_HEADER_SIZE);
-      zebra_client_close (client);
-      return -1;
-    }
-  if (length > STREAM_SIZE(client->ibuf))
-    {
-      zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
-	        __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
-      zebra_client_close (client);
-      return -1;
-    }
-
-  /* Read rest of data. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed [%d] when reading zebra data", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(length-already))
-        {
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-    }
-
-  length -= ZEBRA_HEADER_SIZE;
-
-  /* Debug packet information. */
-  if (IS_ZEBRA_DEBUG_EVENT)
-    zlog_debug ("zebra message comes from socket [%d]", sock);
-
-  if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
-    zlog_debug ("zebra message received [%s] %d in VRF %u",
-	       zserv_command_string (command), length, vrf_id);
-
-  client->last_read_time = quagga_time(NULL);
-  client->last_read_cmd = command;
+static int zread_route_bulk (struct zserv *, u_short, vrf_id_t);
 
+/* Handle one message in client->ibuf. */
+static void
+zebra_client_dispatch (struct zserv *client, uint16_t command, u_short length,
+                       vrf_id_t vrf_id)
+{
   switch (command) 
     {
     case ZEBRA_ROUTER_ID_ADD:
@@ -1646,33 +1972,334 @@ zebra_client_read (struct thread *thread)
       zread_ipv4_import_lookup (client, length, vrf_id);
       break;
     case ZEBRA_HELLO:
-      zread_hello (client);
+      zread_hello (client, length);
       break;
+    case ZEBRA_ROUTE_BULK:
+      zread_route_bulk (client, length, vrf_id);
+      break;
+#ifdef HAVE_ZAPI_RING
+    case ZEBRA_RING_SETUP:
+      zread_ring_setup (client);
+      break;
+#endif /* HAVE_ZAPI_RING */
     case ZEBRA_VRF_UNREGISTER:
       zread_vrf_unregister (client, length, vrf_id);
     case ZEBRA_NEXTHOP_REGISTER:
-      zserv_nexthop_register(client, sock, length, vrf_id);
+      zserv_nexthop_register(client, client->sock, length, vrf_id);
       break;
     case ZEBRA_NEXTHOP_UNREGISTER:
-      zserv_nexthop_unregister(client, sock, length);
+      zserv_nexthop_unregister(client, client->sock, length);
       break;
     default:
       zlog_info ("Zebra received unknown command %d", command);
       break;
     }
 
+}
+
+/* Split a ZEBRA_ROUTE_BULK message into its route messages and handle
+   each one in turn, as if it had been read on its own. */
+static int
+zread_route_bulk (struct zserv *client, u_short length, vrf_id_t vrf_id)
+{
+  struct zapi_bulk_iter it;
+  struct stream *bulk = client->ibuf;
+  struct stream *msg;
+  int ret;
+
+  if (zapi_bulk_iter_init (&it, bulk, length) < 0)
+    {
+      zlog_warn ("%s: socket %d malformed bulk message", __func__,
+                 client->sock);
+      return -1;
+    }
+
+  client->bulk_rx_cnt++;
+  msg = stream_new (STREAM_SIZE (bulk));
+  client->ibuf = msg;
+  while ((ret = zapi_bulk_iter_next (&it, bulk, msg)) > 0)
+    {
+      if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
+        zlog_debug ("zebra bulk message [%s] %d in VRF %u",
+                    zserv_command_string (it.command),
+                    (int) stream_get_endp (msg), vrf_id);
+      zebra_client_dispatch (client, it.command, stream_get_endp (msg),
+                             vrf_id);
+    }
+  client->ibuf = bulk;
+  stream_free (msg);
+
+  if (ret < 0)
+    zlog_warn ("%s: socket %d malformed bulk message", __func__,
+               client->sock);
+  return ret;
+}
+
+#ifdef HAVE_ZAPI_RING
+static int zebra_client_process (struct zserv *);
+static int zserv_ring_read (struct thread *);
+
+/* Is there a complete message at the front of the buffer? */
+static int
+zserv_message_ready (struct stream *rbuf)
+{
+  return STREAM_READABLE (rbuf) >= ZEBRA_HEADER_SIZE
+    && STREAM_READABLE (rbuf) >= stream_getw_from (rbuf,
+                                                   stream_get_getp (rbuf));
+}
+
+/* Top up client->rbuf with whatever the client has put in its ring. */
+static int
+zserv_ring_pull (struct zserv *client)
+{
+  struct stream *rbuf = client->rbuf;
+  ssize_t nbyte;
+
+  stream_discard (rbuf);
+  nbyte = zring_read (client->ring,
+                      STREAM_DATA (rbuf) + stream_get_endp (rbuf),
+                      STREAM_WRITEABLE (rbuf));
+  if (nbyte < 0)
+    {
+      zlog_err ("%s: socket %d ring is corrupt", __func__, client->sock);
+      return -1;
+    }
+  stream_forward_endp (rbuf, nbyte);
+  client->ring_bytes += nbyte;
+  return 0;
+}
+
+/* The ring is drained: sleep until the client rings the data doorbell,
+   unless more data slipped in meanwhile. */
+static void
+zserv_ring_wait (struct zserv *client)
+{
+  if (zring_consumer_sleep (client->ring))
+    THREAD_READ_ON (zebrad.master, client->t_ring, zserv_ring_read, client,
+                    client->ring->data_efd);
+  else if (! client->t_process)
+    client->t_process = thread_add_event (zebrad.master,
+                                          zebra_client_process_event,
+                                          client, 0);
+}
+
+static int
+zserv_ring_read (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+
+  client->t_ring = NULL;
   if (client->t_suicide)
     {
-      /* No need to wait for thread callback, just kill immediately. */
       zebra_client_close(client);
       return -1;
     }
 
-  stream_reset (client->ibuf);
-  zebra_event (ZEBRA_READ, sock, client);
+  zring_doorbell_clear (client->ring->data_efd);
+  client->ring_wakeup_cnt++;
+  return zebra_client_process (client);
+}
+#endif /* HAVE_ZAPI_RING */
+
+/* Handle the complete messages waiting in client->rbuf, or in the
+   client's ring, at most ZEBRA_READ_MSG_BUDGET of them, then wait for
+   more data or, if the budget ran out, come back after other threads
+   have had a turn. */
+static int
+zebra_client_process (struct zserv *client)
+{
+  struct stream *rbuf = client->rbuf;
+  int sock = client->sock;
+  int budget = ZEBRA_READ_MSG_BUDGET;
+  size_t getp;
+  uint16_t length, command;
+  uint8_t marker, version;
+  vrf_id_t vrf_id;
+
+  for (;;)
+    {
+#ifdef HAVE_ZAPI_RING
+      if (client->ring && ! zserv_message_ready (rbuf)
+          && zserv_ring_pull (client) < 0)
+        {
+          zebra_client_close (client);
+          return -1;
+        }
+#endif /* HAVE_ZAPI_RING */
+
+      if (STREAM_READABLE (rbuf) < ZEBRA_HEADER_SIZE)
+        break;
+
+      if (budget-- == 0)
+        {
+          /* More messages are ready, but let other threads run first. */
+          if (! client->t_process)
+            client->t_process = thread_add_event (zebrad.master,
+                                                  zebra_client_process_event,
+                                                  client, 0);
+          return 0;
+        }
+
+      /* Fetch header values */
+      getp = stream_get_getp (rbuf);
+      length = stream_getw_from (rbuf, getp);
+      marker = stream_getc_from (rbuf, getp + 2);
+      version = stream_getc_from (rbuf, getp + 3);
+      vrf_id = stream_getw_from (rbuf, getp + 4);
+      command = stream_getw_from (rbuf, getp + 6);
+
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
+        {
+          zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+                   __func__, sock, marker, version);
+          zebra_client_close (client);
+          return -1;
+        }
+      if (length < ZEBRA_HEADER_SIZE) 
+        {
+          zlog_warn("%s: socket %d message length %u is less than header size %d",
+                    __func__, sock, length, ZEBRA_HEADER_SIZE);
+          zebra_client_close (client);
+          return -1;
+        }
+      if (length > STREAM_SIZE(client->ibuf))
+        {
+          zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
+                    __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
+          zebra_client_close (client);
+          return -1;
+        }
+
+      /* Wait for the rest of this message. */
+      if (STREAM_READABLE (rbuf) < length)
+        break;
+
+      /* Hand the body to the handlers on its own. */
+      stream_forward_getp (rbuf, ZEBRA_HEADER_SIZE);
+      length -= ZEBRA_HEADER_SIZE;
+      stream_reset (client->ibuf);
+      stream_put (client->ibuf, STREAM_PNT (rbuf), length);
+      stream_forward_getp (rbuf, length);
+      client->read_msg_cnt++;
+
+      /* Debug packet information. */
+      if (IS_ZEBRA_DEBUG_EVENT)
+        zlog_debug ("zebra message comes from socket [%d]", sock);
+
+      if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
+        zlog_debug ("zebra message received [%s] %d in VRF %u",
+                   zserv_command_string (command), length, vrf_id);
+
+      client->last_read_time = quagga_time(NULL);
+      client->last_read_cmd = command;
+
+      zebra_client_dispatch (client, command, length, vrf_id);
+
+      if (client->t_suicide)
+        {
+          /* No need to wait for thread callback, just kill immediately. */
+          zebra_client_close(client);
+          return -1;
+        }
+    }
+
+  /* Keep any partial message at the front of the buffer. */
+  stream_discard (rbuf);
+  if (! client->t_read)
+    zebra_event (ZEBRA_READ, sock, client);
+#ifdef HAVE_ZAPI_RING
+  if (client->ring)
+    zserv_ring_wait (client);
+#endif /* HAVE_ZAPI_RING */
   return 0;
 }
 
+static int
+zebra_client_process_event (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+
+  client->t_process = NULL;
+  if (client->t_suicide)
+    {
+      zebra_client_close(client);
+      return -1;
+    }
+  return zebra_client_process (client);
+}
+
+#ifdef HAVE_ZAPI_RING
+/* Like stream_read_try, but keeping any descriptors the client sends. */
+static ssize_t
+zserv_read_fds (struct zserv *client, int sock)
+{
+  struct stream *rbuf = client->rbuf;
+  ssize_t nbyte;
+
+  nbyte = zring_recv_fds (sock, STREAM_DATA (rbuf) + stream_get_endp (rbuf),
+                          STREAM_WRITEABLE (rbuf), client->ring_fds,
+                          &client->ring_nfds);
+  if (nbyte >= 0)
+    {
+      stream_forward_endp (rbuf, nbyte);
+      return nbyte;
+    }
+  if (ERRNO_IO_RETRY (errno))
+    return -2;
+  zlog_warn ("%s: read failed on socket %d: %s", __func__, sock,
+             safe_strerror (errno));
+  return -1;
+}
+#endif /* HAVE_ZAPI_RING */
+
+/* Handler of zebra service request. */
+static int
+zebra_client_read (struct thread *thread)
+{
+  int sock;
+  struct zserv *client;
+  ssize_t nbyte;
+
+  /* Get thread data.  Reset reading thread because I'm running. */
+  sock = THREAD_FD (thread);
+  client = THREAD_ARG (thread);
+  client->t_read = NULL;
+
+  if (client->t_suicide)
+    {
+      zebra_client_close(client);
+      return -1;
+    }
+
+  /* Data from the client's ring may have filled the buffer. */
+  if (! STREAM_WRITEABLE (client->rbuf))
+    return zebra_client_process (client);
+
+#ifdef HAVE_ZAPI_RING
+  /* The ring's descriptors travel with ZEBRA_RING_SETUP. */
+  if (CHECK_FLAG (client->capabilities, ZEBRA_CAPA_SHM_RING)
+      && ! client->ring)
+    nbyte = zserv_read_fds (client, sock);
+  else
+#endif /* HAVE_ZAPI_RING */
+  /* Read whatever the socket has for us, as many messages as fit. */
+  nbyte = stream_read_try (client->rbuf, sock, STREAM_WRITEABLE (client->rbuf));
+  if (nbyte == 0 || nbyte == -1)
+    {
+      if (IS_ZEBRA_DEBUG_EVENT)
+        zlog_debug ("connection closed socket [%d]", sock);
+      zebra_client_close (client);
+      return -1;
+    }
+  if (nbyte > 0)
+    {
+      client->read_cnt++;
+      client->read_bytes += nbyte;
+    }
+
+  return zebra_client_process (client);
+}
+
 
 /* Accept code of zebra server socket. */
 static int
@@ -1950,6 +2577,26 @@ zebra_show_client_detail (struct vty *vty, struct zserv *client)
 	   VTY_NEWLINE);
   vty_out (vty, "Interface Down Notifications: %d%s", client->ifdown_cnt,
 	   VTY_NEWLINE);
+  if (CHECK_FLAG (client->capabilities, ZEBRA_CAPA_ROUTE_BULK))
+    vty_out (vty, "Bulk Route Messages: %d received, %d sent%s",
+	     client->bulk_rx_cnt, client->bulk_tx_cnt, VTY_NEWLINE);
+  vty_out (vty, "Socket Reads: %u, Messages: %u%s", client->read_cnt,
+	   client->read_msg_cnt, VTY_NEWLINE);
+  vty_out (vty, "Redist Queue: %u pending (max %u), %u queued, "
+	   "%u coalesced%s", client->pending_cnt, client->pending_max,
+	   client->pending_queued_cnt, client->pending_coalesced_cnt,
+	   VTY_NEWLINE);
+  zebra_redistribute_show (vty, client);
+#ifdef HAVE_ZAPI_RING
+  if (client->ring)
+    vty_out (vty, "Shared Memory Ring: %llu bytes, %u wakeups%s",
+	     (unsigned long long) client->ring_bytes,
+	     client->ring_wakeup_cnt, VTY_NEWLINE);
+#endif /* HAVE_ZAPI_RING */
+  if (client->read_cnt)
+    vty_out (vty, "Bytes per Read: %.1f, Messages per Read: %.1f%s",
+	     (double) client->read_bytes / client->read_cnt,
+	     (double) client->read_msg_cnt / client->read_cnt, VTY_NEWLINE);
 
   vty_out (vty, "%s", VTY_NEWLINE);
   return;
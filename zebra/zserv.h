@@ -26,6 +26,7 @@
 #include "if.h"
 #include "workqueue.h"
 #include "vrf.h"
+#include "zring.h"
 
 /* Default port information. */
 #define ZEBRA_VTY_PORT                2601
@@ -39,6 +40,9 @@ struct zserv
   /* Client file descriptor. */
   int sock;
 
+  /* Data read from the client but not yet handled. */
+  struct stream *rbuf;
+
   /* Input/output buffer to the client. */
   struct stream *ibuf;
   struct stream *obuf;
@@ -50,9 +54,33 @@ struct zserv
   struct thread *t_read;
   struct thread *t_write;
 
+  /* Event to carry on handling messages after the read budget ran out. */
+  struct thread *t_process;
+
   /* Thread for delayed close. */
   struct thread *t_suicide;
 
+  /* Capabilities agreed with the client in the HELLO exchange. */
+  u_char capabilities;
+
+  /* Pending ZEBRA_ROUTE_BULK message and the event which flushes it. */
+  struct stream *bulk;
+  struct thread *t_bulk;
+
+  /* Latest route messages for each prefix, held back while the client
+     is not keeping up with what we write to it. */
+  struct route_table *pending[AFI_MAX];
+
+  /* Shared memory ring the client writes its messages into, if agreed,
+     the descriptors for it received ahead of ZEBRA_RING_SETUP, and the
+     thread waiting for the client to ring the data doorbell. */
+#ifdef HAVE_ZAPI_RING
+  struct zring *ring;
+  int ring_fds[ZRING_NFDS];
+  int ring_nfds;
+  struct thread *t_ring;
+#endif /* HAVE_ZAPI_RING */
+
   /* default routing table this client munges */
   int rtm_table;
 
@@ -62,6 +90,11 @@ struct zserv
   /* Redistribute default route flag. */
   vrf_bitmap_t redist_default;
 
+  /* Routes of newly redistributed types still to be sent to the client,
+     and the event which sends the next batch of them. */
+  struct list *replay;
+  struct thread *t_replay;
+
   /* Interface information. */
   vrf_bitmap_t ifinfo;
 
@@ -88,6 +121,19 @@ struct zserv
   u_int32_t ifdown_cnt;
   u_int32_t ifadd_cnt;
   u_int32_t ifdel_cnt;
+  u_int32_t bulk_rx_cnt;
+  u_int32_t bulk_tx_cnt;
+  u_int32_t read_cnt;
+  u_int32_t read_msg_cnt;
+  u_int64_t read_bytes;
+  u_int32_t ring_wakeup_cnt;
+  u_int32_t pending_cnt;
+  u_int32_t pending_max;
+  u_int32_t pending_queued_cnt;
+  u_int32_t pending_coalesced_cnt;
+  u_int32_t replay_cnt;
+  u_int32_t replay_route_cnt;
+  u_int64_t ring_bytes;
 
   time_t connect_time;
   time_t last_read_time;
@@ -145,5 +191,8 @@ extern pid_t pid;
 
 extern void zserv_create_header(struct stream *s, uint16_t cmd, vrf_id_t);
 extern int zebra_server_send_message(struct zserv *client);
+extern int zebra_server_queue_message(struct zserv *client);
+extern int zebra_server_flush(struct zserv *client);
+extern void zserv_pending_flush (struct zserv *, struct prefix *);
 
 #endif /* _ZEBRA_ZEBRA_H */